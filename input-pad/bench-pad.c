@@ -0,0 +1,575 @@
+/* vim:set et sts=4: */
+/* input-pad - The input pad
+ * Copyright (C) 2026 Takao Fujiwara <takao.fujiwara1@gmail.com>
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+
+/* The micro benchmarks of the pad parser, the keysym tables and
+ * the Unicode blocks, which do not need a display.
+ * "make bench" runs them with the built pad files. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <sys/resource.h> /* getrusage */
+#include <stdio.h>
+#include <stdlib.h> /* exit */
+#include <string.h> /* strstr */
+#include <unistd.h> /* symlink */
+
+#include "chars-util.h"
+#include "input-pad.h"
+#include "input-pad-group.h"
+#include "keysym-str2val.h"
+#include "unicode_block.h"
+
+#define BENCH_SMALL_SIZE 10000
+#define BENCH_LARGE_SIZE 100000
+
+typedef struct _Bench Bench;
+typedef struct _BenchPad BenchPad;
+typedef void (* BenchFunc) (Bench *bench, gpointer data);
+
+struct _Bench {
+    gint64                      start;
+    gint64                      elapsed;
+    guint64                     allocs_start;
+    guint64                     allocs;
+    gboolean                    paused;
+};
+
+struct _BenchPad {
+    gchar                      *file;
+    gchar                      *dir;
+    InputPadGroup              *group;
+};
+
+static int                      min_time = 500;
+static gchar                   *output_file = NULL;
+static gchar                   *filter = NULL;
+static GString                 *output = NULL;
+static gboolean                 first_result = TRUE;
+static guint64                  n_allocs = 0;
+
+static GOptionEntry entries[] = {
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file,
+    "Write the JSON results to FILE instead of stdout", "FILE"},
+  { "min-time", 't', 0, G_OPTION_ARG_INT, &min_time,
+    "Run each benchmark for MSEC at least", "MSEC"},
+  { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter,
+    "Run the benchmarks whose names contain STRING only", "STRING"},
+  { NULL }
+};
+
+#ifdef __GLIBC__
+/* glibc lets the program interpose the allocator of the libraries
+ * so all the allocations of GLib and libxml2 are counted. */
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+#define HAVE_ALLOC_COUNT 1
+
+
+void *
+malloc (size_t size)
+{
+    n_allocs++;
+    return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+    n_allocs++;
+    return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+    n_allocs++;
+    return __libc_realloc (ptr, size);
+}
+#endif
+
+static void
+bench_pause (Bench *bench)
+{
+    g_return_if_fail (!bench->paused);
+
+    bench->elapsed += g_get_monotonic_time () - bench->start;
+    bench->allocs += n_allocs - bench->allocs_start;
+    bench->paused = TRUE;
+}
+
+static void
+bench_resume (Bench *bench)
+{
+    g_return_if_fail (bench->paused);
+
+    bench->paused = FALSE;
+    bench->allocs_start = n_allocs;
+    bench->start = g_get_monotonic_time ();
+}
+
+static void
+append_json_string (GString *str, const gchar *text)
+{
+    const gchar *p;
+
+    g_string_append_c (str, '"');
+    for (p = text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            g_string_append_c (str, '\\');
+            g_string_append_c (str, *p);
+        } else if ((guchar) *p < 0x20) {
+            g_string_append_printf (str, "\\u%04x", (guint) (guchar) *p);
+        } else {
+            g_string_append_c (str, *p);
+        }
+    }
+    g_string_append_c (str, '"');
+}
+
+/* Runs func until min_time passes and divides the time and
+ * the allocations by n_items of each call.
+ * The peak RSS is the high water mark of the process so far. */
+static void
+bench_run (const gchar *name,
+           BenchFunc    func,
+           gpointer     data,
+           guint        n_items)
+{
+    Bench bench;
+    struct rusage usage;
+    guint64 n_calls = 0;
+    guint64 n_ops;
+    gint64 limit = (gint64) min_time * 1000;
+
+    if (filter && !strstr (name, filter)) {
+        return;
+    }
+    g_printerr ("%s...\n", name);
+
+    memset (&bench, 0, sizeof (Bench));
+    bench.paused = TRUE;
+    /* Warm up the caches and the lazy initializations. */
+    bench_resume (&bench);
+    func (&bench, data);
+    bench_pause (&bench);
+
+    memset (&bench, 0, sizeof (Bench));
+    bench.paused = TRUE;
+    do {
+        bench_resume (&bench);
+        func (&bench, data);
+        bench_pause (&bench);
+        n_calls++;
+    } while (bench.elapsed < limit);
+
+    n_ops = n_calls * (n_items > 0 ? n_items : 1);
+    if (!first_result) {
+        g_string_append (output, ",\n");
+    }
+    first_result = FALSE;
+    g_string_append (output, "    { \"name\": ");
+    append_json_string (output, name);
+    g_string_append_printf (output,
+                            ", \"iterations\": %" G_GUINT64_FORMAT
+                            ", \"ns_per_op\": %.1f",
+                            n_ops,
+                            (gdouble) bench.elapsed * 1000. / n_ops);
+#ifdef HAVE_ALLOC_COUNT
+    g_string_append_printf (output, ", \"allocs_per_op\": %.2f",
+                            (gdouble) bench.allocs / n_ops);
+#else
+    g_string_append (output, ", \"allocs_per_op\": null");
+#endif
+    if (getrusage (RUSAGE_SELF, &usage) == 0) {
+        g_string_append_printf (output, ", \"peak_rss_kb\": %ld",
+                                usage.ru_maxrss);
+    }
+    g_string_append (output, " }");
+}
+
+static void
+bench_append_from_file (Bench *bench, gpointer data)
+{
+    BenchPad *pad = (BenchPad *) data;
+    InputPadGroup *group;
+
+    group = input_pad_group_append_from_file (NULL, pad->file, NULL);
+    bench_pause (bench);
+    input_pad_group_destroy (group);
+    bench_resume (bench);
+}
+
+static void
+bench_parse_all_files (Bench *bench, gpointer data)
+{
+    BenchPad *pad = (BenchPad *) data;
+    InputPadGroup *group;
+
+    group = input_pad_group_parse_all_files (pad->dir, NULL);
+    bench_pause (bench);
+    input_pad_group_destroy (group);
+    bench_resume (bench);
+}
+
+static void
+bench_group_destroy (Bench *bench, gpointer data)
+{
+    BenchPad *pad = (BenchPad *) data;
+    InputPadGroup *group;
+
+    bench_pause (bench);
+    if (pad->dir) {
+        group = input_pad_group_parse_all_files (pad->dir, NULL);
+    } else {
+        group = input_pad_group_append_from_file (NULL, pad->file, NULL);
+    }
+    bench_resume (bench);
+    input_pad_group_destroy (group);
+}
+
+/* Splits and decodes <chars> as the char table of the window does. */
+static void
+bench_chars_decode (Bench *bench, gpointer data)
+{
+    const gchar *chars = (const gchar *) data;
+    gchar **char_table;
+    gchar buff[7];
+    int i;
+    gunichar code;
+
+    char_table = input_pad_chars_split (chars);
+    for (i = 0; char_table[i]; i++) {
+        if (*char_table[i] == '\0') {
+            continue;
+        }
+        code = input_pad_chars_decode (char_table[i]);
+        buff[g_unichar_to_utf8 (code, buff)] = '\0';
+    }
+    g_strfreev (char_table);
+}
+
+static void
+bench_keysym_str2val (Bench *bench, gpointer data)
+{
+    int i;
+
+    for (i = 0; input_pad_keysym_table[i].str; i++) {
+        XStringToKeysym (input_pad_keysym_table[i].str);
+    }
+}
+
+static void
+bench_keysym_val2str (Bench *bench, gpointer data)
+{
+    int i;
+
+    for (i = 0; input_pad_keysym_table[i].str; i++) {
+        XKeysymToString (input_pad_keysym_table[i].keysym);
+    }
+}
+
+/* Formats the ranges of the Unicode blocks as the block list of
+ * the window does. */
+static void
+bench_unicode_block_format (Bench *bench, gpointer data)
+{
+    gchar *range;
+    gchar *range2;
+    int i;
+
+    for (i = 0; input_pad_unicode_block_table[i].label; i++) {
+        input_pad_unicode_block_format_range (
+                input_pad_unicode_block_table[i].start,
+                input_pad_unicode_block_table[i].end,
+                &range, &range2);
+        g_free (range);
+        g_free (range2);
+    }
+}
+
+static gchar *
+create_synthetic_chars (int size)
+{
+    GString *str;
+    int i;
+
+    str = g_string_sized_new (size * 8);
+    for (i = 0; i < size; i++) {
+        /* CJK Unified Ideographs */
+        g_string_append_printf (str, "0x%04X%c",
+                                0x4E00 + i % 0x5200,
+                                (i % 16 == 15) ? '\n' : ' ');
+    }
+    return g_string_free (str, FALSE);
+}
+
+/* Writes a pad of size entries of the table type into dir. */
+static gchar *
+create_synthetic_pad (const gchar       *dir,
+                      InputPadTableType  type,
+                      int                size)
+{
+    GString *str;
+    GError *error = NULL;
+    gchar *chars;
+    gchar *basename;
+    gchar *file;
+    const gchar *type_name;
+    int i;
+
+    str = g_string_new ("<?xml version=\"1.0\"?>\n"
+                        "<input-pad>\n"
+                        "  <pad name=\"bench\">\n"
+                        "    <group>\n"
+                        "      <name>Bench</name>\n"
+                        "      <table>\n"
+                        "        <column>16</column>\n"
+                        "        <name>Bench</name>\n");
+    switch (type) {
+    case INPUT_PAD_TABLE_TYPE_CHARS:
+        type_name = "chars";
+        chars = create_synthetic_chars (size);
+        g_string_append_printf (str, "        <chars>\n%s\n</chars>\n", chars);
+        g_free (chars);
+        break;
+    case INPUT_PAD_TABLE_TYPE_STRINGS:
+        type_name = "strings";
+        for (i = 0; i < size; i++) {
+            g_string_append_printf (str,
+                                    "        <string>\n"
+                                    "          <label>S%d</label>\n"
+                                    "          <comment>String %d</comment>\n"
+                                    "        </string>\n",
+                                    i, i);
+        }
+        break;
+    case INPUT_PAD_TABLE_TYPE_COMMANDS:
+        type_name = "commands";
+        for (i = 0; i < size; i++) {
+            g_string_append_printf (str,
+                                    "        <command>\n"
+                                    "          <label>C%d</label>\n"
+                                    "          <execl>echo %d</execl>\n"
+                                    "        </command>\n",
+                                    i, i);
+        }
+        break;
+    default:
+        g_assert_not_reached ();
+    }
+    g_string_append (str,
+                     "      </table>\n"
+                     "    </group>\n"
+                     "  </pad>\n"
+                     "</input-pad>\n");
+
+    basename = g_strdup_printf ("synthetic-%s-%d.xml", type_name, size);
+    file = g_build_filename (dir, basename, NULL);
+    g_free (basename);
+    if (!g_file_set_contents (file, str->str, str->len, &error)) {
+        g_error ("Cannot write %s: %s", file, error ? error->message : "");
+    }
+    g_string_free (str, TRUE);
+    return file;
+}
+
+static void
+run_pad_benchmarks (const gchar *tmp_dir, int n_files, gchar **files)
+{
+    BenchPad pad = { NULL, NULL, NULL };
+    gchar *name;
+    gchar *basename;
+    gchar *link;
+    gchar *target;
+    gchar *cwd;
+    int i;
+
+    for (i = 0; i < n_files; i++) {
+        basename = g_path_get_basename (files[i]);
+        pad.file = files[i];
+        name = g_strdup_printf ("append-from-file/%s", basename);
+        bench_run (name, bench_append_from_file, &pad, 1);
+        g_free (name);
+        g_free (basename);
+    }
+    pad.file = NULL;
+
+    if (n_files == 0) {
+        return;
+    }
+    /* Only the given files are linked into the pad dir. */
+    pad.dir = g_build_filename (tmp_dir, "pad", NULL);
+    g_mkdir (pad.dir, 0700);
+    cwd = g_get_current_dir ();
+    for (i = 0; i < n_files; i++) {
+        basename = g_path_get_basename (files[i]);
+        link = g_build_filename (pad.dir, basename, NULL);
+        if (g_path_is_absolute (files[i])) {
+            target = g_strdup (files[i]);
+        } else {
+            target = g_build_filename (cwd, files[i], NULL);
+        }
+        if (symlink (target, link) != 0) {
+            g_warning ("Cannot link %s", link);
+        }
+        g_free (target);
+        g_free (link);
+        g_free (basename);
+    }
+    g_free (cwd);
+    bench_run ("parse-all-files/shipped", bench_parse_all_files, &pad, 1);
+    bench_run ("group-destroy/shipped", bench_group_destroy, &pad, 1);
+    g_free (pad.dir);
+}
+
+static void
+run_synthetic_benchmarks (const gchar *tmp_dir)
+{
+    const InputPadTableType types[] = {
+        INPUT_PAD_TABLE_TYPE_CHARS,
+        INPUT_PAD_TABLE_TYPE_STRINGS,
+        INPUT_PAD_TABLE_TYPE_COMMANDS,
+    };
+    const int sizes[] = { BENCH_SMALL_SIZE, BENCH_LARGE_SIZE };
+    BenchPad pad = { NULL, NULL, NULL };
+    gchar *basename;
+    gchar *name;
+    gchar *chars;
+    guint i, j;
+
+    for (i = 0; i < G_N_ELEMENTS (types); i++) {
+        for (j = 0; j < G_N_ELEMENTS (sizes); j++) {
+            pad.file = create_synthetic_pad (tmp_dir, types[i], sizes[j]);
+            basename = g_path_get_basename (pad.file);
+            *strrchr (basename, '.') = '\0';
+            name = g_strdup_printf ("append-from-file/%s", basename);
+            bench_run (name, bench_append_from_file, &pad, 1);
+            g_free (name);
+            name = g_strdup_printf ("group-destroy/%s", basename);
+            bench_run (name, bench_group_destroy, &pad, 1);
+            g_free (name);
+            g_free (basename);
+            g_unlink (pad.file);
+            g_free (pad.file);
+        }
+    }
+
+    for (j = 0; j < G_N_ELEMENTS (sizes); j++) {
+        chars = create_synthetic_chars (sizes[j]);
+        name = g_strdup_printf ("chars-decode/%d", sizes[j]);
+        bench_run (name, bench_chars_decode, chars, sizes[j]);
+        g_free (name);
+        g_free (chars);
+    }
+}
+
+static void
+remove_tmp_dir (const gchar *tmp_dir)
+{
+    GDir *dir;
+    const gchar *filename;
+    gchar *filepath;
+    gchar *pad_dir;
+
+    pad_dir = g_build_filename (tmp_dir, "pad", NULL);
+    if ((dir = g_dir_open (pad_dir, 0, NULL)) != NULL) {
+        while ((filename = g_dir_read_name (dir)) != NULL) {
+            filepath = g_build_filename (pad_dir, filename, NULL);
+            g_unlink (filepath);
+            g_free (filepath);
+        }
+        g_dir_close (dir);
+    }
+    g_rmdir (pad_dir);
+    g_free (pad_dir);
+    g_rmdir (tmp_dir);
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    gchar *tmp_dir;
+    guint n_keysyms;
+
+    context = g_option_context_new ("[PAD_FILE...]");
+    g_option_context_set_summary (context,
+                                  "Run the micro benchmarks of input-pad "
+                                  "and write the results as JSON.");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error ? error->message : "");
+        g_clear_error (&error);
+        g_option_context_free (context);
+        exit (1);
+    }
+    g_option_context_free (context);
+
+    if ((tmp_dir = g_dir_make_tmp ("input-pad-bench-XXXXXX", &error)) == NULL) {
+        g_printerr ("%s\n", error ? error->message : "");
+        g_clear_error (&error);
+        exit (1);
+    }
+    /* The user pads under HOME are not parsed. */
+    g_setenv ("HOME", tmp_dir, TRUE);
+
+    output = g_string_new ("{\n");
+    g_string_append (output, "  \"version\": ");
+    append_json_string (output, input_pad_get_version ());
+    g_string_append_printf (output, ",\n  \"min_time_msec\": %d", min_time);
+    g_string_append (output, ",\n  \"benchmarks\": [\n");
+
+    run_pad_benchmarks (tmp_dir, argc - 1, argv + 1);
+    run_synthetic_benchmarks (tmp_dir);
+
+    n_keysyms = G_N_ELEMENTS (input_pad_keysym_table) - 1;
+    bench_run ("keysym-str2val", bench_keysym_str2val, NULL, n_keysyms);
+    bench_run ("keysym-val2str", bench_keysym_val2str, NULL, n_keysyms);
+    bench_run ("unicode-block-format", bench_unicode_block_format, NULL,
+               G_N_ELEMENTS (input_pad_unicode_block_table) - 1);
+
+    g_string_append (output, "\n  ]\n}\n");
+    remove_tmp_dir (tmp_dir);
+    g_free (tmp_dir);
+
+    if (output_file == NULL) {
+        g_print ("%s", output->str);
+    } else if (!g_file_set_contents (output_file, output->str, output->len,
+                                     &error)) {
+        g_printerr ("Cannot write %s: %s\n", output_file,
+                    error ? error->message : "");
+        g_clear_error (&error);
+        g_string_free (output, TRUE);
+        exit (1);
+    }
+    g_string_free (output, TRUE);
+    return 0;
+}
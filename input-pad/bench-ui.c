@@ -0,0 +1,1256 @@
+/* vim:set et sts=4: */
+/* input-pad - The input pad
+ * Copyright (C) 2026 Takao Fujiwara <takao.fujiwara1@gmail.com>
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+
+/* The end-to-end benchmark of the pad window under Xvfb.
+ * The parent process starts Xvfb and runs itself as the child
+ * processes which create the pad window and a sink window,
+ * click the pad buttons with XTest and measure the frames of
+ * the pad and the texts committed to the sink.
+ * "make bench-ui" runs it with the built pads. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XTest.h>
+#include <sys/resource.h> /* getrusage */
+#include <sys/types.h>
+#include <sys/wait.h> /* waitpid */
+#include <signal.h> /* kill */
+#include <stdio.h>
+#include <stdlib.h> /* exit */
+#include <string.h> /* strcmp */
+#include <unistd.h> /* symlink */
+
+#include "button-gtk.h"
+#include "input-pad.h"
+#include "input-pad-group.h"
+#include "input-pad-window-gtk.h"
+
+#define BENCH_UI_SCREEN "1280x1024x24"
+#define BENCH_UI_FRAME_TIMEOUT (2 * G_USEC_PER_SEC)
+#define BENCH_UI_COMMIT_TIMEOUT (2 * G_USEC_PER_SEC)
+#define BENCH_UI_COMMAND_TIMEOUT (6 * G_USEC_PER_SEC)
+#define BENCH_UI_MAX_COMMANDS 20
+#define BENCH_UI_GROUP_ROUNDS 5
+#define BENCH_UI_TICK 5
+/* The time to settle the events and the frames after an action */
+#define BENCH_UI_SETTLE (30 * 1000)
+
+typedef struct _BenchUI BenchUI;
+typedef struct _FindWidgetData FindWidgetData;
+
+struct _BenchUI {
+    GApplication               *app;
+    GtkWidget                  *pad;
+    GtkWidget                  *sink;
+    GtkTextBuffer              *sink_buffer;
+    Display                    *display;
+    Window                      sink_xid;
+    /* The pad frames of the GdkFrameClock */
+    guint                       n_frames;
+    gint64                      frame_begin;
+    gint64                      frame_end;
+    GArray                     *frame_durations;
+    /* The texts committed to the sink */
+    guint                       n_commits;
+    gint64                      commit_time;
+    guint                       n_send_events;
+    guint                       n_device_events;
+    GString                    *output;
+    gboolean                    first_scenario;
+};
+
+struct _FindWidgetData {
+    const gchar                *name;
+    GType                       type;
+    GtkWidget                  *widget;
+    GPtrArray                  *widgets;
+};
+
+static gchar                   *output_file = NULL;
+static gchar                   *display_name = NULL;
+static gchar                   *xkb_layouts = NULL;
+static int                      n_start_runs = 5;
+static int                      n_chars = 1000;
+static gchar                   *child_mode = NULL;
+static gchar                   *scenarios = NULL;
+static gchar                   *pad_dir = NULL;
+static gint64                   spawn_time = 0;
+
+static GOptionEntry entries[] = {
+  { "output", 0, 0, G_OPTION_ARG_FILENAME, &output_file,
+    "Write the JSON results to FILE instead of stdout", "FILE"},
+  { "display", 0, 0, G_OPTION_ARG_STRING, &display_name,
+    "Use the X DISPLAY instead of starting Xvfb", "DISPLAY"},
+  { "xkb-layouts", 0, 0, G_OPTION_ARG_STRING, &xkb_layouts,
+    "Set the XKB LAYOUTS of Xvfb with setxkbmap for the group switches",
+    "LAYOUTS"},
+  { "start-runs", 0, 0, G_OPTION_ARG_INT, &n_start_runs,
+    "Start the pad N times, the first run is cold", "N"},
+  { "chars", 0, 0, G_OPTION_ARG_INT, &n_chars,
+    "Type N characters with each injection path", "N"},
+  { "bench-child", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &child_mode,
+    NULL, NULL},
+  { "bench-scenarios", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING,
+    &scenarios, NULL, NULL},
+  { "bench-spawn-time", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT64,
+    &spawn_time, NULL, NULL},
+  { "bench-pad-dir", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME,
+    &pad_dir, NULL, NULL},
+  { NULL }
+};
+
+static gint
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+    gint64 va = *(const gint64 *) a;
+    gint64 vb = *(const gint64 *) b;
+
+    return (va > vb) - (va < vb);
+}
+
+static gint64
+get_percentile (GArray *sorted, gdouble percentile)
+{
+    guint i;
+
+    i = (guint) (percentile / 100. * (sorted->len - 1) + 0.5);
+    return g_array_index (sorted, gint64, i);
+}
+
+/* Appends "name": { count, mean, p50, p95, p99, max } in usec. */
+static void
+append_json_stats (GString *str, const gchar *name, GArray *values)
+{
+    GArray *sorted;
+    gint64 sum = 0;
+    guint i;
+
+    g_string_append_printf (str, "\"%s\": { \"count\": %u", name, values->len);
+    if (values->len == 0) {
+        g_string_append (str, " }");
+        return;
+    }
+    sorted = g_array_sized_new (FALSE, FALSE, sizeof (gint64), values->len);
+    g_array_append_vals (sorted, values->data, values->len);
+    g_array_sort (sorted, compare_gint64);
+    for (i = 0; i < sorted->len; i++) {
+        sum += g_array_index (sorted, gint64, i);
+    }
+    g_string_append_printf (str,
+                            ", \"mean\": %.1f"
+                            ", \"p50\": %" G_GINT64_FORMAT
+                            ", \"p95\": %" G_GINT64_FORMAT
+                            ", \"p99\": %" G_GINT64_FORMAT
+                            ", \"max\": %" G_GINT64_FORMAT " }",
+                            (gdouble) sum / sorted->len,
+                            get_percentile (sorted, 50.),
+                            get_percentile (sorted, 95.),
+                            get_percentile (sorted, 99.),
+                            g_array_index (sorted, gint64, sorted->len - 1));
+    g_array_free (sorted, TRUE);
+}
+
+static long
+get_rss_kb (void)
+{
+    gchar *contents = NULL;
+    long size = 0;
+    long resident = 0;
+
+    if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL)) {
+        return -1;
+    }
+    if (sscanf (contents, "%ld %ld", &size, &resident) != 2) {
+        resident = -1;
+    } else {
+        resident = resident * (sysconf (_SC_PAGESIZE) / 1024);
+    }
+    g_free (contents);
+    return resident;
+}
+
+static long
+get_peak_rss_kb (void)
+{
+    struct rusage usage;
+
+    if (getrusage (RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    return usage.ru_maxrss;
+}
+
+static void
+find_widget_foreach (GtkWidget *widget, gpointer data)
+{
+    FindWidgetData *find_data = (FindWidgetData *) data;
+
+    if (find_data->widget) {
+        return;
+    }
+    if (find_data->name &&
+        !g_strcmp0 (gtk_widget_get_name (widget), find_data->name)) {
+        find_data->widget = widget;
+        return;
+    }
+    if (find_data->widgets &&
+        G_TYPE_CHECK_INSTANCE_TYPE (widget, find_data->type)) {
+        g_ptr_array_add (find_data->widgets, widget);
+    }
+    if (GTK_IS_CONTAINER (widget)) {
+        gtk_container_forall (GTK_CONTAINER (widget),
+                              find_widget_foreach, data);
+    }
+}
+
+static GtkWidget *
+find_widget_by_name (GtkWidget *widget, const gchar *name)
+{
+    FindWidgetData data = { name, G_TYPE_INVALID, NULL, NULL };
+
+    find_widget_foreach (widget, &data);
+    if (data.widget == NULL) {
+        g_warning ("Widget %s is not found.", name);
+    }
+    return data.widget;
+}
+
+/* Returns the InputPadGtkButtons whose centers are shown in scrolled. */
+static GPtrArray *
+find_visible_buttons (GtkWidget *scrolled)
+{
+    FindWidgetData data = { NULL, INPUT_PAD_TYPE_GTK_BUTTON, NULL, NULL };
+    GPtrArray *buttons;
+    GtkAllocation allocation;
+    GtkAllocation scrolled_allocation;
+    GtkWidget *button;
+    int x, y;
+    guint i;
+
+    data.widgets = g_ptr_array_new ();
+    find_widget_foreach (scrolled, &data);
+    gtk_widget_get_allocation (scrolled, &scrolled_allocation);
+    buttons = g_ptr_array_new ();
+    for (i = 0; i < data.widgets->len; i++) {
+        button = g_ptr_array_index (data.widgets, i);
+        if (!gtk_widget_get_mapped (button)) {
+            continue;
+        }
+        gtk_widget_get_allocation (button, &allocation);
+        if (!gtk_widget_translate_coordinates (button, scrolled,
+                                               allocation.width / 2,
+                                               allocation.height / 2,
+                                               &x, &y)) {
+            continue;
+        }
+        if (x < 0 || y < 0 ||
+            x >= scrolled_allocation.width || y >= scrolled_allocation.height) {
+            continue;
+        }
+        g_ptr_array_add (buttons, button);
+    }
+    g_ptr_array_free (data.widgets, TRUE);
+    return buttons;
+}
+
+static void
+on_frame_clock_before_paint (GdkFrameClock *clock, gpointer data)
+{
+    BenchUI *ui = (BenchUI *) data;
+
+    ui->frame_begin = g_get_monotonic_time ();
+}
+
+static void
+on_frame_clock_after_paint (GdkFrameClock *clock, gpointer data)
+{
+    BenchUI *ui = (BenchUI *) data;
+    gint64 duration;
+
+    ui->frame_end = g_get_monotonic_time ();
+    if (ui->frame_begin > 0) {
+        duration = ui->frame_end - ui->frame_begin;
+        g_array_append_val (ui->frame_durations, duration);
+    }
+    ui->n_frames++;
+}
+
+static void
+on_sink_changed (GtkTextBuffer *buffer, gpointer data)
+{
+    BenchUI *ui = (BenchUI *) data;
+
+    ui->commit_time = g_get_monotonic_time ();
+    ui->n_commits++;
+}
+
+static gboolean
+on_sink_key_press_event (GtkWidget *widget, GdkEventKey *event, gpointer data)
+{
+    BenchUI *ui = (BenchUI *) data;
+
+    if (event->send_event) {
+        ui->n_send_events++;
+    } else {
+        ui->n_device_events++;
+    }
+    return FALSE;
+}
+
+static gboolean
+on_tick (gpointer data)
+{
+    return G_SOURCE_CONTINUE;
+}
+
+/* Iterates the main loop until *counter is changed.
+ * Returns FALSE if the timeout passes. */
+static gboolean
+wait_for_counter (guint *counter, gint64 timeout)
+{
+    guint start = *counter;
+    gint64 deadline = g_get_monotonic_time () + timeout;
+
+    while (*counter == start) {
+        if (g_get_monotonic_time () > deadline) {
+            return FALSE;
+        }
+        g_main_context_iteration (NULL, TRUE);
+    }
+    return TRUE;
+}
+
+/* Returns the time from start to the end of the next pad frame or -1. */
+static gint64
+wait_for_frame (BenchUI *ui, gint64 start)
+{
+    if (!wait_for_counter (&ui->n_frames, BENCH_UI_FRAME_TIMEOUT)) {
+        return -1;
+    }
+    return ui->frame_end - start;
+}
+
+static void
+wait_for_idle (BenchUI *ui)
+{
+    gint64 deadline = g_get_monotonic_time () + BENCH_UI_SETTLE;
+
+    while (g_get_monotonic_time () < deadline) {
+        g_main_context_iteration (NULL, TRUE);
+    }
+}
+
+static void
+sink_focus (BenchUI *ui)
+{
+    Window focus;
+    int revert;
+
+    XGetInputFocus (ui->display, &focus, &revert);
+    if (focus != ui->sink_xid) {
+        XSetInputFocus (ui->display, ui->sink_xid, RevertToParent,
+                        CurrentTime);
+        XSync (ui->display, False);
+    }
+}
+
+static void
+sink_clear (BenchUI *ui)
+{
+    g_signal_handlers_block_by_func (ui->sink_buffer,
+                                     G_CALLBACK (on_sink_changed), ui);
+    gtk_text_buffer_set_text (ui->sink_buffer, "", -1);
+    g_signal_handlers_unblock_by_func (ui->sink_buffer,
+                                       G_CALLBACK (on_sink_changed), ui);
+}
+
+static void
+click_widget (BenchUI *ui, GtkWidget *widget)
+{
+    GtkAllocation allocation;
+    int x, y;
+
+    gtk_widget_get_allocation (widget, &allocation);
+    gdk_window_get_origin (gtk_widget_get_window (widget), &x, &y);
+    x += allocation.x + allocation.width / 2;
+    y += allocation.y + allocation.height / 2;
+    XTestFakeMotionEvent (ui->display, -1, x, y, CurrentTime);
+    XTestFakeButtonEvent (ui->display, 1, True, CurrentTime);
+    XTestFakeButtonEvent (ui->display, 1, False, CurrentTime);
+    XFlush (ui->display);
+}
+
+static void
+scenario_begin (BenchUI *ui, const gchar *name)
+{
+    g_printerr ("%s...\n", name);
+    wait_for_idle (ui);
+    g_array_set_size (ui->frame_durations, 0);
+    if (!ui->first_scenario) {
+        g_string_append (ui->output, ",\n");
+    }
+    ui->first_scenario = FALSE;
+    g_string_append_printf (ui->output, "      \"%s\": { ", name);
+}
+
+static void
+scenario_end (BenchUI *ui, GArray *latencies, guint n_timeouts)
+{
+    if (latencies) {
+        append_json_stats (ui->output, "latency_usec", latencies);
+        g_string_append_printf (ui->output, ", \"timeouts\": %u, ", n_timeouts);
+    }
+    append_json_stats (ui->output, "frame_usec", ui->frame_durations);
+    g_string_append_printf (ui->output,
+                            ", \"rss_kb\": %ld, \"peak_rss_kb\": %ld }",
+                            get_rss_kb (), get_peak_rss_kb ());
+}
+
+static void
+scenario_skip (BenchUI *ui, const gchar *name, const gchar *reason)
+{
+    g_printerr ("%s: %s\n", name, reason);
+    if (!ui->first_scenario) {
+        g_string_append (ui->output, ",\n");
+    }
+    ui->first_scenario = FALSE;
+    g_string_append_printf (ui->output,
+                            "      \"%s\": { \"skipped\": \"%s\" }",
+                            name, reason);
+}
+
+static void
+select_nth_row (GtkWidget *treeview, int n)
+{
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+
+    model = gtk_tree_view_get_model (GTK_TREE_VIEW (treeview));
+    if (gtk_tree_model_iter_nth_child (model, &iter, NULL, n)) {
+        gtk_tree_selection_select_iter (
+                gtk_tree_view_get_selection (GTK_TREE_VIEW (treeview)),
+                &iter);
+    }
+}
+
+static int
+count_rows (GtkWidget *treeview)
+{
+    GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (treeview));
+
+    return model ? gtk_tree_model_iter_n_children (model, NULL) : 0;
+}
+
+/* Selects the first custom table which has the buttons of type and
+ * returns its visible buttons. */
+static GPtrArray *
+select_custom_table_of_type (BenchUI *ui, InputPadTableType type)
+{
+    GtkWidget *group_view;
+    GtkWidget *table_view;
+    GtkWidget *char_view;
+    GPtrArray *buttons;
+    int i, j;
+
+    input_pad_gtk_window_set_show_table (INPUT_PAD_GTK_WINDOW (ui->pad),
+                                         INPUT_PAD_WINDOW_SHOW_TABLE_TYPE_CUSTOM);
+    wait_for_idle (ui);
+    group_view = find_widget_by_name (ui->pad, "input-pad-custom-group-view");
+    table_view = find_widget_by_name (ui->pad, "input-pad-custom-table-view");
+    char_view = find_widget_by_name (ui->pad, "input-pad-custom-char-view");
+    if (!group_view || !table_view || !char_view) {
+        return NULL;
+    }
+    for (i = 0; i < count_rows (group_view); i++) {
+        select_nth_row (group_view, i);
+        wait_for_idle (ui);
+        for (j = 0; j < count_rows (table_view); j++) {
+            select_nth_row (table_view, j);
+            wait_for_idle (ui);
+            buttons = find_visible_buttons (char_view);
+            if (buttons->len > 0 &&
+                input_pad_gtk_button_get_table_type (
+                        INPUT_PAD_GTK_BUTTON (g_ptr_array_index (buttons, 0)))
+                == type) {
+                return buttons;
+            }
+            g_ptr_array_free (buttons, TRUE);
+        }
+    }
+    return NULL;
+}
+
+/* Switches across every custom table and measures the time to
+ * the next frame. */
+static void
+scenario_tables (BenchUI *ui)
+{
+    GtkWidget *group_view;
+    GtkWidget *table_view;
+    GArray *latencies;
+    gint64 start;
+    gint64 latency;
+    guint n_timeouts = 0;
+    int i, j;
+
+    input_pad_gtk_window_set_show_table (INPUT_PAD_GTK_WINDOW (ui->pad),
+                                         INPUT_PAD_WINDOW_SHOW_TABLE_TYPE_CUSTOM);
+    wait_for_idle (ui);
+    group_view = find_widget_by_name (ui->pad, "input-pad-custom-group-view");
+    table_view = find_widget_by_name (ui->pad, "input-pad-custom-table-view");
+    if (!group_view || !table_view || count_rows (group_view) == 0) {
+        scenario_skip (ui, "tables", "no custom tables");
+        return;
+    }
+
+    scenario_begin (ui, "tables");
+    latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+    for (i = 0; i < count_rows (group_view); i++) {
+        /* The group selection selects its first table. */
+        for (j = 0; j < count_rows (table_view) || j == 0; j++) {
+            start = g_get_monotonic_time ();
+            if (j == 0) {
+                select_nth_row (group_view, i);
+            } else {
+                select_nth_row (table_view, j);
+            }
+            if ((latency = wait_for_frame (ui, start)) < 0) {
+                n_timeouts++;
+            } else {
+                g_array_append_val (latencies, latency);
+            }
+            wait_for_idle (ui);
+        }
+    }
+    scenario_end (ui, latencies, n_timeouts);
+    g_array_free (latencies, TRUE);
+}
+
+/* Scrolls the CJK Unified Ideographs block one step after another. */
+static void
+scenario_scroll (BenchUI *ui)
+{
+    GtkWidget *block_view;
+    GtkWidget *char_view;
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    GtkAdjustment *adjustment;
+    GArray *latencies;
+    gchar *label = NULL;
+    gboolean found = FALSE;
+    gdouble value, step, upper;
+    gint64 start;
+    gint64 latency;
+    guint n_timeouts = 0;
+
+    input_pad_gtk_window_set_show_table (INPUT_PAD_GTK_WINDOW (ui->pad),
+                                         INPUT_PAD_WINDOW_SHOW_TABLE_TYPE_ALL);
+    wait_for_idle (ui);
+    block_view = find_widget_by_name (ui->pad, "input-pad-block-view");
+    char_view = find_widget_by_name (ui->pad, "input-pad-all-char-view");
+    if (!block_view || !char_view) {
+        scenario_skip (ui, "scroll-cjk", "no all char view");
+        return;
+    }
+    model = gtk_tree_view_get_model (GTK_TREE_VIEW (block_view));
+    if (gtk_tree_model_get_iter_first (model, &iter)) {
+        do {
+            /* The label column of the block model */
+            gtk_tree_model_get (model, &iter, 0, &label, -1);
+            found = !g_strcmp0 (label, "CJK Unified Ideographs");
+            g_free (label);
+        } while (!found && gtk_tree_model_iter_next (model, &iter));
+    }
+    if (!found) {
+        scenario_skip (ui, "scroll-cjk", "no CJK Unified Ideographs block");
+        return;
+    }
+
+    scenario_begin (ui, "scroll-cjk");
+    latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+    gtk_tree_selection_select_iter (
+            gtk_tree_view_get_selection (GTK_TREE_VIEW (block_view)), &iter);
+    wait_for_idle (ui);
+    adjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (char_view));
+    step = gtk_adjustment_get_step_increment (adjustment);
+    if (step <= 0) {
+        step = gtk_adjustment_get_page_size (adjustment) / 10;
+    }
+    upper = gtk_adjustment_get_upper (adjustment) -
+            gtk_adjustment_get_page_size (adjustment);
+    for (value = gtk_adjustment_get_lower (adjustment) + step;
+         step > 0; value += step) {
+        value = MIN (value, upper);
+        if (value <= gtk_adjustment_get_value (adjustment)) {
+            break;
+        }
+        start = g_get_monotonic_time ();
+        gtk_adjustment_set_value (adjustment, value);
+        if ((latency = wait_for_frame (ui, start)) < 0) {
+            n_timeouts++;
+        } else {
+            g_array_append_val (latencies, latency);
+        }
+    }
+    scenario_end (ui, latencies, n_timeouts);
+    g_array_free (latencies, TRUE);
+}
+
+/* Locks the XKB groups one after another and measures the time to
+ * the frame which relabels the keyboard layout. */
+static void
+scenario_groups (BenchUI *ui)
+{
+    XkbDescPtr xkb;
+    GArray *latencies;
+    gint64 start;
+    gint64 latency;
+    XkbStateRec state;
+    guint n_timeouts = 0;
+    int n_groups = 0;
+    int round, group;
+
+    xkb = XkbGetKeyboard (ui->display, XkbControlsMask, XkbUseCoreKbd);
+    if (xkb && xkb->ctrls) {
+        n_groups = xkb->ctrls->num_groups;
+    }
+    if (xkb) {
+        XkbFreeKeyboard (xkb, 0, True);
+    }
+    if (n_groups < 2) {
+        scenario_skip (ui, "xkb-groups", "one XKB group");
+        return;
+    }
+
+    input_pad_gtk_window_set_show_layout (INPUT_PAD_GTK_WINDOW (ui->pad),
+                                          INPUT_PAD_WINDOW_SHOW_LAYOUT_TYPE_DEFAULT);
+    /* The group is restored for the display given by --display. */
+    memset (&state, 0, sizeof (XkbStateRec));
+    XkbGetState (ui->display, XkbUseCoreKbd, &state);
+    scenario_begin (ui, "xkb-groups");
+    latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+    for (round = 0; round < BENCH_UI_GROUP_ROUNDS; round++) {
+        for (group = 0; group < n_groups; group++) {
+            start = g_get_monotonic_time ();
+            XkbLockGroup (ui->display, XkbUseCoreKbd, (group + 1) % n_groups);
+            XFlush (ui->display);
+            if ((latency = wait_for_frame (ui, start)) < 0) {
+                n_timeouts++;
+            } else {
+                g_array_append_val (latencies, latency);
+            }
+            wait_for_idle (ui);
+        }
+    }
+    XkbLockGroup (ui->display, XkbUseCoreKbd, state.locked_group);
+    XFlush (ui->display);
+    scenario_end (ui, latencies, n_timeouts);
+    g_array_free (latencies, TRUE);
+}
+
+/* Clicks the buttons and measures the time until the sink text is
+ * changed. */
+static void
+run_clicks (BenchUI   *ui,
+            GPtrArray *buttons,
+            int        n_clicks,
+            gint64     timeout,
+            GArray    *latencies,
+            guint     *n_timeouts)
+{
+    gint64 start;
+    gint64 latency;
+    int i;
+
+    for (i = 0; i < n_clicks; i++) {
+        sink_focus (ui);
+        start = g_get_monotonic_time ();
+        click_widget (ui, g_ptr_array_index (buttons, i % buttons->len));
+        if (!wait_for_counter (&ui->n_commits, timeout)) {
+            (*n_timeouts)++;
+        } else {
+            latency = ui->commit_time - start;
+            g_array_append_val (latencies, latency);
+        }
+        /* The changes of a press, e.g. a paste, are finished. */
+        wait_for_idle (ui);
+        if (i % 100 == 99) {
+            sink_clear (ui);
+        }
+    }
+}
+
+static void
+scenario_type (BenchUI *ui)
+{
+    GPtrArray *buttons;
+    GArray *latencies;
+    guint n_timeouts = 0;
+
+    buttons = select_custom_table_of_type (ui, INPUT_PAD_TABLE_TYPE_CHARS);
+    if (buttons == NULL) {
+        scenario_skip (ui, "type", "no chars table");
+        return;
+    }
+    sink_clear (ui);
+    ui->n_send_events = ui->n_device_events = 0;
+    scenario_begin (ui, "type");
+    latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+    run_clicks (ui, buttons, n_chars, BENCH_UI_COMMIT_TIMEOUT,
+                latencies, &n_timeouts);
+    /* XSendEvent sets send_event and XTest does not. */
+    g_string_append_printf (ui->output,
+                            "\"inject\": \"%s\", ",
+                            ui->n_send_events && ui->n_device_events ? "mixed" :
+                            ui->n_send_events ? "xsendevent" :
+                            ui->n_device_events ? "xtest" : "none");
+    scenario_end (ui, latencies, n_timeouts);
+    g_array_free (latencies, TRUE);
+    g_ptr_array_free (buttons, TRUE);
+}
+
+static void
+scenario_commands (BenchUI *ui)
+{
+    GPtrArray *buttons;
+    GArray *latencies;
+    guint n_timeouts = 0;
+
+    buttons = select_custom_table_of_type (ui, INPUT_PAD_TABLE_TYPE_COMMANDS);
+    if (buttons == NULL) {
+        scenario_skip (ui, "commands", "no commands table");
+        return;
+    }
+    sink_clear (ui);
+    scenario_begin (ui, "commands");
+    latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+    run_clicks (ui, buttons, MIN (buttons->len, BENCH_UI_MAX_COMMANDS),
+                BENCH_UI_COMMAND_TIMEOUT, latencies, &n_timeouts);
+    scenario_end (ui, latencies, n_timeouts);
+    g_array_free (latencies, TRUE);
+    g_ptr_array_free (buttons, TRUE);
+}
+
+static gboolean
+has_scenario (const gchar *name)
+{
+    gchar **names;
+    gboolean retval = FALSE;
+    int i;
+
+    if (scenarios == NULL) {
+        return TRUE;
+    }
+    names = g_strsplit (scenarios, ",", -1);
+    for (i = 0; names[i] && !retval; i++) {
+        retval = !g_strcmp0 (names[i], name);
+    }
+    g_strfreev (names);
+    return retval;
+}
+
+static gboolean
+run_scenarios (gpointer data)
+{
+    BenchUI *ui = (BenchUI *) data;
+    GdkFrameClock *clock;
+    guint tick_id;
+
+    /* Wake up the main loop while the scenarios wait. */
+    tick_id = g_timeout_add (BENCH_UI_TICK, on_tick, NULL);
+    clock = gtk_widget_get_frame_clock (ui->pad);
+    g_signal_connect (clock, "before-paint",
+                      G_CALLBACK (on_frame_clock_before_paint), ui);
+    g_signal_connect (clock, "after-paint",
+                      G_CALLBACK (on_frame_clock_after_paint), ui);
+    gtk_widget_queue_draw (ui->pad);
+    wait_for_idle (ui);
+    sink_focus (ui);
+
+    g_string_append (ui->output, "{\n    \"scenarios\": {\n");
+    if (has_scenario ("tables")) {
+        scenario_tables (ui);
+    }
+    if (has_scenario ("scroll-cjk")) {
+        scenario_scroll (ui);
+    }
+    if (has_scenario ("xkb-groups")) {
+        scenario_groups (ui);
+    }
+    if (has_scenario ("type")) {
+        scenario_type (ui);
+    }
+    if (has_scenario ("commands")) {
+        scenario_commands (ui);
+    }
+    g_string_append (ui->output, "\n    }\n  }");
+
+    g_source_remove (tick_id);
+    g_print ("%s", ui->output->str);
+    g_application_quit (ui->app);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+on_sink_map_event (GtkWidget *widget, GdkEvent *event, gpointer data)
+{
+    BenchUI *ui = (BenchUI *) data;
+
+    g_signal_handlers_disconnect_by_func (widget,
+                                          G_CALLBACK (on_sink_map_event),
+                                          data);
+    ui->sink_xid = GDK_WINDOW_XID (gtk_widget_get_window (widget));
+    g_idle_add (run_scenarios, ui);
+    return FALSE;
+}
+
+static void
+on_app_activated_interact (GApplication *app, gpointer data)
+{
+    BenchUI *ui = (BenchUI *) data;
+    GtkWidget *text_view;
+
+    g_signal_handlers_disconnect_by_func (app,
+                                          G_CALLBACK (on_app_activated_interact),
+                                          data);
+    ui->pad = GTK_WIDGET (input_pad_window_get_window (app));
+    ui->display = GDK_DISPLAY_XDISPLAY (gtk_widget_get_display (ui->pad));
+
+    ui->sink = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title (GTK_WINDOW (ui->sink), "input-pad-bench-ui sink");
+    gtk_window_set_default_size (GTK_WINDOW (ui->sink), 360, 240);
+    gtk_window_move (GTK_WINDOW (ui->sink), 900, 0);
+    text_view = gtk_text_view_new ();
+    gtk_container_add (GTK_CONTAINER (ui->sink), text_view);
+    ui->sink_buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (text_view));
+    g_signal_connect (ui->sink_buffer, "changed",
+                      G_CALLBACK (on_sink_changed), ui);
+    g_signal_connect (text_view, "key-press-event",
+                      G_CALLBACK (on_sink_key_press_event), ui);
+    g_signal_connect_after (ui->sink, "map-event",
+                            G_CALLBACK (on_sink_map_event), ui);
+    gtk_application_add_window (GTK_APPLICATION (app), GTK_WINDOW (ui->sink));
+    gtk_widget_show_all (ui->sink);
+    gtk_widget_grab_focus (text_view);
+}
+
+static gboolean
+on_pad_first_draw (GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+    BenchUI *ui = (BenchUI *) data;
+
+    g_signal_handlers_disconnect_by_func (widget,
+                                          G_CALLBACK (on_pad_first_draw),
+                                          data);
+    /* The parent reads the first frame time and the RSS. */
+    g_print ("%" G_GINT64_FORMAT " %ld\n",
+             g_get_monotonic_time () - spawn_time, get_rss_kb ());
+    g_application_quit (ui->app);
+    return FALSE;
+}
+
+static void
+on_app_activated_start (GApplication *app, gpointer data)
+{
+    g_signal_handlers_disconnect_by_func (app,
+                                          G_CALLBACK (on_app_activated_start),
+                                          data);
+    g_signal_connect_after (input_pad_window_get_window (app), "draw",
+                            G_CALLBACK (on_pad_first_draw), data);
+}
+
+/* Replaces the pads of the window with the pads of the parent
+ * before the first frame. */
+static void
+on_app_activated_pad_dir (GApplication *app, gpointer data)
+{
+    g_signal_handlers_disconnect_by_func (app,
+                                          G_CALLBACK (on_app_activated_pad_dir),
+                                          data);
+    input_pad_window_set_paddir (app, pad_dir, NULL);
+}
+
+static int
+run_child (int argc, char *argv[])
+{
+    BenchUI ui;
+    int do_exit = 0;
+    int retval;
+
+    memset (&ui, 0, sizeof (BenchUI));
+    retval = input_pad_window_init (&argc, &argv, 0, &do_exit);
+    if (do_exit) {
+        return retval;
+    }
+    ui.app = G_APPLICATION (input_pad_window_new ());
+    ui.frame_durations = g_array_new (FALSE, FALSE, sizeof (gint64));
+    ui.output = g_string_new (NULL);
+    ui.first_scenario = TRUE;
+    if (pad_dir) {
+        g_signal_connect (ui.app, "activated",
+                          G_CALLBACK (on_app_activated_pad_dir), NULL);
+    }
+    if (!g_strcmp0 (child_mode, "start")) {
+        g_signal_connect (ui.app, "activated",
+                          G_CALLBACK (on_app_activated_start), &ui);
+    } else {
+        g_signal_connect (ui.app, "activated",
+                          G_CALLBACK (on_app_activated_interact), &ui);
+    }
+    retval = input_pad_window_main (ui.app);
+    g_array_free (ui.frame_durations, TRUE);
+    g_string_free (ui.output, TRUE);
+    return retval;
+}
+
+static gchar *
+start_xvfb (GPid *pid)
+{
+    gchar *xvfb_argv[] = { "Xvfb", "-displayfd", "1", "-screen", "0",
+                           BENCH_UI_SCREEN, "-nolisten", "tcp", "-noreset",
+                           NULL };
+    GError *error = NULL;
+    gchar buff[32];
+    gint out_fd = -1;
+    gssize len = 0;
+    gssize n;
+
+    if (!g_spawn_async_with_pipes (NULL, xvfb_argv, NULL,
+                                   G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                                   NULL, NULL, pid,
+                                   NULL, &out_fd, NULL, &error)) {
+        g_printerr ("Cannot run Xvfb: %s\n", error ? error->message : "");
+        g_clear_error (&error);
+        return NULL;
+    }
+    /* Xvfb writes the display number when it is ready. */
+    while (len < (gssize) sizeof (buff) - 1 &&
+           (n = read (out_fd, buff + len, sizeof (buff) - 1 - len)) > 0) {
+        len += n;
+        if (buff[len - 1] == '\n') {
+            break;
+        }
+    }
+    close (out_fd);
+    buff[len] = '\0';
+    g_strstrip (buff);
+    if (len == 0 || buff[0] == '\0') {
+        g_printerr ("Xvfb does not start.\n");
+        kill (*pid, SIGTERM);
+        waitpid (*pid, NULL, 0);
+        g_spawn_close_pid (*pid);
+        return NULL;
+    }
+    return g_strdup_printf (":%s", buff);
+}
+
+static gchar *
+spawn_child (const gchar *program, const gchar * const *args)
+{
+    GPtrArray *child_argv;
+    GError *error = NULL;
+    gchar *out = NULL;
+    gchar *pad_dir_arg;
+    gchar *time_arg;
+    gint status = 0;
+
+    child_argv = g_ptr_array_new ();
+    g_ptr_array_add (child_argv, (gpointer) program);
+    for (; *args; args++) {
+        g_ptr_array_add (child_argv, (gpointer) *args);
+    }
+    pad_dir_arg = NULL;
+    if (pad_dir) {
+        pad_dir_arg = g_strdup_printf ("--bench-pad-dir=%s", pad_dir);
+        g_ptr_array_add (child_argv, pad_dir_arg);
+    }
+    time_arg = g_strdup_printf ("--bench-spawn-time=%" G_GINT64_FORMAT,
+                                g_get_monotonic_time ());
+    g_ptr_array_add (child_argv, time_arg);
+    g_ptr_array_add (child_argv, NULL);
+    if (!g_spawn_sync (NULL, (gchar **) child_argv->pdata, NULL,
+                       G_SPAWN_CHILD_INHERITS_STDIN,
+                       NULL, NULL, &out, NULL, &status, &error) ||
+        !g_spawn_check_exit_status (status, &error)) {
+        g_printerr ("%s\n", error ? error->message : "");
+        g_clear_error (&error);
+        g_free (out);
+        out = NULL;
+    }
+    g_free (time_arg);
+    g_free (pad_dir_arg);
+    g_ptr_array_free (child_argv, TRUE);
+    return out;
+}
+
+static void
+run_start_benchmark (const gchar *program, GString *output)
+{
+    const gchar *args[] = { "--bench-child=start", NULL };
+    GArray *warm_times;
+    GArray *warm_rss;
+    gint64 usec;
+    gint64 rss;
+    gchar *out;
+    int i;
+
+    warm_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+    warm_rss = g_array_new (FALSE, FALSE, sizeof (gint64));
+    g_string_append (output, "  \"start\": {");
+    for (i = 0; i < n_start_runs; i++) {
+        g_printerr ("start #%d...\n", i);
+        out = spawn_child (program, args);
+        if (out == NULL ||
+            sscanf (out, "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT,
+                    &usec, &rss) != 2) {
+            g_free (out);
+            continue;
+        }
+        g_free (out);
+        /* The first run after Xvfb starts loads the fonts and
+         * the libraries from the disk. */
+        if (i == 0) {
+            g_string_append_printf (output,
+                                    " \"cold\": { \"first_frame_usec\": %"
+                                    G_GINT64_FORMAT ", \"rss_kb\": %"
+                                    G_GINT64_FORMAT " },",
+                                    usec, rss);
+        } else {
+            g_array_append_val (warm_times, usec);
+            g_array_append_val (warm_rss, rss);
+        }
+    }
+    g_string_append (output, " \"warm\": { ");
+    append_json_stats (output, "first_frame_usec", warm_times);
+    g_string_append (output, ", ");
+    append_json_stats (output, "rss_kb", warm_rss);
+    g_string_append (output, " } }");
+    g_array_free (warm_times, TRUE);
+    g_array_free (warm_rss, TRUE);
+}
+
+static void
+run_interact_benchmark (const gchar   *program,
+                        const gchar  **args,
+                        GString       *output,
+                        gboolean      *first)
+{
+    gchar *out;
+
+    out = spawn_child (program, args);
+    if (out == NULL || *out == '\0') {
+        g_free (out);
+        return;
+    }
+    g_string_append (output, *first ? "\n    " : ",\n    ");
+    g_string_append (output, out);
+    *first = FALSE;
+    g_free (out);
+}
+
+/* The pads are linked into the pad dir under HOME, which the children
+ * load with input_pad_window_set_paddir() instead of the installed
+ * pads. HOME is empty otherwise so that the pads of the user are not
+ * appended. */
+static gchar *
+setup_home (int n_files, gchar **files)
+{
+    GError *error = NULL;
+    gchar *home;
+    gchar *basename;
+    gchar *link;
+    gchar *target;
+    gchar *cwd;
+    int i;
+
+    if ((home = g_dir_make_tmp ("input-pad-bench-ui-XXXXXX", &error)) == NULL) {
+        g_printerr ("%s\n", error ? error->message : "");
+        g_clear_error (&error);
+        return NULL;
+    }
+    pad_dir = g_build_filename (home, "pad", NULL);
+    g_mkdir_with_parents (pad_dir, 0700);
+    cwd = g_get_current_dir ();
+    for (i = 0; i < n_files; i++) {
+        basename = g_path_get_basename (files[i]);
+        link = g_build_filename (pad_dir, basename, NULL);
+        if (g_path_is_absolute (files[i])) {
+            target = g_strdup (files[i]);
+        } else {
+            target = g_build_filename (cwd, files[i], NULL);
+        }
+        if (symlink (target, link) != 0) {
+            g_warning ("Cannot link %s", link);
+        }
+        g_free (target);
+        g_free (link);
+        g_free (basename);
+    }
+    g_free (cwd);
+    return home;
+}
+
+static void
+remove_home (const gchar *home)
+{
+    gchar *argv[] = { "rm", "-rf", (gchar *) home, NULL };
+
+    g_spawn_sync (NULL, argv, NULL,
+                  G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL,
+                  NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+static void
+set_xkb_layouts (const gchar *layouts)
+{
+    gchar *argv[] = { "setxkbmap", "-layout", (gchar *) layouts, NULL };
+    GError *error = NULL;
+
+    if (!g_spawn_sync (NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
+                       NULL, NULL, NULL, NULL, NULL, &error)) {
+        g_printerr ("Cannot run setxkbmap: %s\n",
+                    error ? error->message : "");
+        g_clear_error (&error);
+    }
+}
+
+static int
+run_parent (const gchar *program, int argc, char *argv[])
+{
+    /* The NULLs in the middle are replaced with --chars. */
+    const gchar *interact_args[] = { "--bench-child=interact", NULL, NULL };
+    /* -x toggles the injection path of the pad. */
+    const gchar *toggled_args[] = { "--bench-child=interact",
+                                    "--bench-scenarios=type", NULL,
+                                    "-x", NULL };
+    GError *error = NULL;
+    GString *output;
+    GPid xvfb_pid = 0;
+    gchar *display = NULL;
+    gchar *home;
+    gchar *chars_arg;
+    gboolean first = TRUE;
+    int retval = 0;
+
+    if (display_name) {
+        display = g_strdup (display_name);
+    } else if ((display = start_xvfb (&xvfb_pid)) == NULL) {
+        return 1;
+    }
+    if ((home = setup_home (argc - 1, argv + 1)) == NULL) {
+        retval = 1;
+        goto out_xvfb;
+    }
+    g_setenv ("DISPLAY", display, TRUE);
+    g_setenv ("HOME", home, TRUE);
+    /* The block names are looked up in C. */
+    g_setenv ("LC_ALL", "C", TRUE);
+    g_unsetenv ("GTK_IM_MODULE");
+    /* The layouts of the user's display are not changed since
+     * they are not restored. */
+    if (xvfb_pid) {
+        set_xkb_layouts (xkb_layouts ? xkb_layouts : "us,de,fr,ru");
+    } else if (xkb_layouts) {
+        g_printerr ("--xkb-layouts is ignored with --display.\n");
+    }
+
+    chars_arg = g_strdup_printf ("--chars=%d", n_chars);
+    interact_args[1] = chars_arg;
+    toggled_args[2] = chars_arg;
+
+    output = g_string_new ("{\n");
+    g_string_append_printf (output, "  \"version\": \"%s\",\n",
+                            input_pad_get_version ());
+    g_string_append_printf (output, "  \"display\": \"%s\",\n", display);
+    run_start_benchmark (program, output);
+    g_string_append (output, ",\n  \"runs\": [");
+    run_interact_benchmark (program, interact_args, output, &first);
+    run_interact_benchmark (program, toggled_args, output, &first);
+    g_string_append (output, "\n  ]\n}\n");
+    g_free (chars_arg);
+
+    if (output_file == NULL) {
+        g_print ("%s", output->str);
+    } else if (!g_file_set_contents (output_file, output->str, output->len,
+                                     &error)) {
+        g_printerr ("Cannot write %s: %s\n", output_file,
+                    error ? error->message : "");
+        g_clear_error (&error);
+        retval = 1;
+    }
+    g_string_free (output, TRUE);
+    remove_home (home);
+    g_free (home);
+    g_free (pad_dir);
+    pad_dir = NULL;
+
+out_xvfb:
+    if (xvfb_pid) {
+        kill (xvfb_pid, SIGTERM);
+        waitpid (xvfb_pid, NULL, 0);
+        g_spawn_close_pid (xvfb_pid);
+    }
+    g_free (display);
+    return retval;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    gchar *program;
+    int retval;
+
+    program = g_strdup (argv[0]);
+    context = g_option_context_new ("[PAD_FILE...]");
+    g_option_context_set_summary (context,
+                                  "Run the end-to-end benchmarks of the "
+                                  "input-pad window under Xvfb and write "
+                                  "the results as JSON.");
+    g_option_context_add_main_entries (context, entries, NULL);
+    /* The options of the pad are parsed by input_pad_window_init(). */
+    g_option_context_set_ignore_unknown_options (context, TRUE);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error ? error->message : "");
+        g_clear_error (&error);
+        g_option_context_free (context);
+        exit (1);
+    }
+    g_option_context_free (context);
+
+    if (child_mode) {
+        retval = run_child (argc, argv);
+    } else {
+        retval = run_parent (program, argc, argv);
+    }
+    g_free (program);
+    return retval;
+}
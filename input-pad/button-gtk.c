@@ -31,6 +31,7 @@
 
 #define TIMEOUT_INITIAL 500
 #define TIMEOUT_REPEAT  300
+#define TIMEOUT_REPEAT_MIN 30
 #define INPUT_PAD_GTK_BUTTON_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), INPUT_PAD_TYPE_GTK_BUTTON, InputPadGtkButtonPrivate))
 
 enum {
@@ -48,11 +49,18 @@ struct _InputPadGtkButtonPrivate {
     gchar                      *rawtext;
     InputPadTableType           type;
     guint32                     timer;
+    guint                       timer_interval;
+    gboolean                    repeating;
     guint32                     unicode;
 };
 
 static guint                    signals[LAST_SIGNAL] = { 0 };
 static GtkBuildableIface       *parent_buildable_iface;
+static guint                    repeat_delay = TIMEOUT_INITIAL;
+static guint                    repeat_interval = TIMEOUT_REPEAT;
+static gboolean                 repeat_accelerate = FALSE;
+/* The commits which the injection backend has not sent yet */
+static volatile gint           *repeat_pending = NULL;
 
 static void input_pad_gtk_button_buildable_interface_init (GtkBuildableIface *iface);
 
@@ -113,21 +121,51 @@ input_pad_gtk_button_class_init (InputPadGtkButtonClass *klass)
                       0);
 }
 
-static gint
-button_timer_cb (InputPadGtkButton *button)
+/*
+ * Only one timer source is alive during a press. The source is
+ * replaced only when the interval is changed. GLib does not catch up
+ * the missed ticks so the repeats are coalesced when the main loop is
+ * behind, e.g. while the key events are sent.
+ */
+static gboolean
+button_timer_cb (gpointer data)
 {
+    InputPadGtkButton *button = INPUT_PAD_GTK_BUTTON (data);
+    guint interval;
+
     g_return_val_if_fail (button->priv != NULL, FALSE);
 
     if (button->priv->timer == 0) {
         return FALSE;
     }
-
-    button->priv->timer = gdk_threads_add_timeout (TIMEOUT_REPEAT,
-                                                   (GSourceFunc) button_timer_cb,
-                                                   (gpointer) button);
+    /* The repeats do not pile up while the previous one is sent. */
+    if (repeat_pending != NULL && g_atomic_int_get (repeat_pending) > 0) {
+        return TRUE;
+    }
 
     g_signal_emit ((gpointer) button, signals[PRESSED_REPEAT], 0);
-    return TRUE;
+
+    /* The button could be destroyed or released in the signal. */
+    if (button->priv == NULL || button->priv->timer == 0) {
+        return FALSE;
+    }
+    if (!button->priv->repeating) {
+        interval = repeat_interval;
+        button->priv->repeating = TRUE;
+    } else {
+        interval = button->priv->timer_interval;
+    }
+    if (repeat_accelerate && interval > TIMEOUT_REPEAT_MIN) {
+        interval = MAX (interval * 9 / 10, TIMEOUT_REPEAT_MIN);
+    }
+    if (interval == button->priv->timer_interval) {
+        return TRUE;
+    }
+    button->priv->timer_interval = interval;
+    button->priv->timer = gdk_threads_add_timeout (interval,
+                                                   button_timer_cb,
+                                                   (gpointer) button);
+    return FALSE;
 }
 
 static void
@@ -138,8 +176,14 @@ start_timer (InputPadGtkButton *button)
     if (button->priv->timer != 0) {
         return;
     }
-    button->priv->timer = gdk_threads_add_timeout (TIMEOUT_INITIAL,
-                                                   (GSourceFunc) button_timer_cb,
+    /* The command is not run repeatedly. */
+    if (button->priv->type == INPUT_PAD_TABLE_TYPE_COMMANDS) {
+        return;
+    }
+    button->priv->timer_interval = repeat_delay;
+    button->priv->repeating = FALSE;
+    button->priv->timer = gdk_threads_add_timeout (repeat_delay,
+                                                   button_timer_cb,
                                                    (gpointer) button);
 }
 
@@ -279,6 +323,28 @@ create_pixbuf(const gchar *label, int icon_height)
 }
 
 
+void
+input_pad_gtk_button_set_repeat (guint      delay,
+                                 guint      interval,
+                                 gboolean   accelerate)
+{
+    g_return_if_fail (delay > 0 && interval > 0);
+
+    repeat_delay = delay;
+    repeat_interval = interval;
+    repeat_accelerate = accelerate;
+}
+
+/*
+ * pending is the number of the commits in the queue of the injection
+ * backend and the ticks of the repeat are skipped while it is not 0.
+ */
+void
+input_pad_gtk_button_set_repeat_pending (volatile gint *pending)
+{
+    repeat_pending = pending;
+}
+
 GtkWidget *
 input_pad_gtk_button_new_with_label (const gchar *label)
 {
@@ -61,6 +61,12 @@ struct _InputPadGtkButtonClass {
 };
 
 GType               input_pad_gtk_button_get_type (void);
+void                input_pad_gtk_button_set_repeat
+                                       (guint                   delay,
+                                        guint                   interval,
+                                        gboolean                accelerate);
+void                input_pad_gtk_button_set_repeat_pending
+                                       (volatile gint          *pending);
 GtkWidget *         input_pad_gtk_button_new_with_label (const gchar *label);
 GtkWidget *         input_pad_gtk_button_new_with_label_size
                                        (const gchar           *label,
@@ -0,0 +1,80 @@
+/* vim:set et sts=4: */
+/* input-pad - The input pad
+ * Copyright (C) 2026 Takao Fujiwara <takao.fujiwara1@gmail.com>
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <stdio.h> /* sprintf */
+
+#include "chars-util.h"
+
+/* Splits the <chars> or <keysyms> data into the entries.
+ * The returned array has empty strings between the separators. */
+gchar **
+input_pad_chars_split (const gchar *chars)
+{
+    return g_strsplit_set (chars, " \t\n", -1);
+}
+
+/* Decodes an entry of <chars> with or without "0x". */
+gunichar
+input_pad_chars_decode (const gchar *str)
+{
+    if (str[0] == '0' &&
+        (str[1] == 'x' || str[1] == 'X')) {
+        str += 2;
+    }
+    return (gunichar) g_ascii_strtoll (str, NULL, 16);
+}
+
+/* range is "U+XXXXXX - U+XXXXXX" and range2 is the UTF-8 bytes of
+ * start and end. Both are freed with g_free. */
+void
+input_pad_unicode_block_format_range (unsigned int start,
+                                      unsigned int end,
+                                      gchar      **range,
+                                      gchar      **range2)
+{
+    gchar buff[7];
+    gchar buff2[35]; /* 7 x 5 e.g. 'a' -> '0x61 ' */
+    gchar buff3[35];
+    int j;
+
+    *range = g_strdup_printf ("U+%06X - U+%06X", start, end);
+
+    buff[g_unichar_to_utf8 ((gunichar) start, buff)] = '\0';
+    buff2[0] = '\0';
+    for (j = 0; buff[j] && j < 7; j++) {
+        sprintf (buff2 + j * 5, "0x%02X ", (unsigned char) buff[j]);
+    }
+    if (buff[0] == '\0') {
+        buff2[0] = '0'; buff2[0] = 'x'; buff2[1] = '0'; buff2[2] = '0';
+        buff2[3] = '\0';
+    }
+    buff[g_unichar_to_utf8 ((gunichar) end, buff)] = '\0';
+    buff3[0] = '\0';
+    for (j = 0; buff[j] && j < 7; j++) {
+        sprintf (buff3 + j * 5, "0x%02X ", (unsigned char) buff[j]);
+    }
+    *range2 = g_strdup_printf ("%s - %s", buff2, buff3);
+}
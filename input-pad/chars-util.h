@@ -0,0 +1,37 @@
+/* vim:set et sts=4: */
+/* input-pad - The input pad
+ * Copyright (C) 2026 Takao Fujiwara <takao.fujiwara1@gmail.com>
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __INPUT_PAD_CHARS_UTIL_H__
+#define __INPUT_PAD_CHARS_UTIL_H__
+
+#include <glib.h>
+
+/* Internal helpers shared by the window and the benchmarks. */
+
+gchar **                input_pad_chars_split   (const gchar       *chars);
+gunichar                input_pad_chars_decode  (const gchar       *str);
+void                    input_pad_unicode_block_format_range
+                                                (unsigned int       start,
+                                                 unsigned int       end,
+                                                 gchar            **range,
+                                                 gchar            **range2);
+
+#endif
@@ -237,18 +237,39 @@ input_pad_module_get_description (void)
     return _("eekboard layout");
 }
 
+const GOptionEntry *
+input_pad_module_get_option_entries (const gchar **name,
+                                     const gchar **description,
+                                     const gchar **help_description,
+                                     const gchar **domain)
+{
+    *name = "eek";
+    *description = N_("eekboard Options");
+    *help_description = N_("Show eekboard Options");
+    *domain = GETTEXT_PACKAGE;
+    return entries;
+}
+
 gboolean
 input_pad_module_arg_init (int                         *argc,
                            char                      ***argv,
                            InputPadGtkKbduiContext     *context)
 {
     GOptionGroup *group;
+    const gchar *name, *description, *help_description, *domain;
+    const GOptionEntry *group_entries;
+
     if (context == NULL || context->context == NULL) {
         return TRUE;
     }
-    group = g_option_group_new ("eek", N_("eekboard Options"), N_("Show eekboard Options"), NULL, NULL);
-    g_option_group_add_entries (group, entries);
-    g_option_group_set_translation_domain (group, GETTEXT_PACKAGE);
+    group_entries = input_pad_module_get_option_entries (&name,
+                                                         &description,
+                                                         &help_description,
+                                                         &domain);
+    group = g_option_group_new (name, description, help_description,
+                                NULL, NULL);
+    g_option_group_add_entries (group, group_entries);
+    g_option_group_set_translation_domain (group, domain);
     g_option_context_add_group (context->context, group);
     return TRUE;
 }
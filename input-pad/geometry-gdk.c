@@ -36,12 +36,14 @@
 #include <X11/extensions/XKM.h>
 #include <X11/XKBlib.h>
 
+#include <X11/extensions/XKBrules.h>
+
 #ifdef HAVE_LIBXKLAVIER
 #include <libxklavier/xklavier.h>
-#else
-#include <X11/extensions/XKBrules.h>
 #endif
 
+#include <glib/gstdio.h> /* g_stat */
+#include <locale.h>
 #include <string.h> /* strlen */
 
 #include "input-pad-window-gtk.h"
@@ -83,10 +85,61 @@ struct _XklLayoutData {
 };
 #endif
 
+typedef struct _XkbKeymapSignalData XkbKeymapSignalData;
+
+struct _XkbKeymapSignalData {
+    GObject   *object;
+    guint      signal_id;
+    guint      idle_id;
+};
+
+typedef struct _XkbKeysymEntry XkbKeysymEntry;
+
+struct _XkbKeysymEntry {
+    KeyCode                     keycode;
+    guint8                      group;
+    guint8                      n_groups;
+    guint8                      mods;
+    /* The index of the next entry of the same keysym or -1 */
+    gint                        next;
+};
+
 struct _InputPadXKBKeyListPrivate {
     XkbFileInfo  *xkb_info;
+    /* keysym -> index + 1 of the first entry in keysym_entries */
+    GHashTable   *keysym_index;
+    GArray       *keysym_entries;
+};
+
+/* The lists are kept for the public API and the hash tables are
+ * the indexes of the list nodes. */
+struct _InputPadXKBConfigRegPrivate {
+    GHashTable                 *layouts;
+    GHashTable                 *variants;
+    GHashTable                 *option_groups;
+    GHashTable                 *options;
+    InputPadXKBLayoutList      *last_layout;
+    InputPadXKBOptionGroupList *last_option_group;
+};
+
+struct _InputPadXKBLayoutListPrivate {
+    InputPadXKBVariantList     *last_variant;
 };
 
+struct _InputPadXKBOptionGroupListPrivate {
+    InputPadXKBOptionList      *last_option;
+};
+
+/* Increase the version when the format of the registry cache is changed. */
+#define XKB_CONFIG_REG_CACHE_VERSION 1
+#define XKB_CONFIG_REG_CACHE_TYPE "(ussxa(ssa(ss))a(ssa(ss)))"
+
+static int xkb_event_base = -1;
+/* The XkbKeymapSignalData of each window */
+#define XKB_KEYMAP_SIGNAL_DATA_KEY "input-pad-xkb-keymap-signal-data"
+/* The keycodes which are remapped temporarily by the modules */
+static guint8 ignored_keycodes[256 / 8];
+
 static gboolean
 input_pad_xkb_init (InputPadGtkWindow *window)
 {
@@ -97,7 +150,8 @@ input_pad_xkb_init (InputPadGtkWindow *window)
         return retval;
     }
 
-    if (!XkbQueryExtension (xdisplay, NULL, NULL, NULL, NULL, NULL)) {
+    if (!XkbQueryExtension (xdisplay, NULL, &xkb_event_base,
+                            NULL, NULL, NULL)) {
         g_warning ("Could not init XKB");
         return FALSE;
     }
@@ -549,6 +603,90 @@ xkb_setup_events (InputPadGtkWindow    *window,
 #endif
 }
 
+static gboolean
+on_keymap_changed_idle (gpointer data)
+{
+    XkbKeymapSignalData *signal_data = (XkbKeymapSignalData *) data;
+
+    signal_data->idle_id = 0;
+    g_signal_emit (signal_data->object, signal_data->signal_id, 0);
+    return FALSE;
+}
+
+static gboolean
+xkb_map_notify_is_ignored (XkbMapNotifyEvent *map)
+{
+    int keycode;
+
+    if (map->num_key_syms == 0 ||
+        (map->changed & ~(XkbKeySymsMask | XkbKeyTypesMask |
+                          XkbKeyActionsMask | XkbKeyBehaviorsMask |
+                          XkbExplicitComponentsMask |
+                          XkbVirtualModMapMask)) != 0) {
+        return FALSE;
+    }
+    for (keycode = map->first_key_sym;
+         keycode < map->first_key_sym + map->num_key_syms; keycode++) {
+        if (!(ignored_keycodes[keycode / 8] & (1 << (keycode % 8)))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static GdkFilterReturn
+on_filter_xkb_keymap_evt (GdkXEvent *xev, GdkEvent *event, gpointer data)
+{
+    XkbEvent *xkbev = (XkbEvent *) xev;
+    XkbKeymapSignalData *signal_data = (XkbKeymapSignalData *) data;
+
+    if (xkb_event_base < 0 || xkbev->type != xkb_event_base) {
+        return GDK_FILTER_CONTINUE;
+    }
+    if (xkbev->any.xkb_type != XkbMapNotify &&
+        xkbev->any.xkb_type != XkbNewKeyboardNotify) {
+        return GDK_FILTER_CONTINUE;
+    }
+    if (xkbev->any.xkb_type == XkbMapNotify &&
+        xkb_map_notify_is_ignored (&xkbev->map)) {
+        return GDK_FILTER_CONTINUE;
+    }
+    /* The server sends several XkbMapNotify for one keymap change
+     * so the signal is emitted once after the queued events. */
+    if (signal_data->idle_id == 0) {
+        signal_data->idle_id = g_idle_add (on_keymap_changed_idle,
+                                           signal_data);
+    }
+    return GDK_FILTER_CONTINUE;
+}
+
+static gboolean
+xkb_key_row_equal (InputPadXKBKeyRow *row1, InputPadXKBKeyRow *row2)
+{
+    int i, j;
+
+    if (row1->keycode != row2->keycode) {
+        return FALSE;
+    }
+    if (row1->keysym == NULL || row2->keysym == NULL) {
+        return (row1->keysym == row2->keysym);
+    }
+    for (i = 0; row1->keysym[i] && row2->keysym[i]; i++) {
+        for (j = 0; row1->keysym[i][j] && row2->keysym[i][j]; j++) {
+            if (row1->keysym[i][j] != row2->keysym[i][j]) {
+                return FALSE;
+            }
+        }
+        if (row1->keysym[i][j] != row2->keysym[i][j]) {
+            return FALSE;
+        }
+    }
+    if (row1->keysym[i] != NULL || row2->keysym[i] != NULL) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
 static void
 debug_print_key_list (InputPadXKBKeyList *xkb_key_list)
 {
@@ -658,129 +796,350 @@ debug_print_group_layout_list (gchar **names)
     }
 }
 
+static gchar *
+xkb_variant_key_new (const gchar *layout, const gchar *variant)
+{
+    return g_strdup_printf ("%s(%s)", layout, variant);
+}
+
 #ifdef HAVE_LIBXKLAVIER
+static InputPadXKBConfigReg *
+xkb_config_reg_new (void)
+{
+    InputPadXKBConfigReg *config_reg;
+
+    config_reg = g_new0 (InputPadXKBConfigReg, 1);
+    config_reg->priv = g_new0 (InputPadXKBConfigRegPrivate, 1);
+    config_reg->priv->layouts = g_hash_table_new (g_str_hash, g_str_equal);
+    config_reg->priv->variants = g_hash_table_new_full (g_str_hash,
+                                                        g_str_equal,
+                                                        g_free,
+                                                        NULL);
+    config_reg->priv->option_groups = g_hash_table_new (g_str_hash,
+                                                        g_str_equal);
+    config_reg->priv->options = g_hash_table_new (g_str_hash, g_str_equal);
+    return config_reg;
+}
+
 static void
-input_pad_xkb_layout_list_append_layout_variant (InputPadXKBLayoutList *xkb_layout_list,
-                                                 const XklConfigItem   *layout,
-                                                 const XklConfigItem   *variant)
+xkb_config_reg_append_layout_variant (InputPadXKBConfigReg     *config_reg,
+                                      const gchar              *layout_name,
+                                      const gchar              *layout_desc,
+                                      const gchar              *variant_name,
+                                      const gchar              *variant_desc)
 {
-    InputPadXKBLayoutList *list = xkb_layout_list;
+    InputPadXKBConfigRegPrivate *priv;
+    InputPadXKBLayoutList *list;
     InputPadXKBVariantList *variants;
+    gchar *key;
 
-    g_return_if_fail (xkb_layout_list != NULL);
-    g_return_if_fail (layout != NULL && layout->name != NULL);
-    g_return_if_fail (variant != NULL && variant->name != NULL);
+    g_return_if_fail (config_reg != NULL && config_reg->priv != NULL);
+    g_return_if_fail (layout_name != NULL);
 
-    while (list) {
-        if (list->layout == NULL) {
-            list->layout = g_strdup (layout->name);
-            list->desc = layout->description ? g_strdup (layout->description) : NULL;
-            list->variants = g_new0 (InputPadXKBVariantList, 1);
-            list->variants->variant = g_strdup (variant->name);
-            list->variants->desc = variant->description ? g_strdup (variant->description) : NULL;
-            goto end_append_layout_variant;
-        }
-        if (!g_strcmp0 (list->layout, layout->name)) {
-            if (list->variants == NULL) {
-                list->variants = g_new0 (InputPadXKBVariantList, 1);
-                list->variants->variant = g_strdup (variant->name);
-                list->variants->desc = variant->description ? g_strdup (variant->description) : NULL;
-                goto end_append_layout_variant;
-            }
-            variants = list->variants;
-            while (variants->next) {
-                if (variants->variant == NULL) {
-                    variants->variant = g_strdup (variant->name);
-                    variants->desc = variant->description ? g_strdup (variant->description) : NULL;
-                    goto end_append_layout_variant;
-                }
-                if (!g_strcmp0 (variants->variant, variant->name)) {
-                    goto end_append_layout_variant;
-                }
-                variants = variants->next;
-            }
-            variants->next = g_new0 (InputPadXKBVariantList, 1);
-            variants = variants->next;
-            variants->variant = g_strdup (variant->name);
-            variants->desc = variant->description ? g_strdup (variant->description) : NULL;
-            goto end_append_layout_variant;
-        }
-        if (list->next == NULL) {
-            break;
+    priv = config_reg->priv;
+    list = g_hash_table_lookup (priv->layouts, layout_name);
+    if (list == NULL) {
+        list = g_new0 (InputPadXKBLayoutList, 1);
+        list->layout = g_strdup (layout_name);
+        list->desc = g_strdup (layout_desc);
+        list->priv = g_new0 (InputPadXKBLayoutListPrivate, 1);
+        if (priv->last_layout) {
+            priv->last_layout->next = list;
+        } else {
+            config_reg->layouts = list;
         }
-        list = list->next;
+        priv->last_layout = list;
+        g_hash_table_insert (priv->layouts, list->layout, list);
+    }
+    if (variant_name == NULL) {
+        return;
+    }
+
+    key = xkb_variant_key_new (layout_name, variant_name);
+    if (g_hash_table_lookup (priv->variants, key)) {
+        g_free (key);
+        return;
+    }
+    variants = g_new0 (InputPadXKBVariantList, 1);
+    variants->variant = g_strdup (variant_name);
+    variants->desc = g_strdup (variant_desc);
+    if (list->priv->last_variant) {
+        list->priv->last_variant->next = variants;
+    } else {
+        list->variants = variants;
     }
-    list->next = g_new0 (InputPadXKBLayoutList, 1);
-    list = list->next;
-    list->layout = g_strdup (layout->name);
-    list->desc = layout->description ? g_strdup (layout->description) : NULL;
-    list->variants = g_new0 (InputPadXKBVariantList, 1);
-    list->variants->variant = g_strdup (variant->name);
-    list->variants->desc = variant->description ? g_strdup (variant->description) : NULL;
-end_append_layout_variant:
-    ;
+    list->priv->last_variant = variants;
+    g_hash_table_insert (priv->variants, key, variants);
 }
 
 static void
-input_pad_xkb_option_group_list_append_group_option (InputPadXKBOptionGroupList *xkb_group_list,
-                                                     const XklConfigItem   *group,
-                                                     const XklConfigItem   *option)
+xkb_config_reg_append_group_option (InputPadXKBConfigReg       *config_reg,
+                                    const gchar                *group_name,
+                                    const gchar                *group_desc,
+                                    const gchar                *option_name,
+                                    const gchar                *option_desc)
 {
-    InputPadXKBOptionGroupList *list = xkb_group_list;
+    InputPadXKBConfigRegPrivate *priv;
+    InputPadXKBOptionGroupList *list;
     InputPadXKBOptionList *options;
 
-    g_return_if_fail (xkb_group_list != NULL);
-    g_return_if_fail (group != NULL && group->name != NULL);
-    g_return_if_fail (option != NULL && option->name != NULL);
+    g_return_if_fail (config_reg != NULL && config_reg->priv != NULL);
+    g_return_if_fail (group_name != NULL);
+    g_return_if_fail (option_name != NULL);
 
-    while (list) {
-        if (list->option_group == NULL) {
-            list->option_group = g_strdup (group->name);
-            list->desc = g_strdup (group->description);
-            list->options = g_new0 (InputPadXKBOptionList, 1);
-            list->options->option = g_strdup (option->name);
-            list->options->desc = g_strdup (option->description);
-            goto end_append_group_option;
+    priv = config_reg->priv;
+    list = g_hash_table_lookup (priv->option_groups, group_name);
+    if (list == NULL) {
+        list = g_new0 (InputPadXKBOptionGroupList, 1);
+        list->option_group = g_strdup (group_name);
+        list->desc = g_strdup (group_desc);
+        list->priv = g_new0 (InputPadXKBOptionGroupListPrivate, 1);
+        if (priv->last_option_group) {
+            priv->last_option_group->next = list;
+        } else {
+            config_reg->option_groups = list;
         }
-        if (!g_strcmp0 (list->option_group, group->name)) {
-            if (list->options == NULL) {
-                list->options = g_new0 (InputPadXKBOptionList, 1);
-                list->options->option = g_strdup (option->name);
-                list->options->desc = g_strdup (option->description);
-                goto end_append_group_option;
-            }
-            options = list->options;
-            while (options->next) {
-                if (options->option == NULL) {
-                    options->option = g_strdup (option->name);
-                    options->desc = g_strdup (option->description);
-                    goto end_append_group_option;
-                }
-                if (!g_strcmp0 (options->option, option->name)) {
-                    goto end_append_group_option;
-                }
-                options = options->next;
-            }
-            options->next = g_new0 (InputPadXKBOptionList, 1);
-            options = options->next;
-            options->option = g_strdup (option->name);
-            options->desc = g_strdup (option->description);
-            goto end_append_group_option;
+        priv->last_option_group = list;
+        g_hash_table_insert (priv->option_groups, list->option_group, list);
+    }
+
+    if (g_hash_table_lookup (priv->options, option_name)) {
+        return;
+    }
+    options = g_new0 (InputPadXKBOptionList, 1);
+    options->option = g_strdup (option_name);
+    options->desc = g_strdup (option_desc);
+    if (list->priv->last_option) {
+        list->priv->last_option->next = options;
+    } else {
+        list->options = options;
+    }
+    list->priv->last_option = options;
+    g_hash_table_insert (priv->options, options->option, options);
+}
+
+/*
+ * The cache is valid while the rules file of xkeyboard-config and
+ * the message locale of the descriptions are not changed.
+ * NULL descriptions are saved as empty strings.
+ */
+static gchar *
+xkb_config_reg_get_rules_path (Display *xdisplay)
+{
+    XkbRF_VarDefsRec vd;
+    char *rules_file = NULL;
+    gchar *path;
+
+    memset (&vd, 0, sizeof (XkbRF_VarDefsRec));
+    if (!XkbRF_GetNamesProp (xdisplay, &rules_file, &vd) ||
+        rules_file == NULL) {
+        rules_file = NULL;
+    }
+    path = g_strdup_printf ("%s/rules/%s.xml", XKB_BASE,
+                            rules_file ? rules_file : "base");
+    free (rules_file);
+    free (vd.model);
+    free (vd.layout);
+    free (vd.variant);
+    free (vd.options);
+    return path;
+}
+
+static gchar *
+xkb_config_reg_get_cache_path (void)
+{
+    return g_build_filename (g_get_user_cache_dir (),
+                             "input-pad", "xkb-config-registry.cache",
+                             NULL);
+}
+
+static gboolean
+xkb_config_reg_get_rules_mtime (const gchar *rules_path, gint64 *mtimep)
+{
+    GStatBuf buf;
+
+    if (g_stat (rules_path, &buf) != 0) {
+        return FALSE;
+    }
+    *mtimep = (gint64) buf.st_mtime;
+    return TRUE;
+}
+
+static const gchar *
+xkb_config_reg_get_locale (void)
+{
+    const gchar *locale = setlocale (LC_MESSAGES, NULL);
+
+    return locale ? locale : "C";
+}
+
+static gboolean
+xkb_strv_has_string (gchar **strv, const gchar *str)
+{
+    int i;
+
+    for (i = 0; strv[i]; i++) {
+        if (g_strcmp0 (strv[i], str) == 0) {
+            return TRUE;
         }
-        if (list->next == NULL) {
-            break;
+    }
+    return FALSE;
+}
+
+/*
+ * If group_layouts is not NULL, only the layouts in group_layouts
+ * are loaded without the options.
+ */
+static InputPadXKBConfigReg *
+xkb_config_reg_load_cache (const gchar *rules_path, gchar **group_layouts)
+{
+    InputPadXKBConfigReg *config_reg = NULL;
+    GMappedFile *file;
+    GBytes *bytes;
+    GVariant *variant;
+    GVariantIter *layouts, *option_groups, *items;
+    gchar *cache_path;
+    const gchar *path, *locale;
+    const gchar *name, *desc, *item_name, *item_desc;
+    gint64 mtime, rules_mtime;
+    guint32 version;
+
+    if (!xkb_config_reg_get_rules_mtime (rules_path, &rules_mtime)) {
+        return NULL;
+    }
+    cache_path = xkb_config_reg_get_cache_path ();
+    file = g_mapped_file_new (cache_path, FALSE, NULL);
+    g_free (cache_path);
+    if (file == NULL) {
+        return NULL;
+    }
+    bytes = g_mapped_file_get_bytes (file);
+    g_mapped_file_unref (file);
+    variant = g_variant_new_from_bytes (G_VARIANT_TYPE (XKB_CONFIG_REG_CACHE_TYPE),
+                                        bytes, FALSE);
+    g_bytes_unref (bytes);
+    g_variant_ref_sink (variant);
+
+    g_variant_get (variant, "(u&s&sxa(ssa(ss))a(ssa(ss)))",
+                   &version, &path, &locale, &mtime,
+                   &layouts, &option_groups);
+    if (version != XKB_CONFIG_REG_CACHE_VERSION ||
+        g_strcmp0 (path, rules_path) != 0 ||
+        g_strcmp0 (locale, xkb_config_reg_get_locale ()) != 0 ||
+        mtime != rules_mtime) {
+        goto end_load_cache;
+    }
+
+    config_reg = xkb_config_reg_new ();
+    while (g_variant_iter_next (layouts, "(&s&sa(ss))",
+                                &name, &desc, &items)) {
+        if (group_layouts && !xkb_strv_has_string (group_layouts, name)) {
+            g_variant_iter_free (items);
+            continue;
         }
-        list = list->next;
+        xkb_config_reg_append_layout_variant (config_reg,
+                                              name, *desc ? desc : NULL,
+                                              NULL, NULL);
+        while (g_variant_iter_next (items, "(&s&s)",
+                                    &item_name, &item_desc)) {
+            xkb_config_reg_append_layout_variant (config_reg,
+                                                  name, *desc ? desc : NULL,
+                                                  item_name,
+                                                  *item_desc ? item_desc : NULL);
+        }
+        g_variant_iter_free (items);
+    }
+    while (group_layouts == NULL &&
+           g_variant_iter_next (option_groups, "(&s&sa(ss))",
+                                &name, &desc, &items)) {
+        while (g_variant_iter_next (items, "(&s&s)",
+                                    &item_name, &item_desc)) {
+            xkb_config_reg_append_group_option (config_reg,
+                                                name, *desc ? desc : NULL,
+                                                item_name,
+                                                *item_desc ? item_desc : NULL);
+        }
+        g_variant_iter_free (items);
+    }
+
+end_load_cache:
+    g_variant_iter_free (layouts);
+    g_variant_iter_free (option_groups);
+    g_variant_unref (variant);
+    return config_reg;
+}
+
+static void
+xkb_config_reg_save_cache (InputPadXKBConfigReg *config_reg,
+                           const gchar          *rules_path)
+{
+    InputPadXKBLayoutList *layouts;
+    InputPadXKBVariantList *variants;
+    InputPadXKBOptionGroupList *groups;
+    InputPadXKBOptionList *options;
+    GVariantBuilder layouts_builder;
+    GVariantBuilder groups_builder;
+    GVariantBuilder items_builder;
+    GVariant *variant;
+    GError *error = NULL;
+    gchar *cache_path;
+    gchar *cache_dir;
+    gint64 mtime;
+
+    if (!xkb_config_reg_get_rules_mtime (rules_path, &mtime)) {
+        return;
     }
-    list->next = g_new0 (InputPadXKBOptionGroupList, 1);
-    list = list->next;
-    list->option_group = g_strdup (group->name);
-    list->desc = g_strdup (group->description);
-    list->options = g_new0 (InputPadXKBOptionList, 1);
-    list->options->option = g_strdup (option->name);
-    list->options->desc = g_strdup (option->description);
-end_append_group_option:
-    ;
+
+    g_variant_builder_init (&layouts_builder, G_VARIANT_TYPE ("a(ssa(ss))"));
+    for (layouts = config_reg->layouts; layouts; layouts = layouts->next) {
+        g_variant_builder_init (&items_builder, G_VARIANT_TYPE ("a(ss)"));
+        for (variants = layouts->variants; variants;
+             variants = variants->next) {
+            g_variant_builder_add (&items_builder, "(ss)",
+                                   variants->variant,
+                                   variants->desc ? variants->desc : "");
+        }
+        g_variant_builder_add (&layouts_builder, "(ssa(ss))",
+                               layouts->layout,
+                               layouts->desc ? layouts->desc : "",
+                               &items_builder);
+    }
+    g_variant_builder_init (&groups_builder, G_VARIANT_TYPE ("a(ssa(ss))"));
+    for (groups = config_reg->option_groups; groups; groups = groups->next) {
+        g_variant_builder_init (&items_builder, G_VARIANT_TYPE ("a(ss)"));
+        for (options = groups->options; options; options = options->next) {
+            g_variant_builder_add (&items_builder, "(ss)",
+                                   options->option,
+                                   options->desc ? options->desc : "");
+        }
+        g_variant_builder_add (&groups_builder, "(ssa(ss))",
+                               groups->option_group,
+                               groups->desc ? groups->desc : "",
+                               &items_builder);
+    }
+    variant = g_variant_new (XKB_CONFIG_REG_CACHE_TYPE,
+                             XKB_CONFIG_REG_CACHE_VERSION,
+                             rules_path,
+                             xkb_config_reg_get_locale (),
+                             mtime,
+                             &layouts_builder,
+                             &groups_builder);
+    g_variant_ref_sink (variant);
+
+    cache_path = xkb_config_reg_get_cache_path ();
+    cache_dir = g_path_get_dirname (cache_path);
+    g_mkdir_with_parents (cache_dir, 0700);
+    if (!g_file_set_contents (cache_path,
+                              g_variant_get_data (variant),
+                              g_variant_get_size (variant),
+                              &error)) {
+        g_warning ("Could not save %s: %s", cache_path,
+                   error ? error->message : "");
+        g_clear_error (&error);
+    }
+    g_free (cache_dir);
+    g_free (cache_path);
+    g_variant_unref (variant);
 }
 
 static void
@@ -790,14 +1149,13 @@ add_variant (XklConfigRegistry   *xklconfig_registry,
 {
     XklLayoutData *layout_data = (XklLayoutData *) data;
     if (*layout_data->config_regp == NULL) {
-        *layout_data->config_regp = g_new0 (InputPadXKBConfigReg, 1);
-    }
-    if ((*layout_data->config_regp)->layouts == NULL) {
-        (*layout_data->config_regp)->layouts = g_new0 (InputPadXKBLayoutList, 1);
+        *layout_data->config_regp = xkb_config_reg_new ();
     }
-    input_pad_xkb_layout_list_append_layout_variant ((*layout_data->config_regp)->layouts,
-                                                    layout_data->layout,
-                                                    item);
+    xkb_config_reg_append_layout_variant (*layout_data->config_regp,
+                                          layout_data->layout->name,
+                                          layout_data->layout->description,
+                                          item->name,
+                                          item->description);
 }
 
 static void
@@ -824,14 +1182,13 @@ add_option (XklConfigRegistry   *xklconfig_registry,
 {
     XklLayoutData *layout_data = (XklLayoutData *) data;
     if (*layout_data->config_regp == NULL) {
-        *layout_data->config_regp = g_new0 (InputPadXKBConfigReg, 1);
-    }
-    if ((*layout_data->config_regp)->option_groups == NULL) {
-        (*layout_data->config_regp)->option_groups = g_new0 (InputPadXKBOptionGroupList, 1);
+        *layout_data->config_regp = xkb_config_reg_new ();
     }
-    input_pad_xkb_option_group_list_append_group_option ((*layout_data->config_regp)->option_groups,
-                                                         layout_data->layout,
-                                                         item);
+    xkb_config_reg_append_group_option (*layout_data->config_regp,
+                                        layout_data->layout->name,
+                                        layout_data->layout->description,
+                                        item->name,
+                                        item->description);
 }
 
 static void
@@ -1128,6 +1485,13 @@ input_pad_gdk_xkb_destroy_keyboard_layouts (InputPadGtkWindow   *window,
         return;
     }
 
+    if (xkb_key_list->priv && xkb_key_list->priv->keysym_index) {
+        g_hash_table_destroy (xkb_key_list->priv->keysym_index);
+        g_array_free (xkb_key_list->priv->keysym_entries, TRUE);
+        xkb_key_list->priv->keysym_index = NULL;
+        xkb_key_list->priv->keysym_entries = NULL;
+    }
+
     for (i = 1; list; i++) {
         row = list->row;
         while (row) {
@@ -1244,6 +1608,248 @@ input_pad_gdk_xkb_signal_emit (InputPadGtkWindow   *window, guint signal_id)
     xkb_setup_events (window, signal_id);
 }
 
+void
+input_pad_gdk_xkb_setup_keymap_events (InputPadGtkWindow   *window,
+                                       guint                signal_id)
+{
+    Display *xdisplay;
+    XkbKeymapSignalData *keymap_signal_data;
+
+    g_return_if_fail (window != NULL && INPUT_PAD_IS_GTK_WINDOW (window));
+
+    if (!input_pad_xkb_init (window)) {
+        return;
+    }
+    if (g_object_get_data (G_OBJECT (window),
+                           XKB_KEYMAP_SIGNAL_DATA_KEY) != NULL) {
+        return;
+    }
+
+    xdisplay = GDK_WINDOW_XDISPLAY (gtk_widget_get_window (GTK_WIDGET (window)));
+    XkbSelectEvents (xdisplay, XkbUseCoreKbd,
+                     XkbMapNotifyMask | XkbNewKeyboardNotifyMask,
+                     XkbMapNotifyMask | XkbNewKeyboardNotifyMask);
+
+    keymap_signal_data = g_new0 (XkbKeymapSignalData, 1);
+    keymap_signal_data->object = G_OBJECT (window);
+    keymap_signal_data->signal_id = signal_id;
+    gdk_window_add_filter (NULL, (GdkFilterFunc)
+                           on_filter_xkb_keymap_evt, keymap_signal_data);
+    g_object_set_data (G_OBJECT (window), XKB_KEYMAP_SIGNAL_DATA_KEY,
+                       keymap_signal_data);
+}
+
+/*
+ * The changes of the ignored keycodes do not emit the keymap-changed
+ * signal, e.g. the spare keycodes remapped by the XTest module.
+ */
+void
+input_pad_gdk_xkb_set_keycode_ignored (guint                keycode,
+                                       gboolean             ignored)
+{
+    g_return_if_fail (keycode < 256);
+
+    if (ignored) {
+        ignored_keycodes[keycode / 8] |= (1 << (keycode % 8));
+    } else {
+        ignored_keycodes[keycode / 8] &= ~(1 << (keycode % 8));
+    }
+}
+
+void
+input_pad_gdk_xkb_remove_keymap_events (InputPadGtkWindow   *window)
+{
+    XkbKeymapSignalData *keymap_signal_data;
+
+    keymap_signal_data = (XkbKeymapSignalData *)
+        g_object_get_data (G_OBJECT (window), XKB_KEYMAP_SIGNAL_DATA_KEY);
+    if (keymap_signal_data == NULL) {
+        return;
+    }
+    g_object_set_data (G_OBJECT (window), XKB_KEYMAP_SIGNAL_DATA_KEY, NULL);
+
+    gdk_window_remove_filter (NULL, (GdkFilterFunc)
+                              on_filter_xkb_keymap_evt, keymap_signal_data);
+    if (keymap_signal_data->idle_id != 0) {
+        g_source_remove (keymap_signal_data->idle_id);
+        keymap_signal_data->idle_id = 0;
+    }
+    g_free (keymap_signal_data);
+}
+
+gboolean
+input_pad_gdk_xkb_diff_keyboard_layouts (InputPadXKBKeyList    *prev_list,
+                                         InputPadXKBKeyList    *new_list,
+                                         InputPadXKBKeyRowFunc  func,
+                                         gpointer               data)
+{
+    InputPadXKBKeyList *list1, *list2;
+    InputPadXKBKeyRow *row1, *row2;
+
+    if (prev_list == NULL || new_list == NULL) {
+        return FALSE;
+    }
+
+    /* The keys can be updated in place only if the geometry is same. */
+    for (list1 = prev_list, list2 = new_list;
+         list1 && list2;
+         list1 = list1->next, list2 = list2->next) {
+        for (row1 = list1->row, row2 = list2->row;
+             row1 && row2;
+             row1 = row1->next, row2 = row2->next) {
+            if (g_strcmp0 (row1->name, row2->name) != 0) {
+                return FALSE;
+            }
+        }
+        if (row1 != NULL || row2 != NULL) {
+            return FALSE;
+        }
+    }
+    if (list1 != NULL || list2 != NULL) {
+        return FALSE;
+    }
+
+    if (func == NULL) {
+        return TRUE;
+    }
+
+    for (list1 = prev_list, list2 = new_list;
+         list1 && list2;
+         list1 = list1->next, list2 = list2->next) {
+        for (row1 = list1->row, row2 = list2->row;
+             row1 && row2;
+             row1 = row1->next, row2 = row2->next) {
+            func (row2, !xkb_key_row_equal (row1, row2), data);
+        }
+    }
+    return TRUE;
+}
+
+XkbDescPtr
+input_pad_gdk_xkb_key_list_get_desc (InputPadXKBKeyList *xkb_key_list)
+{
+    if (xkb_key_list == NULL || xkb_key_list->priv == NULL ||
+        xkb_key_list->priv->xkb_info == NULL) {
+        return NULL;
+    }
+    return xkb_key_list->priv->xkb_info->xkb;
+}
+
+static gboolean
+xkb_key_type_get_level_mods (XkbKeyTypePtr  type,
+                             int            level,
+                             guint         *modsp)
+{
+    int i;
+
+    if (level == 0) {
+        *modsp = 0;
+        return TRUE;
+    }
+    for (i = 0; i < type->map_count; i++) {
+        if (type->map[i].active && type->map[i].level == level) {
+            *modsp = type->map[i].mods.mask;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * The index is built from the client side keymap of the key list
+ * so it does not send any requests to the server. The key list is
+ * parsed again on the keymap changes so the index is also rebuilt.
+ */
+static void
+xkb_keysym_index_build (InputPadXKBKeyListPrivate *priv)
+{
+    XkbDescPtr xkb = priv->xkb_info ? priv->xkb_info->xkb : NULL;
+    XkbKeyTypePtr type;
+    XkbKeysymEntry entry;
+    KeySym keysym;
+    guint mods;
+    int keycode, group, level, n_groups, width;
+    gpointer head;
+
+    priv->keysym_index = g_hash_table_new (g_direct_hash, g_direct_equal);
+    priv->keysym_entries = g_array_new (FALSE, FALSE, sizeof (XkbKeysymEntry));
+    if (xkb == NULL || xkb->map == NULL) {
+        return;
+    }
+    for (keycode = xkb->min_key_code; keycode <= xkb->max_key_code; keycode++) {
+        n_groups = XkbKeyNumGroups (xkb, keycode);
+        for (group = 0; group < n_groups; group++) {
+            type = XkbKeyKeyType (xkb, keycode, group);
+            width = XkbKeyGroupWidth (xkb, keycode, group);
+            for (level = 0; level < width; level++) {
+                keysym = XkbKeySymEntry (xkb, keycode, level, group);
+                if (keysym == NoSymbol ||
+                    !xkb_key_type_get_level_mods (type, level, &mods)) {
+                    continue;
+                }
+                head = g_hash_table_lookup (priv->keysym_index,
+                                            GUINT_TO_POINTER (keysym));
+                entry.keycode = (KeyCode) keycode;
+                entry.group = (guint8) group;
+                entry.n_groups = (guint8) n_groups;
+                entry.mods = (guint8) mods;
+                entry.next = GPOINTER_TO_INT (head) - 1;
+                g_array_append_val (priv->keysym_entries, entry);
+                g_hash_table_insert (priv->keysym_index,
+                                     GUINT_TO_POINTER (keysym),
+                                     GINT_TO_POINTER (priv->keysym_entries->len));
+            }
+        }
+    }
+}
+
+/*
+ * Looks up the key on the group which produces the keysym without
+ * any server requests. The level without modifiers is preferred.
+ */
+gboolean
+input_pad_gdk_xkb_lookup_keysym (InputPadXKBKeyList    *xkb_key_list,
+                                 guint                  keysym,
+                                 int                    group,
+                                 guint                 *keycodep,
+                                 guint                 *modsp)
+{
+    InputPadXKBKeyListPrivate *priv;
+    XkbKeysymEntry *entry;
+    XkbKeysymEntry *found = NULL;
+    int i;
+
+    if (xkb_key_list == NULL || xkb_key_list->priv == NULL || keysym == 0) {
+        return FALSE;
+    }
+    priv = xkb_key_list->priv;
+    if (priv->keysym_index == NULL) {
+        xkb_keysym_index_build (priv);
+    }
+    i = GPOINTER_TO_INT (g_hash_table_lookup (priv->keysym_index,
+                                              GUINT_TO_POINTER (keysym))) - 1;
+    for (; i >= 0; i = entry->next) {
+        entry = &g_array_index (priv->keysym_entries, XkbKeysymEntry, i);
+        /* The groups out of range are wrapped by the key. */
+        if (entry->group != group % entry->n_groups) {
+            continue;
+        }
+        if (found == NULL || (found->mods != 0 && entry->mods == 0)) {
+            found = entry;
+        }
+    }
+    if (found == NULL) {
+        return FALSE;
+    }
+    if (keycodep) {
+        *keycodep = found->keycode;
+    }
+    if (modsp) {
+        *modsp = found->mods;
+    }
+    return TRUE;
+}
+
 char **
 input_pad_gdk_xkb_get_group_layouts (InputPadGtkWindow   *window, 
                                      InputPadXKBKeyList  *xkb_key_list)
@@ -1284,17 +1890,29 @@ input_pad_gdk_xkb_parse_config_registry (InputPadGtkWindow   *window,
 #ifdef HAVE_LIBXKLAVIER
     InputPadXKBConfigReg  *config_reg = NULL;
     XklConfigRegistry *xklconfig_registry;
+    gchar *rules_path;
 
     g_return_val_if_fail (window != NULL && INPUT_PAD_IS_GTK_WINDOW (window), NULL);
 
     if (xklengine == NULL) {
         xklengine = init_xkl_engine (window, &initial_xkl_rec, &initial_group);
     }
+    rules_path = xkb_config_reg_get_rules_path (GDK_WINDOW_XDISPLAY (gtk_widget_get_window (GTK_WIDGET (window))));
+    if ((config_reg = xkb_config_reg_load_cache (rules_path, NULL)) != NULL) {
+        g_free (rules_path);
+        return config_reg;
+    }
     xklconfig_registry = init_xkl_config_registry (window);
     get_reg_layout_with_xkl_config_registry (&config_reg,
                                              xklconfig_registry);
     get_reg_option_with_xkl_config_registry (&config_reg,
                                              xklconfig_registry);
+    if (config_reg == NULL) {
+        g_free (rules_path);
+        return NULL;
+    }
+    xkb_config_reg_save_cache (config_reg, rules_path);
+    g_free (rules_path);
 
     debug_print_layout_list (config_reg->layouts);
     debug_print_option_group_list (config_reg->option_groups);
@@ -1304,6 +1922,164 @@ input_pad_gdk_xkb_parse_config_registry (InputPadGtkWindow   *window,
 #endif
 }
 
+InputPadXKBConfigReg *
+input_pad_gdk_xkb_parse_group_config_registry (InputPadGtkWindow  *window,
+                                               InputPadXKBKeyList *xkb_key_list,
+                                               gchar             **group_layouts,
+                                               gchar             **group_variants)
+{
+#ifdef HAVE_LIBXKLAVIER
+    InputPadXKBConfigReg  *config_reg;
+    gchar *rules_path;
+    const gchar *variant;
+    gchar *desc;
+    int i;
+
+    g_return_val_if_fail (window != NULL && INPUT_PAD_IS_GTK_WINDOW (window), NULL);
+
+    if (group_layouts == NULL) {
+        return NULL;
+    }
+    if (xklengine == NULL) {
+        xklengine = init_xkl_engine (window, &initial_xkl_rec, &initial_group);
+    }
+    rules_path = xkb_config_reg_get_rules_path (GDK_WINDOW_XDISPLAY (gtk_widget_get_window (GTK_WIDGET (window))));
+    config_reg = xkb_config_reg_load_cache (rules_path, group_layouts);
+    g_free (rules_path);
+    if (config_reg == NULL) {
+        config_reg = xkb_config_reg_new ();
+    }
+
+    /* Use the names if the registry is not cached yet. */
+    for (i = 0; group_layouts[i]; i++) {
+        variant = NULL;
+        if (group_variants && i < g_strv_length (group_variants) &&
+            group_variants[i] && *group_variants[i] != '\0') {
+            variant = group_variants[i];
+        }
+        if (variant == NULL) {
+            xkb_config_reg_append_layout_variant (config_reg,
+                                                  group_layouts[i],
+                                                  group_layouts[i],
+                                                  NULL, NULL);
+            continue;
+        }
+        desc = xkb_variant_key_new (group_layouts[i], variant);
+        xkb_config_reg_append_layout_variant (config_reg,
+                                              group_layouts[i],
+                                              group_layouts[i],
+                                              variant, desc);
+        g_free (desc);
+    }
+    return config_reg;
+#else
+    return NULL;
+#endif
+}
+
+void
+input_pad_gdk_xkb_destroy_config_registry (InputPadXKBConfigReg *config_reg)
+{
+    InputPadXKBLayoutList *layouts, *next_layouts;
+    InputPadXKBVariantList *variants, *next_variants;
+    InputPadXKBOptionGroupList *groups, *next_groups;
+    InputPadXKBOptionList *options, *next_options;
+
+    if (config_reg == NULL) {
+        return;
+    }
+    for (layouts = config_reg->layouts; layouts; layouts = next_layouts) {
+        next_layouts = layouts->next;
+        for (variants = layouts->variants; variants;
+             variants = next_variants) {
+            next_variants = variants->next;
+            g_free (variants->variant);
+            g_free (variants->desc);
+            g_free (variants);
+        }
+        g_free (layouts->layout);
+        g_free (layouts->desc);
+        g_free (layouts->priv);
+        g_free (layouts);
+    }
+    for (groups = config_reg->option_groups; groups; groups = next_groups) {
+        next_groups = groups->next;
+        for (options = groups->options; options; options = next_options) {
+            next_options = options->next;
+            g_free (options->option);
+            g_free (options->desc);
+            g_free (options);
+        }
+        g_free (groups->option_group);
+        g_free (groups->desc);
+        g_free (groups->priv);
+        g_free (groups);
+    }
+    if (config_reg->priv) {
+        g_hash_table_destroy (config_reg->priv->layouts);
+        g_hash_table_destroy (config_reg->priv->variants);
+        g_hash_table_destroy (config_reg->priv->option_groups);
+        g_hash_table_destroy (config_reg->priv->options);
+        g_free (config_reg->priv);
+    }
+    g_free (config_reg);
+}
+
+InputPadXKBLayoutList *
+input_pad_gdk_xkb_config_reg_lookup_layout (InputPadXKBConfigReg  *config_reg,
+                                            const char            *layout)
+{
+    g_return_val_if_fail (layout != NULL, NULL);
+
+    if (config_reg == NULL || config_reg->priv == NULL) {
+        return NULL;
+    }
+    return g_hash_table_lookup (config_reg->priv->layouts, layout);
+}
+
+InputPadXKBVariantList *
+input_pad_gdk_xkb_config_reg_lookup_variant (InputPadXKBConfigReg *config_reg,
+                                             const char           *layout,
+                                             const char           *variant)
+{
+    InputPadXKBVariantList *retval;
+    gchar *key;
+
+    g_return_val_if_fail (layout != NULL && variant != NULL, NULL);
+
+    if (config_reg == NULL || config_reg->priv == NULL) {
+        return NULL;
+    }
+    key = xkb_variant_key_new (layout, variant);
+    retval = g_hash_table_lookup (config_reg->priv->variants, key);
+    g_free (key);
+    return retval;
+}
+
+InputPadXKBOptionGroupList *
+input_pad_gdk_xkb_config_reg_lookup_option_group (InputPadXKBConfigReg *config_reg,
+                                                  const char           *option_group)
+{
+    g_return_val_if_fail (option_group != NULL, NULL);
+
+    if (config_reg == NULL || config_reg->priv == NULL) {
+        return NULL;
+    }
+    return g_hash_table_lookup (config_reg->priv->option_groups, option_group);
+}
+
+InputPadXKBOptionList *
+input_pad_gdk_xkb_config_reg_lookup_option (InputPadXKBConfigReg  *config_reg,
+                                            const char            *option)
+{
+    g_return_val_if_fail (option != NULL, NULL);
+
+    if (config_reg == NULL || config_reg->priv == NULL) {
+        return NULL;
+    }
+    return g_hash_table_lookup (config_reg->priv->options, option);
+}
+
 Bool
 input_pad_gdk_xkb_set_layout (InputPadGtkWindow        *window,
                               InputPadXKBKeyList       *xkb_key_list,
@@ -22,9 +22,15 @@
 #ifndef __INPUT_PAD_GEOMETRY_GDK_H__
 #define __INPUT_PAD_GEOMETRY_GDK_H__
 
+#include <X11/XKBlib.h>
+
 #include "input-pad-window-gtk.h"
 #include "geometry-xkb.h"
 
+typedef void (* InputPadXKBKeyRowFunc) (InputPadXKBKeyRow     *row,
+                                        gboolean               changed,
+                                        gpointer               data);
+
 void                    input_pad_gdk_xkb_destroy_keyboard_layouts
                                         (InputPadGtkWindow     *window,
                                          InputPadXKBKeyList    *xkb_key_list);
@@ -33,6 +39,27 @@ InputPadXKBKeyList *    input_pad_gdk_xkb_parse_keyboard_layouts
 void                    input_pad_gdk_xkb_signal_emit
                                         (InputPadGtkWindow     *window,
                                          guint                  signal_id);
+void                    input_pad_gdk_xkb_setup_keymap_events
+                                        (InputPadGtkWindow     *window,
+                                         guint                  signal_id);
+void                    input_pad_gdk_xkb_remove_keymap_events
+                                        (InputPadGtkWindow     *window);
+void                    input_pad_gdk_xkb_set_keycode_ignored
+                                        (guint                  keycode,
+                                         gboolean               ignored);
+gboolean                input_pad_gdk_xkb_diff_keyboard_layouts
+                                        (InputPadXKBKeyList    *prev_list,
+                                         InputPadXKBKeyList    *new_list,
+                                         InputPadXKBKeyRowFunc  func,
+                                         gpointer               data);
+XkbDescPtr              input_pad_gdk_xkb_key_list_get_desc
+                                        (InputPadXKBKeyList    *xkb_key_list);
+gboolean                input_pad_gdk_xkb_lookup_keysym
+                                        (InputPadXKBKeyList    *xkb_key_list,
+                                         guint                  keysym,
+                                         int                    group,
+                                         guint                 *keycodep,
+                                         guint                 *modsp);
 char **                 input_pad_gdk_xkb_get_group_layouts
                                         (InputPadGtkWindow     *window,
                                          InputPadXKBKeyList    *xkb_key_list);
@@ -45,6 +72,28 @@ char **                 input_pad_gdk_xkb_get_group_options
 InputPadXKBConfigReg *  input_pad_gdk_xkb_parse_config_registry
                                         (InputPadGtkWindow     *window,
                                          InputPadXKBKeyList    *xkb_key_list);
+InputPadXKBConfigReg *  input_pad_gdk_xkb_parse_group_config_registry
+                                        (InputPadGtkWindow     *window,
+                                         InputPadXKBKeyList    *xkb_key_list,
+                                         gchar                **group_layouts,
+                                         gchar                **group_variants);
+void                    input_pad_gdk_xkb_destroy_config_registry
+                                        (InputPadXKBConfigReg  *config_reg);
+InputPadXKBLayoutList * input_pad_gdk_xkb_config_reg_lookup_layout
+                                        (InputPadXKBConfigReg  *config_reg,
+                                         const char            *layout);
+InputPadXKBVariantList *
+                        input_pad_gdk_xkb_config_reg_lookup_variant
+                                        (InputPadXKBConfigReg  *config_reg,
+                                         const char            *layout,
+                                         const char            *variant);
+InputPadXKBOptionGroupList *
+                        input_pad_gdk_xkb_config_reg_lookup_option_group
+                                        (InputPadXKBConfigReg  *config_reg,
+                                         const char            *option_group);
+InputPadXKBOptionList * input_pad_gdk_xkb_config_reg_lookup_option
+                                        (InputPadXKBConfigReg  *config_reg,
+                                         const char            *option);
 Bool                    input_pad_gdk_xkb_set_layout
                                         (InputPadGtkWindow     *window,
                                          InputPadXKBKeyList    *xkb_key_list,
@@ -95,6 +95,15 @@ G_MODULE_EXPORT
 const gchar *       input_pad_module_get_description (void);
 G_MODULE_EXPORT
 InputPadWindowType  input_pad_module_get_type (void);
+/* Optional. The entries are saved in the manifest of the modules so
+ * that the module is opened only when one of the options is given. */
+G_MODULE_EXPORT
+const GOptionEntry *
+                    input_pad_module_get_option_entries
+                                        (const gchar            **name,
+                                         const gchar            **description,
+                                         const gchar            **help_description,
+                                         const gchar            **domain);
 G_MODULE_EXPORT
 gboolean            input_pad_module_arg_init
                                         (int                     *argc,
@@ -23,9 +23,25 @@
 #include <config.h>
 #endif
 
-#include "input-pad.h"
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <signal.h>
 #include <stdlib.h> /* exit */
 
+#include "input-pad.h"
+
+/*
+ * The signals are dispatched on the main loop and the "Quit" action
+ * destroys the window so the modules restore the keyboard, e.g.
+ * the spare keys of the XTest module.
+ */
+static gboolean
+on_exit_signal (gpointer data)
+{
+    g_action_group_activate_action (G_ACTION_GROUP (data), "Quit", NULL);
+    return TRUE;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -40,6 +56,9 @@ main (int argc, char *argv[])
     }
 
     data = input_pad_window_new ();
+    g_unix_signal_add (SIGINT, on_exit_signal, data);
+    g_unix_signal_add (SIGTERM, on_exit_signal, data);
+    g_unix_signal_add (SIGHUP, on_exit_signal, data);
 
     return input_pad_window_main (data);
 }
@@ -26,9 +26,25 @@ struct _InputPadGroupPrivate {
     void                *signal_window;
 };
 
+typedef enum {
+    INPUT_PAD_TABLE_CMD_CACHE_NEVER = 0,
+    INPUT_PAD_TABLE_CMD_CACHE_TTL,
+    INPUT_PAD_TABLE_CMD_CACHE_SESSION
+} InputPadTableCmdCacheType;
+
+typedef struct _InputPadTableCmdCache InputPadTableCmdCache;
+
+/* <cache> in <command>: "never", the seconds of TTL or "session" */
+struct _InputPadTableCmdCache {
+    InputPadTableCmdCacheType type;
+    guint               ttl;
+};
+
 struct _InputPadTablePrivate {
     guint               inited : 1;
     void               *signal_window;
+    /* The cache policies in parallel with data.cmds */
+    InputPadTableCmdCache *cmd_caches;
 };
 
 #endif
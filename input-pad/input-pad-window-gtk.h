@@ -77,8 +77,9 @@ struct _InputPadGtkWindowClass {
 
     void     (* reorder_button_pressed) (InputPadGtkWindow      *window);
 
+    void     (* keymap_changed)        (InputPadGtkWindow      *window);
+
     /* Padding for future expansion */
-    void (*_window_reserved1) (void);
     void (*_window_reserved2) (void);
     void (*_window_reserved3) (void);
     void (*_window_reserved4) (void);
@@ -116,6 +117,22 @@ void                input_pad_gtk_window_set_char_button_sensitive
                                         gboolean                sensitive);
 void                input_pad_gtk_window_reorder_button_pressed
                                        (InputPadGtkWindow      *window);
+void                input_pad_gtk_window_set_paste_threshold
+                                       (InputPadGtkWindow      *window,
+                                        int                     threshold);
+int                 input_pad_gtk_window_get_paste_threshold
+                                       (InputPadGtkWindow      *window);
+void                input_pad_gtk_window_set_layout_keys
+                                       (InputPadGtkWindow      *window,
+                                        gboolean                layout_keys);
+gboolean            input_pad_gtk_window_get_layout_keys
+                                       (InputPadGtkWindow      *window);
+gboolean            input_pad_gtk_window_lookup_keysym
+                                       (InputPadGtkWindow      *window,
+                                        guint                   keysym,
+                                        int                     group,
+                                        guint                  *keycodep,
+                                        guint                  *modsp);
 guint               input_pad_gtk_window_get_keyboard_state
                                        (InputPadGtkWindow      *window);
 void                input_pad_gtk_window_set_keyboard_state
@@ -142,6 +159,9 @@ void                input_pad_gtk_window_set_show_table
 void                input_pad_gtk_window_set_show_layout
                                        (InputPadGtkWindow      *window,
                                         InputPadWindowShowLayoutType type);
+void                input_pad_gtk_window_get_stats
+                                       (InputPadGtkWindow      *window,
+                                        InputPadWindowStats    *stats);
 
 G_END_DECLS
 
@@ -38,6 +38,7 @@ typedef enum
 {
     INPUT_PAD_WINDOW_SHOW_LAYOUT_TYPE_NOTHING = 0,
     INPUT_PAD_WINDOW_SHOW_LAYOUT_TYPE_DEFAULT,
+    INPUT_PAD_WINDOW_SHOW_LAYOUT_TYPE_GEOMETRY,
 } InputPadWindowShowLayoutType;
 
 typedef struct _InputPadWindowKbduiName InputPadWindowKbduiName;
@@ -48,6 +49,39 @@ struct _InputPadWindowKbduiName {
     InputPadWindowType  type;
 };
 
+#define INPUT_PAD_WINDOW_STATS_N_LATENCY_BUCKETS 24
+
+typedef struct _InputPadWindowStats InputPadWindowStats;
+
+/**
+ * InputPadWindowStats:
+ * @n_widgets: The number of the live widgets in the window
+ * @n_buttons: The number of the live char and key buttons
+ * @pixbuf_bytes: The bytes of the pixbufs shown in the window
+ * @pad_bytes: The bytes of the parsed pad files
+ * @n_signal_handlers: The number of the signal handlers which are
+ * connected between the window and its widgets
+ * @n_events_injected: The number of the key events sent to the other
+ * windows
+ * @n_x_requests: The number of the X requests of the display
+ * @n_commands_spawned: The number of the commands run for COMMANDS tables
+ * @n_presses: The number of the committed presses
+ * @press_latency_buckets: The histogram of the time from a press to
+ * its commit. The bucket i counts the presses in [2^i, 2^(i+1)) usec.
+ */
+struct _InputPadWindowStats {
+    unsigned int        n_widgets;
+    unsigned int        n_buttons;
+    unsigned long       pixbuf_bytes;
+    unsigned long       pad_bytes;
+    unsigned int        n_signal_handlers;
+    unsigned long       n_events_injected;
+    unsigned long       n_x_requests;
+    unsigned long       n_commands_spawned;
+    unsigned long       n_presses;
+    unsigned long       press_latency_buckets[INPUT_PAD_WINDOW_STATS_N_LATENCY_BUCKETS];
+};
+
 const char *        input_pad_get_version (void);
 
 /**
@@ -80,6 +114,9 @@ void                input_pad_window_set_char_button_sensitive
                                          unsigned int   sensitive);
 void                input_pad_window_reorder_button_pressed
                                         (void          *window_data);
+void                input_pad_window_set_paste_threshold
+                                        (void          *window_data,
+                                         int            threshold);
 InputPadWindowKbduiName *
                     input_pad_window_get_kbdui_name_list (void);
 int                 input_pad_window_get_kbdui_name_list_length (void);
@@ -99,6 +136,9 @@ void                input_pad_window_set_show_layout
                                         (void           *window_data,
                                          InputPadWindowShowLayoutType type);
 void *              input_pad_window_get_window (void *window_data);
+void                input_pad_window_get_stats
+                                        (void           *window_data,
+                                         InputPadWindowStats *stats);
 void                input_pad_window_activate (void *window_data);
 int                 input_pad_window_main (void *window_data);
 void                input_pad_window_destroy (void *window_data);
@@ -0,0 +1,843 @@
+/* vim:set et sts=4: */
+/* input-pad - The input pad
+ * Copyright (C) 2026 Takao Fujiwara <takao.fujiwara1@gmail.com>
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XKBgeom.h>
+
+#include <string.h> /* strncpy */
+
+#include "i18n.h"
+#include "input-pad-marshal.h"
+#include "keyboard-gtk.h"
+
+/* XKB geometry unit is 1/10 mm. */
+#define KEYBOARD_NATURAL_SCALE  0.12
+#define KEYBOARD_MIN_SCALE      0.06
+#define KEYBOARD_DEFAULT_TEXT_HEIGHT 40.
+
+enum {
+    KEY_PRESSED,
+    LAST_SIGNAL,
+};
+
+typedef struct _KeyboardKey KeyboardKey;
+typedef struct _KeyboardDoodad KeyboardDoodad;
+
+/* The paths and bounds are saved in the keyboard coordinate
+ * so that they do not need to be rebuilt when the widget is resized. */
+struct _KeyboardKey {
+    gchar                       name[XkbKeyNameLength + 1];
+    guint                       keycode;
+    guint                     **keysyms;
+    guint                       keysym;
+    int                         group;
+    guint                       keypad : 1;
+    cairo_path_t               *path;
+    cairo_path_t               *top_path;
+    double                      x1, y1, x2, y2;
+    gchar                      *label;
+    PangoLayout                *layout;
+};
+
+struct _KeyboardDoodad {
+    cairo_path_t               *path;
+    guint                       solid : 1;
+    gchar                      *text;
+    double                      x, y;
+    double                      text_height;
+};
+
+struct _InputPadGtkKeyboardPrivate
+{
+    GPtrArray                  *keys;
+    GPtrArray                  *doodads;
+    double                      width_mm;
+    double                      height_mm;
+    double                      scale;
+    double                      offset_x;
+    double                      offset_y;
+    KeyboardKey                *pressed_key;
+    /* 1x1 surface to build the paths and hit test */
+    cairo_surface_t            *hit_surface;
+    cairo_t                    *hit_cr;
+    InputPadGtkKeyboardLabelFunc
+                                label_func;
+};
+
+static guint                    signals[LAST_SIGNAL] = { 0 };
+
+G_DEFINE_TYPE_WITH_CODE (InputPadGtkKeyboard, input_pad_gtk_keyboard,
+                         GTK_TYPE_DRAWING_AREA,
+                         G_ADD_PRIVATE (InputPadGtkKeyboard))
+
+static void
+keyboard_key_free (gpointer data)
+{
+    KeyboardKey *key = (KeyboardKey *) data;
+
+    if (key->path) {
+        cairo_path_destroy (key->path);
+    }
+    if (key->top_path) {
+        cairo_path_destroy (key->top_path);
+    }
+    if (key->layout) {
+        g_object_unref (key->layout);
+    }
+    g_free (key->label);
+    g_slice_free (KeyboardKey, key);
+}
+
+static void
+keyboard_doodad_free (gpointer data)
+{
+    KeyboardDoodad *doodad = (KeyboardDoodad *) data;
+
+    if (doodad->path) {
+        cairo_path_destroy (doodad->path);
+    }
+    g_free (doodad->text);
+    g_slice_free (KeyboardDoodad, doodad);
+}
+
+static void
+append_rounded_rectangle (cairo_t *cr,
+                          double   x,
+                          double   y,
+                          double   width,
+                          double   height,
+                          double   radius)
+{
+    if (radius <= 0.) {
+        cairo_rectangle (cr, x, y, width, height);
+        return;
+    }
+    radius = MIN (radius, MIN (width, height) / 2.);
+    cairo_new_sub_path (cr);
+    cairo_arc (cr, x + width - radius, y + radius, radius,
+               -G_PI / 2., 0.);
+    cairo_arc (cr, x + width - radius, y + height - radius, radius,
+               0., G_PI / 2.);
+    cairo_arc (cr, x + radius, y + height - radius, radius,
+               G_PI / 2., G_PI);
+    cairo_arc (cr, x + radius, y + radius, radius,
+               G_PI, G_PI * 3. / 2.);
+    cairo_close_path (cr);
+}
+
+/*
+ * Returns the path of the outline in the identity coordinate of cr
+ * while the outline is transformed with the current matrix.
+ */
+static cairo_path_t *
+outline_path_new (cairo_t *cr, XkbOutlinePtr outline)
+{
+    XkbPointPtr points;
+    cairo_matrix_t matrix;
+    cairo_path_t *path;
+    int i;
+
+    if (outline == NULL || outline->num_points < 1) {
+        return NULL;
+    }
+
+    points = outline->points;
+    cairo_new_path (cr);
+    if (outline->num_points == 1) {
+        append_rounded_rectangle (cr, 0., 0.,
+                                  points[0].x, points[0].y,
+                                  outline->corner_radius);
+    } else if (outline->num_points == 2) {
+        append_rounded_rectangle (cr, points[0].x, points[0].y,
+                                  points[1].x - points[0].x,
+                                  points[1].y - points[0].y,
+                                  outline->corner_radius);
+    } else {
+        cairo_move_to (cr, points[0].x, points[0].y);
+        for (i = 1; i < outline->num_points; i++) {
+            cairo_line_to (cr, points[i].x, points[i].y);
+        }
+        cairo_close_path (cr);
+    }
+
+    cairo_get_matrix (cr, &matrix);
+    cairo_identity_matrix (cr);
+    path = cairo_copy_path (cr);
+    cairo_set_matrix (cr, &matrix);
+    cairo_new_path (cr);
+    return path;
+}
+
+static void
+keyboard_add_doodad (InputPadGtkKeyboard   *keyboard,
+                     cairo_t               *cr,
+                     XkbGeometryPtr         geom,
+                     XkbDoodadPtr           doodad)
+{
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+    KeyboardDoodad *item;
+    XkbShapePtr shape = NULL;
+    double x = 0.;
+    double y = 0.;
+
+    cairo_save (cr);
+    cairo_translate (cr, doodad->any.left, doodad->any.top);
+    if (doodad->any.angle != 0) {
+        cairo_rotate (cr, doodad->any.angle * G_PI / 1800.);
+    }
+
+    item = g_slice_new0 (KeyboardDoodad);
+    switch (doodad->any.type) {
+    case XkbOutlineDoodad:
+    case XkbSolidDoodad:
+        shape = XkbShapeDoodadShape (geom, &doodad->shape);
+        item->solid = (doodad->any.type == XkbSolidDoodad);
+        break;
+    case XkbIndicatorDoodad:
+        shape = XkbIndicatorDoodadShape (geom, &doodad->indicator);
+        break;
+    case XkbLogoDoodad:
+        shape = XkbLogoDoodadShape (geom, &doodad->logo);
+        break;
+    case XkbTextDoodad:
+        if (doodad->text.text == NULL) {
+            break;
+        }
+        item->text = g_strdup (doodad->text.text);
+        cairo_user_to_device (cr, &x, &y);
+        item->x = x;
+        item->y = y;
+        item->text_height = doodad->text.height > 0 ?
+            doodad->text.height : KEYBOARD_DEFAULT_TEXT_HEIGHT;
+        break;
+    default:;
+    }
+    if (shape != NULL && shape->num_outlines > 0) {
+        item->path = outline_path_new (cr, &shape->outlines[0]);
+    }
+    cairo_restore (cr);
+
+    if (item->path == NULL && item->text == NULL) {
+        keyboard_doodad_free (item);
+        return;
+    }
+    g_ptr_array_add (priv->doodads, item);
+}
+
+static void
+keyboard_add_key (InputPadGtkKeyboard  *keyboard,
+                  cairo_t              *cr,
+                  XkbDescPtr            xkb,
+                  XkbKeyPtr             xkb_key,
+                  XkbShapePtr           shape,
+                  GHashTable           *key_rows)
+{
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+    InputPadXKBKeyRow *key_row;
+    KeyboardKey *key;
+    char *formatted;
+
+    if (shape->num_outlines < 1) {
+        return;
+    }
+
+    key = g_slice_new0 (KeyboardKey);
+    strncpy (key->name, xkb_key->name.name, XkbKeyNameLength);
+    key->name[XkbKeyNameLength] = '\0';
+    key->keycode = XkbFindKeycodeByName (xkb, xkb_key->name.name, True);
+    key->keypad = g_str_has_prefix (key->name, "KP");
+    formatted = XkbKeyNameText (xkb_key->name.name, XkbMessage);
+    if (formatted && strlen (formatted) > 2) {
+        gchar *name = g_strndup (formatted + 1, strlen (formatted) - 2);
+        key_row = g_hash_table_lookup (key_rows, name);
+        g_free (name);
+    } else {
+        key_row = g_hash_table_lookup (key_rows, key->name);
+    }
+    if (key_row != NULL) {
+        key->keysyms = key_row->keysym;
+    }
+
+    key->path = outline_path_new (cr, &shape->outlines[0]);
+    /* The key without any points is neither drawn nor hit and
+     * cairo_append_path() does not accept NULL. */
+    if (key->path == NULL) {
+        keyboard_key_free (key);
+        return;
+    }
+    if (shape->num_outlines > 1) {
+        key->top_path = outline_path_new (cr, &shape->outlines[1]);
+    }
+
+    cairo_new_path (cr);
+    cairo_save (cr);
+    cairo_identity_matrix (cr);
+    cairo_append_path (cr, key->path);
+    cairo_path_extents (cr, &key->x1, &key->y1, &key->x2, &key->y2);
+    cairo_restore (cr);
+    cairo_new_path (cr);
+
+    g_ptr_array_add (priv->keys, key);
+}
+
+static void
+keyboard_add_section (InputPadGtkKeyboard  *keyboard,
+                      cairo_t              *cr,
+                      XkbDescPtr            xkb,
+                      XkbSectionPtr         section,
+                      GHashTable           *key_rows)
+{
+    XkbGeometryPtr geom = xkb->geom;
+    XkbRowPtr row;
+    XkbKeyPtr xkb_key;
+    XkbShapePtr shape;
+    int i, j;
+    double x, y;
+
+    cairo_save (cr);
+    cairo_translate (cr, section->left, section->top);
+    if (section->angle != 0) {
+        cairo_rotate (cr, section->angle * G_PI / 1800.);
+    }
+
+    row = section->rows;
+    for (i = 0; i < section->num_rows; i++, row++) {
+        x = row->left;
+        y = row->top;
+        xkb_key = row->keys;
+        for (j = 0; j < row->num_keys; j++, xkb_key++) {
+            shape = XkbKeyShape (geom, xkb_key);
+            if (row->vertical) {
+                y += xkb_key->gap;
+            } else {
+                x += xkb_key->gap;
+            }
+            cairo_save (cr);
+            cairo_translate (cr, x, y);
+            keyboard_add_key (keyboard, cr, xkb, xkb_key, shape, key_rows);
+            cairo_restore (cr);
+            if (row->vertical) {
+                y += shape->bounds.y2;
+            } else {
+                x += shape->bounds.x2;
+            }
+        }
+    }
+    for (i = 0; i < section->num_doodads; i++) {
+        keyboard_add_doodad (keyboard, cr, geom, &section->doodads[i]);
+    }
+    cairo_restore (cr);
+}
+
+static void
+keyboard_clear (InputPadGtkKeyboard *keyboard)
+{
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+
+    priv->pressed_key = NULL;
+    if (priv->keys) {
+        g_ptr_array_free (priv->keys, TRUE);
+        priv->keys = NULL;
+    }
+    if (priv->doodads) {
+        g_ptr_array_free (priv->doodads, TRUE);
+        priv->doodads = NULL;
+    }
+}
+
+static void
+keyboard_update_scale (InputPadGtkKeyboard *keyboard)
+{
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+    GtkWidget *widget = GTK_WIDGET (keyboard);
+    double width = gtk_widget_get_allocated_width (widget);
+    double height = gtk_widget_get_allocated_height (widget);
+
+    if (priv->width_mm <= 0. || priv->height_mm <= 0.) {
+        priv->scale = KEYBOARD_NATURAL_SCALE;
+        priv->offset_x = priv->offset_y = 0.;
+        return;
+    }
+    priv->scale = MIN (width / priv->width_mm, height / priv->height_mm);
+    priv->offset_x = (width - priv->width_mm * priv->scale) / 2.;
+    priv->offset_y = (height - priv->height_mm * priv->scale) / 2.;
+}
+
+static KeyboardKey *
+keyboard_find_key (InputPadGtkKeyboard *keyboard, double wx, double wy)
+{
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+    KeyboardKey *key;
+    double x, y;
+    guint i;
+
+    if (priv->keys == NULL || priv->scale <= 0.) {
+        return NULL;
+    }
+
+    x = (wx - priv->offset_x) / priv->scale;
+    y = (wy - priv->offset_y) / priv->scale;
+    /* The keys drawn later are on top. */
+    for (i = priv->keys->len; i > 0; i--) {
+        key = g_ptr_array_index (priv->keys, i - 1);
+        if (x < key->x1 || x > key->x2 || y < key->y1 || y > key->y2) {
+            continue;
+        }
+        cairo_new_path (priv->hit_cr);
+        cairo_append_path (priv->hit_cr, key->path);
+        if (cairo_in_fill (priv->hit_cr, x, y)) {
+            cairo_new_path (priv->hit_cr);
+            return key;
+        }
+    }
+    cairo_new_path (priv->hit_cr);
+    return NULL;
+}
+
+static void
+keyboard_queue_draw_key (InputPadGtkKeyboard *keyboard, KeyboardKey *key)
+{
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+    double scale = priv->scale;
+
+    gtk_widget_queue_draw_area (GTK_WIDGET (keyboard),
+                                (int) (priv->offset_x + key->x1 * scale) - 1,
+                                (int) (priv->offset_y + key->y1 * scale) - 1,
+                                (int) ((key->x2 - key->x1) * scale) + 3,
+                                (int) ((key->y2 - key->y1) * scale) + 3);
+}
+
+static gboolean
+keyboard_key_set_level (InputPadGtkKeyboard    *keyboard,
+                        KeyboardKey            *key,
+                        int                     group,
+                        int                     level)
+{
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+    guint new_keysym;
+    gchar *tooltip = NULL;
+    int i;
+
+    if (key->keysyms == NULL) {
+        return FALSE;
+    }
+    for (i = 0; key->keysyms[i]; i++);
+    if (group >= i) {
+        group = 0;
+    }
+    if (key->keysyms[group] == NULL) {
+        return FALSE;
+    }
+    for (i = 0; key->keysyms[group][i]; i++);
+    if (i == 0) {
+        return FALSE;
+    }
+    if (level >= i) {
+        level = 0;
+    }
+    new_keysym = key->keysyms[group][level];
+    if (key->label != NULL && key->keysym == new_keysym) {
+        return FALSE;
+    }
+
+    key->keysym = new_keysym;
+    key->group = group;
+    g_free (key->label);
+    key->label = NULL;
+    if (key->layout) {
+        g_object_unref (key->layout);
+        key->layout = NULL;
+    }
+    if (priv->label_func) {
+        key->label = priv->label_func (new_keysym, GTK_WIDGET (keyboard),
+                                       &tooltip);
+    }
+    return TRUE;
+}
+
+static gboolean
+input_pad_gtk_keyboard_draw (GtkWidget *widget, cairo_t *cr)
+{
+    InputPadGtkKeyboard *keyboard = INPUT_PAD_GTK_KEYBOARD (widget);
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+    GtkStyleContext *style_context;
+    KeyboardKey *key;
+    KeyboardDoodad *doodad;
+    PangoLayout *layout;
+    int lwidth, lheight;
+    guint i;
+
+    style_context = gtk_widget_get_style_context (widget);
+    gtk_render_background (style_context, cr, 0, 0,
+                           gtk_widget_get_allocated_width (widget),
+                           gtk_widget_get_allocated_height (widget));
+    if (priv->keys == NULL) {
+        return FALSE;
+    }
+
+    keyboard_update_scale (keyboard);
+
+    cairo_save (cr);
+    cairo_translate (cr, priv->offset_x, priv->offset_y);
+    cairo_scale (cr, priv->scale, priv->scale);
+    cairo_set_line_width (cr, 1. / priv->scale);
+
+    for (i = 0; i < priv->doodads->len; i++) {
+        doodad = g_ptr_array_index (priv->doodads, i);
+        if (doodad->path == NULL) {
+            continue;
+        }
+        cairo_new_path (cr);
+        cairo_append_path (cr, doodad->path);
+        cairo_set_source_rgba (cr, 0.5, 0.5, 0.5, 1.);
+        if (doodad->solid) {
+            cairo_fill (cr);
+        } else {
+            cairo_stroke (cr);
+        }
+    }
+
+    for (i = 0; i < priv->keys->len; i++) {
+        key = g_ptr_array_index (priv->keys, i);
+        cairo_new_path (cr);
+        cairo_append_path (cr, key->path);
+        if (key == priv->pressed_key) {
+            cairo_set_source_rgba (cr, 0.6, 0.6, 0.6, 1.);
+        } else {
+            cairo_set_source_rgba (cr, 0.85, 0.85, 0.85, 1.);
+        }
+        cairo_fill_preserve (cr);
+        cairo_set_source_rgba (cr, 0.3, 0.3, 0.3, 1.);
+        cairo_stroke (cr);
+        if (key->top_path && key != priv->pressed_key) {
+            cairo_new_path (cr);
+            cairo_append_path (cr, key->top_path);
+            cairo_set_source_rgba (cr, 0.95, 0.95, 0.95, 1.);
+            cairo_fill (cr);
+        }
+    }
+    cairo_restore (cr);
+
+    /* The labels are drawn with the widget font without scaling. */
+    cairo_set_source_rgba (cr, 0., 0., 0., 1.);
+    for (i = 0; i < priv->keys->len; i++) {
+        key = g_ptr_array_index (priv->keys, i);
+        if (key->label == NULL) {
+            continue;
+        }
+        if (key->layout == NULL) {
+            key->layout = gtk_widget_create_pango_layout (widget, key->label);
+        }
+        pango_layout_get_pixel_size (key->layout, &lwidth, &lheight);
+        cairo_move_to (cr,
+                       priv->offset_x + (key->x1 + key->x2) / 2. * priv->scale
+                       - lwidth / 2.,
+                       priv->offset_y + (key->y1 + key->y2) / 2. * priv->scale
+                       - lheight / 2.);
+        pango_cairo_show_layout (cr, key->layout);
+    }
+    for (i = 0; i < priv->doodads->len; i++) {
+        doodad = g_ptr_array_index (priv->doodads, i);
+        if (doodad->text == NULL) {
+            continue;
+        }
+        layout = gtk_widget_create_pango_layout (widget, doodad->text);
+        cairo_move_to (cr,
+                       priv->offset_x + doodad->x * priv->scale,
+                       priv->offset_y + doodad->y * priv->scale);
+        pango_cairo_show_layout (cr, layout);
+        g_object_unref (layout);
+    }
+    return FALSE;
+}
+
+static void
+input_pad_gtk_keyboard_get_preferred_width (GtkWidget *widget,
+                                            gint      *minimum,
+                                            gint      *natural)
+{
+    InputPadGtkKeyboardPrivate *priv = INPUT_PAD_GTK_KEYBOARD (widget)->priv;
+
+    *minimum = (gint) (priv->width_mm * KEYBOARD_MIN_SCALE);
+    *natural = (gint) (priv->width_mm * KEYBOARD_NATURAL_SCALE);
+}
+
+static void
+input_pad_gtk_keyboard_get_preferred_height (GtkWidget *widget,
+                                             gint      *minimum,
+                                             gint      *natural)
+{
+    InputPadGtkKeyboardPrivate *priv = INPUT_PAD_GTK_KEYBOARD (widget)->priv;
+
+    *minimum = (gint) (priv->height_mm * KEYBOARD_MIN_SCALE);
+    *natural = (gint) (priv->height_mm * KEYBOARD_NATURAL_SCALE);
+}
+
+static gboolean
+input_pad_gtk_keyboard_button_press (GtkWidget      *widget,
+                                     GdkEventButton *event)
+{
+    InputPadGtkKeyboard *keyboard = INPUT_PAD_GTK_KEYBOARD (widget);
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+    KeyboardKey *key;
+    guint base_keysym = 0;
+
+    if (event->button != 1 || event->type != GDK_BUTTON_PRESS) {
+        return FALSE;
+    }
+    if ((key = keyboard_find_key (keyboard, event->x, event->y)) == NULL) {
+        return FALSE;
+    }
+    if (priv->pressed_key) {
+        keyboard_queue_draw_key (keyboard, priv->pressed_key);
+    }
+    priv->pressed_key = key;
+    keyboard_queue_draw_key (keyboard, key);
+
+    if (key->keysyms == NULL || key->keysym == 0) {
+        return TRUE;
+    }
+    if (key->keysyms[key->group]) {
+        base_keysym = key->keysyms[key->group][0];
+    }
+    g_signal_emit (keyboard, signals[KEY_PRESSED], 0,
+                   key->label, key->keysym, key->keycode, base_keysym);
+    return TRUE;
+}
+
+static gboolean
+input_pad_gtk_keyboard_button_release (GtkWidget      *widget,
+                                       GdkEventButton *event)
+{
+    InputPadGtkKeyboard *keyboard = INPUT_PAD_GTK_KEYBOARD (widget);
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+
+    if (priv->pressed_key == NULL) {
+        return FALSE;
+    }
+    keyboard_queue_draw_key (keyboard, priv->pressed_key);
+    priv->pressed_key = NULL;
+    return TRUE;
+}
+
+static gboolean
+input_pad_gtk_keyboard_query_tooltip (GtkWidget  *widget,
+                                      gint        x,
+                                      gint        y,
+                                      gboolean    keyboard_mode,
+                                      GtkTooltip *tooltip)
+{
+    InputPadGtkKeyboard *keyboard = INPUT_PAD_GTK_KEYBOARD (widget);
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+    KeyboardKey *key;
+    gchar *text = NULL;
+    gchar *label;
+
+    if (keyboard_mode || priv->label_func == NULL) {
+        return FALSE;
+    }
+    if ((key = keyboard_find_key (keyboard, x, y)) == NULL ||
+        key->keysym == 0) {
+        return FALSE;
+    }
+    label = priv->label_func (key->keysym, widget, &text);
+    g_free (label);
+    if (text == NULL || *text == '\0') {
+        return FALSE;
+    }
+    gtk_tooltip_set_text (tooltip, text);
+    return TRUE;
+}
+
+static void
+input_pad_gtk_keyboard_destroy (GtkWidget *widget)
+{
+    InputPadGtkKeyboard *keyboard = INPUT_PAD_GTK_KEYBOARD (widget);
+    InputPadGtkKeyboardPrivate *priv = keyboard->priv;
+
+    if (priv) {
+        keyboard_clear (keyboard);
+        if (priv->hit_cr) {
+            cairo_destroy (priv->hit_cr);
+            priv->hit_cr = NULL;
+        }
+        if (priv->hit_surface) {
+            cairo_surface_destroy (priv->hit_surface);
+            priv->hit_surface = NULL;
+        }
+    }
+    GTK_WIDGET_CLASS (input_pad_gtk_keyboard_parent_class)->destroy (widget);
+}
+
+static void
+input_pad_gtk_keyboard_init (InputPadGtkKeyboard *keyboard)
+{
+    InputPadGtkKeyboardPrivate *priv;
+
+    priv = input_pad_gtk_keyboard_get_instance_private (keyboard);
+    priv->scale = KEYBOARD_NATURAL_SCALE;
+    priv->hit_surface = cairo_image_surface_create (CAIRO_FORMAT_A8, 1, 1);
+    priv->hit_cr = cairo_create (priv->hit_surface);
+    keyboard->priv = priv;
+
+    gtk_widget_add_events (GTK_WIDGET (keyboard),
+                           GDK_BUTTON_PRESS_MASK |
+                           GDK_BUTTON_RELEASE_MASK);
+    gtk_widget_set_has_tooltip (GTK_WIDGET (keyboard), TRUE);
+}
+
+static void
+input_pad_gtk_keyboard_class_init (InputPadGtkKeyboardClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+    GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+    widget_class->destroy = input_pad_gtk_keyboard_destroy;
+    widget_class->draw = input_pad_gtk_keyboard_draw;
+    widget_class->get_preferred_width =
+        input_pad_gtk_keyboard_get_preferred_width;
+    widget_class->get_preferred_height =
+        input_pad_gtk_keyboard_get_preferred_height;
+    widget_class->button_press_event = input_pad_gtk_keyboard_button_press;
+    widget_class->button_release_event = input_pad_gtk_keyboard_button_release;
+    widget_class->query_tooltip = input_pad_gtk_keyboard_query_tooltip;
+
+    signals[KEY_PRESSED] =
+        g_signal_new (I_("key-pressed"),
+                      G_TYPE_FROM_CLASS (gobject_class),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (InputPadGtkKeyboardClass, key_pressed),
+                      NULL, NULL,
+                      INPUT_PAD_VOID__STRING_UINT_UINT_UINT,
+                      G_TYPE_NONE,
+                      4, G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                      G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT);
+}
+
+GtkWidget *
+input_pad_gtk_keyboard_new (void)
+{
+    return GTK_WIDGET (g_object_new (INPUT_PAD_TYPE_GTK_KEYBOARD, NULL));
+}
+
+gboolean
+input_pad_gtk_keyboard_set_geometry (InputPadGtkKeyboard *keyboard,
+                                     XkbDescPtr           xkb,
+                                     InputPadXKBKeyList  *xkb_key_list)
+{
+    InputPadGtkKeyboardPrivate *priv;
+    InputPadXKBKeyList *list;
+    InputPadXKBKeyRow *row;
+    XkbGeometryPtr geom;
+    XkbDrawablePtr draw, draw_head;
+    GHashTable *key_rows;
+    cairo_t *cr;
+
+    g_return_val_if_fail (keyboard != NULL &&
+                          INPUT_PAD_IS_GTK_KEYBOARD (keyboard), FALSE);
+
+    priv = keyboard->priv;
+    keyboard_clear (keyboard);
+    if (xkb == NULL || (geom = xkb->geom) == NULL) {
+        priv->width_mm = priv->height_mm = 0.;
+        gtk_widget_queue_resize (GTK_WIDGET (keyboard));
+        return FALSE;
+    }
+
+    key_rows = g_hash_table_new (g_str_hash, g_str_equal);
+    for (list = xkb_key_list; list; list = list->next) {
+        for (row = list->row; row; row = row->next) {
+            if (row->name) {
+                g_hash_table_insert (key_rows, row->name, row);
+            }
+        }
+    }
+
+    priv->keys = g_ptr_array_new_with_free_func (keyboard_key_free);
+    priv->doodads = g_ptr_array_new_with_free_func (keyboard_doodad_free);
+    priv->width_mm = geom->width_mm;
+    priv->height_mm = geom->height_mm;
+
+    cr = priv->hit_cr;
+    cairo_save (cr);
+    cairo_identity_matrix (cr);
+    draw_head = XkbGetOrderedDrawables (geom, NULL);
+    for (draw = draw_head; draw; draw = draw->next) {
+        if (draw->type == XkbDW_Section) {
+            keyboard_add_section (keyboard, cr, xkb, draw->u.section,
+                                  key_rows);
+        } else if (draw->type == XkbDW_Doodad) {
+            keyboard_add_doodad (keyboard, cr, geom, draw->u.doodad);
+        }
+    }
+    XkbFreeOrderedDrawables (draw_head);
+    cairo_restore (cr);
+    cairo_new_path (cr);
+    g_hash_table_destroy (key_rows);
+
+    gtk_widget_queue_resize (GTK_WIDGET (keyboard));
+    return TRUE;
+}
+
+void
+input_pad_gtk_keyboard_set_level (InputPadGtkKeyboard *keyboard,
+                                  int                  group,
+                                  int                  level,
+                                  int                  keypad_level)
+{
+    InputPadGtkKeyboardPrivate *priv;
+    KeyboardKey *key;
+    gboolean changed = FALSE;
+    guint i;
+
+    g_return_if_fail (keyboard != NULL &&
+                      INPUT_PAD_IS_GTK_KEYBOARD (keyboard));
+
+    priv = keyboard->priv;
+    if (priv->keys == NULL) {
+        return;
+    }
+    for (i = 0; i < priv->keys->len; i++) {
+        key = g_ptr_array_index (priv->keys, i);
+        if (keyboard_key_set_level (keyboard, key, group,
+                                    key->keypad ? keypad_level : level)) {
+            changed = TRUE;
+        }
+    }
+    if (changed) {
+        gtk_widget_queue_draw (GTK_WIDGET (keyboard));
+    }
+}
+
+void
+input_pad_gtk_keyboard_set_label_func (InputPadGtkKeyboard         *keyboard,
+                                       InputPadGtkKeyboardLabelFunc func)
+{
+    g_return_if_fail (keyboard != NULL &&
+                      INPUT_PAD_IS_GTK_KEYBOARD (keyboard));
+
+    keyboard->priv->label_func = func;
+}
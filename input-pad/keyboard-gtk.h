@@ -0,0 +1,102 @@
+/* vim:set et sts=4: */
+/* input-pad - The input pad
+ * Copyright (C) 2026 Takao Fujiwara <takao.fujiwara1@gmail.com>
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __INPUT_PAD_KEYBOARD_GTK_H__
+#define __INPUT_PAD_KEYBOARD_GTK_H__
+
+#include <gtk/gtk.h>
+#include <X11/XKBlib.h>
+
+#include "geometry-xkb.h"
+
+G_BEGIN_DECLS
+
+#define INPUT_PAD_TYPE_GTK_KEYBOARD            (input_pad_gtk_keyboard_get_type ())
+#define INPUT_PAD_GTK_KEYBOARD(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), INPUT_PAD_TYPE_GTK_KEYBOARD, InputPadGtkKeyboard))
+#define INPUT_PAD_GTK_KEYBOARD_CLASS(class)    (G_TYPE_CHECK_CLASS_CAST ((class), INPUT_PAD_TYPE_GTK_KEYBOARD, InputPadGtkKeyboardClass))
+#define INPUT_PAD_IS_GTK_KEYBOARD(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), INPUT_PAD_TYPE_GTK_KEYBOARD))
+
+typedef struct _InputPadGtkKeyboard InputPadGtkKeyboard;
+typedef struct _InputPadGtkKeyboardPrivate InputPadGtkKeyboardPrivate;
+typedef struct _InputPadGtkKeyboardClass InputPadGtkKeyboardClass;
+
+/**
+ * InputPadGtkKeyboardLabelFunc:
+ * @keysym: The keysym on the key
+ * @widget: The #GtkWidget
+ * @tooltipp: (out): The tooltip which is not freed
+ *
+ * Returns: the newly allocated label on the key.
+ */
+typedef gchar * (* InputPadGtkKeyboardLabelFunc) (guint         keysym,
+                                                  GtkWidget    *widget,
+                                                  gchar       **tooltipp);
+
+struct _InputPadGtkKeyboard
+{
+    GtkDrawingArea parent;
+
+    /*< private >*/
+    InputPadGtkKeyboardPrivate         *priv;
+};
+
+/**
+ * InputPadGtkKeyboardClass:
+ * @parent_class: The parent class.
+ */
+struct _InputPadGtkKeyboardClass
+{
+    GtkDrawingAreaClass parent_class;
+
+    void     (* key_pressed)           (InputPadGtkKeyboard    *keyboard,
+                                        const gchar            *label,
+                                        guint                   keysym,
+                                        guint                   keycode,
+                                        guint                   base_keysym);
+
+    /*< private >*/
+
+    /* Padding for future expansion */
+    void (*_gtk_reserved1) (void);
+    void (*_gtk_reserved2) (void);
+    void (*_gtk_reserved3) (void);
+    void (*_gtk_reserved4) (void);
+};
+
+GType               input_pad_gtk_keyboard_get_type (void);
+GtkWidget *         input_pad_gtk_keyboard_new (void);
+gboolean            input_pad_gtk_keyboard_set_geometry
+                                       (InputPadGtkKeyboard     *keyboard,
+                                        XkbDescPtr               xkb,
+                                        InputPadXKBKeyList      *xkb_key_list);
+void                input_pad_gtk_keyboard_set_level
+                                       (InputPadGtkKeyboard     *keyboard,
+                                        int                      group,
+                                        int                      level,
+                                        int                      keypad_level);
+void                input_pad_gtk_keyboard_set_label_func
+                                       (InputPadGtkKeyboard     *keyboard,
+                                        InputPadGtkKeyboardLabelFunc
+                                                                 func);
+
+G_END_DECLS
+
+#endif
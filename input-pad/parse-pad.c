@@ -28,10 +28,12 @@
 #include <libxml/parser.h>
 #include <unistd.h> /* getuid */
 #include <pwd.h> /* getpwuid */
+#include <string.h> /* memset */
 
 #include "i18n.h"
 #include "input-pad-group.h"
 #include "input-pad-private.h"
+#include "profile-gdk.h"
 
 static const gchar *xml_file;
 static const gchar *translation_domain;
@@ -200,7 +202,38 @@ parse_string (xmlNodePtr node, InputPadTableStr *str)
 }
 
 static void
-parse_command (xmlNodePtr node, InputPadTableCmd *cmd)
+parse_command_cache (xmlNodePtr node, InputPadTableCmdCache *cache)
+{
+    char *content = NULL;
+    char *end = NULL;
+    guint64 ttl;
+
+    get_content (node, &content, FALSE);
+    g_strstrip (content);
+    if (!g_strcmp0 (content, "never")) {
+        cache->type = INPUT_PAD_TABLE_CMD_CACHE_NEVER;
+    } else if (!g_strcmp0 (content, "session")) {
+        cache->type = INPUT_PAD_TABLE_CMD_CACHE_SESSION;
+    } else {
+        ttl = g_ascii_strtoull (content, &end, 10);
+        if (end == content || *end != '\0' || ttl > G_MAXUINT) {
+            g_warning ("cache %s is not \"never\", \"session\" or seconds in the file %s",
+                       content, xml_file);
+            cache->type = INPUT_PAD_TABLE_CMD_CACHE_NEVER;
+        } else if (ttl == 0) {
+            cache->type = INPUT_PAD_TABLE_CMD_CACHE_NEVER;
+        } else {
+            cache->type = INPUT_PAD_TABLE_CMD_CACHE_TTL;
+            cache->ttl = (guint) ttl;
+        }
+    }
+    g_free (content);
+}
+
+static void
+parse_command (xmlNodePtr             node,
+               InputPadTableCmd      *cmd,
+               InputPadTableCmdCache *cache)
 {
     xmlNodePtr current;
     gboolean has_execl = FALSE;
@@ -226,6 +259,15 @@ parse_command (xmlNodePtr node, InputPadTableCmd *cmd)
                              xml_file);
                 }
             }
+            if (!g_strcmp0 ((char *) current->name, "cache")) {
+                if (current->children) {
+                    parse_command_cache (current->children, cache);
+                } else {
+                    g_error ("tag %s does not have child tags in the file %s",
+                             (char *) current->name,
+                             xml_file);
+                }
+            }
         }
     }
     if (!has_execl) {
@@ -322,7 +364,14 @@ parse_table_sub_command (xmlNodePtr node, InputPadTable **ptable)
         (*ptable)->data.cmds[len + 1].label= NULL;
         (*ptable)->data.cmds[len + 1].execl = NULL;
     }
-    parse_command (node, &(*ptable)->data.cmds[len]);
+    (*ptable)->priv->cmd_caches = g_renew (InputPadTableCmdCache,
+                                           (*ptable)->priv->cmd_caches,
+                                           len + 1);
+    memset (&(*ptable)->priv->cmd_caches[len], 0,
+            sizeof (InputPadTableCmdCache));
+    parse_command (node,
+                   &(*ptable)->data.cmds[len],
+                   &(*ptable)->priv->cmd_caches[len]);
 }
 
 static void
@@ -586,6 +635,8 @@ input_pad_group_parse_all_files (const char *custom_dirname, const char *domain)
     InputPadGroup *group = NULL;
     GSList *file_list = NULL;
     GSList *list;
+    InputPadProfileSpan *span;
+    InputPadProfileSpan *file_span;
 
     if (custom_dirname != NULL) {
         dirname = (const gchar *) custom_dirname;
@@ -637,14 +688,18 @@ input_pad_group_parse_all_files (const char *custom_dirname, const char *domain)
         return NULL;
     }
 
+    span = input_pad_profile_span_begin ("parse-pads", dirname);
     list = file_list = g_slist_sort (file_list, cmp_filepath);
     while (list) {
         filepath = (gchar *) list->data;
+        file_span = input_pad_profile_span_begin ("parse-pad-file", filepath);
         group = input_pad_group_append_from_file (group, filepath, domain);
+        input_pad_profile_span_end (file_span);
         g_free (filepath);
         list = g_slist_next (list);
     }
     g_slist_free (file_list);
+    input_pad_profile_span_end (span);
 
     return group;
 }
@@ -673,6 +728,10 @@ input_pad_group_destroy (InputPadGroup *group_data)
             } else if (table->type == INPUT_PAD_TABLE_TYPE_COMMANDS) {
                 free_command_array (table->data.cmds);
                 table->data.cmds = NULL;
+                if (table->priv) {
+                    g_free (table->priv->cmd_caches);
+                    table->priv->cmd_caches = NULL;
+                }
             } else {
                 g_warning ("Free is not defined in type %d", table->type);
             }
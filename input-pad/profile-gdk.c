@@ -0,0 +1,477 @@
+/* vim:set et sts=4: */
+/* input-pad - The input pad
+ * Copyright (C) 2026 Takao Fujiwara <takao.fujiwara1@gmail.com>
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+#include <gdk/gdkx.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <X11/Xlib.h>
+#include <sys/resource.h> /* getrusage */
+#include <stdio.h>
+#include <string.h> /* memset */
+
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+#include "input-pad.h"
+#include "profile-gdk.h"
+
+/* The values under HISTOGRAM_N_LINEAR are counted exactly and
+ * the larger values are counted with 3 significant bits. */
+#define HISTOGRAM_N_LINEAR 16
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_MAX_EXPONENT 30
+#define HISTOGRAM_N_BUCKETS \
+    (HISTOGRAM_N_LINEAR + \
+     (HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BITS) * (1 << HISTOGRAM_SUB_BITS))
+
+typedef struct _InputPadProfileSample InputPadProfileSample;
+
+struct _InputPadProfileSample {
+    gint64                      wall;
+    gint64                      cpu;
+    gint64                      heap;
+    gulong                      x_requests;
+};
+
+struct _InputPadProfileSpan {
+    gchar                      *name;
+    gchar                      *detail;
+    int                         depth;
+    gboolean                    ended;
+    InputPadProfileSample       begin;
+    InputPadProfileSample       end;
+};
+
+/* The two windows of the period are kept and the older one is
+ * cleared when the period passes. */
+struct _InputPadProfileHistogram {
+    gint64                      period;
+    gint64                      window_start;
+    int                         current;
+    guint32                     counts[2][HISTOGRAM_N_BUCKETS];
+    guint64                     n_values[2];
+    gint64                      max[2];
+};
+
+static gboolean                 profile_enabled = FALSE;
+static gchar                   *profile_filename = NULL;
+static GPtrArray               *profile_spans = NULL;
+static InputPadProfileSample    profile_start;
+static int                      profile_depth = 0;
+
+static void
+profile_span_free (gpointer data)
+{
+    InputPadProfileSpan *span = (InputPadProfileSpan *) data;
+
+    g_free (span->name);
+    g_free (span->detail);
+    g_slice_free (InputPadProfileSpan, span);
+}
+
+/* The X requests are counted with the request serial since
+ * Xlib does not count the round trips. */
+static gulong
+get_x_requests (void)
+{
+    GdkDisplay *display = gdk_display_get_default ();
+
+    if (display == NULL || !GDK_IS_X11_DISPLAY (display)) {
+        return 0;
+    }
+    return XNextRequest (GDK_DISPLAY_XDISPLAY (display)) - 1;
+}
+
+static void
+profile_sample (InputPadProfileSample *sample)
+{
+    struct rusage usage;
+
+    sample->wall = g_get_monotonic_time ();
+    sample->cpu = 0;
+    if (getrusage (RUSAGE_SELF, &usage) == 0) {
+        sample->cpu = (gint64) usage.ru_utime.tv_sec * G_USEC_PER_SEC +
+                      usage.ru_utime.tv_usec +
+                      (gint64) usage.ru_stime.tv_sec * G_USEC_PER_SEC +
+                      usage.ru_stime.tv_usec;
+    }
+#ifdef HAVE_MALLINFO2
+    sample->heap = (gint64) mallinfo2 ().uordblks;
+#else
+    sample->heap = 0;
+#endif
+    sample->x_requests = get_x_requests ();
+}
+
+static void
+append_json_string (GString *str, const gchar *text)
+{
+    const gchar *p;
+
+    if (text == NULL) {
+        g_string_append (str, "null");
+        return;
+    }
+    g_string_append_c (str, '"');
+    for (p = text; *p; p++) {
+        switch (*p) {
+        case '"':
+            g_string_append (str, "\\\"");
+            break;
+        case '\\':
+            g_string_append (str, "\\\\");
+            break;
+        case '\n':
+            g_string_append (str, "\\n");
+            break;
+        case '\t':
+            g_string_append (str, "\\t");
+            break;
+        default:
+            if ((guchar) *p < 0x20) {
+                g_string_append_printf (str, "\\u%04x", (guint) (guchar) *p);
+            } else {
+                g_string_append_c (str, *p);
+            }
+        }
+    }
+    g_string_append_c (str, '"');
+}
+
+static void
+append_json_span (GString *str, InputPadProfileSpan *span)
+{
+    g_string_append (str, "    { \"name\": ");
+    append_json_string (str, span->name);
+    g_string_append (str, ", \"detail\": ");
+    append_json_string (str, span->detail);
+    g_string_append_printf (str,
+                            ", \"depth\": %d"
+                            ", \"start_usec\": %" G_GINT64_FORMAT
+                            ", \"wall_usec\": %" G_GINT64_FORMAT
+                            ", \"cpu_usec\": %" G_GINT64_FORMAT,
+                            span->depth,
+                            span->begin.wall - profile_start.wall,
+                            span->end.wall - span->begin.wall,
+                            span->end.cpu - span->begin.cpu);
+#ifdef HAVE_MALLINFO2
+    g_string_append_printf (str, ", \"heap_bytes\": %" G_GINT64_FORMAT,
+                            span->end.heap - span->begin.heap);
+#endif
+    g_string_append_printf (str, ", \"x_requests\": %lu }",
+                            span->end.x_requests - span->begin.x_requests);
+}
+
+/**
+ * input_pad_profile_start:
+ * @filename: (allow-none): The JSON file of the report
+ *
+ * Starts to record the spans.
+ * If @filename is %NULL, the report is written to stderr unless
+ * the file name is set by the later call.
+ */
+void
+input_pad_profile_start (const gchar *filename)
+{
+    if (filename) {
+        g_free (profile_filename);
+        profile_filename = g_strdup (filename);
+    }
+    if (profile_enabled) {
+        return;
+    }
+    profile_enabled = TRUE;
+    profile_spans = g_ptr_array_new_with_free_func (profile_span_free);
+    profile_depth = 0;
+    profile_sample (&profile_start);
+}
+
+gboolean
+input_pad_profile_is_enabled (void)
+{
+    return profile_enabled;
+}
+
+/**
+ * input_pad_profile_span_begin:
+ * @name: The phase name
+ * @detail: (allow-none): The file name or the other detail of the phase
+ *
+ * Returns: the span which is passed to input_pad_profile_span_end()
+ * or %NULL if the profiler is not started.
+ */
+InputPadProfileSpan *
+input_pad_profile_span_begin (const gchar *name, const gchar *detail)
+{
+    InputPadProfileSpan *span;
+
+    if (!profile_enabled) {
+        return NULL;
+    }
+
+    span = g_slice_new0 (InputPadProfileSpan);
+    span->name = g_strdup (name);
+    span->detail = g_strdup (detail);
+    span->depth = profile_depth++;
+    g_ptr_array_add (profile_spans, span);
+    profile_sample (&span->begin);
+    return span;
+}
+
+void
+input_pad_profile_span_end (InputPadProfileSpan *span)
+{
+    /* The span is freed by input_pad_profile_write(). */
+    if (span == NULL || !profile_enabled || span->ended) {
+        return;
+    }
+    profile_sample (&span->end);
+    span->ended = TRUE;
+    if (profile_depth > 0) {
+        profile_depth--;
+    }
+}
+
+/**
+ * input_pad_profile_write:
+ *
+ * Writes the ended spans as JSON and stops the profiler.
+ */
+void
+input_pad_profile_write (void)
+{
+    InputPadProfileSample now;
+    GString *str;
+    GError *error = NULL;
+    struct rusage usage;
+    gboolean first = TRUE;
+    guint i;
+
+    if (!profile_enabled) {
+        return;
+    }
+
+    profile_sample (&now);
+    str = g_string_new ("{\n");
+    g_string_append (str, "  \"version\": ");
+    append_json_string (str, input_pad_get_version ());
+    g_string_append_printf (str, ",\n  \"total_wall_usec\": %" G_GINT64_FORMAT,
+                            now.wall - profile_start.wall);
+    g_string_append_printf (str, ",\n  \"total_cpu_usec\": %" G_GINT64_FORMAT,
+                            now.cpu);
+    if (getrusage (RUSAGE_SELF, &usage) == 0) {
+        g_string_append_printf (str, ",\n  \"max_rss_kb\": %ld",
+                                usage.ru_maxrss);
+    }
+    g_string_append_printf (str, ",\n  \"x_requests\": %lu",
+                            now.x_requests);
+    g_string_append (str, ",\n  \"spans\": [\n");
+    for (i = 0; i < profile_spans->len; i++) {
+        InputPadProfileSpan *span = g_ptr_array_index (profile_spans, i);
+
+        if (!span->ended) {
+            continue;
+        }
+        if (!first) {
+            g_string_append (str, ",\n");
+        }
+        append_json_span (str, span);
+        first = FALSE;
+    }
+    g_string_append (str, "\n  ]\n}\n");
+
+    if (profile_filename == NULL) {
+        g_printerr ("%s", str->str);
+    } else if (!g_file_set_contents (profile_filename, str->str, str->len,
+                                     &error)) {
+        g_warning ("Cannot write the profile %s: %s", profile_filename,
+                   error ? error->message : "");
+        g_clear_error (&error);
+    }
+    g_string_free (str, TRUE);
+
+    /* The spans which are not ended yet are freed too. */
+    g_ptr_array_free (profile_spans, TRUE);
+    profile_spans = NULL;
+    g_free (profile_filename);
+    profile_filename = NULL;
+    profile_enabled = FALSE;
+}
+
+static int
+histogram_get_index (gint64 usec)
+{
+    int exponent;
+
+    if (usec < HISTOGRAM_N_LINEAR) {
+        return usec < 0 ? 0 : (int) usec;
+    }
+    if (usec >= ((gint64) 1 << HISTOGRAM_MAX_EXPONENT)) {
+        return HISTOGRAM_N_BUCKETS - 1;
+    }
+    exponent = g_bit_nth_msf ((gulong) usec, -1);
+    return HISTOGRAM_N_LINEAR +
+           (exponent - HISTOGRAM_SUB_BITS - 1) * (1 << HISTOGRAM_SUB_BITS) +
+           (int) ((usec >> (exponent - HISTOGRAM_SUB_BITS)) &
+                  ((1 << HISTOGRAM_SUB_BITS) - 1));
+}
+
+/* The upper bound of the bucket */
+static gint64
+histogram_get_value (int index)
+{
+    int exponent;
+    int sub;
+
+    if (index < HISTOGRAM_N_LINEAR) {
+        return index;
+    }
+    index -= HISTOGRAM_N_LINEAR;
+    exponent = index / (1 << HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS + 1;
+    sub = index % (1 << HISTOGRAM_SUB_BITS);
+    return ((((gint64) 1 << HISTOGRAM_SUB_BITS) + sub + 1) <<
+            (exponent - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+static void
+histogram_roll (InputPadProfileHistogram *histogram)
+{
+    gint64 now = g_get_monotonic_time ();
+
+    if (now - histogram->window_start < histogram->period) {
+        return;
+    }
+    /* Both windows are old after two periods. */
+    if (now - histogram->window_start >= histogram->period * 2) {
+        memset (histogram->counts, 0, sizeof (histogram->counts));
+        histogram->n_values[0] = histogram->n_values[1] = 0;
+        histogram->max[0] = histogram->max[1] = 0;
+    } else {
+        histogram->current = !histogram->current;
+        memset (histogram->counts[histogram->current], 0,
+                sizeof (histogram->counts[0]));
+        histogram->n_values[histogram->current] = 0;
+        histogram->max[histogram->current] = 0;
+    }
+    histogram->window_start = now;
+}
+
+/**
+ * input_pad_profile_histogram_new:
+ * @period: The usec of the rolling window
+ *
+ * Returns: the histogram of the values in the last one or two @period.
+ */
+InputPadProfileHistogram *
+input_pad_profile_histogram_new (gint64 period)
+{
+    InputPadProfileHistogram *histogram;
+
+    histogram = g_slice_new0 (InputPadProfileHistogram);
+    histogram->period = period;
+    histogram->window_start = g_get_monotonic_time ();
+    return histogram;
+}
+
+void
+input_pad_profile_histogram_free (InputPadProfileHistogram *histogram)
+{
+    if (histogram == NULL) {
+        return;
+    }
+    g_slice_free (InputPadProfileHistogram, histogram);
+}
+
+void
+input_pad_profile_histogram_record (InputPadProfileHistogram *histogram,
+                                    gint64                    usec)
+{
+    int current;
+
+    g_return_if_fail (histogram != NULL);
+
+    histogram_roll (histogram);
+    current = histogram->current;
+    histogram->counts[current][histogram_get_index (usec)]++;
+    histogram->n_values[current]++;
+    if (usec > histogram->max[current]) {
+        histogram->max[current] = usec;
+    }
+}
+
+guint64
+input_pad_profile_histogram_get_count (InputPadProfileHistogram *histogram)
+{
+    g_return_val_if_fail (histogram != NULL, 0);
+
+    histogram_roll (histogram);
+    return histogram->n_values[0] + histogram->n_values[1];
+}
+
+gint64
+input_pad_profile_histogram_get_max (InputPadProfileHistogram *histogram)
+{
+    g_return_val_if_fail (histogram != NULL, 0);
+
+    histogram_roll (histogram);
+    return MAX (histogram->max[0], histogram->max[1]);
+}
+
+/**
+ * input_pad_profile_histogram_get_percentile:
+ * @histogram: The #InputPadProfileHistogram
+ * @percentile: The percentile between 0 and 100
+ *
+ * Returns: the upper bound of the bucket of the @percentile.
+ */
+gint64
+input_pad_profile_histogram_get_percentile (InputPadProfileHistogram *histogram,
+                                            gdouble                   percentile)
+{
+    guint64 n_values;
+    guint64 rank;
+    guint64 sum = 0;
+    int i;
+
+    g_return_val_if_fail (histogram != NULL, 0);
+
+    if ((n_values = input_pad_profile_histogram_get_count (histogram)) == 0) {
+        return 0;
+    }
+    rank = (guint64) (n_values * CLAMP (percentile, 0., 100.) / 100.);
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (i = 0; i < HISTOGRAM_N_BUCKETS; i++) {
+        sum += histogram->counts[0][i] + histogram->counts[1][i];
+        if (sum >= rank) {
+            return MIN (histogram_get_value (i),
+                        input_pad_profile_histogram_get_max (histogram));
+        }
+    }
+    return input_pad_profile_histogram_get_max (histogram);
+}
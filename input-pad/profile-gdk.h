@@ -0,0 +1,67 @@
+/* vim:set et sts=4: */
+/* input-pad - The input pad
+ * Copyright (C) 2026 Takao Fujiwara <takao.fujiwara1@gmail.com>
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __INPUT_PAD_PROFILE_GDK_H__
+#define __INPUT_PAD_PROFILE_GDK_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _InputPadProfileSpan InputPadProfileSpan;
+typedef struct _InputPadProfileHistogram InputPadProfileHistogram;
+
+void                    input_pad_profile_start
+                                        (const gchar           *filename);
+gboolean                input_pad_profile_is_enabled
+                                        (void);
+InputPadProfileSpan *   input_pad_profile_span_begin
+                                        (const gchar           *name,
+                                         const gchar           *detail);
+void                    input_pad_profile_span_end
+                                        (InputPadProfileSpan   *span);
+void                    input_pad_profile_write
+                                        (void);
+
+InputPadProfileHistogram *
+                        input_pad_profile_histogram_new
+                                        (gint64                 period);
+void                    input_pad_profile_histogram_free
+                                        (InputPadProfileHistogram
+                                                               *histogram);
+void                    input_pad_profile_histogram_record
+                                        (InputPadProfileHistogram
+                                                               *histogram,
+                                         gint64                 usec);
+guint64                 input_pad_profile_histogram_get_count
+                                        (InputPadProfileHistogram
+                                                               *histogram);
+gint64                  input_pad_profile_histogram_get_max
+                                        (InputPadProfileHistogram
+                                                               *histogram);
+gint64                  input_pad_profile_histogram_get_percentile
+                                        (InputPadProfileHistogram
+                                                               *histogram,
+                                         gdouble                percentile);
+
+G_END_DECLS
+
+#endif
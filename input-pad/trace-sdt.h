@@ -0,0 +1,90 @@
+/* vim:set et sts=4: */
+/* input-pad - The input pad
+ * Copyright (C) 2026 Takao Fujiwara <takao.fujiwara1@gmail.com>
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __INPUT_PAD_TRACE_SDT_H__
+#define __INPUT_PAD_TRACE_SDT_H__
+
+/*
+ * The SystemTap SDT probes of the provider "input_pad".
+ * A probe is a nop instruction until perf, bpftrace or stap attaches it,
+ * e.g. % perf buildid-cache --add libinput-pad-1.0.so
+ *      % perf record -e sdt_input_pad:table_switch_begin ...
+ * The probes are not compiled without --enable-sdt.
+ * The arguments which cost to compute are computed only while
+ * INPUT_PAD_TRACE_ENABLED() is true, i.e. the tracer attaches the probe
+ * and increments its semaphore.
+ *
+ * table_switch_begin (type, name)      the custom table is selected
+ * table_switch_end (type, name)        the custom table is shown
+ * table_append (type, n_items)         the custom table buttons are created
+ * all_char_table (start, end)          the code point block is shown
+ * viewport_relabel (start, end)       the code points [start, end) are
+ *                                      relabeled on scroll
+ * group_switch_begin (group)           the XKB group is changed
+ * group_switch_end (group)
+ * command_run (command, cached)        the command button is pressed
+ * command_commit (command, bytes)      the command output is committed
+ * paste_commit (bytes)                 the string is pasted
+ * send_event_key (keysym, keycode, state)  XSendEvent injection
+ * xtest_key (keysym, keycode, state)   XTest key injection
+ * xtest_string (bytes, n_chars)        XTest string injection
+ */
+
+#ifdef HAVE_SYS_SDT_H
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+/* Every probe of a file refers to its semaphore. */
+#define INPUT_PAD_TRACE_SEMAPHORE(name) \
+    static unsigned short input_pad_##name##_semaphore \
+    __attribute__ ((used, section (".probes")))
+
+INPUT_PAD_TRACE_SEMAPHORE (table_switch_begin);
+INPUT_PAD_TRACE_SEMAPHORE (table_switch_end);
+INPUT_PAD_TRACE_SEMAPHORE (table_append);
+INPUT_PAD_TRACE_SEMAPHORE (all_char_table);
+INPUT_PAD_TRACE_SEMAPHORE (viewport_relabel);
+INPUT_PAD_TRACE_SEMAPHORE (group_switch_begin);
+INPUT_PAD_TRACE_SEMAPHORE (group_switch_end);
+INPUT_PAD_TRACE_SEMAPHORE (command_run);
+INPUT_PAD_TRACE_SEMAPHORE (command_commit);
+INPUT_PAD_TRACE_SEMAPHORE (paste_commit);
+INPUT_PAD_TRACE_SEMAPHORE (send_event_key);
+INPUT_PAD_TRACE_SEMAPHORE (xtest_key);
+INPUT_PAD_TRACE_SEMAPHORE (xtest_string);
+
+#define INPUT_PAD_TRACE_ENABLED(name) \
+    __builtin_expect (input_pad_##name##_semaphore, 0)
+
+#define INPUT_PAD_TRACE1(name, a1) \
+    DTRACE_PROBE1 (input_pad, name, a1)
+#define INPUT_PAD_TRACE2(name, a1, a2) \
+    DTRACE_PROBE2 (input_pad, name, a1, a2)
+#define INPUT_PAD_TRACE3(name, a1, a2, a3) \
+    DTRACE_PROBE3 (input_pad, name, a1, a2, a3)
+#else
+#define INPUT_PAD_TRACE_ENABLED(name) 0
+#define INPUT_PAD_TRACE1(name, a1)
+#define INPUT_PAD_TRACE2(name, a1, a2)
+#define INPUT_PAD_TRACE3(name, a1, a2, a3)
+#endif
+
+#endif
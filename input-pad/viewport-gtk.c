@@ -19,9 +19,14 @@
  * MA  02110-1301  USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <gtk/gtk.h>
 
 #include "button-gtk.h"
+#include "trace-sdt.h"
 #include "viewport-gtk.h"
 
 #define INPUT_PAD_STEP_INCREMENT 20
@@ -161,6 +166,7 @@ input_pad_gtk_viewport_vadjustment_value_changed_cb (GtkAdjustment *vadjustment,
         list = list->next;
     }
     g_list_free (orig_list);
+    INPUT_PAD_TRACE2 (viewport_relabel, start, num);
 }
 
 static void
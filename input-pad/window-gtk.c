@@ -23,12 +23,16 @@
 #include <config.h>
 #endif
 
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
 #include <gdk/gdkx.h>
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h> /* XA_WINDOW */
 #include <X11/keysym.h>
-#include <string.h> /* strlen */
+#include <string.h> /* strlen, strstr */
+#include <errno.h>
 
 #ifdef ENABLE_NLS
 #include <locale.h>
@@ -36,6 +40,7 @@
 
 #include "i18n.h"
 #include "button-gtk.h"
+#include "chars-util.h"
 #include "combobox-gtk.h"
 #include "geometry-gdk.h"
 #include "input-pad.h"
@@ -44,13 +49,39 @@
 #include "input-pad-marshal.h"
 #include "input-pad-private.h"
 #include "input-pad-window-gtk.h"
+#include "keyboard-gtk.h"
+#include "profile-gdk.h"
+#include "trace-sdt.h"
 #include "unicode_block.h"
 #include "viewport-gtk.h"
 
 #define N_KEYBOARD_LAYOUT_PART 3
+/* The previous texts are restored after the pasting application
+ * requests the selection and does not request it again in this
+ * milliseconds, e.g. for another target. */
+#define PASTE_RESTORE_DELAY 200
+/* The hidden dialogs are destroyed after this seconds. */
+#define DIALOG_DISUSE_TIMEOUT 60
+#define DIALOG_UI_RESOURCE "/com/github/fujiwarat/input-pad/dialog.ui"
+/* The press latency histograms keep the last one or two periods. */
+#define PRESS_HISTOGRAM_PERIOD (60 * G_USEC_PER_SEC)
+#define PRESS_TRACE_MAX_HANDLERS 8
+/* The hidden resident window drops the caches after this seconds. */
+#define RESIDENT_TRIM_TIMEOUT 300
+#define PASTE_DEFAULT_KEY "<Control>v"
+/* The cached commands are prefetched when the TTL is this seconds or more. */
+#define COMMAND_CACHE_PREFETCH_TTL 60
 #define INPUT_PAD_UI_FILE INPUT_PAD_UI_GTK_DIR "/input-pad.ui"
 #define MAX_UCODE 0x10ffff
 #define MODULE_NAME_PREFIX "input-pad-"
+#define KBDUI_MANIFEST_FILE "kbdui-modules.cache"
+#define KBDUI_MANIFEST_GROUP "Manifest"
+#define KBDUI_MANIFEST_MODULE_GROUP_PREFIX "Module "
+#define KBDUI_MANIFEST_OPTION_GROUP_PREFIX "Option "
+/* Incremented when the keys of the manifest are changed. */
+#define KBDUI_MANIFEST_VERSION 2
+#define KBDUI_OPTION_TRANSLATE(domain, str) \
+    (((domain) && (str) && *(str)) ? g_dgettext ((domain), (str)) : (str))
 #define USE_GLOBAL_GMODULE 1
 
 #if GTK_CHECK_VERSION (3, 19, 10)
@@ -102,7 +133,17 @@
 typedef struct _CodePointData CodePointData;
 typedef struct _KeyboardLayoutPart KeyboardLayoutPart;
 typedef struct _CharTreeViewData CharTreeViewData;
+typedef struct _CommandSlot CommandSlot;
+typedef struct _CommandPlan CommandPlan;
+typedef struct _CommandCacheEntry CommandCacheEntry;
+typedef struct _CommandRun CommandRun;
 typedef struct _TableForEachData TableForEachData;
+typedef struct _StatsForEachData StatsForEachData;
+typedef struct _PressTrace PressTrace;
+typedef struct _KeyboardUpdateData KeyboardUpdateData;
+typedef struct _KeyboardLevelState KeyboardLevelState;
+typedef struct _ConfigSearchItem ConfigSearchItem;
+typedef struct _KbduiModuleOptions KbduiModuleOptions;
 typedef struct _InputPadGtkApplicationClass InputPadGtkApplicationClass;
 
 enum {
@@ -112,6 +153,7 @@ enum {
     GROUP_APPENDED,
     CHAR_BUTTON_SENSITIVE,
     REORDER_BUTTON_PRESSED,
+    KEYMAP_CHANGED,
     LAST_SIGNAL
 };
 
@@ -120,6 +162,13 @@ enum {
     APP_LAST_SIGNAL
 };
 
+enum {
+    PROP_0,
+    PROP_STATS,
+    PROP_PASTE_THRESHOLD,
+    PROP_LAYOUT_KEYS
+};
+
 enum {
     DIGIT_TEXT_COL = 0,
     DIGIT_VISIBLE_COL,
@@ -132,9 +181,19 @@ enum {
     LAYOUT_VARIANT_NAME_COL,
     LAYOUT_VARIANT_DESC_COL,
     LAYOUT_VISIBLE_COL,
+    LAYOUT_SENSITIVE_COL,
     LAYOUT_N_COLS,
 };
 
+enum {
+    OPTION_NAME_COL = 0,
+    OPTION_DESC_COL,
+    OPTION_ACTIVE_COL,
+    OPTION_IS_OPTION_COL,
+    OPTION_WEIGHT_COL,
+    OPTION_N_COLS,
+};
+
 enum {
     CHAR_BLOCK_LABEL_COL = 0,
     CHAR_BLOCK_UNICODE_COL,
@@ -148,9 +207,16 @@ enum {
 struct _InputPadGtkApplication
 {
     GtkApplication     parent;
-    GtkBuilder        *builder;
+    /* The dialogs are created when they are shown first. */
+    GtkWidget         *code_point_dialog;
+    GtkWidget         *about_dialog;
+    GtkWidget         *contents_dialog;
+    guint              dialogs_disuse_id;
+    guint              resident_trim_id;
     InputPadGtkWindow *window;
     gboolean           show;
+    /* The resident application is held until it is quit. */
+    gboolean           held;
 };
 
 struct _InputPadGtkApplicationClass
@@ -162,13 +228,63 @@ struct _InputPadGtkApplicationClass
 
 G_DEFINE_TYPE(InputPadGtkApplication, input_pad_gtk_application, GTK_TYPE_APPLICATION);
 
+/* The shift level and group shown on the default keyboard.
+ * Shift switches the main part and Num_Lock switches the keypad part. */
+struct _KeyboardLevelState {
+    int                         group;
+    guint                       shift : 1;
+    guint                       num_lock : 1;
+};
+
+/* The stages of a press until it is committed */
+typedef enum {
+    /* From the press to the button-pressed emission or the paste */
+    PRESS_STAGE_PREPARE = 0,
+    /* The button-pressed handlers of the modules and the applications */
+    PRESS_STAGE_HANDLERS,
+    /* The handlers when the XTest module queued the commit to its worker
+     * thread. The worker sends the events later on its own display. */
+    PRESS_STAGE_ENQUEUE,
+    /* The default handler which sends the event with XSendEvent */
+    PRESS_STAGE_DEFAULT,
+    /* XSync after the emission, which is measured with --log-slow-press
+     * and not for the commits queued to the XTest worker */
+    PRESS_STAGE_X_SERVER,
+    PRESS_STAGE_TOTAL,
+    N_PRESS_STAGES
+} PressStage;
+
+struct _PressTrace {
+    InputPadTableType           type;
+    gint64                      start;
+    gint64                      emit;
+    gint64                      default_start;
+    gint64                      end;
+    /* The XTest module queued the commit to its worker thread. */
+    guint                       queued : 1;
+    /* The accumulator marks the return of each handler. */
+    guint                       n_handlers;
+    gint64                      handler_end[PRESS_TRACE_MAX_HANDLERS];
+};
+
 struct _InputPadGtkWindowPrivate {
     InputPadGroup              *group;
     guint                       show_all : 1;
     GModule                    *module_gdk_xtest;
     InputPadXKBKeyList         *xkb_key_list;
+    /* XKB key name -> InputPadGtkButton of the default keyboard */
+    GHashTable                 *keyboard_buttons;
+    GPtrArray                  *keyboard_part_buttons[N_KEYBOARD_LAYOUT_PART];
+    KeyboardLevelState          keyboard_level_state;
+    /* InputPadGtkKeyboard drawn from the XKB geometry */
+    GtkWidget                  *keyboard_geometry_widget;
+    guint                       keyboard_geometry : 1;
     guint                       keyboard_state;
+    /* The full registry is loaded only while the config dialogs run. */
     InputPadXKBConfigReg       *xkb_config_reg;
+    guint                       xkb_config_reg_ref;
+    /* The registry of the group layouts for the layout combobox */
+    InputPadXKBConfigReg       *xkb_group_config_reg;
     gchar                     **group_layouts;
     gchar                     **group_variants;
     gchar                     **group_options;
@@ -182,11 +298,74 @@ struct _InputPadGtkWindowPrivate {
     GtkWidget                  *config_layouts_remove_treeview;
     GtkWidget                  *config_layouts_combobox;
     GtkWidget                  *config_options_dialog;
-    GtkWidget                  *config_options_vbox;
+    GtkWidget                  *config_options_treeview;
+    GtkWidget                  *config_layouts_search_entry;
+    GtkWidget                  *config_options_search_entry;
+    /* The config dialogs are destroyed after they are not used. */
+    guint                       config_dialogs_disuse_id;
+    /* The checked options while the options dialog runs */
+    GHashTable                 *config_options_active;
+    GPtrArray                  *config_layouts_index;
+    GPtrArray                  *config_options_index;
+
+    /* The focused window for XSendEvent is looked up again only
+     * after _NET_ACTIVE_WINDOW or the focus is changed and only when
+     * it is the active toplevel itself. It is looked up on every
+     * press when the WM does not set _NET_ACTIVE_WINDOW or when the
+     * focus is on a subwindow, which can change without
+     * _NET_ACTIVE_WINDOW. */
+    XKeyEvent                   send_event_template;
+    Window                      send_event_active_window;
+    guint                       send_event_setup : 1;
+    guint                       send_event_focus_valid : 1;
+    guint                       send_event_active_valid : 1;
+    /* WM_CLASS of the cached focused window to choose the paste key */
+    Window                      focus_class_window;
+    gchar                      *focus_class_name;
+#ifdef DEBUG
+    guint                       send_event_round_trips;
+#endif
+
+    /* The long strings are committed by pasting the selections and
+     * the previous texts are restored after the paste. */
+    gchar                      *paste_text;
+    gchar                      *paste_saved_texts[2];
+    guint                       paste_restore_id;
+    /* paste_text is on the selections until the target requests it. */
+    guint                       paste_pending : 1;
+    /* The selections are set again by the window itself. */
+    guint                       paste_setting : 1;
+    /* The previous texts are being requested. */
+    gboolean                    paste_requested;
+    /* The length of the pasted strings. -1 disables the paste. */
+    int                         paste_threshold;
+    /* The CHARS and KEYSYMS buttons are emitted with the keys of
+     * the current layout. */
+    gboolean                    layout_keys;
+
+    /* The command -> CommandPlan compiled on the first press */
+    GHashTable                 *command_plans;
+    /* The command -> CommandRun of the running COMMANDS buttons */
+    GHashTable                 *command_runs;
+    /* The expanded envp and argv -> CommandCacheEntry */
+    GHashTable                 *command_cache;
 
     GtkWidget                  *top_custom_char_view_hbox;
     GtkWidget                  *top_char_view_hbox;
     GtkWidget                  *top_keyboard_layout_vbox;
+    /* The char views are created when they are shown first. */
+    guint                       custom_char_views_created : 1;
+    guint                       all_char_view_created : 1;
+
+    /* The counters for input_pad_gtk_window_get_stats() */
+    gulong                      n_events_injected;
+    gulong                      n_commands_spawned;
+    gulong                      n_presses;
+    gulong                      press_latency_buckets[INPUT_PAD_WINDOW_STATS_N_LATENCY_BUCKETS];
+    /* The last press which is not committed yet */
+    PressTrace                  press_trace;
+    /* The table type -> the stage -> InputPadProfileHistogram */
+    InputPadProfileHistogram   *press_histograms[INPUT_PAD_TABLE_TYPE_COMMANDS + 1][N_PRESS_STAGES];
 };
 
 struct _CodePointData {
@@ -203,6 +382,23 @@ struct _TableForEachData {
     InputPadGtkWindow          *window;
 };
 
+struct _StatsForEachData {
+    InputPadGtkWindow          *window;
+    InputPadWindowStats        *stats;
+};
+
+struct _KeyboardUpdateData {
+    InputPadGtkWindow          *window;
+    gboolean                    rebuild;
+};
+
+/* The strings of parent and name are owned by the XKB config registry. */
+struct _ConfigSearchItem {
+    const gchar                *parent;
+    const gchar                *name;
+    gchar                      *text;
+};
+
 struct _KeyboardLayoutPart {
     int                         key_row_id;
     int                         row;
@@ -217,6 +413,67 @@ struct _CharTreeViewData {
     GtkWidget                  *sub_tv;
 };
 
+/* The $NAME in argv[arg] is replaced with the value of
+ * the environment variable NAME on each press. */
+struct _CommandSlot {
+    guint                       arg;
+    gchar                      *prefix;
+    gchar                      *name;
+    gchar                      *suffix;
+};
+
+/* The leading NAME=value words of the command are envp and
+ * the rest is argv. */
+struct _CommandPlan {
+    GSubprocessLauncher        *launcher;
+    gchar                     **argv;
+    guint                       argc;
+    gchar                     **envp;
+    CommandSlot                *slots;
+    guint                       n_slots;
+    InputPadTableCmdCache       cache;
+};
+
+struct _CommandCacheEntry {
+    gchar                      *output;
+    /* G_MAXINT64 for the session */
+    gint64                      expires;
+};
+
+/* window is NULL after the window is destroyed. */
+struct _CommandRun {
+    InputPadGtkWindow          *window;
+    GtkWidget                  *button;
+    gchar                      *command;
+    GSubprocess                *subprocess;
+    GCancellable               *cancellable;
+    guint                       timeout_id;
+    guint                       timed_out : 1;
+    /* The output of the prefetch is cached only. */
+    guint                       prefetch : 1;
+    guint                       state;
+    guint                       group;
+    gchar                      *cache_key;
+    InputPadTableCmdCache       cache;
+    /* The press which is committed when the command exits */
+    PressTrace                  press_trace;
+};
+
+/* The options of a kbdui module are read from the manifest and
+ * the module is opened only when one of them is given. */
+struct _KbduiModuleOptions {
+    gchar                      *module;
+    /* FALSE if the module does not describe its options and
+     * it is opened on every startup. */
+    gboolean                    known;
+    gchar                      *name;
+    gchar                      *description;
+    gchar                      *help_description;
+    GArray                     *entries;
+    /* The given options to be parsed by the module */
+    GPtrArray                  *args;
+};
+
 static guint                    signals[LAST_SIGNAL] = { 0 };
 static guint                    app_signals[APP_LAST_SIGNAL] = { 0 };
 #ifdef MODULE_XTEST_GDK_BASE
@@ -224,9 +481,51 @@ static gboolean                 use_module_xtest = FALSE;
 #endif
 /* The kbdui_name is used for CLI only. */
 static gchar                   *kbdui_name = NULL;
+/* The kbdui modules are listed again when MODULE_KBDUI_DIR is changed. */
+static InputPadWindowKbduiName *kbdui_name_list = NULL;
+static gint64                   kbdui_name_list_mtime = -1;
 static gboolean                 ask_version = FALSE;
+static gboolean                 resident = FALSE;
+static gboolean                 start_hidden = FALSE;
+static gchar                   *profile_startup_file = NULL;
+/* The span from the map of the window to the first frame. */
+static InputPadProfileSpan     *first_frame_span = NULL;
 static guint                    set_show_table_type = 1;
 static guint                    set_show_layout_type = 0;
+static int                      paste_threshold = -1;
+static int                      repeat_delay = 500;
+static int                      repeat_interval = 300;
+static gboolean                 repeat_accelerate = FALSE;
+static int                      command_timeout = 5000;
+static int                      log_slow_press = 0;
+/* The press of the running button-pressed emission */
+static PressTrace              *current_press_trace = NULL;
+static const gchar             *press_stage_names[N_PRESS_STAGES] = {
+    "prepare",
+    "handlers",
+    "enqueue",
+    "default",
+    "x-server",
+    "total"
+};
+static const gchar             *table_type_names[INPUT_PAD_TABLE_TYPE_COMMANDS + 1] = {
+    "none",
+    "chars",
+    "keysyms",
+    "strings",
+    "commands"
+};
+static gchar                  **paste_keys = NULL;
+/* The window class -> the accelerator of the paste key */
+static GHashTable              *paste_key_table = NULL;
+static const gchar             *paste_default_keys[] = {
+    "XTerm=<Shift>Insert",
+    "URxvt=<Shift>Insert",
+    "Gnome-terminal=<Control><Shift>v",
+    "konsole=<Control><Shift>v",
+    "Xfce4-terminal=<Control><Shift>v",
+    NULL
+};
 
 #ifdef USE_GLOBAL_GMODULE
 /* module_table: global GModule hash table
@@ -253,7 +552,34 @@ static GOptionEntry entries[] = {
     N_("Use TYPE of char table. The available TYPE=0, 1, 2"), "TYPE"},
   { "with-layout-type", 'l', 0, G_OPTION_ARG_INT, &set_show_layout_type,
     /* Translators: the word 'TYPE' is not translated. */
-    N_("Use TYPE of keyboard layout. The available TYPE=0, 1"), "TYPE"},
+    N_("Use TYPE of keyboard layout. The available TYPE=0, 1, 2"), "TYPE"},
+  { "repeat-delay", 0, 0, G_OPTION_ARG_INT, &repeat_delay,
+    /* Translators: the word 'MSEC' is not translated. */
+    N_("Start to repeat the pressed button after MSEC"), "MSEC"},
+  { "repeat-interval", 0, 0, G_OPTION_ARG_INT, &repeat_interval,
+    /* Translators: the word 'MSEC' is not translated. */
+    N_("Repeat the pressed button every MSEC"), "MSEC"},
+  { "repeat-accelerate", 0, 0, G_OPTION_ARG_NONE, &repeat_accelerate,
+    N_("Accelerate the repeat of the pressed button"), NULL},
+  { "paste-threshold", 0, 0, G_OPTION_ARG_INT, &paste_threshold,
+    /* Translators: the word 'LENGTH' is not translated. */
+    N_("Paste strings of LENGTH or more characters with the clipboard. It is disabled by default"), "LENGTH"},
+  { "paste-key", 0, 0, G_OPTION_ARG_STRING_ARRAY, &paste_keys,
+    /* Translators: the words 'CLASS' and 'KEY' are not translated. */
+    N_("Paste with KEY in the windows of CLASS, e.g. XTerm=<Shift>Insert"), "CLASS=KEY"},
+  { "command-timeout", 0, 0, G_OPTION_ARG_INT, &command_timeout,
+    /* Translators: the word 'MSEC' is not translated. */
+    N_("Cancel the command of the pressed button after MSEC. 0 disables it"), "MSEC"},
+  { "log-slow-press", 0, 0, G_OPTION_ARG_INT, &log_slow_press,
+    /* Translators: the word 'MSEC' is not translated. */
+    N_("Log the stages of the presses which take MSEC or more to be committed. 0 disables it"), "MSEC"},
+  { "resident", 0, 0, G_OPTION_ARG_NONE, &resident,
+    N_("Keep running hidden after the window is closed and show the window again when input-pad is run"), NULL},
+  { "hidden", 0, 0, G_OPTION_ARG_NONE, &start_hidden,
+    N_("Prepare the window without showing it"), NULL},
+  { "profile-startup", 0, 0, G_OPTION_ARG_FILENAME, &profile_startup_file,
+    /* Translators: the word 'FILE' is not translated. */
+    N_("Write the time of the startup phases to FILE as JSON"), "FILE"},
   { NULL }
 };
 
@@ -285,8 +611,12 @@ static InputPadGroup *  get_nth_pad_group       (InputPadGroup     *group,
                                                  int                nth);
 static InputPadTable *  get_nth_pad_table       (InputPadTable     *table,
                                                  int                nth);
-static void             run_command             (const gchar       *command,
-                                                 gchar            **command_output);
+static void             run_command             (InputPadGtkWindow *window,
+                                                 GtkWidget         *button,
+                                                 const gchar       *command,
+                                                 guint              state,
+                                                 guint              group);
+static void             run_command_cancel_all  (InputPadGtkWindow *window);
 static void             append_custom_char_view_table
                                                 (GtkWidget         *scrolled,
                                                  InputPadTable     *table_data);
@@ -315,14 +645,31 @@ static void             config_layouts_combobox_remove_layout
                                                  const gchar *variant_name,
                                                  const gchar *variant_desc);
 static void             config_layouts_list_append_layout
-                                                (GtkListStore *list,
+                                                (GtkTreeStore *list,
+                                                 GtkTreeIter  *parent,
                                                  const gchar *layout_name,
                                                  const gchar *layout_desc,
                                                  const gchar *variant_name,
                                                  const gchar *variant_desc);
 static void             config_layouts_list_remove_iter
-                                                (GtkListStore *list,
+                                                (GtkTreeStore *list,
                                                  GtkTreeIter  *iter);
+static void             config_layouts_add_list_restore
+                                                (InputPadGtkWindow *window,
+                                                 GtkTreeStore *add_list,
+                                                 const gchar *layout_name,
+                                                 const gchar *variant_name);
+static void             config_layouts_treeview_set
+                                                (InputPadGtkWindow *input_pad,
+                                                 InputPadXKBLayoutList
+                                                                   *xkb_layout_list);
+static void             config_options_treeview_set
+                                                (InputPadGtkWindow *input_pad,
+                                                 InputPadXKBOptionGroupList
+                                                                   *xkb_group_list);
+static gboolean         config_dialogs_ensure   (InputPadGtkWindow *window);
+static gboolean         on_config_dialogs_disuse_timeout
+                                                (gpointer           data);
 static void             create_keyboard_layout_list_ui_real
                                                 (GtkWidget         *vbox,
                                                  InputPadGtkWindow *window);
@@ -345,6 +692,16 @@ static void             destroy_all_char_view_table
                                                  InputPadGtkWindow *window);
 static void             input_pad_gtk_window_real_destroy
                                                 (GtkWidget         *widget);
+static void             input_pad_gtk_window_set_property
+                                                (GObject           *object,
+                                                 guint              prop_id,
+                                                 const GValue      *value,
+                                                 GParamSpec        *pspec);
+static void             input_pad_gtk_window_get_property
+                                                (GObject           *object,
+                                                 guint              prop_id,
+                                                 GValue            *value,
+                                                 GParamSpec        *pspec);
 static void             on_toggle_action        (GSimpleAction     *action,
                                                  GVariant          *parameter,
                                                  gpointer          app);
@@ -356,37 +713,103 @@ G_DEFINE_TYPE_WITH_PRIVATE (InputPadGtkWindow,
                             input_pad_gtk_window,
                             GTK_TYPE_APPLICATION_WINDOW);
 
-static void
-on_window_keyboard_changed (InputPadGtkWindow *window,
-                            gint               group,
-                            gpointer           data)
+static gboolean
+keyboard_button_set_level (InputPadGtkButton *button,
+                           int                group,
+                           int                level,
+                           GtkWidget         *widget)
 {
-    InputPadGtkButton *button;
     guint **keysyms;
-    int i = 0;
+    guint new_keysym;
+    int i;
     gchar *tooltip, *display_name;
 
-    g_return_if_fail (window != NULL &&
-                      INPUT_PAD_IS_GTK_WINDOW (window));
-    g_return_if_fail (data != NULL &&
-                      INPUT_PAD_IS_GTK_BUTTON (data));
-
-    button = INPUT_PAD_GTK_BUTTON (data);
     keysyms = input_pad_gtk_button_get_all_keysyms (button);
-    g_return_if_fail (keysyms != NULL);
-    while (keysyms[i]) i++;
+    if (keysyms == NULL) {
+        return FALSE;
+    }
+    for (i = 0; keysyms[i]; i++);
     if (group >= i) {
-        return;
+        return FALSE;
+    }
+    for (i = 0; keysyms[group][i]; i++);
+    if (i == 0) {
+        return FALSE;
+    }
+    if (level >= i) {
+        level = 0;
     }
 
+    new_keysym = keysyms[group][level];
+    if (input_pad_gtk_button_get_keysym_group (button) == group &&
+        input_pad_gtk_button_get_keysym (button) == new_keysym) {
+        return FALSE;
+    }
     input_pad_gtk_button_set_keysym_group (button, group);
-    input_pad_gtk_button_set_keysym (button, keysyms[group][0]);
-    display_name = get_keysym_display_name (keysyms[group][0],
-                                            GTK_WIDGET (window), &tooltip);
+    input_pad_gtk_button_set_keysym (button, new_keysym);
+    display_name = get_keysym_display_name (new_keysym, widget, &tooltip);
     input_pad_gtk_button_set_label_size (button, display_name,
                                          KEYBOARD_ICON_SIZE);
     gtk_widget_set_tooltip_text (GTK_WIDGET (button), tooltip);
     g_free (display_name);
+    return TRUE;
+}
+
+/*
+ * Relabel the default keyboard from keyboard_level_state at once.
+ * Only the buttons whose keysym is changed are redrawn.
+ */
+static void
+keyboard_level_state_apply (InputPadGtkWindow *window)
+{
+    KeyboardLevelState *state;
+    GPtrArray *buttons;
+    guint i;
+    int part, level;
+
+    g_return_if_fail (window != NULL && window->priv != NULL);
+
+    state = &window->priv->keyboard_level_state;
+    if (window->priv->keyboard_geometry_widget) {
+        input_pad_gtk_keyboard_set_level (INPUT_PAD_GTK_KEYBOARD (window->priv->keyboard_geometry_widget),
+                                          state->group,
+                                          state->shift ? 1 : 0,
+                                          state->num_lock ? 1 : 0);
+    }
+    for (part = 0; part < N_KEYBOARD_LAYOUT_PART; part++) {
+        if ((buttons = window->priv->keyboard_part_buttons[part]) == NULL) {
+            continue;
+        }
+        if (part == 0) {
+            level = state->shift ? 1 : 0;
+        } else if (part == N_KEYBOARD_LAYOUT_PART - 1) {
+            level = state->num_lock ? 1 : 0;
+        } else {
+            level = 0;
+        }
+        for (i = 0; i < buttons->len; i++) {
+            keyboard_button_set_level (INPUT_PAD_GTK_BUTTON (g_ptr_array_index (buttons, i)),
+                                       state->group, level,
+                                       GTK_WIDGET (window));
+        }
+    }
+}
+
+static void
+on_window_keyboard_changed (InputPadGtkWindow *window,
+                            gint               group,
+                            gpointer           data)
+{
+    g_return_if_fail (window != NULL &&
+                      INPUT_PAD_IS_GTK_WINDOW (window));
+
+    if (window->priv == NULL) {
+        return;
+    }
+    INPUT_PAD_TRACE1 (group_switch_begin, group);
+    window->priv->keyboard_level_state.group = group;
+    keyboard_level_state_apply (window);
+    INPUT_PAD_TRACE1 (group_switch_end, group);
 }
 
 static void
@@ -450,11 +873,14 @@ on_window_group_changed_custom_char_views (InputPadGtkWindow *window,
 
     g_return_if_fail (INPUT_PAD_IS_GTK_WINDOW (window));
     g_return_if_fail (GTK_IS_BOX (data));
+    /* The group is NULL when the system pad dir is not found and
+     * paddir can replace it. */
     g_return_if_fail (window->priv != NULL);
-    g_return_if_fail (window->priv->group != NULL);
 
     hbox = GTK_WIDGET (data);
-    destroy_custom_char_views (hbox, window);
+    if (window->priv->custom_char_views_created) {
+        destroy_custom_char_views (hbox, window);
+    }
     if (paddir != NULL) {
         custom_group = input_pad_group_parse_all_files (paddir, domain);
     }
@@ -462,7 +888,9 @@ on_window_group_changed_custom_char_views (InputPadGtkWindow *window,
         input_pad_group_destroy (window->priv->group);
         window->priv->group = custom_group;
     }
-    create_custom_char_views (hbox, window);
+    if (window->priv->custom_char_views_created) {
+        create_custom_char_views (hbox, window);
+    }
 }
 
 static void
@@ -480,7 +908,9 @@ on_window_group_appended_custom_char_views (InputPadGtkWindow *window,
     g_return_if_fail (window->priv->group != NULL);
 
     hbox = GTK_WIDGET (data);
-    destroy_custom_char_views (hbox, window);
+    if (window->priv->custom_char_views_created) {
+        destroy_custom_char_views (hbox, window);
+    }
     if (padfile != NULL) {
         custom_group = input_pad_group_append_from_file (window->priv->group,
                                                          padfile,
@@ -489,7 +919,9 @@ on_window_group_appended_custom_char_views (InputPadGtkWindow *window,
     if (custom_group != NULL) {
         window->priv->group = custom_group;
     }
-    create_custom_char_views (hbox, window);
+    if (window->priv->custom_char_views_created) {
+        create_custom_char_views (hbox, window);
+    }
 }
 
 static void
@@ -552,46 +984,27 @@ on_button_base_clicked (GtkButton *button, gpointer data)
 static void
 on_button_shift_clicked (GtkButton *button, gpointer data)
 {
-    InputPadGtkButton *gen_button;
-    guint current_keysym;
-    guint new_keysym = 0;
-    int i, group;
-    guint **keysyms;
-    gchar *tooltip;
-    gchar *display_name;
-
-    g_return_if_fail (INPUT_PAD_IS_GTK_BUTTON (data));
-    gen_button = INPUT_PAD_GTK_BUTTON (data);
-    current_keysym = input_pad_gtk_button_get_keysym (gen_button);
-    group = input_pad_gtk_button_get_keysym_group (gen_button);
-    keysyms = input_pad_gtk_button_get_all_keysyms (gen_button);
-    if (keysyms == NULL || keysyms[group] == NULL) {
-        return;
-    }
-    if (current_keysym == 0 ||
-        current_keysym == XK_Shift_L || current_keysym == XK_Shift_R) {
-        return;
-    }
-    for (i = 0; keysyms[group][i] && (i < 20); i++) {
-        if (keysyms[group][i] == current_keysym) {
-            break;
-        }
-    }
-    if (i == 0 && keysyms[group][i] && keysyms[group][i + 1]) {
-        new_keysym = keysyms[group][i + 1];
-    } else {
-        new_keysym = keysyms[group][0];
-    }
-    if (new_keysym) {
-        display_name = get_keysym_display_name (new_keysym,
-                                                GTK_WIDGET (button),
-                                                &tooltip);
-        input_pad_gtk_button_set_keysym (gen_button, new_keysym);
-        input_pad_gtk_button_set_label_size (gen_button, display_name,
-                                             KEYBOARD_ICON_SIZE);
-        g_free (display_name);
-        gtk_widget_set_tooltip_text (GTK_WIDGET (gen_button), tooltip);
-    }
+    InputPadGtkWindow *window;
+    KeyboardLevelState *state;
+
+    g_return_if_fail (INPUT_PAD_IS_GTK_WINDOW (data));
+    window = INPUT_PAD_GTK_WINDOW (data);
+    state = &window->priv->keyboard_level_state;
+    state->shift = !state->shift;
+    keyboard_level_state_apply (window);
+}
+
+static void
+on_button_num_lock_clicked (GtkButton *button, gpointer data)
+{
+    InputPadGtkWindow *window;
+    KeyboardLevelState *state;
+
+    g_return_if_fail (INPUT_PAD_IS_GTK_WINDOW (data));
+    window = INPUT_PAD_GTK_WINDOW (data);
+    state = &window->priv->keyboard_level_state;
+    state->num_lock = !state->num_lock;
+    keyboard_level_state_apply (window);
 }
 
 static void
@@ -652,6 +1065,167 @@ on_button_up_pressed (GtkButton *button, gpointer data)
     char_label_set_code_point (cp_data->char_label, code);
 }
 
+static gboolean
+is_keyboard_special_keysym (guint keysym)
+{
+    switch (keysym) {
+    case XK_Shift_L:
+    case XK_Shift_R:
+    case XK_Control_L:
+    case XK_Control_R:
+    case XK_Alt_L:
+    case XK_Alt_R:
+    case XK_Num_Lock:
+        return TRUE;
+    default:;
+    }
+    return FALSE;
+}
+
+static void
+keyboard_button_update_key_row (InputPadXKBKeyRow      *key_row,
+                                gboolean                changed,
+                                gpointer                data)
+{
+    KeyboardUpdateData *update_data = (KeyboardUpdateData *) data;
+    InputPadGtkWindow *window = update_data->window;
+    InputPadGtkButton *button;
+    guint **prev_keysyms;
+
+    button = g_hash_table_lookup (window->priv->keyboard_buttons,
+                                  key_row->name);
+    if (button == NULL || key_row->keysym == NULL) {
+        update_data->rebuild = TRUE;
+        return;
+    }
+
+    /* The buttons refer the keysyms of the previous key list
+     * which will be freed. */
+    prev_keysyms = input_pad_gtk_button_get_all_keysyms (button);
+    input_pad_gtk_button_set_all_keysyms (button, key_row->keysym);
+    input_pad_gtk_button_set_keycode (button, (guint) key_row->keycode);
+    if (!changed) {
+        return;
+    }
+
+    /* Shift, Ctrl, Alt and Num_Lock buttons have own signals. */
+    if ((prev_keysyms && prev_keysyms[0] &&
+         is_keyboard_special_keysym (prev_keysyms[0][0])) ||
+        (key_row->keysym[0] &&
+         is_keyboard_special_keysym (key_row->keysym[0][0]))) {
+        update_data->rebuild = TRUE;
+        return;
+    }
+    /* Force keyboard_level_state_apply() to relabel the button. */
+    input_pad_gtk_button_set_keysym (button, 0);
+}
+
+static void
+reset_group_layouts (InputPadGtkWindow *window)
+{
+    if (window->priv->group_layouts) {
+        g_strfreev (window->priv->group_layouts);
+        window->priv->group_layouts = NULL;
+    }
+    if (window->priv->group_variants) {
+        g_strfreev (window->priv->group_variants);
+        window->priv->group_variants = NULL;
+    }
+    if (window->priv->group_options) {
+        g_strfreev (window->priv->group_options);
+        window->priv->group_options = NULL;
+    }
+    window->priv->group_layouts =
+        input_pad_gdk_xkb_get_group_layouts (window,
+                                             window->priv->xkb_key_list);
+    window->priv->group_variants =
+        input_pad_gdk_xkb_get_group_variants (window,
+                                              window->priv->xkb_key_list);
+    window->priv->group_options =
+        input_pad_gdk_xkb_get_group_options (window,
+                                             window->priv->xkb_key_list);
+}
+
+/*
+ * Update only the buttons whose keycode or keysyms are changed
+ * if the key geometry is not changed. Otherwise rebuild the keyboard.
+ */
+static void
+update_keyboard_layout (InputPadGtkWindow *window, GtkWidget *keyboard_vbox)
+{
+    InputPadXKBKeyList *xkb_key_list;
+    KeyboardUpdateData update_data = { NULL, FALSE };
+
+    xkb_key_list = input_pad_gdk_xkb_parse_keyboard_layouts (window);
+
+    /* The drawn keyboard has no per-key widgets and is rebuilt from
+     * the new geometry without destroying the widget. */
+    if (window->priv->keyboard_geometry_widget != NULL &&
+        xkb_key_list != NULL &&
+        input_pad_gtk_keyboard_set_geometry (INPUT_PAD_GTK_KEYBOARD (window->priv->keyboard_geometry_widget),
+                                             input_pad_gdk_xkb_key_list_get_desc (xkb_key_list),
+                                             xkb_key_list)) {
+        if (window->priv->xkb_key_list) {
+            input_pad_gdk_xkb_destroy_keyboard_layouts (window,
+                                                        window->priv->xkb_key_list);
+        }
+        window->priv->xkb_key_list = xkb_key_list;
+        keyboard_level_state_apply (window);
+        return;
+    }
+
+    if (window->priv->keyboard_buttons != NULL &&
+        input_pad_gdk_xkb_diff_keyboard_layouts (window->priv->xkb_key_list,
+                                                 xkb_key_list,
+                                                 NULL, NULL)) {
+        update_data.window = window;
+        input_pad_gdk_xkb_diff_keyboard_layouts (window->priv->xkb_key_list,
+                                                 xkb_key_list,
+                                                 keyboard_button_update_key_row,
+                                                 &update_data);
+        if (!update_data.rebuild) {
+            input_pad_gdk_xkb_destroy_keyboard_layouts (window,
+                                                        window->priv->xkb_key_list);
+            window->priv->xkb_key_list = xkb_key_list;
+            keyboard_level_state_apply (window);
+            return;
+        }
+    }
+
+    if (window->priv->kbdui_name && xkb_key_list == NULL) {
+        if (window->priv->xkb_key_list) {
+            input_pad_gdk_xkb_destroy_keyboard_layouts (window,
+                                                        window->priv->xkb_key_list);
+            window->priv->xkb_key_list = NULL;
+        }
+        return;
+    }
+
+    destroy_prev_keyboard_layout (keyboard_vbox, window);
+    if (window->priv->xkb_key_list) {
+        input_pad_gdk_xkb_destroy_keyboard_layouts (window,
+                                                    window->priv->xkb_key_list);
+    }
+    window->priv->xkb_key_list = xkb_key_list;
+    create_keyboard_layout_ui_real (keyboard_vbox, window);
+}
+
+static void
+on_window_keymap_changed (InputPadGtkWindow *window,
+                          gpointer           data)
+{
+    g_return_if_fail (window != NULL &&
+                      INPUT_PAD_IS_GTK_WINDOW (window));
+    g_return_if_fail (GTK_IS_WIDGET (data));
+
+    if (window->priv == NULL || window->priv->xkb_key_list == NULL) {
+        return;
+    }
+
+    update_keyboard_layout (window, GTK_WIDGET (data));
+    reset_group_layouts (window);
+}
+
 static void
 on_combobox_layout_changed (GtkComboBox *combobox,
                             gpointer     data)
@@ -684,42 +1258,13 @@ on_combobox_layout_changed (GtkComboBox *combobox,
     g_free (variant);
     g_free (option);
 
-    if (window->priv->xkb_key_list) {
-        input_pad_gdk_xkb_destroy_keyboard_layouts (window,
-                                                    window->priv->xkb_key_list);
-        window->priv->xkb_key_list = NULL;
-    }
-    window->priv->xkb_key_list =
-        input_pad_gdk_xkb_parse_keyboard_layouts (window);
+    keyboard_vbox = gtk_widget_get_parent (gtk_widget_get_parent (GTK_WIDGET (combobox)));
+    update_keyboard_layout (window, keyboard_vbox);
     if (window->priv->kbdui_name && window->priv->xkb_key_list == NULL) {
         return;
     }
 
-    keyboard_vbox = gtk_widget_get_parent (gtk_widget_get_parent (GTK_WIDGET (combobox)));
-    destroy_prev_keyboard_layout (keyboard_vbox, window);
-    create_keyboard_layout_ui_real (keyboard_vbox, window);
-
-    if (window->priv->group_layouts) {
-        g_strfreev (window->priv->group_layouts);
-        window->priv->group_layouts = NULL;
-    }
-    if (window->priv->group_variants) {
-        g_strfreev (window->priv->group_variants);
-        window->priv->group_variants = NULL;
-    }
-    if (window->priv->group_options) {
-        g_strfreev (window->priv->group_options);
-        window->priv->group_options = NULL;
-    }
-    window->priv->group_layouts =
-        input_pad_gdk_xkb_get_group_layouts (window,
-                                             window->priv->xkb_key_list);
-    window->priv->group_variants =
-        input_pad_gdk_xkb_get_group_variants (window,
-                                              window->priv->xkb_key_list);
-    window->priv->group_options =
-        input_pad_gdk_xkb_get_group_options (window,
-                                             window->priv->xkb_key_list);
+    reset_group_layouts (window);
     input_pad_gdk_xkb_signal_emit (window, signals[KBD_CHANGED]);
 }
 
@@ -736,52 +1281,180 @@ xor_modifiers (InputPadGtkWindow *window, guint modifiers)
     window->priv->keyboard_state = state;
 }
 
-/*
- * % xterm -xrm "XTerm*allowSendEvents: true"
- */
-static int
-send_key_event (GdkWindow      *gdkwindow,
-                guint           keysym,
-                guint           keycode,
-                guint           state)
+static GdkFilterReturn
+on_filter_root_property_evt (GdkXEvent *xev, GdkEvent *event, gpointer data)
 {
-    XEvent xevent;
-    Window input_focus;
-    int revert;
+    XEvent *xevent = (XEvent *) xev;
+    InputPadGtkWindow *window = INPUT_PAD_GTK_WINDOW (data);
 
-    XGetInputFocus (GDK_WINDOW_XDISPLAY (gdkwindow), &input_focus, &revert);
-    if (input_focus == (Window) 0) {
-        g_warning ("WARNING: Could not get a focused window.");
-        return FALSE;
+    if (xevent->type == PropertyNotify &&
+        xevent->xproperty.atom ==
+            gdk_x11_get_xatom_by_name_for_display (gdk_display_get_default (),
+                                                   "_NET_ACTIVE_WINDOW")) {
+        window->priv->send_event_focus_valid = FALSE;
+        window->priv->send_event_active_valid = FALSE;
     }
+    return GDK_FILTER_CONTINUE;
+}
 
-    xevent.type = KeyPress;
-    xevent.xkey.type = KeyPress;
-    xevent.xkey.serial = 0L;
-    xevent.xkey.send_event = True;
-    xevent.xkey.display = GDK_WINDOW_XDISPLAY (gdkwindow);
-    xevent.xkey.root = XDefaultRootWindow (xevent.xkey.display);
-    xevent.xkey.window = input_focus;
-    xevent.xkey.subwindow = xevent.xkey.window;
-    xevent.xkey.time = CurrentTime;
-    xevent.xkey.state = state;
-    if (keycode) {
-        xevent.xkey.keycode = keycode;
-    } else {
-        xevent.xkey.keycode = XKeysymToKeycode (xevent.xkey.display,
-                                                (KeySym) keysym);
-    }
-    xevent.xkey.same_screen = True;
-    XSendEvent (xevent.xkey.display, xevent.xkey.window, True,
-                KeyPressMask, &xevent);
+static gboolean
+on_window_focus_changed (GtkWidget     *widget,
+                         GdkEventFocus *event,
+                         gpointer       data)
+{
+    InputPadGtkWindow *window = INPUT_PAD_GTK_WINDOW (widget);
 
-    XSync (xevent.xkey.display, False);
-    xevent.type = KeyRelease;
+    if (window->priv) {
+        window->priv->send_event_focus_valid = FALSE;
+    }
+    return FALSE;
+}
+
+static void
+send_event_setup (InputPadGtkWindow *window)
+{
+    GdkWindow *root = gdk_get_default_root_window ();
+    XKeyEvent *template = &window->priv->send_event_template;
+
+    gdk_window_set_events (root,
+                           gdk_window_get_events (root) |
+                           GDK_PROPERTY_CHANGE_MASK);
+    gdk_window_add_filter (root, on_filter_root_property_evt, window);
+    g_signal_connect (G_OBJECT (window), "focus-in-event",
+                      G_CALLBACK (on_window_focus_changed), NULL);
+    g_signal_connect (G_OBJECT (window), "focus-out-event",
+                      G_CALLBACK (on_window_focus_changed), NULL);
+
+    memset (template, 0, sizeof (XKeyEvent));
+    template->serial = 0L;
+    template->send_event = True;
+    template->display = GDK_WINDOW_XDISPLAY (gtk_widget_get_window (GTK_WIDGET (window)));
+    template->root = XDefaultRootWindow (template->display);
+    template->time = CurrentTime;
+    template->same_screen = True;
+    window->priv->send_event_setup = TRUE;
+}
+
+/* Returns _NET_ACTIVE_WINDOW which is read again after it is changed. */
+static Window
+send_event_get_active_window (InputPadGtkWindow *window)
+{
+    XKeyEvent *template = &window->priv->send_event_template;
+    Atom type = None;
+    int format = 0;
+    unsigned long n_items = 0;
+    unsigned long bytes_after = 0;
+    unsigned char *prop = NULL;
+
+    if (window->priv->send_event_active_valid) {
+        return window->priv->send_event_active_window;
+    }
+    window->priv->send_event_active_window = None;
+    if (XGetWindowProperty (template->display, template->root,
+                            gdk_x11_get_xatom_by_name_for_display (gdk_display_get_default (),
+                                                                   "_NET_ACTIVE_WINDOW"),
+                            0, 1, False, XA_WINDOW,
+                            &type, &format, &n_items, &bytes_after,
+                            &prop) == Success &&
+        type == XA_WINDOW && format == 32 && n_items == 1 && prop) {
+        window->priv->send_event_active_window = *(Window *) prop;
+    }
+    if (prop) {
+        XFree (prop);
+    }
+    window->priv->send_event_active_valid = TRUE;
+#ifdef DEBUG
+    window->priv->send_event_round_trips++;
+#endif
+    return window->priv->send_event_active_window;
+}
+
+/* Returns the focused window and looks it up only when it could change. */
+static Window
+send_event_get_focus (InputPadGtkWindow *window)
+{
+    XKeyEvent *template = &window->priv->send_event_template;
+    int revert;
+
+    if (!window->priv->send_event_setup) {
+        send_event_setup (window);
+    }
+    if (!window->priv->send_event_focus_valid ||
+        !gdk_x11_screen_supports_net_wm_hint (gtk_widget_get_screen (GTK_WIDGET (window)),
+                                              gdk_atom_intern_static_string ("_NET_ACTIVE_WINDOW"))) {
+        XGetInputFocus (template->display, &template->window, &revert);
+        template->subwindow = template->window;
+#ifdef DEBUG
+        window->priv->send_event_round_trips++;
+#endif
+        /* The focus on a subwindow of the toplevel can change without
+         * _NET_ACTIVE_WINDOW so only the toplevel itself is cached. */
+        window->priv->send_event_focus_valid =
+            (template->window != None &&
+             template->window == send_event_get_active_window (window));
+    }
+    return template->window;
+}
+
+static void
+send_event_destroy (InputPadGtkWindow *window)
+{
+    if (!window->priv->send_event_setup) {
+        return;
+    }
+    gdk_window_remove_filter (gdk_get_default_root_window (),
+                              on_filter_root_property_evt, window);
+    window->priv->send_event_setup = FALSE;
+}
+
+/*
+ * % xterm -xrm "XTerm*allowSendEvents: true"
+ */
+static int
+send_key_event (InputPadGtkWindow  *window,
+                guint               keysym,
+                guint               keycode,
+                guint               state)
+{
+    XEvent xevent;
+    XKeyEvent *template = &window->priv->send_event_template;
+
+    if (send_event_get_focus (window) == (Window) 0) {
+        g_warning ("WARNING: Could not get a focused window.");
+        window->priv->send_event_focus_valid = FALSE;
+        return FALSE;
+    }
+    INPUT_PAD_TRACE3 (send_event_key, keysym, keycode, state);
+
+    xevent.xkey = *template;
+    xevent.type = KeyPress;
+    xevent.xkey.type = KeyPress;
+    xevent.xkey.state = state;
+    if (keycode) {
+        xevent.xkey.keycode = keycode;
+    } else {
+        xevent.xkey.keycode = XKeysymToKeycode (xevent.xkey.display,
+                                                (KeySym) keysym);
+    }
+    /* The focused window could be destroyed after it is cached. */
+    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    XSendEvent (xevent.xkey.display, xevent.xkey.window, True,
+                KeyPressMask, &xevent);
+
+    xevent.type = KeyRelease;
     xevent.xkey.type = KeyRelease;
     XSendEvent (xevent.xkey.display, xevent.xkey.window, True,
                 KeyReleaseMask, &xevent);
-    XSync (xevent.xkey.display, False);
-
+    /* Both events are in order on the connection and flushed at once. */
+    XFlush (xevent.xkey.display);
+    gdk_x11_display_error_trap_pop_ignored (gdk_display_get_default ());
+    window->priv->n_events_injected++;
+
+#ifdef DEBUG
+    g_debug ("send_key_event: %u round trips",
+             window->priv->send_event_round_trips);
+    window->priv->send_event_round_trips = 0;
+#endif
     return TRUE;
 }
 
@@ -863,15 +1536,118 @@ on_button_send_clicked (GtkButton *button, gpointer data)
                    str, type, code, 0, state, &retval);
 }
 
+static gboolean
+config_registry_ref (InputPadGtkWindow *window)
+{
+    InputPadXKBConfigReg *xkb_config_reg;
+
+    if (window->priv->xkb_config_reg == NULL) {
+        xkb_config_reg =
+            input_pad_gdk_xkb_parse_config_registry (window,
+                                                     window->priv->xkb_key_list);
+        if (xkb_config_reg == NULL) {
+            return FALSE;
+        }
+        window->priv->xkb_config_reg = xkb_config_reg;
+        config_layouts_treeview_set (window, xkb_config_reg->layouts);
+        config_options_treeview_set (window, xkb_config_reg->option_groups);
+    }
+    window->priv->xkb_config_reg_ref++;
+    return TRUE;
+}
+
+/*
+ * The search indexes refer to the strings of the registry
+ * and they are destroyed with the registry.
+ */
 static void
-on_button_config_layouts_clicked (GtkButton *button, gpointer data)
+config_registry_unref (InputPadGtkWindow *window)
 {
-    GtkWidget *dlg = GTK_WIDGET (data);
-    GtkWidget *top_window = gtk_widget_get_toplevel (GTK_WIDGET (button));
+    g_return_if_fail (window->priv->xkb_config_reg_ref > 0);
+
+    if (--window->priv->xkb_config_reg_ref > 0) {
+        return;
+    }
+    gtk_tree_view_set_model (GTK_TREE_VIEW (window->priv->config_layouts_add_treeview),
+                             NULL);
+    gtk_tree_view_set_model (GTK_TREE_VIEW (window->priv->config_layouts_remove_treeview),
+                             NULL);
+    gtk_tree_view_set_model (GTK_TREE_VIEW (window->priv->config_options_treeview),
+                             NULL);
+    if (window->priv->config_options_active) {
+        g_hash_table_destroy (window->priv->config_options_active);
+        window->priv->config_options_active = NULL;
+    }
+    if (window->priv->config_layouts_index) {
+        g_ptr_array_free (window->priv->config_layouts_index, TRUE);
+        window->priv->config_layouts_index = NULL;
+    }
+    if (window->priv->config_options_index) {
+        g_ptr_array_free (window->priv->config_options_index, TRUE);
+        window->priv->config_options_index = NULL;
+    }
+    input_pad_gdk_xkb_destroy_config_registry (window->priv->xkb_config_reg);
+    window->priv->xkb_config_reg = NULL;
+    /* The search handlers do nothing without the registry. */
+    gtk_entry_set_text (GTK_ENTRY (window->priv->config_layouts_search_entry),
+                        "");
+    gtk_entry_set_text (GTK_ENTRY (window->priv->config_options_search_entry),
+                        "");
+}
+
+static void
+run_config_dialog (InputPadGtkWindow *window,
+                   GtkWidget         *dlg,
+                   GtkWidget         *button)
+{
+    GtkWidget *top_window = gtk_widget_get_toplevel (button);
 
+    if (!config_registry_ref (window)) {
+        return;
+    }
     gtk_window_set_transient_for (GTK_WINDOW (dlg), GTK_WINDOW (top_window));
     gtk_dialog_run (GTK_DIALOG (dlg));
     gtk_widget_hide (dlg);
+    config_registry_unref (window);
+    if (window->priv->xkb_config_reg_ref == 0 &&
+        window->priv->config_dialogs_disuse_id == 0) {
+        window->priv->config_dialogs_disuse_id =
+            g_timeout_add_seconds (DIALOG_DISUSE_TIMEOUT,
+                                   on_config_dialogs_disuse_timeout,
+                                   window);
+    }
+}
+
+static void
+on_button_config_layouts_clicked (GtkButton *button, gpointer data)
+{
+    InputPadGtkWindow *window;
+
+    g_return_if_fail (data != NULL &&
+                      INPUT_PAD_IS_GTK_WINDOW (data));
+
+    window = INPUT_PAD_GTK_WINDOW (data);
+    if (!config_dialogs_ensure (window)) {
+        return;
+    }
+    run_config_dialog (window, window->priv->config_layouts_dialog,
+                       GTK_WIDGET (button));
+}
+
+static void
+on_button_config_options_clicked (GtkButton *button, gpointer data)
+{
+    InputPadGtkWindow *window;
+
+    g_return_if_fail (data != NULL &&
+                      INPUT_PAD_IS_GTK_WINDOW (data));
+
+    window = INPUT_PAD_GTK_WINDOW (data);
+    if (!config_dialogs_ensure (window)) {
+        return;
+    }
+    run_config_dialog (window, window->priv->config_options_dialog,
+                       GTK_WIDGET (button));
 }
 
 static void
@@ -898,6 +1674,7 @@ on_button_config_layouts_add_clicked (GtkButton *button, gpointer data)
     gchar *layout_desc = NULL;
     gchar *variant_name = NULL;
     gchar *variant_desc = NULL;
+    gboolean sensitive = FALSE;
 
     g_return_if_fail (data != NULL &&
                       INPUT_PAD_IS_GTK_WINDOW (data));
@@ -923,9 +1700,24 @@ on_button_config_layouts_add_clicked (GtkButton *button, gpointer data)
                         &variant_name,
                         LAYOUT_VARIANT_DESC_COL,
                         &variant_desc,
+                        LAYOUT_SENSITIVE_COL,
+                        &sensitive,
                         -1);
-    config_layouts_list_remove_iter (GTK_LIST_STORE (add_model), &iter);
-    config_layouts_list_append_layout (GTK_LIST_STORE (remove_model),
+    if (layout_name == NULL || !sensitive) {
+        g_free (layout_name);
+        g_free (layout_desc);
+        g_free (variant_name);
+        g_free (variant_desc);
+        return;
+    }
+    /* Keep the layout row for the variants. */
+    if (gtk_tree_model_iter_has_child (add_model, &iter)) {
+        gtk_tree_store_set (GTK_TREE_STORE (add_model), &iter,
+                            LAYOUT_SENSITIVE_COL, FALSE, -1);
+    } else {
+        config_layouts_list_remove_iter (GTK_TREE_STORE (add_model), &iter);
+    }
+    config_layouts_list_append_layout (GTK_TREE_STORE (remove_model), NULL,
                                        layout_name, layout_desc,
                                        variant_name, variant_desc);
     gtk_tree_store_append (GTK_TREE_STORE (combo_model), &iter, NULL);
@@ -1012,10 +1804,9 @@ on_button_config_layouts_remove_clicked (GtkButton *button, gpointer data)
     }
 
     if (!is_default_layout) {
-        config_layouts_list_remove_iter (GTK_LIST_STORE (remove_model), &iter);
-        config_layouts_list_append_layout (GTK_LIST_STORE (add_model),
-                                           layout_name, layout_desc,
-                                           variant_name, variant_desc);
+        config_layouts_list_remove_iter (GTK_TREE_STORE (remove_model), &iter);
+        config_layouts_add_list_restore (window, GTK_TREE_STORE (add_model),
+                                         layout_name, variant_name);
         config_layouts_combobox_remove_layout (GTK_TREE_STORE (combo_model),
                                                layout_name, layout_desc,
                                                variant_name, variant_desc);
@@ -1031,16 +1822,11 @@ static void
 on_button_config_options_close_clicked (GtkButton *button, gpointer data)
 {
     InputPadGtkWindow *window;
-    GList *orig_list, *orig_list_button;
-    GList *list = NULL;
-    GList *list_button = NULL;
-    GtkWidget *expander;
-    GtkWidget *vbox;
-    GtkWidget *checkbutton;
+    InputPadXKBOptionGroupList *groups = NULL;
+    InputPadXKBOptionList *options;
     GtkWidget *combobox;
     GtkTreeIter iter;
     GtkTreeModel *model;
-    const gchar *text;
     gchar *layout = NULL;
     gchar *variant = NULL;
     gchar *option = NULL;
@@ -1052,37 +1838,24 @@ on_button_config_options_close_clicked (GtkButton *button, gpointer data)
 
     gtk_widget_hide (window->priv->config_options_dialog);
 
-    list = gtk_container_get_children (GTK_CONTAINER (window->priv->config_options_vbox));
-    orig_list = list;
-    while (list) {
-        GList *tmp_list;
-
-        expander = GTK_WIDGET (list->data);
-
-        tmp_list = gtk_container_get_children (GTK_CONTAINER (expander));
-        vbox = GTK_WIDGET (tmp_list->data);
-        g_list_free (tmp_list);
-
-        list_button = gtk_container_get_children (GTK_CONTAINER (vbox));
-        orig_list_button = list_button;
-        while (list_button) {
-            checkbutton = GTK_WIDGET (list_button->data);
-            text = (gchar *) g_object_get_data (G_OBJECT (checkbutton), "option");
-            if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (checkbutton))) {
-                if (option == NULL) {
-                    option = g_strdup (text);
-                } else {
-                    gchar *p = g_strdup_printf ("%s,%s", option, text);
-                    g_free (option);
-                    option = p;
-                }
+    if (window->priv->xkb_config_reg && window->priv->config_options_active) {
+        groups = window->priv->xkb_config_reg->option_groups;
+    }
+    for (; groups; groups = groups->next) {
+        for (options = groups->options; options; options = options->next) {
+            if (!g_hash_table_contains (window->priv->config_options_active,
+                                        options->option)) {
+                continue;
+            }
+            if (option == NULL) {
+                option = g_strdup (options->option);
+            } else {
+                gchar *p = g_strdup_printf ("%s,%s", option, options->option);
+                g_free (option);
+                option = p;
             }
-            list_button = list_button->next;
         }
-        g_list_free (orig_list_button);
-        list = list->next;
     }
-    g_list_free (orig_list);
 
     combobox = window->priv->config_layouts_combobox;
     if (!gtk_combo_box_get_active_iter (GTK_COMBO_BOX (combobox), &iter)) {
@@ -1106,59 +1879,186 @@ on_button_config_options_close_clicked (GtkButton *button, gpointer data)
 }
 
 static void
-on_button_pressed (GtkButton *button, gpointer data)
+press_trace_begin (InputPadGtkWindow *window, InputPadTableType type)
 {
-    InputPadGtkWindow *window;
-    InputPadGtkButton *ibutton;
-    InputPadTableType  type;
-    const char *str;
-    const char *rawtext;
-    char *command_output = NULL;
-    guint keycode;
-    guint keysym;
-    guint **keysyms;
-    guint group;
-    guint state = 0;
-    gboolean retval = FALSE;
+    PressTrace *trace = &window->priv->press_trace;
 
-    g_return_if_fail (INPUT_PAD_IS_GTK_BUTTON (button));
-    g_return_if_fail (data != NULL &&
-                      INPUT_PAD_IS_GTK_WINDOW (data));
+    memset (trace, 0, sizeof (PressTrace));
+    trace->type = type;
+    trace->start = g_get_monotonic_time ();
+}
 
-    window = INPUT_PAD_GTK_WINDOW (data);
-    ibutton = INPUT_PAD_GTK_BUTTON (button);
-    str = input_pad_gtk_button_get_label (ibutton);
-    rawtext = input_pad_gtk_button_get_rawtext (ibutton);
-    type = input_pad_gtk_button_get_table_type (ibutton);
-    keycode  = input_pad_gtk_button_get_keycode (ibutton);
-    keysym = input_pad_gtk_button_get_keysym (ibutton);
-    keysyms = input_pad_gtk_button_get_all_keysyms (ibutton);
-    group = input_pad_gtk_button_get_keysym_group (ibutton);
-    state = window->priv->keyboard_state;
-    if (!g_strcmp0 (str, " ") &&
-        keysym == (guint) '\t' && keycode == 0 && keysyms == NULL) {
-        str = "\t";
-        keysym = 0;
-    } else if (type == INPUT_PAD_TABLE_TYPE_COMMANDS) {
-        run_command (rawtext, &command_output);
-        if (command_output == NULL) {
-            return;
+static void
+press_trace_record (InputPadGtkWindow *window,
+                    InputPadTableType  type,
+                    PressStage         stage,
+                    gint64             usec)
+{
+    InputPadProfileHistogram **histogramp;
+
+    if (type > INPUT_PAD_TABLE_TYPE_COMMANDS) {
+        type = INPUT_PAD_TABLE_TYPE_NONE;
+    }
+    histogramp = &window->priv->press_histograms[type][stage];
+    if (*histogramp == NULL) {
+        *histogramp = input_pad_profile_histogram_new (PRESS_HISTOGRAM_PERIOD);
+    }
+    input_pad_profile_histogram_record (*histogramp, usec);
+}
+
+static gboolean
+press_trace_has_stage (PressTrace *trace, PressStage stage)
+{
+    switch (stage) {
+    case PRESS_STAGE_PREPARE:
+    case PRESS_STAGE_TOTAL:
+        return TRUE;
+    case PRESS_STAGE_HANDLERS:
+        return trace->emit != 0 && !trace->queued;
+    case PRESS_STAGE_ENQUEUE:
+        return trace->emit != 0 && trace->queued;
+    case PRESS_STAGE_DEFAULT:
+        return trace->emit != 0 && trace->default_start != 0;
+    case PRESS_STAGE_X_SERVER:
+        return trace->emit != 0 && !trace->queued && log_slow_press > 0;
+    default:;
+    }
+    return FALSE;
+}
+
+static void
+press_trace_log (PressTrace   *trace,
+                 const gchar  *str,
+                 gint64        stages[N_PRESS_STAGES])
+{
+    GString *message;
+    gint64 prev;
+    guint i;
+    int j;
+
+    message = g_string_new (NULL);
+    g_string_append_printf (message, "Slow press \"%s\" (%s):",
+                            str ? str : "",
+                            table_type_names[trace->type <= INPUT_PAD_TABLE_TYPE_COMMANDS ? trace->type : 0]);
+    for (j = 0; j < N_PRESS_STAGES; j++) {
+        if (!press_trace_has_stage (trace, j)) {
+            continue;
         }
-        str = command_output;
-    } else if (rawtext) {
-        str = rawtext;
+        g_string_append_printf (message, " %s %.3f ms,",
+                                press_stage_names[j], stages[j] / 1000.);
     }
-    if (keysyms && (keysym != keysyms[group][0])) {
-        state |= ShiftMask;
+    prev = trace->emit;
+    for (i = 0; i < trace->n_handlers; i++) {
+        if (trace->default_start && trace->handler_end[i] > trace->default_start) {
+            break;
+        }
+        g_string_append_printf (message, " handler #%u %.3f ms,",
+                                i, (trace->handler_end[i] - prev) / 1000.);
+        prev = trace->handler_end[i];
+    }
+    g_string_truncate (message, message->len - 1);
+    g_message ("%s", message->str);
+    g_string_free (message, TRUE);
+}
+
+/* Records the stages of the last press when it is committed.
+ * The bucket i of the stats counts the latencies in [2^i, 2^(i+1)) usec. */
+static void
+press_trace_end (InputPadGtkWindow *window, const gchar *str)
+{
+    PressTrace *trace = &window->priv->press_trace;
+    gint64 stages[N_PRESS_STAGES] = { 0, };
+    gint64 now;
+    gint64 usec;
+    GdkDisplay *display;
+    guint i = 0;
+    int j;
+
+    if (trace->start == 0) {
+        return;
+    }
+    now = g_get_monotonic_time ();
+    if (trace->emit == 0) {
+        stages[PRESS_STAGE_PREPARE] = now - trace->start;
+    } else {
+        stages[PRESS_STAGE_PREPARE] = trace->emit - trace->start;
+        if (trace->default_start) {
+            stages[PRESS_STAGE_HANDLERS] = trace->default_start - trace->emit;
+            stages[PRESS_STAGE_DEFAULT] = trace->end - trace->default_start;
+        } else if (trace->queued) {
+            stages[PRESS_STAGE_ENQUEUE] = trace->end - trace->emit;
+        } else {
+            stages[PRESS_STAGE_HANDLERS] = trace->end - trace->emit;
+        }
+        /* The round trip waits for the X server to process the events.
+         * The XTest worker sends them on another display. */
+        display = gtk_widget_get_display (GTK_WIDGET (window));
+        if (press_trace_has_stage (trace, PRESS_STAGE_X_SERVER) &&
+            GDK_IS_X11_DISPLAY (display)) {
+            XSync (GDK_DISPLAY_XDISPLAY (display), False);
+            now = g_get_monotonic_time ();
+            stages[PRESS_STAGE_X_SERVER] = now - trace->end;
+        }
+    }
+    stages[PRESS_STAGE_TOTAL] = now - trace->start;
+
+    for (j = 0; j < N_PRESS_STAGES; j++) {
+        if (!press_trace_has_stage (trace, j)) {
+            continue;
+        }
+        press_trace_record (window, trace->type, j, stages[j]);
+    }
+
+    usec = stages[PRESS_STAGE_TOTAL];
+    while (usec >= 2 && i < INPUT_PAD_WINDOW_STATS_N_LATENCY_BUCKETS - 1) {
+        usec >>= 1;
+        i++;
+    }
+    window->priv->press_latency_buckets[i]++;
+    window->priv->n_presses++;
+
+    if (log_slow_press > 0 &&
+        stages[PRESS_STAGE_TOTAL] >= (gint64) log_slow_press * 1000) {
+        press_trace_log (trace, str, stages);
     }
+    trace->start = 0;
+}
+
+static void
+emit_button_pressed (InputPadGtkWindow     *window,
+                     const char            *str,
+                     InputPadTableType      type,
+                     guint                  keysym,
+                     guint                  keycode,
+                     guint                  state,
+                     guint                  group)
+{
+    gboolean retval = FALSE;
+    PressTrace *trace = &window->priv->press_trace;
+
     state = input_pad_xkb_build_core_state (state, group);
 
+    if (trace->start) {
+        trace->emit = g_get_monotonic_time ();
+        current_press_trace = trace;
+    }
     g_signal_emit (window, signals[BUTTON_PRESSED], 0,
                    str, type, keysym, keycode, state, &retval);
-
-    if (type == INPUT_PAD_TABLE_TYPE_COMMANDS) {
-        g_free (command_output);
+    if (trace->start) {
+        trace->end = g_get_monotonic_time ();
+        current_press_trace = NULL;
+    }
+    /* The handler of a module, e.g. XTest, sent the event. */
+    if (retval) {
+        window->priv->n_events_injected++;
+#ifdef MODULE_XTEST_GDK_BASE
+        if (trace->start && use_module_xtest) {
+            trace->queued = TRUE;
+        }
+#endif
     }
+    press_trace_end (window, str);
+
     if (state & ShiftMask) {
         state ^= ShiftMask;
     }
@@ -1174,46 +2074,470 @@ on_button_pressed (GtkButton *button, gpointer data)
 }
 
 static void
-on_button_pressed_repeat (InputPadGtkButton *button, gpointer data)
+paste_key_table_init (void)
 {
-    guint keysym;
+    const gchar **keys[2];
+    gchar **pair;
+    guint keyval;
+    GdkModifierType mods;
+    int i, j;
 
-    g_return_if_fail (INPUT_PAD_IS_GTK_BUTTON (button));
+    paste_key_table = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free, g_free);
+    /* The options override the default keys. */
+    keys[0] = paste_default_keys;
+    keys[1] = (const gchar **) paste_keys;
+    for (i = 0; i < G_N_ELEMENTS (keys); i++) {
+        for (j = 0; keys[i] && keys[i][j]; j++) {
+            pair = g_strsplit (keys[i][j], "=", 2);
+            if (pair[0] == NULL || pair[1] == NULL) {
+                g_warning ("Invalid paste key: %s", keys[i][j]);
+                g_strfreev (pair);
+                continue;
+            }
+            gtk_accelerator_parse (pair[1], &keyval, &mods);
+            if (keyval == 0) {
+                g_warning ("Invalid paste key: %s", keys[i][j]);
+            } else {
+                g_hash_table_replace (paste_key_table,
+                                      g_strdup (pair[0]),
+                                      g_strdup (pair[1]));
+            }
+            g_strfreev (pair);
+        }
+    }
+}
 
-    keysym = input_pad_gtk_button_get_keysym (button);
-    if ((keysym == XK_Control_L) || (keysym == XK_Control_R) ||
-        (keysym == XK_Alt_L) || (keysym == XK_Alt_L) ||
-        (keysym == XK_Shift_L) || (keysym == XK_Shift_R) ||
-        (keysym == XK_Num_Lock) ||
-        FALSE) {
-        return;
+/*
+ * The focused window could be the child of the window with WM_CLASS.
+ * The class is looked up again only when the cached focus changes.
+ */
+static const gchar *
+get_focus_window_class (InputPadGtkWindow *window)
+{
+    Display *display;
+    Window focus, root, parent, *children = NULL;
+    unsigned int n_children;
+    XClassHint hint;
+    gchar *class_name = NULL;
+
+    focus = send_event_get_focus (window);
+    if (focus == window->priv->focus_class_window &&
+        window->priv->focus_class_name != NULL) {
+        return window->priv->focus_class_name;
+    }
+    g_free (window->priv->focus_class_name);
+    window->priv->focus_class_name = NULL;
+    window->priv->focus_class_window = focus;
+    display = GDK_WINDOW_XDISPLAY (gtk_widget_get_window (GTK_WIDGET (window)));
+    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    while (focus != None && focus != PointerRoot) {
+        if (XGetClassHint (display, focus, &hint)) {
+            class_name = g_strdup (hint.res_class);
+            XFree (hint.res_name);
+            XFree (hint.res_class);
+            break;
+        }
+        if (!XQueryTree (display, focus, &root, &parent,
+                         &children, &n_children)) {
+            break;
+        }
+        if (children) {
+            XFree (children);
+        }
+        if (parent == root) {
+            break;
+        }
+        focus = parent;
     }
-    on_button_pressed (GTK_BUTTON (button), data);
+    gdk_x11_display_error_trap_pop_ignored (gdk_display_get_default ());
+    window->priv->focus_class_name = class_name;
+    return class_name;
+}
+
+static GtkClipboard *
+paste_get_clipboard (InputPadGtkWindow *window, int i)
+{
+    return gtk_widget_get_clipboard (GTK_WIDGET (window),
+                                     i == 0 ? GDK_SELECTION_CLIPBOARD :
+                                         GDK_SELECTION_PRIMARY);
+}
+
+static int
+paste_get_clipboard_index (InputPadGtkWindow *window, GtkClipboard *clipboard)
+{
+    return (clipboard == paste_get_clipboard (window, 0)) ? 0 : 1;
 }
 
+/*
+ * The window keeps the selections with the previous texts after
+ * the paste and the selections without the previous texts are
+ * cleared.
+ */
 static void
-on_button_layout_arrow_pressed (GtkButton *button, gpointer data)
+paste_restore (InputPadGtkWindow *window)
 {
-    KeyboardLayoutPart *table_data = (KeyboardLayoutPart *) data;
+    GtkClipboard *clipboard;
     int i;
-    int reduced_width = 0;
-    int width, height;
-    const gchar *prev_label;
-    gboolean extend = FALSE;
-    GtkWidget *toplevel;
 
-    prev_label = gtk_button_get_label (button);
-    if (!g_strcmp0 (prev_label, "->")) {
-        extend = TRUE;
-    } else {
-        extend = FALSE;
+    window->priv->paste_pending = FALSE;
+    g_free (window->priv->paste_text);
+    window->priv->paste_text = NULL;
+    for (i = 0; i < G_N_ELEMENTS (window->priv->paste_saved_texts); i++) {
+        clipboard = paste_get_clipboard (window, i);
+        if (window->priv->paste_saved_texts[i] == NULL &&
+            gtk_clipboard_get_owner (clipboard) == G_OBJECT (window)) {
+            gtk_clipboard_clear (clipboard);
+        }
     }
-    for (i = 1; i < N_KEYBOARD_LAYOUT_PART; i++) {
-        if (extend) {
-            gtk_widget_show (table_data[i].table);
-            gtk_button_set_label (button, "<-");
-            gtk_widget_set_tooltip_text (GTK_WIDGET (button),
-                                         _("Fold layout"));
+}
+
+static gboolean
+on_paste_restore_timeout (gpointer data)
+{
+    InputPadGtkWindow *window = INPUT_PAD_GTK_WINDOW (data);
+
+    window->priv->paste_restore_id = 0;
+    paste_restore (window);
+    return FALSE;
+}
+
+static void
+paste_selection_get (GtkClipboard      *clipboard,
+                     GtkSelectionData  *selection_data,
+                     guint              info,
+                     gpointer           data)
+{
+    InputPadGtkWindow *window = INPUT_PAD_GTK_WINDOW (data);
+    int i;
+
+    if (window->priv == NULL) {
+        return;
+    }
+    i = paste_get_clipboard_index (window, clipboard);
+    if (window->priv->paste_pending) {
+        gtk_selection_data_set_text (selection_data,
+                                     window->priv->paste_text
+                                         ? window->priv->paste_text : "",
+                                     -1);
+        /* The target got the text so the previous texts are restored. */
+        if (window->priv->paste_restore_id != 0) {
+            g_source_remove (window->priv->paste_restore_id);
+        }
+        window->priv->paste_restore_id =
+            g_timeout_add (PASTE_RESTORE_DELAY, on_paste_restore_timeout,
+                           window);
+    } else if (window->priv->paste_saved_texts[i]) {
+        gtk_selection_data_set_text (selection_data,
+                                     window->priv->paste_saved_texts[i], -1);
+    }
+}
+
+/* Another application owns the selection. */
+static void
+paste_selection_clear (GtkClipboard *clipboard,
+                       gpointer      data)
+{
+    InputPadGtkWindow *window = INPUT_PAD_GTK_WINDOW (data);
+    int i;
+
+    if (window->priv == NULL || window->priv->paste_setting) {
+        return;
+    }
+    i = paste_get_clipboard_index (window, clipboard);
+    g_free (window->priv->paste_saved_texts[i]);
+    window->priv->paste_saved_texts[i] = NULL;
+}
+
+static void
+paste_send_key (InputPadGtkWindow *window)
+{
+    GtkTargetList *list;
+    GtkTargetEntry *targets;
+    const gchar *class_name;
+    const gchar *accel = NULL;
+    guint keyval = 0;
+    guint keycode = 0;
+    guint mods = 0;
+    GdkModifierType accel_mods = 0;
+    int n_targets, i;
+
+    list = gtk_target_list_new (NULL, 0);
+    gtk_target_list_add_text_targets (list, 0);
+    targets = gtk_target_table_new_from_list (list, &n_targets);
+    window->priv->paste_setting = TRUE;
+    for (i = 0; i < G_N_ELEMENTS (window->priv->paste_saved_texts); i++) {
+        gtk_clipboard_set_with_owner (paste_get_clipboard (window, i),
+                                      targets, n_targets,
+                                      paste_selection_get,
+                                      paste_selection_clear,
+                                      G_OBJECT (window));
+    }
+    window->priv->paste_setting = FALSE;
+    window->priv->paste_pending = TRUE;
+    gtk_target_table_free (targets, n_targets);
+    gtk_target_list_unref (list);
+    /* The paste key could be sent from another X connection. */
+    gdk_display_sync (gtk_widget_get_display (GTK_WIDGET (window)));
+
+    if (paste_key_table == NULL) {
+        paste_key_table_init ();
+    }
+    class_name = get_focus_window_class (window);
+    if (class_name) {
+        accel = g_hash_table_lookup (paste_key_table, class_name);
+    }
+    gtk_accelerator_parse (accel ? accel : PASTE_DEFAULT_KEY,
+                           &keyval, &accel_mods);
+    input_pad_gdk_xkb_lookup_keysym (window->priv->xkb_key_list,
+                                     keyval,
+                                     window->priv->keyboard_level_state.group,
+                                     &keycode, &mods);
+    emit_button_pressed (window, "", INPUT_PAD_TABLE_TYPE_KEYSYMS,
+                         keyval, keycode, (guint) accel_mods | mods,
+                         window->priv->keyboard_level_state.group);
+}
+
+static void
+on_paste_text_received (GtkClipboard  *clipboard,
+                        const gchar   *text,
+                        gpointer       data)
+{
+    InputPadGtkWindow *window = INPUT_PAD_GTK_WINDOW (data);
+
+    if (window->priv == NULL) {
+        g_object_unref (window);
+        return;
+    }
+    if (clipboard == paste_get_clipboard (window, 0)) {
+        g_free (window->priv->paste_saved_texts[0]);
+        window->priv->paste_saved_texts[0] = g_strdup (text);
+        gtk_clipboard_request_text (paste_get_clipboard (window, 1),
+                                    on_paste_text_received,
+                                    window);
+        return;
+    }
+    g_free (window->priv->paste_saved_texts[1]);
+    window->priv->paste_saved_texts[1] = g_strdup (text);
+    window->priv->paste_requested = FALSE;
+    paste_send_key (window);
+    g_object_unref (window);
+}
+
+/*
+ * The long string is put on the CLIPBOARD and PRIMARY selections
+ * and one paste key is sent instead of the key events of
+ * every character.
+ */
+static void
+commit_paste (InputPadGtkWindow *window, const gchar *str)
+{
+    gchar *text;
+
+    if (INPUT_PAD_TRACE_ENABLED (paste_commit)) {
+        INPUT_PAD_TRACE1 (paste_commit, strlen (str));
+    }
+    press_trace_end (window, str);
+
+    /* The strings pressed while the previous texts are requested
+     * are pasted together with one paste key. */
+    if (window->priv->paste_requested) {
+        text = g_strconcat (window->priv->paste_text, str, NULL);
+        g_free (window->priv->paste_text);
+        window->priv->paste_text = text;
+        return;
+    }
+    g_free (window->priv->paste_text);
+    window->priv->paste_text = g_strdup (str);
+
+    /* The previous texts are already saved during the last paste. */
+    if (window->priv->paste_pending) {
+        paste_send_key (window);
+        return;
+    }
+    window->priv->paste_requested = TRUE;
+    gtk_clipboard_request_text (paste_get_clipboard (window, 0),
+                                on_paste_text_received,
+                                g_object_ref (window));
+}
+
+/*
+ * The characters on the current layout can be sent as the real key
+ * events. The keycode and modifiers are looked up without
+ * any server requests.
+ */
+static gboolean
+lookup_keysym_on_layout (InputPadGtkWindow     *window,
+                         const char            *str,
+                         guint                 *keysymp,
+                         guint                 *keycodep,
+                         guint                 *statep)
+{
+    guint keysym = *keysymp;
+    guint keycode = 0;
+    guint mods = 0;
+
+    if (keysym == 0 && str && *str && g_utf8_strlen (str, -1) == 1) {
+        keysym = gdk_unicode_to_keyval (g_utf8_get_char (str));
+    }
+    if (!input_pad_gdk_xkb_lookup_keysym (window->priv->xkb_key_list,
+                                          keysym,
+                                          window->priv->keyboard_level_state.group,
+                                          &keycode, &mods)) {
+        return FALSE;
+    }
+    *keysymp = keysym;
+    *keycodep = keycode;
+    /* The level of the key replaces the level of the pad so that
+     * the pad's Shift does not change the character. */
+    *statep = (*statep & ~(ShiftMask | LockMask | Mod5Mask)) | mods;
+    return TRUE;
+}
+
+static void
+on_button_pressed (GtkButton *button, gpointer data)
+{
+    InputPadGtkWindow *window;
+    InputPadGtkButton *ibutton;
+    InputPadTableType  type;
+    const char *str;
+    const char *rawtext;
+    guint keycode;
+    guint keysym;
+    guint **keysyms;
+    guint group;
+    guint state = 0;
+
+    g_return_if_fail (INPUT_PAD_IS_GTK_BUTTON (button));
+    g_return_if_fail (data != NULL &&
+                      INPUT_PAD_IS_GTK_WINDOW (data));
+
+    window = INPUT_PAD_GTK_WINDOW (data);
+    ibutton = INPUT_PAD_GTK_BUTTON (button);
+    str = input_pad_gtk_button_get_label (ibutton);
+    rawtext = input_pad_gtk_button_get_rawtext (ibutton);
+    type = input_pad_gtk_button_get_table_type (ibutton);
+    press_trace_begin (window, type);
+    keycode  = input_pad_gtk_button_get_keycode (ibutton);
+    keysym = input_pad_gtk_button_get_keysym (ibutton);
+    keysyms = input_pad_gtk_button_get_all_keysyms (ibutton);
+    group = input_pad_gtk_button_get_keysym_group (ibutton);
+    state = window->priv->keyboard_state;
+    if (!g_strcmp0 (str, " ") &&
+        keysym == (guint) '\t' && keycode == 0 && keysyms == NULL) {
+        str = "\t";
+        keysym = 0;
+    } else if (type == INPUT_PAD_TABLE_TYPE_COMMANDS) {
+        /* The output is committed when the command exits. */
+        run_command (window, GTK_WIDGET (button), rawtext, state, group);
+        return;
+    } else if (rawtext) {
+        str = rawtext;
+    }
+    if (keysyms && (keysym != keysyms[group][0])) {
+        state |= ShiftMask;
+    }
+    if (window->priv->paste_threshold >= 0 && str && keycode == 0 &&
+        (type == INPUT_PAD_TABLE_TYPE_STRINGS ||
+         (type == INPUT_PAD_TABLE_TYPE_CHARS && keysym == 0)) &&
+        g_utf8_strlen (str, -1) >= window->priv->paste_threshold) {
+        commit_paste (window, str);
+        return;
+    }
+    if (window->priv->layout_keys && keycode == 0 &&
+        (type == INPUT_PAD_TABLE_TYPE_CHARS ||
+         type == INPUT_PAD_TABLE_TYPE_KEYSYMS) &&
+        lookup_keysym_on_layout (window, str, &keysym, &keycode, &state)) {
+        group = window->priv->keyboard_level_state.group;
+    }
+    emit_button_pressed (window, str, type, keysym, keycode, state, group);
+}
+
+static void
+on_keyboard_key_pressed (InputPadGtkKeyboard   *keyboard,
+                         const gchar           *label,
+                         guint                  keysym,
+                         guint                  keycode,
+                         guint                  base_keysym,
+                         gpointer               data)
+{
+    InputPadGtkWindow *window;
+    guint state;
+
+    g_return_if_fail (data != NULL &&
+                      INPUT_PAD_IS_GTK_WINDOW (data));
+
+    window = INPUT_PAD_GTK_WINDOW (data);
+    press_trace_begin (window, INPUT_PAD_TABLE_TYPE_KEYSYMS);
+    state = window->priv->keyboard_state;
+    if (keysym != base_keysym) {
+        state |= ShiftMask;
+    }
+    emit_button_pressed (window, label, INPUT_PAD_TABLE_TYPE_KEYSYMS,
+                         keysym, keycode, state,
+                         window->priv->keyboard_level_state.group);
+
+    switch (base_keysym) {
+    case XK_Shift_L:
+    case XK_Shift_R:
+        on_button_shift_clicked (NULL, window);
+        break;
+    case XK_Control_L:
+    case XK_Control_R:
+        on_button_ctrl_clicked (NULL, window);
+        break;
+    case XK_Alt_L:
+    case XK_Alt_R:
+        on_button_alt_clicked (NULL, window);
+        break;
+    case XK_Num_Lock:
+        on_button_num_lock_clicked (NULL, window);
+        break;
+    default:;
+    }
+}
+
+static void
+on_button_pressed_repeat (InputPadGtkButton *button, gpointer data)
+{
+    guint keysym;
+
+    g_return_if_fail (INPUT_PAD_IS_GTK_BUTTON (button));
+
+    keysym = input_pad_gtk_button_get_keysym (button);
+    if ((keysym == XK_Control_L) || (keysym == XK_Control_R) ||
+        (keysym == XK_Alt_L) || (keysym == XK_Alt_L) ||
+        (keysym == XK_Shift_L) || (keysym == XK_Shift_R) ||
+        (keysym == XK_Num_Lock) ||
+        FALSE) {
+        return;
+    }
+    on_button_pressed (GTK_BUTTON (button), data);
+}
+
+static void
+on_button_layout_arrow_pressed (GtkButton *button, gpointer data)
+{
+    KeyboardLayoutPart *table_data = (KeyboardLayoutPart *) data;
+    int i;
+    int reduced_width = 0;
+    int width, height;
+    const gchar *prev_label;
+    gboolean extend = FALSE;
+    GtkWidget *toplevel;
+
+    prev_label = gtk_button_get_label (button);
+    if (!g_strcmp0 (prev_label, "->")) {
+        extend = TRUE;
+    } else {
+        extend = FALSE;
+    }
+    for (i = 1; i < N_KEYBOARD_LAYOUT_PART; i++) {
+        if (extend) {
+            gtk_widget_show (table_data[i].table);
+            gtk_button_set_label (button, "<-");
+            gtk_widget_set_tooltip_text (GTK_WIDGET (button),
+                                         _("Fold layout"));
         } else {
             gtk_widget_hide (table_data[i].table);
             gtk_button_set_label (button, "->");
@@ -1235,35 +2559,6 @@ on_button_layout_arrow_pressed (GtkButton *button, gpointer data)
     }
 }
 
-static void
-on_checkbutton_config_options_option_clicked (GtkButton *button, gpointer data)
-{
-    GtkWidget *expander;
-    GtkWidget *label;
-    int checked;
-    gchar *text;
-
-    g_return_if_fail (GTK_IS_EXPANDER (data));
-    expander = GTK_WIDGET (data);
-    label = gtk_expander_get_label_widget (GTK_EXPANDER (expander));
-    checked = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (expander), "checked"));
-    if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (button))) {
-        text = g_strdup_printf ("<b>%s</b>",
-                                gtk_label_get_text (GTK_LABEL (label)));
-        gtk_label_set_markup (GTK_LABEL (label), text);
-        checked++;
-    } else {
-        checked--;
-        if (checked <= 0) {
-            text = g_strdup (gtk_label_get_text (GTK_LABEL (label)));
-            gtk_label_set_text (GTK_LABEL (label), text);
-            g_free (text);
-        }
-    }
-    g_object_set_data (G_OBJECT (expander), "checked",
-                       GINT_TO_POINTER (checked));
-}
-
 static void
 on_combobox_changed (GtkComboBox *combobox, gpointer data)
 {
@@ -1368,8 +2663,10 @@ on_tree_view_select_custom_char_table (GtkTreeSelection     *selection,
     table = get_nth_pad_table (group->table, n);
     g_return_if_fail (table != NULL && table->priv != NULL);
     table->priv->signal_window = window;
+    INPUT_PAD_TRACE2 (table_switch_begin, table->type, table->name);
     destroy_custom_char_view_table (scrolled, window);
     append_custom_char_view_table (scrolled, table);
+    INPUT_PAD_TRACE2 (table_switch_end, table->type, table->name);
 }
 
 static void
@@ -1403,6 +2700,7 @@ on_window_realize (GtkWidget *window, gpointer data)
 {
     GtkWidget *keyboard_vbox;
     InputPadGtkWindow *input_pad;
+    InputPadProfileSpan *span;
 
     g_return_if_fail (INPUT_PAD_IS_GTK_WINDOW (window));
     g_return_if_fail (GTK_IS_WIDGET (data));
@@ -1410,13 +2708,17 @@ on_window_realize (GtkWidget *window, gpointer data)
     input_pad = INPUT_PAD_GTK_WINDOW (window);
     keyboard_vbox = GTK_WIDGET (data);
 
+    span = input_pad_profile_span_begin ("realize", NULL);
     input_pad->priv->xkb_key_list = 
         input_pad_gdk_xkb_parse_keyboard_layouts (input_pad);
     if (input_pad->priv->kbdui_name && input_pad->priv->xkb_key_list == NULL) {
+        input_pad_profile_span_end (span);
         return;
     }
 
     create_keyboard_layout_ui_real (keyboard_vbox, input_pad);
+    input_pad_gdk_xkb_setup_keymap_events (input_pad,
+                                           signals[KEYMAP_CHANGED]);
     input_pad->priv->group_layouts =
         input_pad_gdk_xkb_get_group_layouts (input_pad,
                                              input_pad->priv->xkb_key_list);
@@ -1426,16 +2728,20 @@ on_window_realize (GtkWidget *window, gpointer data)
     input_pad->priv->group_options =
         input_pad_gdk_xkb_get_group_options (input_pad,
                                              input_pad->priv->xkb_key_list);
-    input_pad->priv->xkb_config_reg =
-        input_pad_gdk_xkb_parse_config_registry (input_pad,
-                                                 input_pad->priv->xkb_key_list);
-    if (input_pad->priv->xkb_config_reg == NULL) {
+    input_pad->priv->xkb_group_config_reg =
+        input_pad_gdk_xkb_parse_group_config_registry (input_pad,
+                                                       input_pad->priv->xkb_key_list,
+                                                       input_pad->priv->group_layouts,
+                                                       input_pad->priv->group_variants);
+    if (input_pad->priv->xkb_group_config_reg == NULL) {
         input_pad_gdk_xkb_signal_emit (input_pad, signals[KBD_CHANGED]);
+        input_pad_profile_span_end (span);
         return;
     }
 
     create_keyboard_layout_list_ui_real (keyboard_vbox, input_pad);
     input_pad_gdk_xkb_signal_emit (input_pad, signals[KBD_CHANGED]);
+    input_pad_profile_span_end (span);
 }
 
 static void
@@ -1955,26 +3261,41 @@ command_table_get_label_array (InputPadTableCmd *cmds)
 }
 
 static void
-run_command (const gchar *command, gchar **command_output)
+command_plan_free (CommandPlan *plan)
+{
+    guint i;
+
+    if (plan == NULL) {
+        return;
+    }
+    for (i = 0; i < plan->n_slots; i++) {
+        g_free (plan->slots[i].prefix);
+        g_free (plan->slots[i].name);
+        g_free (plan->slots[i].suffix);
+    }
+    g_free (plan->slots);
+    g_clear_object (&plan->launcher);
+    g_strfreev (plan->argv);
+    g_strfreev (plan->envp);
+    g_slice_free (CommandPlan, plan);
+}
+
+static CommandPlan *
+command_plan_new (const gchar *command)
 {
     GError  *error;
+    CommandPlan *plan;
+    CommandSlot *slot;
     char   **argv;
-    char   **envp = NULL;
     char    *p;
     char    *end;
-    char    *name;
-    const char *value;
-    char    *extracted;
-    char    *new_arg;
-    char    *std_output = NULL;
-    char    *std_error = NULL;
-    int      i, n, exit_status;
+    int      i, n;
 
     error = NULL;
     if (!g_shell_parse_argv (command, NULL, &argv, &error)) {
         g_warning ("Could not parse command: %s", error->message);
         g_error_free (error);
-        return;
+        return NULL;
     }
     n = 0;
     for (i = 0; argv[i]; i++) {
@@ -1984,88 +3305,531 @@ run_command (const gchar *command, gchar **command_output)
             break;
         }
     }
+    if (argv[n] == NULL) {
+        g_warning ("Could not find the program in command: %s", command);
+        g_strfreev (argv);
+        return NULL;
+    }
+
+    plan = g_slice_new0 (CommandPlan);
     if (n > 0) {
-        envp = g_new0 (char *, n + 1);
+        plan->envp = g_new0 (char *, n + 1);
+        memcpy (plan->envp, argv, n * sizeof (char *));
+    }
+    plan->argc = g_strv_length (&argv[n]);
+    plan->argv = g_new0 (char *, plan->argc + 1);
+    memcpy (plan->argv, &argv[n], plan->argc * sizeof (char *));
+    /* The strings are owned by plan->envp and plan->argv. */
+    g_free (argv);
+
+    plan->slots = g_new0 (CommandSlot, plan->argc);
+    for (i = 0; plan->argv[i]; i++) {
+        if ((p = g_strstr_len (plan->argv[i], -1, "$")) == NULL ||
+            *(p + 1) == '\0') {
+            continue;
+        }
+        slot = &plan->slots[plan->n_slots++];
+        slot->arg = i;
+        slot->prefix = g_strndup (plan->argv[i], p - plan->argv[i]);
+        end = g_strstr_len (p + 1, -1, " ");
+        if (end) {
+            slot->name = g_strndup (p + 1, end - p - 1);
+            slot->suffix = g_strdup (end);
+        } else {
+            slot->name = g_strdup (p + 1);
+            slot->suffix = g_strdup ("");
+        }
     }
-    for (i = 0; i < n; i++) {
-        envp[i] = g_strdup (argv[i]);
+
+    plan->launcher =
+        g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                   G_SUBPROCESS_FLAGS_STDERR_PIPE);
+    /* The NAME=value in the command are the whole environment. */
+    if (plan->envp) {
+        g_subprocess_launcher_set_environ (plan->launcher, plan->envp);
     }
-    for (i = n; argv[i]; i++) {
-        if ((p = g_strstr_len (argv[i], -1, "$")) != NULL &&
-            *(p + 1) != '\0') {
-            end = g_strstr_len (p + 1, -1, " ");
-            if (end) {
-                name = g_strndup (p, end - p);
-            } else {
-                name = g_strdup (p);
-            }
-            value = g_getenv (name + 1);
-            g_free (name);
-            if (value != NULL) {
-                extracted = g_strdup (value);
-            } else {
-                extracted = g_strdup ("");
+    return plan;
+}
+
+/* The cache policy is the <cache> of the command in the pad files. */
+static void
+command_plan_set_cache (InputPadGtkWindow *window,
+                        CommandPlan       *plan,
+                        const gchar       *command)
+{
+    InputPadGroup *group;
+    InputPadTable *table;
+    int i;
+
+    for (group = window->priv->group; group; group = group->next) {
+        for (table = group->table; table; table = table->next) {
+            if (table->type != INPUT_PAD_TABLE_TYPE_COMMANDS ||
+                table->data.cmds == NULL ||
+                table->priv == NULL || table->priv->cmd_caches == NULL) {
+                continue;
             }
-            *p = '\0';
-            if (end) {
-                new_arg = g_strconcat (argv[i], extracted, end, NULL);
-            } else {
-                new_arg = g_strconcat (argv[i], extracted, NULL);
+            for (i = 0; table->data.cmds[i].execl; i++) {
+                if (!g_strcmp0 (table->data.cmds[i].execl, command)) {
+                    plan->cache = table->priv->cmd_caches[i];
+                    return;
+                }
             }
-            g_free (argv[i]);
-            argv[i] = new_arg;
         }
     }
-    error = NULL;
-    if (!g_spawn_sync (NULL,
-                       &argv[n],
-                       envp,
-                       G_SPAWN_SEARCH_PATH,
-                       NULL, NULL,
-                       &std_output, &std_error,
-                       &exit_status, &error)) {
-        g_warning ("Could not run the script %s: %s: %s",
-                   command,
-                   error->message,
-                   std_error ? std_error : "");
-        g_error_free (error);
-        g_strfreev (argv);
-        return;
+}
+
+static CommandPlan *
+command_plan_lookup (InputPadGtkWindow *window, const gchar *command)
+{
+    CommandPlan *plan;
+
+    if (window->priv->command_plans == NULL) {
+        window->priv->command_plans =
+            g_hash_table_new_full (g_str_hash, g_str_equal,
+                                   g_free,
+                                   (GDestroyNotify) command_plan_free);
     }
-    g_strfreev (argv);
-    g_strfreev (envp);
-    if (exit_status != 0) {
-        g_warning ("Failed to run the script %s: %s", command,
-                   std_error ? std_error : "");
+    if (g_hash_table_lookup_extended (window->priv->command_plans, command,
+                                      NULL, (gpointer *) &plan)) {
+        return plan;
     }
-    if (std_output && strlen (std_output) > 2) {
-        if (command_output) {
-            *command_output = g_strdup (g_strchomp (std_output));
-        }
+    /* The command which cannot be parsed is also kept not to
+     * warn again. */
+    plan = command_plan_new (command);
+    if (plan != NULL) {
+        command_plan_set_cache (window, plan, command);
     }
-    g_free (std_output);
-    g_free (std_error);
+    g_hash_table_insert (window->priv->command_plans,
+                         g_strdup (command), plan);
+    return plan;
+}
+
+/* argv is the array of plan->argc + 1 and the filled slots are
+ * returned to be freed. */
+static gchar **
+command_plan_fill (CommandPlan *plan, const gchar **argv)
+{
+    CommandSlot *slot;
+    gchar **filled;
+    const char *value;
+    guint i;
+
+    memcpy (argv, plan->argv, (plan->argc + 1) * sizeof (gchar *));
+    if (plan->n_slots == 0) {
+        return NULL;
+    }
+    filled = g_new0 (gchar *, plan->n_slots + 1);
+    for (i = 0; i < plan->n_slots; i++) {
+        slot = &plan->slots[i];
+        value = g_getenv (slot->name);
+        filled[i] = g_strconcat (slot->prefix,
+                                 value ? value : "",
+                                 slot->suffix,
+                                 NULL);
+        argv[slot->arg] = filled[i];
+    }
+    return filled;
 }
 
 static void
-append_unicode_table (GtkWidget         *table,
-                      unsigned           int min,
-                      unsigned           int start,
-                      unsigned           int end,
-                      InputPadGtkWindow *input_pad)
+command_cache_entry_free (CommandCacheEntry *entry)
 {
-    GtkCssProvider *css_provider;
-    GtkStyleContext *style_context;
-    GtkWidget *button;
-    GError *error = NULL;
-    unsigned int num;
-    int row, col;
+    g_free (entry->output);
+    g_slice_free (CommandCacheEntry, entry);
+}
 
-    css_provider = gtk_css_provider_new ();
-    if (input_pad->child) {
-        gtk_css_provider_load_from_data (
-                css_provider,
-                CSS_DATA_NARROW_BUTTON,
+static gchar *
+command_cache_key (CommandPlan *plan, const gchar **argv)
+{
+    GString *key;
+    int i;
+
+    key = g_string_new (NULL);
+    for (i = 0; plan->envp && plan->envp[i]; i++) {
+        g_string_append (key, plan->envp[i]);
+        g_string_append_c (key, '\x1f');
+    }
+    g_string_append_c (key, '\x1e');
+    for (i = 0; argv[i]; i++) {
+        g_string_append (key, argv[i]);
+        g_string_append_c (key, '\x1f');
+    }
+    return g_string_free (key, FALSE);
+}
+
+/* Returns the cached output of argv and sets the cache key to keyp if
+ * the plan is cached. */
+static const gchar *
+command_cache_lookup (InputPadGtkWindow *window,
+                      CommandPlan       *plan,
+                      const gchar      **argv,
+                      gchar            **keyp)
+{
+    CommandCacheEntry *entry;
+
+    *keyp = NULL;
+    if (plan->cache.type == INPUT_PAD_TABLE_CMD_CACHE_NEVER) {
+        return NULL;
+    }
+    *keyp = command_cache_key (plan, argv);
+    if (window->priv->command_cache == NULL) {
+        return NULL;
+    }
+    entry = g_hash_table_lookup (window->priv->command_cache, *keyp);
+    if (entry == NULL) {
+        return NULL;
+    }
+    if (entry->expires <= g_get_monotonic_time ()) {
+        g_hash_table_remove (window->priv->command_cache, *keyp);
+        return NULL;
+    }
+    return entry->output;
+}
+
+static void
+command_cache_insert (InputPadGtkWindow           *window,
+                      const gchar                 *key,
+                      const InputPadTableCmdCache *cache,
+                      const gchar                 *output)
+{
+    CommandCacheEntry *entry;
+
+    if (window->priv->command_cache == NULL) {
+        window->priv->command_cache =
+            g_hash_table_new_full (g_str_hash, g_str_equal,
+                                   g_free,
+                                   (GDestroyNotify) command_cache_entry_free);
+    }
+    entry = g_slice_new0 (CommandCacheEntry);
+    entry->output = g_strdup (output);
+    if (cache->type == INPUT_PAD_TABLE_CMD_CACHE_SESSION) {
+        entry->expires = G_MAXINT64;
+    } else {
+        entry->expires = g_get_monotonic_time () +
+                         (gint64) cache->ttl * G_USEC_PER_SEC;
+    }
+    g_hash_table_replace (window->priv->command_cache,
+                          g_strdup (key), entry);
+}
+
+static void
+command_commit_output (InputPadGtkWindow *window,
+                       const gchar       *command,
+                       const gchar       *output,
+                       guint              state,
+                       guint              group)
+{
+    gchar *str;
+
+    if (output == NULL || strlen (output) <= 2) {
+        return;
+    }
+    str = g_strchomp (g_strdup (output));
+    if (INPUT_PAD_TRACE_ENABLED (command_commit)) {
+        INPUT_PAD_TRACE2 (command_commit, command, strlen (str));
+    }
+    if (window->priv->paste_threshold >= 0 &&
+        g_utf8_strlen (str, -1) >= window->priv->paste_threshold) {
+        commit_paste (window, str);
+    } else {
+        emit_button_pressed (window, str,
+                             INPUT_PAD_TABLE_TYPE_COMMANDS,
+                             0, 0, state, group);
+    }
+    g_free (str);
+}
+
+static void
+command_run_free (CommandRun *run)
+{
+    if (run->timeout_id != 0) {
+        g_source_remove (run->timeout_id);
+        run->timeout_id = 0;
+    }
+    g_clear_object (&run->subprocess);
+    g_clear_object (&run->cancellable);
+    g_clear_object (&run->button);
+    g_free (run->command);
+    g_free (run->cache_key);
+    g_slice_free (CommandRun, run);
+}
+
+static void
+command_run_set_running (CommandRun *run, gboolean running)
+{
+    GtkStyleContext *style_context;
+
+    if (run->button == NULL) {
+        return;
+    }
+    style_context = gtk_widget_get_style_context (run->button);
+    if (running) {
+        gtk_style_context_add_class (style_context,
+                                     GTK_STYLE_CLASS_DIM_LABEL);
+    } else {
+        gtk_style_context_remove_class (style_context,
+                                        GTK_STYLE_CLASS_DIM_LABEL);
+    }
+}
+
+static gboolean
+on_command_timeout (gpointer data)
+{
+    CommandRun *run = (CommandRun *) data;
+
+    run->timeout_id = 0;
+    run->timed_out = TRUE;
+    g_cancellable_cancel (run->cancellable);
+    g_subprocess_force_exit (run->subprocess);
+    return FALSE;
+}
+
+static void
+on_command_communicated (GObject *source, GAsyncResult *result, gpointer data)
+{
+    CommandRun *run = (CommandRun *) data;
+    InputPadGtkWindow *window = run->window;
+    GError *error = NULL;
+    char *std_output = NULL;
+    char *std_error = NULL;
+    gboolean successful = FALSE;
+
+    if (!g_subprocess_communicate_utf8_finish (G_SUBPROCESS (source), result,
+                                               &std_output, &std_error,
+                                               &error)) {
+        if (run->timed_out) {
+            g_warning ("The script %s did not exit in %d msec",
+                       run->command, command_timeout);
+        } else if (!g_error_matches (error,
+                                     G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_warning ("Could not run the script %s: %s",
+                       run->command, error->message);
+        }
+        g_error_free (error);
+    } else if (!g_subprocess_get_successful (G_SUBPROCESS (source))) {
+        g_warning ("Failed to run the script %s: %s", run->command,
+                   std_error ? std_error : "");
+    } else {
+        successful = TRUE;
+    }
+
+    if (window != NULL) {
+        g_hash_table_remove (window->priv->command_runs, run->command);
+        command_run_set_running (run, FALSE);
+        if (successful && run->cache_key && std_output) {
+            command_cache_insert (window, run->cache_key, &run->cache,
+                                  std_output);
+        }
+        if (!run->prefetch) {
+            window->priv->press_trace = run->press_trace;
+            command_commit_output (window, run->command, std_output,
+                                   run->state, run->group);
+        }
+    }
+    g_free (std_output);
+    g_free (std_error);
+    command_run_free (run);
+}
+
+/* cache_key is owned by the returned CommandRun. */
+static CommandRun *
+command_run_new (InputPadGtkWindow *window,
+                 const gchar       *command,
+                 CommandPlan       *plan,
+                 const gchar      **argv,
+                 gchar             *cache_key)
+{
+    GSubprocess *subprocess;
+    GError  *error;
+    CommandRun *run;
+
+    error = NULL;
+    subprocess = g_subprocess_launcher_spawnv (plan->launcher,
+                                               (const gchar * const *) argv,
+                                               &error);
+    if (subprocess == NULL) {
+        g_warning ("Could not run the script %s: %s",
+                   command, error->message);
+        g_error_free (error);
+        g_free (cache_key);
+        return NULL;
+    }
+    window->priv->n_commands_spawned++;
+
+    if (window->priv->command_runs == NULL) {
+        window->priv->command_runs =
+            g_hash_table_new (g_str_hash, g_str_equal);
+    }
+    run = g_slice_new0 (CommandRun);
+    run->window = window;
+    run->command = g_strdup (command);
+    run->subprocess = subprocess;
+    run->cancellable = g_cancellable_new ();
+    run->cache_key = cache_key;
+    run->cache = plan->cache;
+    if (command_timeout > 0) {
+        run->timeout_id = g_timeout_add (command_timeout,
+                                         on_command_timeout,
+                                         run);
+    }
+    g_hash_table_insert (window->priv->command_runs, run->command, run);
+    g_subprocess_communicate_utf8_async (subprocess, NULL,
+                                         run->cancellable,
+                                         on_command_communicated,
+                                         run);
+    return run;
+}
+
+static void
+command_run_set_button (CommandRun *run,
+                        GtkWidget  *button,
+                        guint       state,
+                        guint       group)
+{
+    run->prefetch = FALSE;
+    run->button = g_object_ref (button);
+    run->state = state;
+    run->group = group;
+    run->press_trace = run->window->priv->press_trace;
+    run->window->priv->press_trace.start = 0;
+    command_run_set_running (run, TRUE);
+}
+
+static void
+run_command (InputPadGtkWindow *window,
+             GtkWidget         *button,
+             const gchar       *command,
+             guint              state,
+             guint              group)
+{
+    CommandPlan *plan;
+    CommandRun *run = NULL;
+    const gchar **argv;
+    const gchar *output;
+    gchar  **filled;
+    gchar   *cache_key;
+
+    if (window->priv->command_runs) {
+        run = g_hash_table_lookup (window->priv->command_runs, command);
+    }
+    /* The presses while the command runs are coalesced into the running
+     * one and the prefetch is committed when it finishes. */
+    if (run != NULL) {
+        if (run->prefetch) {
+            command_run_set_button (run, button, state, group);
+        }
+        return;
+    }
+    if ((plan = command_plan_lookup (window, command)) == NULL) {
+        return;
+    }
+    argv = g_newa (const gchar *, plan->argc + 1);
+    filled = command_plan_fill (plan, argv);
+    output = command_cache_lookup (window, plan, argv, &cache_key);
+    INPUT_PAD_TRACE2 (command_run, command, output != NULL);
+    if (output != NULL) {
+        command_commit_output (window, command, output, state, group);
+        g_free (cache_key);
+        g_strfreev (filled);
+        return;
+    }
+    run = command_run_new (window, command, plan, argv, cache_key);
+    g_strfreev (filled);
+    if (run != NULL) {
+        command_run_set_button (run, button, state, group);
+    }
+}
+
+/* The cached commands of the session or the long TTL are run in
+ * the background when the table is shown. */
+static void
+command_table_prefetch (InputPadGtkWindow *window, InputPadTable *table_data)
+{
+    InputPadTableCmd *cmds = table_data->data.cmds;
+    InputPadTableCmdCache *caches = table_data->priv->cmd_caches;
+    CommandPlan *plan;
+    CommandRun *run;
+    const gchar **argv;
+    gchar  **filled;
+    gchar   *cache_key;
+    int i;
+
+    if (cmds == NULL || caches == NULL) {
+        return;
+    }
+    for (i = 0; cmds[i].execl; i++) {
+        if ((plan = command_plan_lookup (window, cmds[i].execl)) == NULL) {
+            continue;
+        }
+        plan->cache = caches[i];
+        if (plan->cache.type == INPUT_PAD_TABLE_CMD_CACHE_NEVER ||
+            (plan->cache.type == INPUT_PAD_TABLE_CMD_CACHE_TTL &&
+             plan->cache.ttl < COMMAND_CACHE_PREFETCH_TTL)) {
+            continue;
+        }
+        if (window->priv->command_runs &&
+            g_hash_table_lookup (window->priv->command_runs, cmds[i].execl)) {
+            continue;
+        }
+        argv = g_new (const gchar *, plan->argc + 1);
+        filled = command_plan_fill (plan, argv);
+        if (command_cache_lookup (window, plan, argv, &cache_key) != NULL) {
+            g_free (cache_key);
+        } else {
+            run = command_run_new (window, cmds[i].execl, plan, argv,
+                                   cache_key);
+            if (run != NULL) {
+                run->prefetch = TRUE;
+            }
+        }
+        g_strfreev (filled);
+        g_free (argv);
+    }
+}
+
+static void
+run_command_cancel_all (InputPadGtkWindow *window)
+{
+    GHashTableIter iter;
+    CommandRun *run;
+
+    if (window->priv->command_runs == NULL) {
+        return;
+    }
+    /* Each CommandRun is freed in on_command_communicated later. */
+    g_hash_table_iter_init (&iter, window->priv->command_runs);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &run)) {
+        run->window = NULL;
+        if (run->timeout_id != 0) {
+            g_source_remove (run->timeout_id);
+            run->timeout_id = 0;
+        }
+        g_cancellable_cancel (run->cancellable);
+        g_subprocess_force_exit (run->subprocess);
+    }
+    g_hash_table_destroy (window->priv->command_runs);
+    window->priv->command_runs = NULL;
+}
+
+static void
+append_unicode_table (GtkWidget         *table,
+                      unsigned           int min,
+                      unsigned           int start,
+                      unsigned           int end,
+                      InputPadGtkWindow *input_pad)
+{
+    GtkCssProvider *css_provider;
+    GtkStyleContext *style_context;
+    GtkWidget *button;
+    GError *error = NULL;
+    unsigned int num;
+    int row, col;
+
+    css_provider = gtk_css_provider_new ();
+    if (input_pad->child) {
+        gtk_css_provider_load_from_data (
+                css_provider,
+                CSS_DATA_NARROW_BUTTON,
                 -1,
                 &error);
     } else {
@@ -2180,9 +3944,9 @@ append_custom_char_view_table (GtkWidget *scrolled, InputPadTable *table_data)
     input_pad = INPUT_PAD_GTK_WINDOW (table_data->priv->signal_window);
 
     if (table_data->type == INPUT_PAD_TABLE_TYPE_CHARS) {
-        char_table = g_strsplit_set (table_data->data.chars, " \t\n", -1);
+        char_table = input_pad_chars_split (table_data->data.chars);
     } else if (table_data->type == INPUT_PAD_TABLE_TYPE_KEYSYMS) {
-        char_table = g_strsplit_set (table_data->data.keysyms, " \t\n", -1);
+        char_table = input_pad_chars_split (table_data->data.keysyms);
     } else if (table_data->type == INPUT_PAD_TABLE_TYPE_STRINGS) {
         char_table = string_table_get_label_array (table_data->data.strs);
     } else if (table_data->type == INPUT_PAD_TABLE_TYPE_COMMANDS) {
@@ -2204,6 +3968,7 @@ append_custom_char_view_table (GtkWidget *scrolled, InputPadTable *table_data)
     if (num % col) {
         row++;
     }
+    INPUT_PAD_TRACE2 (table_append, table_data->type, num);
 
 #if 0
     if (INPUT_PAD_IS_GTK_WINDOW (table_data->priv->signal_window)) {
@@ -2254,12 +4019,7 @@ append_custom_char_view_table (GtkWidget *scrolled, InputPadTable *table_data)
         len = strlen (str);
         if (len > 0) {
             if (table_data->type == INPUT_PAD_TABLE_TYPE_CHARS) {
-                if (str[0] == '0' && 
-                    (str[1] == 'x' || str[1] == 'X')) {
-                    str += 2;
-                    len -= 2;
-                }
-                code = (int) g_ascii_strtoll (str, NULL, 16);
+                code = (int) input_pad_chars_decode (str);
                 button = input_pad_gtk_button_new_with_unicode (code);
                 /* Decided input-pad always sends char but not keysym.
                  * Now keyboard layout can be used instead. */
@@ -2335,6 +4095,9 @@ append_custom_char_view_table (GtkWidget *scrolled, InputPadTable *table_data)
     }
     g_object_unref (css_provider);
     g_strfreev (char_table);
+    if (table_data->type == INPUT_PAD_TABLE_TYPE_COMMANDS) {
+        command_table_prefetch (input_pad, table_data);
+    }
 
     table_data->priv->inited = 1;
 }
@@ -2424,11 +4187,7 @@ create_keyboard_layout_ui_real_default (GtkWidget *vbox, InputPadGtkWindow *wind
     GtkWidget *hbox;
     GtkWidget *table;
     GtkWidget *button;
-    GtkWidget *button_shift_l = NULL;
-    GtkWidget *button_shift_r = NULL;
-    GtkWidget *button_num_lock = NULL;
     GError *error = NULL;
-    GList *orig_children, *children = NULL;
     char *tooltip;
     char *display_name;
 
@@ -2481,7 +4240,14 @@ create_keyboard_layout_ui_real_default (GtkWidget *vbox, InputPadGtkWindow *wind
     if (row > max_row) {
         max_row = row;
     }
+    if (window->priv->keyboard_buttons == NULL) {
+        window->priv->keyboard_buttons =
+            g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    }
     for (i = 0; i < N_KEYBOARD_LAYOUT_PART; i++) {
+        if (window->priv->keyboard_part_buttons[i] == NULL) {
+            window->priv->keyboard_part_buttons[i] = g_ptr_array_new ();
+        }
         table = gtk_grid_new ();
         g_object_set (table,
                       "halign", GTK_ALIGN_START,
@@ -2549,13 +4315,18 @@ create_keyboard_layout_ui_real_default (GtkWidget *vbox, InputPadGtkWindow *wind
             g_signal_connect (G_OBJECT (button), "pressed-repeat",
                               G_CALLBACK (on_button_pressed_repeat),
                               (gpointer) window);
-            g_signal_connect (G_OBJECT (window), "keyboard-changed",
-                              G_CALLBACK (on_window_keyboard_changed),
-                              (gpointer) button);
-            if (key_row->keysym[0][0] == XK_Shift_L) {
-                button_shift_l = button;
-            } else if (key_row->keysym[0][0] == XK_Shift_R) {
-                button_shift_r = button;
+            g_ptr_array_add (window->priv->keyboard_part_buttons[n],
+                             button);
+            if (key_row->name) {
+                g_hash_table_replace (window->priv->keyboard_buttons,
+                                      g_strdup (key_row->name),
+                                      button);
+            }
+            if (key_row->keysym[0][0] == XK_Shift_L ||
+                key_row->keysym[0][0] == XK_Shift_R) {
+                g_signal_connect (G_OBJECT (button), "clicked",
+                                  G_CALLBACK (on_button_shift_clicked),
+                                  (gpointer) window);
             } else if (key_row->keysym[0][0] == XK_Control_L ||
                        key_row->keysym[0][0] == XK_Control_R) {
                 g_signal_connect (G_OBJECT (button), "clicked",
@@ -2567,7 +4338,9 @@ create_keyboard_layout_ui_real_default (GtkWidget *vbox, InputPadGtkWindow *wind
                                   G_CALLBACK (on_button_alt_clicked),
                                   (gpointer) window);
             } else if (key_row->keysym[0][0] == XK_Num_Lock) {
-                button_num_lock = button;
+                g_signal_connect (G_OBJECT (button), "clicked",
+                                  G_CALLBACK (on_button_num_lock_clicked),
+                                  (gpointer) window);
             }
             col++;
             key_row = key_row->next;
@@ -2579,42 +4352,6 @@ create_keyboard_layout_ui_real_default (GtkWidget *vbox, InputPadGtkWindow *wind
         list = list->next;
     }
 
-    children = gtk_container_get_children (GTK_CONTAINER (table_data[0].table));
-    orig_children = children;
-    while (children) {
-        if (!GTK_IS_BUTTON (children->data)) {
-            children = children->next;
-            continue;
-        }
-        if (button_shift_l) {
-            g_signal_connect (G_OBJECT (button_shift_l), "clicked",
-                              G_CALLBACK (on_button_shift_clicked),
-                              (gpointer) children->data);
-        }
-        if (button_shift_r) {
-            g_signal_connect (G_OBJECT (button_shift_r), "clicked",
-                              G_CALLBACK (on_button_shift_clicked),
-                              (gpointer) children->data);
-        }
-        children = children->next;
-    }
-    g_list_free (orig_children);
-    children = gtk_container_get_children (GTK_CONTAINER (table_data[2].table));
-    orig_children = children;
-    while (children) {
-        if (!GTK_IS_BUTTON (children->data)) {
-            children = children->next;
-            continue;
-        }
-        if (button_num_lock) {
-            g_signal_connect (G_OBJECT (button_num_lock), "clicked",
-                              G_CALLBACK (on_button_shift_clicked),
-                              (gpointer) children->data);
-        }
-        children = children->next;
-    }
-    g_list_free (orig_children);
-
     button = gtk_button_new_with_label ("->");
     gtk_widget_set_tooltip_text (button, _("Extend layout"));
     style_context = gtk_widget_get_style_context (button);
@@ -2629,6 +4366,44 @@ create_keyboard_layout_ui_real_default (GtkWidget *vbox, InputPadGtkWindow *wind
                       table_data);
 
     g_object_unref (css_provider);
+    keyboard_level_state_apply (window);
+}
+
+static gboolean
+create_keyboard_layout_ui_real_geometry (GtkWidget *vbox, InputPadGtkWindow *window)
+{
+    InputPadXKBKeyList *xkb_key_list = window->priv->xkb_key_list;
+    XkbDescPtr xkb;
+    GtkWidget *hbox;
+    GtkWidget *keyboard;
+
+    if ((xkb = input_pad_gdk_xkb_key_list_get_desc (xkb_key_list)) == NULL ||
+        xkb->geom == NULL) {
+        return FALSE;
+    }
+
+    hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 5);
+    keyboard = input_pad_gtk_keyboard_new ();
+    input_pad_gtk_keyboard_set_label_func (INPUT_PAD_GTK_KEYBOARD (keyboard),
+                                           get_keysym_display_name);
+    if (!input_pad_gtk_keyboard_set_geometry (INPUT_PAD_GTK_KEYBOARD (keyboard),
+                                              xkb, xkb_key_list)) {
+        gtk_widget_destroy (keyboard);
+        gtk_widget_destroy (hbox);
+        return FALSE;
+    }
+    gtk_box_pack_start (GTK_BOX (vbox), hbox, TRUE, TRUE, 0);
+    gtk_box_reorder_child (GTK_BOX (vbox), hbox, 0);
+    gtk_widget_show (hbox);
+    gtk_box_pack_start (GTK_BOX (hbox), keyboard, TRUE, TRUE, 0);
+    gtk_widget_show (keyboard);
+    g_signal_connect (G_OBJECT (keyboard), "key-pressed",
+                      G_CALLBACK (on_keyboard_key_pressed),
+                      (gpointer) window);
+    window->priv->keyboard_geometry_widget = keyboard;
+
+    keyboard_level_state_apply (window);
+    return TRUE;
 }
 
 G_INLINE_FUNC void
@@ -2641,6 +4416,10 @@ create_keyboard_layout_ui_real (GtkWidget         *vbox,
                                vbox, window);
         return;
     }
+    if (window->priv->keyboard_geometry &&
+        create_keyboard_layout_ui_real_geometry (vbox, window)) {
+        return;
+    }
     create_keyboard_layout_ui_real_default (vbox, window);
 }
 
@@ -2649,11 +4428,7 @@ keyboard_element_remove (GtkWidget *button, gpointer data)
 {
     TableForEachData *foreach_data = (TableForEachData *) data;
     GtkWidget *table = foreach_data->table;
-    InputPadGtkWindow *window = foreach_data->window;
 
-    g_signal_handlers_disconnect_by_func (G_OBJECT (window),
-                                          G_CALLBACK (on_window_keyboard_changed),
-                                          (gpointer) button);
     gtk_container_remove (GTK_CONTAINER (table), button);
 }
 
@@ -2678,7 +4453,18 @@ destroy_prev_keyboard_layout_default (GtkWidget *vbox, InputPadGtkWindow *window
     GList *children = NULL;
     GtkWidget *hbox;
     static TableForEachData foreach_data = { NULL, };
+    int i;
 
+    if (window->priv->keyboard_buttons) {
+        g_hash_table_destroy (window->priv->keyboard_buttons);
+        window->priv->keyboard_buttons = NULL;
+    }
+    for (i = 0; i < N_KEYBOARD_LAYOUT_PART; i++) {
+        if (window->priv->keyboard_part_buttons[i]) {
+            g_ptr_array_free (window->priv->keyboard_part_buttons[i], TRUE);
+            window->priv->keyboard_part_buttons[i] = NULL;
+        }
+    }
     children = gtk_container_get_children (GTK_CONTAINER (vbox));
     hbox = GTK_WIDGET (children->data);
     g_list_free (children);
@@ -2689,6 +4475,19 @@ destroy_prev_keyboard_layout_default (GtkWidget *vbox, InputPadGtkWindow *window
     gtk_container_remove (GTK_CONTAINER (vbox), hbox);
 }
 
+static void
+destroy_prev_keyboard_layout_geometry (GtkWidget *vbox, InputPadGtkWindow *window)
+{
+    GList *children = NULL;
+    GtkWidget *hbox;
+
+    window->priv->keyboard_geometry_widget = NULL;
+    children = gtk_container_get_children (GTK_CONTAINER (vbox));
+    hbox = GTK_WIDGET (children->data);
+    g_list_free (children);
+    gtk_container_remove (GTK_CONTAINER (vbox), hbox);
+}
+
 G_INLINE_FUNC void
 destroy_prev_keyboard_layout (GtkWidget         *vbox,
                               InputPadGtkWindow *window)
@@ -2699,6 +4498,10 @@ destroy_prev_keyboard_layout (GtkWidget         *vbox,
                                vbox, window);
         return;
     }
+    if (window->priv->keyboard_geometry_widget) {
+        destroy_prev_keyboard_layout_geometry (vbox, window);
+        return;
+    }
     destroy_prev_keyboard_layout_default (vbox, window);
 }
 
@@ -2775,8 +4578,21 @@ config_layouts_combobox_remove_layout (GtkTreeStore *list,
     } while (gtk_tree_model_iter_next (GTK_TREE_MODEL (list), &iter));
 }
 
+static GtkTreeStore *
+config_layouts_list_new (void)
+{
+    return gtk_tree_store_new (LAYOUT_N_COLS,
+                               G_TYPE_STRING,
+                               G_TYPE_STRING,
+                               G_TYPE_STRING,
+                               G_TYPE_STRING,
+                               G_TYPE_BOOLEAN,
+                               G_TYPE_BOOLEAN);
+}
+
 static void
-config_layouts_list_append_layout (GtkListStore *list,
+config_layouts_list_append_layout (GtkTreeStore *list,
+                                   GtkTreeIter  *parent,
                                    const gchar *layout_name,
                                    const gchar *layout_desc,
                                    const gchar *variant_name,
@@ -2784,8 +4600,8 @@ config_layouts_list_append_layout (GtkListStore *list,
 {
     GtkTreeIter   iter;
 
-    gtk_list_store_append (list, &iter);
-    gtk_list_store_set (list, &iter,
+    gtk_tree_store_append (list, &iter, parent);
+    gtk_tree_store_set (list, &iter,
                         LAYOUT_LAYOUT_NAME_COL,
                         layout_name,
                         LAYOUT_LAYOUT_DESC_COL,
@@ -2793,14 +4609,28 @@ config_layouts_list_append_layout (GtkListStore *list,
                         LAYOUT_VARIANT_NAME_COL,
                         variant_name,
                         LAYOUT_VARIANT_DESC_COL, NULL,
-                        LAYOUT_VISIBLE_COL, TRUE, -1);
+                        LAYOUT_VISIBLE_COL, TRUE,
+                        LAYOUT_SENSITIVE_COL, TRUE, -1);
 }
 
+/* The placeholder row is replaced with the variants on expanding. */
 static void
-config_layouts_list_remove_iter (GtkListStore *list,
+config_layouts_list_append_placeholder (GtkTreeStore *list,
+                                        GtkTreeIter  *parent)
+{
+    GtkTreeIter   iter;
+
+    gtk_tree_store_append (list, &iter, parent);
+    gtk_tree_store_set (list, &iter,
+                        LAYOUT_VISIBLE_COL, FALSE,
+                        LAYOUT_SENSITIVE_COL, FALSE, -1);
+}
+
+static void
+config_layouts_list_remove_iter (GtkTreeStore *list,
                                  GtkTreeIter  *iter)
 {
-    if (!gtk_list_store_remove (list, iter)) {
+    if (!gtk_tree_store_remove (list, iter)) {
         /* FIXME: Should set iter at the end again? */
         return;
     }
@@ -2811,7 +4641,7 @@ config_layouts_list_remove_iter (GtkListStore *list,
 
 static void
 config_layouts_treeview_set_list (GtkWidget    *treeview,
-                                  GtkListStore *list,
+                                  GtkTreeStore *list,
                                   gboolean      is_sortable)
 {
     GtkCellRenderer *renderer;
@@ -2829,108 +4659,304 @@ config_layouts_treeview_set_list (GtkWidget    *treeview,
     gtk_tree_view_set_model (GTK_TREE_VIEW (treeview), GTK_TREE_MODEL (list));
     g_object_unref (G_OBJECT (list));
 
+    if (gtk_tree_view_get_n_columns (GTK_TREE_VIEW (treeview)) > 0) {
+        return;
+    }
     renderer = gtk_cell_renderer_text_new ();
     column = gtk_tree_view_column_new_with_attributes (_("Layout"), renderer,
                                                        "text", LAYOUT_LAYOUT_DESC_COL,
                                                        "visible", LAYOUT_VISIBLE_COL,
+                                                       "sensitive", LAYOUT_SENSITIVE_COL,
                                                        NULL);
     gtk_tree_view_append_column (GTK_TREE_VIEW (treeview), column);
     gtk_widget_show (treeview);
 }
 
+static gchar *
+config_layouts_key_new (const gchar *layout_name, const gchar *variant_name)
+{
+    return g_strdup_printf ("%s(%s)", layout_name,
+                            variant_name ? variant_name : "");
+}
+
+static gboolean
+config_layouts_is_active (GHashTable  *active_layouts,
+                          const gchar *layout_name,
+                          const gchar *variant_name)
+{
+    gchar *key = config_layouts_key_new (layout_name, variant_name);
+    gboolean retval = g_hash_table_contains (active_layouts, key);
+
+    g_free (key);
+    return retval;
+}
+
+/* The layouts in the layout combobox are active. */
+static GHashTable *
+config_layouts_active_new (InputPadGtkWindow *window)
+{
+    GHashTable *active_layouts;
+    GtkTreeModel *combo_model;
+    GtkTreeIter iter;
+    gchar *layout_name = NULL;
+    gchar *variant_name = NULL;
+
+    active_layouts = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, NULL);
+    combo_model = gtk_combo_box_get_model (GTK_COMBO_BOX (window->priv->config_layouts_combobox));
+    if (combo_model == NULL ||
+        !gtk_tree_model_get_iter_first (combo_model, &iter)) {
+        return active_layouts;
+    }
+    do {
+        gtk_tree_model_get (combo_model, &iter,
+                            LAYOUT_LAYOUT_NAME_COL,
+                            &layout_name,
+                            LAYOUT_VARIANT_NAME_COL,
+                            &variant_name,
+                            -1);
+        g_hash_table_add (active_layouts,
+                          config_layouts_key_new (layout_name,
+                                                  variant_name));
+        g_free (layout_name);
+        g_free (variant_name);
+    } while (gtk_tree_model_iter_next (combo_model, &iter));
+    return active_layouts;
+}
+
+/*
+ * Append the layout row. The active layout is kept insensitive
+ * only for its variants.
+ */
+static gboolean
+config_layouts_add_list_append_layout (GtkTreeStore           *add_list,
+                                       InputPadXKBLayoutList  *layouts,
+                                       GHashTable             *active_layouts,
+                                       GtkTreeIter            *iter)
+{
+    gboolean is_active;
+
+    is_active = config_layouts_is_active (active_layouts,
+                                          layouts->layout, NULL);
+    if (is_active && layouts->variants == NULL) {
+        return FALSE;
+    }
+    gtk_tree_store_append (add_list, iter, NULL);
+    gtk_tree_store_set (add_list, iter,
+                        LAYOUT_LAYOUT_NAME_COL, layouts->layout,
+                        LAYOUT_LAYOUT_DESC_COL, layouts->desc,
+                        LAYOUT_VARIANT_NAME_COL, NULL,
+                        LAYOUT_VARIANT_DESC_COL, NULL,
+                        LAYOUT_VISIBLE_COL, TRUE,
+                        LAYOUT_SENSITIVE_COL, !is_active, -1);
+    return TRUE;
+}
+
+static GtkTreeStore *
+config_layouts_add_list_new (InputPadGtkWindow      *window,
+                             GHashTable             *active_layouts)
+{
+    InputPadXKBLayoutList *layouts;
+    GtkTreeStore *add_list;
+    GtkTreeIter   iter;
+
+    add_list = config_layouts_list_new ();
+    if (window->priv->xkb_config_reg == NULL) {
+        return add_list;
+    }
+    for (layouts = window->priv->xkb_config_reg->layouts; layouts;
+         layouts = layouts->next) {
+        if (!config_layouts_add_list_append_layout (add_list, layouts,
+                                                    active_layouts,
+                                                    &iter)) {
+            continue;
+        }
+        if (layouts->variants) {
+            config_layouts_list_append_placeholder (add_list, &iter);
+        }
+    }
+    return add_list;
+}
+
+static gboolean
+config_layouts_find_layout (GtkTreeModel   *model,
+                            const gchar    *layout_name,
+                            GtkTreeIter    *iter)
+{
+    gchar *name = NULL;
+    gboolean found;
+
+    if (!gtk_tree_model_get_iter_first (model, iter)) {
+        return FALSE;
+    }
+    do {
+        gtk_tree_model_get (model, iter, LAYOUT_LAYOUT_NAME_COL, &name, -1);
+        found = (g_strcmp0 (name, layout_name) == 0);
+        g_free (name);
+        if (found) {
+            return TRUE;
+        }
+    } while (gtk_tree_model_iter_next (model, iter));
+    return FALSE;
+}
+
+static gboolean
+config_layouts_has_placeholder (GtkTreeModel   *model,
+                                GtkTreeIter    *parent,
+                                GtkTreeIter    *child)
+{
+    gchar *name = NULL;
+
+    if (!gtk_tree_model_iter_children (model, child, parent)) {
+        return FALSE;
+    }
+    gtk_tree_model_get (model, child, LAYOUT_LAYOUT_NAME_COL, &name, -1);
+    if (name != NULL) {
+        g_free (name);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Put back the removed layout into the available layouts. */
+static void
+config_layouts_add_list_restore (InputPadGtkWindow      *window,
+                                 GtkTreeStore           *add_list,
+                                 const gchar            *layout_name,
+                                 const gchar            *variant_name)
+{
+    InputPadXKBLayoutList *layouts;
+    InputPadXKBVariantList *variants;
+    GtkTreeIter iter, child;
+    GHashTable *active_layouts;
+
+    layouts =
+        input_pad_gdk_xkb_config_reg_lookup_layout (window->priv->xkb_config_reg,
+                                                    layout_name);
+    if (layouts == NULL) {
+        return;
+    }
+    if (!config_layouts_find_layout (GTK_TREE_MODEL (add_list),
+                                     layout_name, &iter)) {
+        if (variant_name != NULL) {
+            return;
+        }
+        active_layouts = config_layouts_active_new (window);
+        if (config_layouts_add_list_append_layout (add_list, layouts,
+                                                   active_layouts,
+                                                   &iter) &&
+            layouts->variants) {
+            config_layouts_list_append_placeholder (add_list, &iter);
+        }
+        g_hash_table_destroy (active_layouts);
+        return;
+    }
+    if (variant_name == NULL) {
+        gtk_tree_store_set (add_list, &iter,
+                            LAYOUT_SENSITIVE_COL, TRUE, -1);
+        return;
+    }
+    if (config_layouts_has_placeholder (GTK_TREE_MODEL (add_list),
+                                        &iter, &child)) {
+        return;
+    }
+    variants =
+        input_pad_gdk_xkb_config_reg_lookup_variant (window->priv->xkb_config_reg,
+                                                     layout_name,
+                                                     variant_name);
+    if (variants == NULL) {
+        return;
+    }
+    config_layouts_list_append_layout (add_list, &iter,
+                                       layouts->layout, layouts->desc,
+                                       variants->variant, variants->desc);
+}
+
+static gboolean
+on_treeview_config_layouts_test_expand_row (GtkTreeView *treeview,
+                                            GtkTreeIter *iter,
+                                            GtkTreePath *path,
+                                            gpointer     data)
+{
+    InputPadGtkWindow *window;
+    InputPadXKBLayoutList *layouts;
+    InputPadXKBVariantList *variants;
+    GtkTreeModel *model;
+    GtkTreeIter child;
+    GHashTable *active_layouts;
+    gchar *layout_name = NULL;
+
+    g_return_val_if_fail (INPUT_PAD_IS_GTK_WINDOW (data), FALSE);
+
+    window = INPUT_PAD_GTK_WINDOW (data);
+    model = gtk_tree_view_get_model (treeview);
+    if (!config_layouts_has_placeholder (model, iter, &child)) {
+        return FALSE;
+    }
+    gtk_tree_model_get (model, iter, LAYOUT_LAYOUT_NAME_COL, &layout_name, -1);
+    layouts =
+        input_pad_gdk_xkb_config_reg_lookup_layout (window->priv->xkb_config_reg,
+                                                    layout_name);
+    g_free (layout_name);
+    active_layouts = config_layouts_active_new (window);
+    for (variants = layouts ? layouts->variants : NULL; variants;
+         variants = variants->next) {
+        if (config_layouts_is_active (active_layouts,
+                                      layouts->layout, variants->variant)) {
+            continue;
+        }
+        config_layouts_list_append_layout (GTK_TREE_STORE (model), iter,
+                                           layouts->layout, layouts->desc,
+                                           variants->variant,
+                                           variants->desc);
+    }
+    g_hash_table_destroy (active_layouts);
+    gtk_tree_store_remove (GTK_TREE_STORE (model), &child);
+    return FALSE;
+}
+
+/*
+ * Only the layout rows are created and the variants are appended
+ * when the layout row is expanded.
+ */
 static void
 config_layouts_treeview_set (InputPadGtkWindow         *input_pad,
                              InputPadXKBLayoutList     *xkb_layout_list)
 {
     InputPadXKBLayoutList *layouts = NULL;
-    GtkTreeIter   iter;
-    GtkListStore *add_list;
-    GtkListStore *remove_list;
-    gchar **group_layouts = input_pad->priv->group_layouts;
-    gchar **group_variants = input_pad->priv->group_variants;
-    int i;
+    InputPadXKBVariantList *variants;
+    GtkTreeStore *add_list;
+    GtkTreeStore *remove_list;
+    GHashTable *active_layouts;
 
-    add_list = gtk_list_store_new (LAYOUT_N_COLS,
-                                   G_TYPE_STRING,
-                                   G_TYPE_STRING,
-                                   G_TYPE_STRING,
-                                   G_TYPE_STRING,
-                                   G_TYPE_BOOLEAN);
-    remove_list = gtk_list_store_new (LAYOUT_N_COLS,
-                                      G_TYPE_STRING,
-                                      G_TYPE_STRING,
-                                      G_TYPE_STRING,
-                                      G_TYPE_STRING,
-                                      G_TYPE_BOOLEAN);
+    active_layouts = config_layouts_active_new (input_pad);
+    add_list = config_layouts_add_list_new (input_pad, active_layouts);
+    remove_list = config_layouts_list_new ();
 
     for (layouts = xkb_layout_list; layouts; layouts = layouts->next) {
-        InputPadXKBVariantList *variants = layouts->variants;
-
-        config_layouts_list_append_layout (add_list,
+        if (config_layouts_is_active (active_layouts,
+                                      layouts->layout, NULL)) {
+            config_layouts_list_append_layout (remove_list, NULL,
+                                               layouts->layout,
+                                               layouts->desc,
+                                               NULL,
+                                               NULL);
+        }
+        for (variants = layouts->variants; variants;
+             variants = variants->next) {
+            if (!config_layouts_is_active (active_layouts,
                                            layouts->layout,
-                                           layouts->desc,
-                                           NULL,
-                                           NULL);
-        while (variants) {
-            config_layouts_list_append_layout (add_list,
+                                           variants->variant)) {
+                continue;
+            }
+            config_layouts_list_append_layout (remove_list, NULL,
                                                layouts->layout,
                                                layouts->desc,
                                                variants->variant,
                                                variants->desc);
-            variants = variants->next;
         }
     }
-
-    gtk_tree_model_get_iter_first (GTK_TREE_MODEL (add_list), &iter);
-    do {
-        gchar *layout_name = NULL;
-        gchar *layout_desc = NULL;
-        gchar *variant_name = NULL;
-        gchar *variant_desc = NULL;
-
-        gtk_tree_model_get (GTK_TREE_MODEL (add_list), &iter,
-                            LAYOUT_LAYOUT_NAME_COL,
-                            &layout_name,
-                            LAYOUT_LAYOUT_DESC_COL,
-                            &layout_desc,
-                            LAYOUT_VARIANT_NAME_COL,
-                            &variant_name,
-                            LAYOUT_VARIANT_DESC_COL,
-                            &variant_desc,
-                            -1);
-        for (i = 0; group_layouts[i]; i++) {
-            if (!g_strcmp0 (group_layouts[i], layout_name)) {
-                if (group_variants == NULL ||
-                    i >= g_strv_length (group_variants) ||
-                    group_variants[i] == NULL ||
-                    *group_variants[i] == '\0') {
-                    if (variant_name == NULL) {
-                        config_layouts_list_remove_iter (add_list, &iter);
-                        config_layouts_list_append_layout (remove_list,
-                                                           layout_name,
-                                                           layout_desc,
-                                                           variant_name,
-                                                           variant_desc);
-                        break;
-                    }
-                } else {
-                    if (!g_strcmp0 (group_variants[i], variant_name)) {
-                        config_layouts_list_remove_iter (add_list, &iter);
-                        config_layouts_list_append_layout (remove_list,
-                                                           layout_name,
-                                                           layout_desc,
-                                                           variant_name,
-                                                           variant_desc);
-                        break;
-                    }
-                }
-            }
-        }
-        g_free (layout_name);
-        g_free (layout_desc);
-        g_free (variant_name);
-        g_free (variant_desc);
-    } while (gtk_tree_model_iter_next (GTK_TREE_MODEL (add_list), &iter));
+    g_hash_table_destroy (active_layouts);
 
     config_layouts_treeview_set_list (input_pad->priv->config_layouts_add_treeview,
                                       add_list, TRUE);
@@ -2938,81 +4964,496 @@ config_layouts_treeview_set (InputPadGtkWindow         *input_pad,
                                       remove_list, FALSE);
 }
 
+static void
+config_search_item_free (gpointer data)
+{
+    ConfigSearchItem *item = (ConfigSearchItem *) data;
+
+    g_free (item->text);
+    g_slice_free (ConfigSearchItem, item);
+}
+
+static void
+config_search_index_append (GPtrArray      *index,
+                            const gchar    *parent,
+                            const gchar    *name,
+                            const gchar    *desc)
+{
+    ConfigSearchItem *item;
+    gchar *text;
+
+    item = g_slice_new0 (ConfigSearchItem);
+    item->parent = parent;
+    item->name = name;
+    text = g_strdup_printf ("%s %s", desc ? desc : "", name ? name : parent);
+    item->text = g_utf8_casefold (text, -1);
+    g_free (text);
+    g_ptr_array_add (index, item);
+}
+
+static GPtrArray *
+config_layouts_index_new (InputPadXKBConfigReg *xkb_config_reg)
+{
+    InputPadXKBLayoutList *layouts;
+    InputPadXKBVariantList *variants;
+    GPtrArray *index;
+
+    index = g_ptr_array_new_with_free_func (config_search_item_free);
+    for (layouts = xkb_config_reg->layouts; layouts;
+         layouts = layouts->next) {
+        config_search_index_append (index, layouts->layout, NULL,
+                                    layouts->desc);
+        for (variants = layouts->variants; variants;
+             variants = variants->next) {
+            config_search_index_append (index, layouts->layout,
+                                        variants->variant,
+                                        variants->desc);
+        }
+    }
+    return index;
+}
+
+static void
+on_entry_config_layouts_search_changed (GtkSearchEntry *entry,
+                                        gpointer        data)
+{
+    InputPadGtkWindow *window;
+    InputPadXKBLayoutList *layouts;
+    InputPadXKBVariantList *variants;
+    ConfigSearchItem *item;
+    GtkTreeStore *add_list;
+    GtkTreeIter iter, *parent;
+    GHashTable *active_layouts;
+    GHashTable *layout_rows;
+    gchar *needle;
+    guint i;
+
+    g_return_if_fail (INPUT_PAD_IS_GTK_WINDOW (data));
+
+    window = INPUT_PAD_GTK_WINDOW (data);
+    if (window->priv->xkb_config_reg == NULL) {
+        return;
+    }
+    active_layouts = config_layouts_active_new (window);
+    if (*gtk_entry_get_text (GTK_ENTRY (entry)) == '\0') {
+        add_list = config_layouts_add_list_new (window, active_layouts);
+        g_hash_table_destroy (active_layouts);
+        config_layouts_treeview_set_list (window->priv->config_layouts_add_treeview,
+                                          add_list, TRUE);
+        return;
+    }
+    if (window->priv->config_layouts_index == NULL) {
+        window->priv->config_layouts_index =
+            config_layouts_index_new (window->priv->xkb_config_reg);
+    }
+
+    needle = g_utf8_casefold (gtk_entry_get_text (GTK_ENTRY (entry)), -1);
+    add_list = config_layouts_list_new ();
+    layout_rows = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         NULL, (GDestroyNotify) gtk_tree_iter_free);
+    for (i = 0; i < window->priv->config_layouts_index->len; i++) {
+        item = g_ptr_array_index (window->priv->config_layouts_index, i);
+        if (strstr (item->text, needle) == NULL) {
+            continue;
+        }
+        layouts =
+            input_pad_gdk_xkb_config_reg_lookup_layout (window->priv->xkb_config_reg,
+                                                        item->parent);
+        if ((parent = g_hash_table_lookup (layout_rows, item->parent)) == NULL) {
+            if (!config_layouts_add_list_append_layout (add_list, layouts,
+                                                        active_layouts,
+                                                        &iter)) {
+                continue;
+            }
+            parent = gtk_tree_iter_copy (&iter);
+            g_hash_table_insert (layout_rows, (gpointer) item->parent, parent);
+        }
+        if (item->name == NULL ||
+            config_layouts_is_active (active_layouts,
+                                      item->parent, item->name)) {
+            continue;
+        }
+        variants =
+            input_pad_gdk_xkb_config_reg_lookup_variant (window->priv->xkb_config_reg,
+                                                         item->parent,
+                                                         item->name);
+        config_layouts_list_append_layout (add_list, parent,
+                                           layouts->layout, layouts->desc,
+                                           variants->variant, variants->desc);
+    }
+    g_hash_table_destroy (layout_rows);
+    g_hash_table_destroy (active_layouts);
+    g_free (needle);
+
+    config_layouts_treeview_set_list (window->priv->config_layouts_add_treeview,
+                                      add_list, TRUE);
+    gtk_tree_view_expand_all (GTK_TREE_VIEW (window->priv->config_layouts_add_treeview));
+}
+
+static GtkTreeStore *
+config_options_list_new (void)
+{
+    return gtk_tree_store_new (OPTION_N_COLS,
+                               G_TYPE_STRING,
+                               G_TYPE_STRING,
+                               G_TYPE_BOOLEAN,
+                               G_TYPE_BOOLEAN,
+                               G_TYPE_INT);
+}
+
+static gboolean
+config_options_group_is_active (InputPadGtkWindow          *window,
+                                InputPadXKBOptionGroupList *groups)
+{
+    InputPadXKBOptionList *options;
+
+    for (options = groups->options; options; options = options->next) {
+        if (g_hash_table_contains (window->priv->config_options_active,
+                                   options->option)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void
+config_options_list_append_group (InputPadGtkWindow            *window,
+                                  GtkTreeStore                 *list,
+                                  InputPadXKBOptionGroupList   *groups,
+                                  GtkTreeIter                  *iter)
+{
+    gtk_tree_store_append (list, iter, NULL);
+    gtk_tree_store_set (list, iter,
+                        OPTION_NAME_COL, groups->option_group,
+                        OPTION_DESC_COL, groups->desc,
+                        OPTION_ACTIVE_COL, FALSE,
+                        OPTION_IS_OPTION_COL, FALSE,
+                        OPTION_WEIGHT_COL,
+                        config_options_group_is_active (window, groups) ?
+                            PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL,
+                        -1);
+}
+
+static void
+config_options_list_append_options (InputPadGtkWindow          *window,
+                                    GtkTreeStore               *list,
+                                    GtkTreeIter                *parent,
+                                    InputPadXKBOptionGroupList *groups,
+                                    const gchar                *only_option)
+{
+    InputPadXKBOptionList *options;
+    GtkTreeIter iter;
+
+    for (options = groups->options; options; options = options->next) {
+        if (only_option && g_strcmp0 (options->option, only_option) != 0) {
+            continue;
+        }
+        gtk_tree_store_append (list, &iter, parent);
+        gtk_tree_store_set (list, &iter,
+                            OPTION_NAME_COL, options->option,
+                            OPTION_DESC_COL, options->desc,
+                            OPTION_ACTIVE_COL,
+                            g_hash_table_contains (window->priv->config_options_active,
+                                                   options->option),
+                            OPTION_IS_OPTION_COL, TRUE,
+                            OPTION_WEIGHT_COL, PANGO_WEIGHT_NORMAL,
+                            -1);
+    }
+}
+
+static GtkTreeStore *
+config_options_group_list_new (InputPadGtkWindow *window)
+{
+    InputPadXKBOptionGroupList *groups;
+    GtkTreeStore *list;
+    GtkTreeIter iter, child;
+
+    list = config_options_list_new ();
+    if (window->priv->xkb_config_reg == NULL) {
+        return list;
+    }
+    for (groups = window->priv->xkb_config_reg->option_groups; groups;
+         groups = groups->next) {
+        config_options_list_append_group (window, list, groups, &iter);
+        if (groups->options) {
+            /* The placeholder is replaced with the options on expanding. */
+            gtk_tree_store_append (list, &child, &iter);
+        }
+    }
+    return list;
+}
+
+static gboolean
+on_treeview_config_options_test_expand_row (GtkTreeView *treeview,
+                                            GtkTreeIter *iter,
+                                            GtkTreePath *path,
+                                            gpointer     data)
+{
+    InputPadGtkWindow *window;
+    InputPadXKBOptionGroupList *groups;
+    GtkTreeModel *model;
+    GtkTreeIter child;
+    gchar *name = NULL;
+
+    g_return_val_if_fail (INPUT_PAD_IS_GTK_WINDOW (data), FALSE);
+
+    window = INPUT_PAD_GTK_WINDOW (data);
+    model = gtk_tree_view_get_model (treeview);
+    if (!gtk_tree_model_iter_children (model, &child, iter)) {
+        return FALSE;
+    }
+    gtk_tree_model_get (model, &child, OPTION_NAME_COL, &name, -1);
+    if (name != NULL) {
+        g_free (name);
+        return FALSE;
+    }
+    gtk_tree_model_get (model, iter, OPTION_NAME_COL, &name, -1);
+    groups =
+        input_pad_gdk_xkb_config_reg_lookup_option_group (window->priv->xkb_config_reg,
+                                                          name);
+    g_free (name);
+    if (groups) {
+        config_options_list_append_options (window, GTK_TREE_STORE (model),
+                                            iter, groups, NULL);
+    }
+    gtk_tree_store_remove (GTK_TREE_STORE (model), &child);
+    return FALSE;
+}
+
+static void
+on_cell_config_options_toggled (GtkCellRendererToggle  *renderer,
+                                gchar                  *path,
+                                gpointer                data)
+{
+    InputPadGtkWindow *window;
+    InputPadXKBOptionGroupList *groups;
+    GtkTreeModel *model;
+    GtkTreeIter iter, parent;
+    gchar *name = NULL;
+    gboolean active = FALSE;
+    gboolean is_option = FALSE;
+
+    g_return_if_fail (INPUT_PAD_IS_GTK_WINDOW (data));
+
+    window = INPUT_PAD_GTK_WINDOW (data);
+    model = gtk_tree_view_get_model (GTK_TREE_VIEW (window->priv->config_options_treeview));
+    if (model == NULL ||
+        window->priv->config_options_active == NULL ||
+        !gtk_tree_model_get_iter_from_string (model, &iter, path)) {
+        return;
+    }
+    gtk_tree_model_get (model, &iter,
+                        OPTION_NAME_COL, &name,
+                        OPTION_ACTIVE_COL, &active,
+                        OPTION_IS_OPTION_COL, &is_option,
+                        -1);
+    if (!is_option) {
+        g_free (name);
+        return;
+    }
+    active = !active;
+    gtk_tree_store_set (GTK_TREE_STORE (model), &iter,
+                        OPTION_ACTIVE_COL, active, -1);
+    if (active) {
+        g_hash_table_add (window->priv->config_options_active, name);
+    } else {
+        g_hash_table_remove (window->priv->config_options_active, name);
+        g_free (name);
+    }
+
+    if (!gtk_tree_model_iter_parent (model, &parent, &iter)) {
+        return;
+    }
+    gtk_tree_model_get (model, &parent, OPTION_NAME_COL, &name, -1);
+    groups =
+        input_pad_gdk_xkb_config_reg_lookup_option_group (window->priv->xkb_config_reg,
+                                                          name);
+    g_free (name);
+    if (groups) {
+        gtk_tree_store_set (GTK_TREE_STORE (model), &parent,
+                            OPTION_WEIGHT_COL,
+                            config_options_group_is_active (window, groups) ?
+                                PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL,
+                            -1);
+    }
+}
+
+static GPtrArray *
+config_options_index_new (InputPadXKBConfigReg *xkb_config_reg)
+{
+    InputPadXKBOptionGroupList *groups;
+    InputPadXKBOptionList *options;
+    GPtrArray *index;
+
+    index = g_ptr_array_new_with_free_func (config_search_item_free);
+    for (groups = xkb_config_reg->option_groups; groups;
+         groups = groups->next) {
+        config_search_index_append (index, groups->option_group, NULL,
+                                    groups->desc);
+        for (options = groups->options; options; options = options->next) {
+            config_search_index_append (index, groups->option_group,
+                                        options->option,
+                                        options->desc);
+        }
+    }
+    return index;
+}
+
+static void
+on_entry_config_options_search_changed (GtkSearchEntry *entry,
+                                        gpointer        data)
+{
+    InputPadGtkWindow *window;
+    InputPadXKBOptionGroupList *groups;
+    ConfigSearchItem *item;
+    GtkTreeStore *list;
+    GtkTreeIter iter, *parent;
+    GHashTable *group_rows;
+    GHashTable *full_groups;
+    gchar *needle;
+    guint i;
+
+    g_return_if_fail (INPUT_PAD_IS_GTK_WINDOW (data));
+
+    window = INPUT_PAD_GTK_WINDOW (data);
+    if (window->priv->xkb_config_reg == NULL) {
+        return;
+    }
+    if (*gtk_entry_get_text (GTK_ENTRY (entry)) == '\0') {
+        list = config_options_group_list_new (window);
+        gtk_tree_view_set_model (GTK_TREE_VIEW (window->priv->config_options_treeview),
+                                 GTK_TREE_MODEL (list));
+        g_object_unref (list);
+        return;
+    }
+    if (window->priv->config_options_index == NULL) {
+        window->priv->config_options_index =
+            config_options_index_new (window->priv->xkb_config_reg);
+    }
+
+    needle = g_utf8_casefold (gtk_entry_get_text (GTK_ENTRY (entry)), -1);
+    list = config_options_list_new ();
+    group_rows = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        NULL, (GDestroyNotify) gtk_tree_iter_free);
+    /* All the options are shown if the group matches. */
+    full_groups = g_hash_table_new (g_str_hash, g_str_equal);
+    for (i = 0; i < window->priv->config_options_index->len; i++) {
+        item = g_ptr_array_index (window->priv->config_options_index, i);
+        if (strstr (item->text, needle) == NULL ||
+            g_hash_table_contains (full_groups, item->parent)) {
+            continue;
+        }
+        groups =
+            input_pad_gdk_xkb_config_reg_lookup_option_group (window->priv->xkb_config_reg,
+                                                              item->parent);
+        if ((parent = g_hash_table_lookup (group_rows, item->parent)) == NULL) {
+            config_options_list_append_group (window, list, groups, &iter);
+            parent = gtk_tree_iter_copy (&iter);
+            g_hash_table_insert (group_rows, (gpointer) item->parent, parent);
+        }
+        if (item->name == NULL) {
+            g_hash_table_add (full_groups, (gpointer) item->parent);
+        }
+        config_options_list_append_options (window, list, parent, groups,
+                                            item->name);
+    }
+    g_hash_table_destroy (full_groups);
+    g_hash_table_destroy (group_rows);
+    g_free (needle);
+
+    gtk_tree_view_set_model (GTK_TREE_VIEW (window->priv->config_options_treeview),
+                             GTK_TREE_MODEL (list));
+    g_object_unref (list);
+    gtk_tree_view_expand_all (GTK_TREE_VIEW (window->priv->config_options_treeview));
+}
+
+/*
+ * Only the option groups are created and the options are appended
+ * when the group row is expanded.
+ */
 static void
 config_options_treeview_set (InputPadGtkWindow                 *input_pad,
                              InputPadXKBOptionGroupList        *xkb_group_list)
 {
-    InputPadXKBOptionGroupList *groups = NULL;
-    GtkWidget *expander;
-    GtkWidget *vbox;
-    GtkWidget *checkbutton;
-    GtkWidget *label;
+    GtkTreeStore *list;
     gchar **group_options = input_pad->priv->group_options;
     int i;
 
-    for (groups = xkb_group_list ; groups; groups = groups->next) {
-        int checked = 0;
-
-        expander = gtk_expander_new (groups->desc);
-        gtk_box_pack_start (GTK_BOX (input_pad->priv->config_options_vbox),
-                            expander, TRUE, TRUE, 0);
-        gtk_widget_show (expander);
-        g_object_set_data (G_OBJECT (expander), "option_group",
-                           (gpointer) groups->option_group);
-        g_object_set_data (G_OBJECT (expander), "checked",
-                           GINT_TO_POINTER (checked));
-        vbox = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
-        gtk_widget_set_margin_start (vbox, 18);
-        gtk_container_add (GTK_CONTAINER (expander), vbox);
-        gtk_widget_show (vbox);
-
-        InputPadXKBOptionList *options = groups->options;
-        while (options) {
-            gboolean has_option = FALSE;
-
-            checkbutton = gtk_check_button_new_with_label (options->desc);
-            g_object_set_data (G_OBJECT (checkbutton), "option",
-                               (gpointer) options->option);
-            for (i = 0; group_options[i]; i++) {
-                if (!g_strcmp0 (group_options[i], options->option)) {
-                    has_option = TRUE;
-                    break;
-                }
-            }
-            if (has_option) {
-                gchar *text = g_strdup_printf ("<b>%s</b>", groups->desc);
-
-                gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (checkbutton),
-                                              TRUE);
-                label = gtk_expander_get_label_widget (GTK_EXPANDER (expander));
-                gtk_label_set_markup (GTK_LABEL (label), text);
-                g_free (text);
-                g_object_set_data (G_OBJECT (expander), "checked",
-                                   GINT_TO_POINTER (++checked));
-            }
-            g_signal_connect (checkbutton, "toggled",
-                              G_CALLBACK (on_checkbutton_config_options_option_clicked),
-                              (gpointer) expander);
-            gtk_box_pack_start (GTK_BOX (vbox), checkbutton, FALSE, TRUE, 0);
-            gtk_widget_show (checkbutton);
-            options = options->next;
+    if (input_pad->priv->config_options_active == NULL) {
+        input_pad->priv->config_options_active =
+            g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    }
+    g_hash_table_remove_all (input_pad->priv->config_options_active);
+    for (i = 0; group_options && group_options[i]; i++) {
+        if (*group_options[i] == '\0') {
+            continue;
         }
+        g_hash_table_add (input_pad->priv->config_options_active,
+                          g_strdup (group_options[i]));
     }
+
+    list = config_options_group_list_new (input_pad);
+    gtk_tree_view_set_model (GTK_TREE_VIEW (input_pad->priv->config_options_treeview),
+                             GTK_TREE_MODEL (list));
+    g_object_unref (list);
+}
+
+static void
+config_treeviews_init (InputPadGtkWindow *input_pad)
+{
+    GtkWidget *treeview = input_pad->priv->config_options_treeview;
+    GtkCellRenderer *renderer;
+    GtkTreeViewColumn *column;
+
+    column = gtk_tree_view_column_new ();
+    renderer = gtk_cell_renderer_toggle_new ();
+    gtk_tree_view_column_pack_start (column, renderer, FALSE);
+    gtk_tree_view_column_set_attributes (column, renderer,
+                                         "active", OPTION_ACTIVE_COL,
+                                         "visible", OPTION_IS_OPTION_COL,
+                                         NULL);
+    g_signal_connect (renderer, "toggled",
+                      G_CALLBACK (on_cell_config_options_toggled),
+                      (gpointer) input_pad);
+    renderer = gtk_cell_renderer_text_new ();
+    gtk_tree_view_column_pack_start (column, renderer, TRUE);
+    gtk_tree_view_column_set_attributes (column, renderer,
+                                         "text", OPTION_DESC_COL,
+                                         "weight", OPTION_WEIGHT_COL,
+                                         NULL);
+    gtk_tree_view_append_column (GTK_TREE_VIEW (treeview), column);
+    gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (treeview), FALSE);
+
+    g_signal_connect (treeview, "test-expand-row",
+                      G_CALLBACK (on_treeview_config_options_test_expand_row),
+                      (gpointer) input_pad);
+    g_signal_connect (input_pad->priv->config_options_search_entry,
+                      "search-changed",
+                      G_CALLBACK (on_entry_config_options_search_changed),
+                      (gpointer) input_pad);
+    g_signal_connect (input_pad->priv->config_layouts_add_treeview,
+                      "test-expand-row",
+                      G_CALLBACK (on_treeview_config_layouts_test_expand_row),
+                      (gpointer) input_pad);
+    g_signal_connect (input_pad->priv->config_layouts_search_entry,
+                      "search-changed",
+                      G_CALLBACK (on_entry_config_layouts_search_changed),
+                      (gpointer) input_pad);
 }
 
 static GtkTreeModel *
 layout_model_new (InputPadGtkWindow            *input_pad,
-                  InputPadXKBLayoutList        *xkb_layout_list)
+                  InputPadXKBConfigReg         *xkb_config_reg)
 {
-    InputPadXKBLayoutList *layouts = NULL;
+    InputPadXKBLayoutList *layouts;
+    InputPadXKBVariantList *variants;
     GtkTreeStore *store;
     GtkTreeIter   iter;
     gchar **group_layouts = input_pad->priv->group_layouts;
     gchar **group_variants = input_pad->priv->group_variants;
     int i;
 
-    store = gtk_tree_store_new (LAYOUT_N_COLS, G_TYPE_STRING, G_TYPE_STRING,
-                                G_TYPE_STRING, G_TYPE_STRING, G_TYPE_BOOLEAN);
+    store = config_layouts_list_new ();
     for (i = 0; group_layouts[i]; i++) {
         const gchar *layout_name = NULL;
         const gchar *layout_desc = NULL;
@@ -3020,31 +5461,22 @@ layout_model_new (InputPadGtkWindow            *input_pad,
         const gchar *variant_desc = NULL;
         gboolean has_layout = FALSE;
 
-        for (layouts = xkb_layout_list ;layouts; layouts = layouts->next) {
-            InputPadXKBVariantList *variants = layouts->variants;
-
-            if (!g_strcmp0 (group_layouts[i], layouts->layout)) {
-                layout_name = layouts->layout;
-                layout_desc = layouts->desc;
-                if (group_variants == NULL ||
-                    i >= g_strv_length (group_variants) ||
-                    group_variants[i] == NULL ||
-                    *group_variants[i] == '\0') {
-                    has_layout = TRUE;
-                    break;
-                }
-                while (variants) {
-                    if (!g_strcmp0 (group_variants[i], variants->variant)) {
-                        has_layout = TRUE;
-                        variant_name = variants->variant;
-                        variant_desc = variants->desc;
-                        break;
-                    }
-                    variants = variants->next;
-                }
-            }
-            if (has_layout) {
-                break;
+        layouts = input_pad_gdk_xkb_config_reg_lookup_layout (xkb_config_reg,
+                                                              group_layouts[i]);
+        if (layouts != NULL) {
+            layout_name = layouts->layout;
+            layout_desc = layouts->desc;
+            if (group_variants == NULL ||
+                i >= g_strv_length (group_variants) ||
+                group_variants[i] == NULL ||
+                *group_variants[i] == '\0') {
+                has_layout = TRUE;
+            } else if ((variants = input_pad_gdk_xkb_config_reg_lookup_variant (xkb_config_reg,
+                                                                                group_layouts[i],
+                                                                                group_variants[i])) != NULL) {
+                has_layout = TRUE;
+                variant_name = variants->variant;
+                variant_desc = variants->desc;
             }
         }
         if (!has_layout) {
@@ -3080,8 +5512,7 @@ layout_model_new (InputPadGtkWindow            *input_pad,
 static void
 create_keyboard_layout_list_ui_real (GtkWidget *vbox, InputPadGtkWindow *window)
 {
-    InputPadXKBConfigReg *xkb_config_reg = window->priv->xkb_config_reg;
-    InputPadXKBLayoutList *layouts;
+    InputPadXKBConfigReg *xkb_config_reg = window->priv->xkb_group_config_reg;
     GtkWidget *hbox;
     GtkWidget *label;
     GtkWidget *combobox;
@@ -3091,12 +5522,7 @@ create_keyboard_layout_list_ui_real (GtkWidget *vbox, InputPadGtkWindow *window)
     GtkCellRenderer *renderer;
 
     g_return_if_fail (xkb_config_reg != NULL);
-    layouts = xkb_config_reg->layouts;
-    g_return_if_fail (layouts != NULL);
-    g_return_if_fail (xkb_config_reg->option_groups != NULL);
 
-    config_layouts_treeview_set (window, layouts);
-    config_options_treeview_set (window, xkb_config_reg->option_groups);
     hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 5);
     gtk_box_pack_start (GTK_BOX (vbox), hbox, FALSE, FALSE, 0);
     gtk_widget_show (hbox);
@@ -3108,7 +5534,7 @@ create_keyboard_layout_list_ui_real (GtkWidget *vbox, InputPadGtkWindow *window)
     combobox = gtk_combo_box_new ();
     gtk_label_set_mnemonic_widget (GTK_LABEL (label), combobox);
     gtk_box_pack_start (GTK_BOX (hbox), combobox, FALSE, FALSE, 0);
-    model = layout_model_new (window, layouts);
+    model = layout_model_new (window, xkb_config_reg);
     gtk_combo_box_set_model (GTK_COMBO_BOX (combobox), model);
     g_object_unref (G_OBJECT (model));
     if (gtk_tree_model_get_iter_first (model, &iter)) {
@@ -3137,7 +5563,7 @@ create_keyboard_layout_list_ui_real (GtkWidget *vbox, InputPadGtkWindow *window)
 
     g_signal_connect (button, "clicked",
                       G_CALLBACK (on_button_config_layouts_clicked),
-                      (gpointer) window->priv->config_layouts_dialog);
+                      (gpointer) window);
 }
 
 static void
@@ -3263,13 +5689,10 @@ all_char_table_model_new (void)
 {
     GtkTreeStore *store;
     GtkTreeIter   iter;
-    int i, j;
+    int i;
     unsigned int start, end;
     gchar *range;
     gchar *range2;
-    gchar buff[7];
-    gchar buff2[35]; /* 7 x 5 e.g. 'a' -> '0x61 ' */
-    gchar buff3[35];
 
     store = gtk_tree_store_new (CHAR_BLOCK_N_COLS,
                                 G_TYPE_STRING, G_TYPE_STRING,
@@ -3280,23 +5703,8 @@ all_char_table_model_new (void)
         gtk_tree_store_append (store, &iter, NULL);
         start = input_pad_unicode_block_table[i].start;
         end = input_pad_unicode_block_table[i].end;
-        range = g_strdup_printf ("U+%06X - U+%06X", start, end);
-
-        buff[g_unichar_to_utf8 ((gunichar) start, buff)] = '\0';
-        buff2[0] = '\0';
-        for (j = 0; buff[j] && j < 7; j++) {
-            sprintf (buff2 + j * 5, "0x%02X ", (unsigned char) buff[j]);
-        }
-        if (buff[0] == '\0') {
-            buff2[0] = '0'; buff2[0] = 'x'; buff2[1] = '0'; buff2[2] = '0';
-            buff2[3] = '\0';
-        }
-        buff[g_unichar_to_utf8 ((gunichar) end, buff)] = '\0';
-        buff3[0] = '\0';
-        for (j = 0; buff[j] && j < 7; j++) {
-            sprintf (buff3 + j * 5, "0x%02X ", (unsigned char) buff[j]);
-        }
-        range2 = g_strdup_printf ("%s - %s", buff2, buff3);
+        input_pad_unicode_block_format_range (start, end,
+                                              &range, &range2);
 
         gtk_tree_store_set (store, &iter,
                             CHAR_BLOCK_LABEL_COL,
@@ -3319,18 +5727,141 @@ all_char_table_model_new (void)
     return GTK_TREE_MODEL (store);
 }
 
+/* The builder has the objects of object_ids only. */
+static GtkBuilder *
+dialog_builder_new (gchar **object_ids)
+{
+    GtkBuilder *builder;
+    GError *error = NULL;
+
+    builder = gtk_builder_new ();
+    gtk_builder_set_translation_domain (builder, GETTEXT_PACKAGE);
+    if (!gtk_builder_add_objects_from_resource (builder, DIALOG_UI_RESOURCE,
+                                                object_ids, &error)) {
+        g_warning ("Could not load %s from %s: %s",
+                   object_ids[0], DIALOG_UI_RESOURCE, error->message);
+        g_error_free (error);
+        g_object_unref (builder);
+        return NULL;
+    }
+    return builder;
+}
+
 static void
-create_about_dialog_ui (GtkBuilder *builder, GtkWidget *window)
+config_dialogs_destroy (InputPadGtkWindow *window)
+{
+    if (window->priv->config_dialogs_disuse_id != 0) {
+        g_source_remove (window->priv->config_dialogs_disuse_id);
+        window->priv->config_dialogs_disuse_id = 0;
+    }
+    if (window->priv->config_layouts_dialog) {
+        gtk_widget_destroy (window->priv->config_layouts_dialog);
+    }
+    if (window->priv->config_options_dialog) {
+        gtk_widget_destroy (window->priv->config_options_dialog);
+    }
+    window->priv->config_layouts_dialog = NULL;
+    window->priv->config_layouts_add_treeview = NULL;
+    window->priv->config_layouts_remove_treeview = NULL;
+    window->priv->config_options_dialog = NULL;
+    window->priv->config_options_treeview = NULL;
+    window->priv->config_layouts_search_entry = NULL;
+    window->priv->config_options_search_entry = NULL;
+}
+
+static gboolean
+on_config_dialogs_disuse_timeout (gpointer data)
+{
+    InputPadGtkWindow *window = INPUT_PAD_GTK_WINDOW (data);
+
+    window->priv->config_dialogs_disuse_id = 0;
+    config_dialogs_destroy (window);
+    return FALSE;
+}
+
+static gboolean
+config_dialogs_ensure (InputPadGtkWindow *window)
+{
+    GtkBuilder *builder;
+    GtkWidget *button_close;
+    GtkWidget *button_add;
+    GtkWidget *button_remove;
+    GtkWidget *button_option;
+    GtkWidget *button_option_close;
+    gchar *object_ids[] = { "ConfigLayoutsDialog",
+                            "ConfigOptionsDialog",
+                            NULL };
+
+    if (window->priv->config_dialogs_disuse_id != 0) {
+        g_source_remove (window->priv->config_dialogs_disuse_id);
+        window->priv->config_dialogs_disuse_id = 0;
+    }
+    if (window->priv->config_layouts_dialog) {
+        return TRUE;
+    }
+    if ((builder = dialog_builder_new (object_ids)) == NULL) {
+        return FALSE;
+    }
+    button_close = GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsCloseButton"));
+    button_add = GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsAddButton"));
+    button_remove = GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsRemoveButton"));
+    button_option = GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsOptionButton"));
+    button_option_close = GTK_WIDGET (gtk_builder_get_object (builder, "ConfigOptionsCloseButton"));
+    window->priv->config_layouts_dialog =
+        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsDialog"));
+    window->priv->config_layouts_add_treeview =
+        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsAddTreeView"));
+    window->priv->config_layouts_remove_treeview =
+        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsRemoveTreeView"));
+    window->priv->config_options_dialog =
+        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigOptionsDialog"));
+    window->priv->config_options_treeview =
+        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigOptionsTreeView"));
+    window->priv->config_layouts_search_entry =
+        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsSearchEntry"));
+    window->priv->config_options_search_entry =
+        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigOptionsSearchEntry"));
+    config_treeviews_init (window);
+
+    g_signal_connect (G_OBJECT (button_close), "clicked",
+                      G_CALLBACK (on_button_config_layouts_close_clicked),
+                      (gpointer) window->priv->config_layouts_dialog);
+    g_signal_connect (G_OBJECT (button_add), "clicked",
+                      G_CALLBACK (on_button_config_layouts_add_clicked),
+                      (gpointer) window);
+    g_signal_connect (G_OBJECT (button_remove), "clicked",
+                      G_CALLBACK (on_button_config_layouts_remove_clicked),
+                      (gpointer) window);
+    g_signal_connect (G_OBJECT (button_option), "clicked",
+                      G_CALLBACK (on_button_config_options_clicked),
+                      (gpointer) window);
+    g_signal_connect (G_OBJECT (button_option_close), "clicked",
+                      G_CALLBACK (on_button_config_options_close_clicked),
+                      (gpointer) window);
+    g_object_unref (builder);
+    return TRUE;
+}
+
+static GtkWidget *
+create_about_dialog_ui (GtkWidget *window)
 {
+    GtkBuilder *builder;
     GtkWidget *about_dlg;
+    gchar *object_ids[] = { "AboutDialog", NULL };
 
+    if ((builder = dialog_builder_new (object_ids)) == NULL) {
+        return NULL;
+    }
     about_dlg = GTK_WIDGET (gtk_builder_get_object (builder, "AboutDialog"));
     set_about (about_dlg);
+    g_object_unref (builder);
+    return about_dlg;
 }
 
-static void
-create_code_point_dialog_ui (GtkBuilder *builder, GtkWidget *window)
+static GtkWidget *
+create_code_point_dialog_ui (GtkWidget *window)
 {
+    GtkBuilder *builder;
     GtkWidget *cp_dlg;
     GtkWidget *digit_hbox;
     GtkWidget *char_label;
@@ -3343,7 +5874,11 @@ create_code_point_dialog_ui (GtkBuilder *builder, GtkWidget *window)
     GList *orig_list;
     GList *list = NULL;
     static CodePointData cp_data = {NULL, NULL};
+    gchar *object_ids[] = { "CodePointDialog", NULL };
 
+    if ((builder = dialog_builder_new (object_ids)) == NULL) {
+        return NULL;
+    }
     cp_dlg = GTK_WIDGET (gtk_builder_get_object (builder, "CodePointDialog"));
 
     digit_hbox = GTK_WIDGET (gtk_builder_get_object (builder, "CodePointDigitHBox"));
@@ -3391,18 +5926,27 @@ create_code_point_dialog_ui (GtkBuilder *builder, GtkWidget *window)
                       G_CALLBACK (on_button_ok_clicked), (gpointer) cp_dlg);
 
     set_code_point_base (&cp_data, 16);
+    g_object_unref (builder);
+    return cp_dlg;
 }
 
-static void
-create_contents_dialog_ui (GtkBuilder *builder, GtkWidget *window)
+static GtkWidget *
+create_contents_dialog_ui (GtkWidget *window)
 {
+    GtkBuilder *builder;
     GtkWidget *contents_dlg;
     GtkWidget *contents_ok;
+    gchar *object_ids[] = { "ContentsDialog", NULL };
 
+    if ((builder = dialog_builder_new (object_ids)) == NULL) {
+        return NULL;
+    }
     contents_dlg = GTK_WIDGET (gtk_builder_get_object (builder, "ContentsDialog"));
     contents_ok = GTK_WIDGET (gtk_builder_get_object (builder, "ContentsOKButton"));
     g_signal_connect (G_OBJECT (contents_ok), "clicked",
                       G_CALLBACK (on_button_ok_clicked), (gpointer) contents_dlg);
+    g_object_unref (builder);
+    return contents_dlg;
 }
 
 static void
@@ -3431,6 +5975,8 @@ create_custom_char_views (GtkWidget *hbox, InputPadGtkWindow *window)
     /* GtkViewport is not used because the header of GtkTreeviewColumn
      * is hidden with GtkViewport. */
     main_tv = gtk_tree_view_new ();
+    /* The widget names are looked up by input-pad-bench-ui. */
+    gtk_widget_set_name (main_tv, "input-pad-custom-group-view");
     gtk_container_add (GTK_CONTAINER (scrolled), main_tv);
     model = custom_char_group_model_new (INPUT_PAD_GTK_WINDOW (window));
     gtk_tree_view_set_model (GTK_TREE_VIEW (main_tv), model);
@@ -3448,6 +5994,7 @@ create_custom_char_views (GtkWidget *hbox, InputPadGtkWindow *window)
     /* GtkViewport is not used because the header of GtkTreeviewColumn
      * is hidden with GtkViewport. */
     sub_tv = gtk_tree_view_new ();
+    gtk_widget_set_name (sub_tv, "input-pad-custom-table-view");
     gtk_container_add (GTK_CONTAINER (scrolled), sub_tv);
     gtk_widget_show (sub_tv);
 
@@ -3468,6 +6015,7 @@ create_custom_char_views (GtkWidget *hbox, InputPadGtkWindow *window)
     gtk_tree_view_set_show_expanders (GTK_TREE_VIEW (sub_tv), FALSE);
 
     scrolled = gtk_scrolled_window_new (NULL, NULL);
+    gtk_widget_set_name (scrolled, "input-pad-custom-char-view");
     gtk_widget_set_size_request (scrolled, 350, 200);
     gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
                                     GTK_POLICY_AUTOMATIC,
@@ -3550,8 +6098,20 @@ destroy_custom_char_views (GtkWidget *hbox, InputPadGtkWindow *window)
 }
 
 static void
-create_custom_char_view_ui (GtkBuilder *builder,
-                            GtkWidget  *window,
+custom_char_views_ensure (InputPadGtkWindow *window)
+{
+    InputPadGtkWindowPrivate *priv;
+
+    priv = input_pad_gtk_window_get_instance_private (window);
+    if (priv->custom_char_views_created) {
+        return;
+    }
+    create_custom_char_views (priv->top_custom_char_view_hbox, window);
+    priv->custom_char_views_created = 1;
+}
+
+static void
+create_custom_char_view_ui (GtkWidget  *window,
                             GActionMap *map)
 {
     InputPadGtkWindowPrivate *priv;
@@ -3563,12 +6123,11 @@ create_custom_char_view_ui (GtkBuilder *builder,
     priv = input_pad_gtk_window_get_instance_private (INPUT_PAD_GTK_WINDOW (window));
     hbox = priv->top_custom_char_view_hbox;
 
-    create_custom_char_views (hbox, INPUT_PAD_GTK_WINDOW (window));
-
     /* Should not call g_variant_unref() for g_action_change_state()
      * and g_simple_action_set_state() since the variant is floating? */
     action = g_action_map_lookup_action (map, "ShowCustomChars");
     if (set_show_table_type == 1) {
+        custom_char_views_ensure (INPUT_PAD_GTK_WINDOW (window));
         g_action_change_state (action, g_variant_new_boolean (TRUE));
         gtk_widget_show (hbox);
     } else {
@@ -3597,6 +6156,7 @@ append_all_char_view_table (GtkWidget      *scrolled,
     g_return_if_fail (INPUT_PAD_IS_GTK_WINDOW (window));
 
     input_pad = INPUT_PAD_GTK_WINDOW (window);
+    INPUT_PAD_TRACE2 (all_char_table, start, end);
 
     if ((end - start + 1) > INPUT_PAD_MAX_COLUMN * INPUT_PAD_MAX_ROW) {
 #if 0
@@ -3650,9 +6210,7 @@ destroy_all_char_view_table (GtkWidget *scrolled, InputPadGtkWindow *window)
 }
 
 static void
-create_all_char_view_ui (GtkBuilder    *builder,
-                         GtkWidget     *window,
-                         GActionMap    *map)
+all_char_view_ensure (InputPadGtkWindow *window)
 {
     InputPadGtkWindowPrivate *priv;
     GtkWidget *hbox;
@@ -3667,10 +6225,13 @@ create_all_char_view_ui (GtkBuilder    *builder,
     GtkCssProvider *css_provider;
     GtkStyleContext *style_context;
     static CharTreeViewData tv_data;
-    GAction *action;
     GError *error = NULL;
 
-    priv = input_pad_gtk_window_get_instance_private (INPUT_PAD_GTK_WINDOW (window));
+    priv = input_pad_gtk_window_get_instance_private (window);
+    if (priv->all_char_view_created) {
+        return;
+    }
+    priv->all_char_view_created = 1;
     hbox = priv->top_char_view_hbox;
 
     scrolled = gtk_scrolled_window_new (NULL, NULL);
@@ -3684,6 +6245,8 @@ create_all_char_view_ui (GtkBuilder    *builder,
     /* GtkViewport is not used because the header of GtkTreeviewColumn
      * is hidden with GtkViewport. */
     tv = gtk_tree_view_new ();
+    /* The widget names are looked up by input-pad-bench-ui. */
+    gtk_widget_set_name (tv, "input-pad-block-view");
     gtk_container_add (GTK_CONTAINER (scrolled), tv);
     model = all_char_table_model_new ();
     gtk_tree_view_set_model (GTK_TREE_VIEW (tv), model);
@@ -3712,6 +6275,7 @@ create_all_char_view_ui (GtkBuilder    *builder,
     gtk_tree_view_append_column (GTK_TREE_VIEW (tv), column);
 
     scrolled = gtk_scrolled_window_new (NULL, NULL);
+    gtk_widget_set_name (scrolled, "input-pad-all-char-view");
     gtk_widget_set_size_request (scrolled, 470, 200);
     gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
                                     GTK_POLICY_AUTOMATIC,
@@ -3741,7 +6305,7 @@ create_all_char_view_ui (GtkBuilder    *builder,
 
     selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (tv));
     tv_data.scrolled = scrolled;
-    tv_data.window = window;
+    tv_data.window = GTK_WIDGET (window);
     g_signal_connect (G_OBJECT (selection), "changed",
                       G_CALLBACK (on_tree_view_select_all_char), &tv_data);
 
@@ -3749,11 +6313,24 @@ create_all_char_view_ui (GtkBuilder    *builder,
     if (gtk_tree_model_get_iter_first (model, &iter)) {
         gtk_tree_selection_select_iter (selection, &iter);
     }
+}
+
+static void
+create_all_char_view_ui (GtkWidget     *window,
+                         GActionMap    *map)
+{
+    InputPadGtkWindowPrivate *priv;
+    GtkWidget *hbox;
+    GAction *action;
+
+    priv = input_pad_gtk_window_get_instance_private (INPUT_PAD_GTK_WINDOW (window));
+    hbox = priv->top_char_view_hbox;
 
     /* Should not call g_variant_unref() for g_action_change_state()
      * and g_simple_action_set_state() since the variant is floating? */
     action = g_action_map_lookup_action (map, "ShowAllChars");
     if (set_show_table_type == 2) {
+        all_char_view_ensure (INPUT_PAD_GTK_WINDOW (window));
         g_action_change_state (action, g_variant_new_boolean (TRUE));
         gtk_widget_show (hbox);
     } else {
@@ -3770,61 +6347,30 @@ create_all_char_view_ui (GtkBuilder    *builder,
 }
 
 static void
-create_keyboard_layout_ui (GtkBuilder  *builder,
-                           GtkWidget   *window,
+create_keyboard_layout_ui (GtkWidget   *window,
                            GActionMap  *map)
 {
     InputPadGtkWindowPrivate *priv;
     GtkWidget *keyboard_vbox;
-    GtkWidget *button_close;
-    GtkWidget *button_add;
-    GtkWidget *button_remove;
-    GtkWidget *button_option;
-    GtkWidget *button_option_close;
     GAction *action;
-    InputPadGtkWindow *input_pad = INPUT_PAD_GTK_WINDOW (window);
 
     priv = input_pad_gtk_window_get_instance_private (INPUT_PAD_GTK_WINDOW (window));
     keyboard_vbox = priv->top_keyboard_layout_vbox;
-    button_close = GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsCloseButton"));
-    button_add = GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsAddButton"));
-    button_remove = GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsRemoveButton"));
-    button_option = GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsOptionButton"));
-    button_option_close = GTK_WIDGET (gtk_builder_get_object (builder, "ConfigOptionsCloseButton"));
-    input_pad->priv->config_layouts_dialog =
-        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsDialog"));
-    input_pad->priv->config_layouts_add_treeview =
-        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsAddTreeView"));
-    input_pad->priv->config_layouts_remove_treeview =
-        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigLayoutsRemoveTreeView"));
-    input_pad->priv->config_options_dialog =
-        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigOptionsDialog"));
-    input_pad->priv->config_options_vbox =
-        GTK_WIDGET (gtk_builder_get_object (builder, "ConfigOptionsVBox"));
 
     g_signal_connect_after (G_OBJECT (window), "realize",
                             G_CALLBACK (on_window_realize),
                             (gpointer) keyboard_vbox);
-    g_signal_connect (G_OBJECT (button_close), "clicked",
-                      G_CALLBACK (on_button_config_layouts_close_clicked),
-                      (gpointer) input_pad->priv->config_layouts_dialog);
-    g_signal_connect (G_OBJECT (button_add), "clicked",
-                      G_CALLBACK (on_button_config_layouts_add_clicked),
-                      (gpointer) window);
-    g_signal_connect (G_OBJECT (button_remove), "clicked",
-                      G_CALLBACK (on_button_config_layouts_remove_clicked),
-                      (gpointer) window);
-    g_signal_connect (G_OBJECT (button_option), "clicked",
-                      G_CALLBACK (on_button_config_layouts_clicked),
-                      (gpointer) input_pad->priv->config_options_dialog);
-    g_signal_connect (G_OBJECT (button_option_close), "clicked",
-                      G_CALLBACK (on_button_config_options_close_clicked),
-                      (gpointer) input_pad);
+    g_signal_connect (G_OBJECT (window), "keymap-changed",
+                      G_CALLBACK (on_window_keymap_changed),
+                      (gpointer) keyboard_vbox);
+    g_signal_connect (G_OBJECT (window), "keyboard-changed",
+                      G_CALLBACK (on_window_keyboard_changed),
+                      NULL);
 
     /* Should not call g_variant_unref() for g_action_change_state()
      * and g_simple_action_set_state() since the variant is floating? */
     action = g_action_map_lookup_action (map, "ShowLayout");
-    if (set_show_layout_type == 1) {
+    if (set_show_layout_type != INPUT_PAD_WINDOW_SHOW_LAYOUT_TYPE_NOTHING) {
         g_action_change_state (action, g_variant_new_boolean (TRUE));
         gtk_widget_show (keyboard_vbox);
     } else {
@@ -3833,16 +6379,36 @@ create_keyboard_layout_ui (GtkBuilder  *builder,
     }
 }
 
+static void
+on_window_first_map (GtkWidget *widget, gpointer data)
+{
+    g_signal_handlers_disconnect_by_func (widget,
+                                          G_CALLBACK (on_window_first_map),
+                                          data);
+    first_frame_span = input_pad_profile_span_begin ("first-frame", NULL);
+}
+
+static gboolean
+on_window_first_draw (GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+    g_signal_handlers_disconnect_by_func (widget,
+                                          G_CALLBACK (on_window_first_draw),
+                                          data);
+    input_pad_profile_span_end (first_frame_span);
+    first_frame_span = NULL;
+    input_pad_profile_write ();
+    return FALSE;
+}
+
 static InputPadGtkWindow *
 create_ui (InputPadGtkApplication *app, unsigned int child)
 {
     GError *error = NULL;
     InputPadGtkWindow *window = NULL;
-    GtkBuilder *builder = NULL;
     GActionMap *map = G_ACTION_MAP (app);
+    InputPadProfileSpan *span;
 
-    builder = app->builder;
-
+    span = input_pad_profile_span_begin ("create-ui", NULL);
     window = INPUT_PAD_GTK_WINDOW (g_object_new (INPUT_PAD_TYPE_GTK_WINDOW,
                                                  "application", app,
                                                  NULL));
@@ -3855,22 +6421,50 @@ create_ui (InputPadGtkApplication *app, unsigned int child)
     gtk_window_set_default_icon_from_file (DATAROOTDIR "/pixmaps/input-pad.png",
                                            &error);
 
-    create_code_point_dialog_ui (builder, GTK_WIDGET (window));
-    create_about_dialog_ui (builder, GTK_WIDGET (window));
-    create_contents_dialog_ui (builder, GTK_WIDGET (window));
-    create_custom_char_view_ui (builder, GTK_WIDGET (window), map);
-    create_all_char_view_ui (builder, GTK_WIDGET (window), map);
-    create_keyboard_layout_ui (builder, GTK_WIDGET (window), map);
+    /* The dialogs and the hidden char views are created when
+     * they are shown. */
+    create_custom_char_view_ui (GTK_WIDGET (window), map);
+    create_all_char_view_ui (GTK_WIDGET (window), map);
+    create_keyboard_layout_ui (GTK_WIDGET (window), map);
 
-    gtk_builder_connect_signals (builder, NULL);
+    input_pad_profile_span_end (span);
+    if (input_pad_profile_is_enabled ()) {
+        g_signal_connect (G_OBJECT (window), "map",
+                          G_CALLBACK (on_window_first_map), NULL);
+        g_signal_connect_after (G_OBJECT (window), "draw",
+                                G_CALLBACK (on_window_first_draw), NULL);
+    }
 
     return window;
 }
 
 #ifdef MODULE_XTEST_GDK_BASE
 
+/* The module is looked up without g_module_open() to choose
+ * the command line option. */
+static gboolean
+has_xtest_gmodule (void)
+{
+    gchar *filename;
+    gboolean retval;
+
+    g_return_val_if_fail (MODULE_XTEST_GDK_BASE != NULL, FALSE);
+
+    if (!g_module_supported ()) {
+        return FALSE;
+    }
+
+    filename = g_module_build_path (MODULE_XTEST_GDK_DIR, MODULE_XTEST_GDK_BASE);
+    g_return_val_if_fail (filename != NULL, FALSE);
+
+    retval = g_file_test (filename, G_FILE_TEST_EXISTS);
+    g_free (filename);
+
+    return retval;
+}
+
 static GModule *
-open_xtest_gmodule (gboolean check)
+open_xtest_gmodule (void)
 {
     gchar *filename;
     GModule *module = NULL;
@@ -3880,10 +6474,8 @@ open_xtest_gmodule (gboolean check)
 
     if (!g_module_supported ()) {
         error = g_module_error ();
-        if (!check) {
-            g_warning ("Module (%s) is not supported on your platform: %s",
-                       MODULE_XTEST_GDK_BASE, error ? error : "");
-        }
+        g_warning ("Module (%s) is not supported on your platform: %s",
+                   MODULE_XTEST_GDK_BASE, error ? error : "");
         return NULL;
     }
 
@@ -3893,9 +6485,7 @@ open_xtest_gmodule (gboolean check)
     module = g_module_open (filename, G_MODULE_BIND_LAZY);
     if (module == NULL) {
         error = g_module_error ();
-        if (!check) {
-            g_warning ("Could not open %s: %s", filename, error ? error : "");
-        }
+        g_warning ("Could not open %s: %s", filename, error ? error : "");
         g_free (filename);
         return NULL;
     }
@@ -3940,7 +6530,7 @@ input_pad_gtk_window_xtest_gdk_init (InputPadGtkWindow *window)
     if (window->priv->module_gdk_xtest) {
         return;
     }
-    if ((module = open_xtest_gmodule (FALSE)) == NULL) {
+    if ((module = open_xtest_gmodule ()) == NULL) {
         return;
     }
 
@@ -4234,88 +6824,27 @@ input_pad_gtk_window_parse_kbdui_module_arg_init (int                          *
         return NULL;
     }
 
-    name = g_strdup_printf ("%s%s", MODULE_NAME_PREFIX, kbdui_name);
-    filepath = g_module_build_path (MODULE_KBDUI_DIR, name);
-    g_free (name);
-    g_return_val_if_fail (filepath != NULL, NULL);
-
-    module = kbdui_module_open (filepath);
-    if (module == NULL) {
-        error = g_module_error ();
-        g_warning ("Could not open %s: %s", filepath, error ? error : "");
-        g_free (filepath);
-        return NULL;
-    }
-    g_free (filepath);
-
-    if (!input_pad_gtk_window_kbdui_module_arg_init (argc, argv,
-                                                     module, kbdui_context)) {
-        kbdui_module_close (module);
-        return NULL;
-    }
-
-    return module;
-}
-
-static GList *
-input_pad_gtk_window_parse_kbdui_modules (int                          *argc,
-                                          char                       ***argv,
-                                          InputPadGtkKbduiContext      *kbdui_context)
-{
-    GList *list = NULL;
-    GError *error = NULL;
-    const gchar *err_message;
-    const gchar *dirname = MODULE_KBDUI_DIR;
-    const gchar *filename;
-    gchar *filepath;
-    GModule *module = NULL;
-    GDir *dir;
-
-    g_return_val_if_fail (MODULE_KBDUI_DIR != NULL, NULL);
-
-    if (!g_module_supported ()) {
-        err_message = g_module_error ();
-        g_warning ("Module is not supported on your platform: %s",
-                   err_message ? err_message : "");
-        return NULL;
-    }
-
-    if (!g_file_test (dirname, G_FILE_TEST_IS_DIR)) {
-        g_warning ("Directory Not Found: %s", dirname);
+    name = g_strdup_printf ("%s%s", MODULE_NAME_PREFIX, kbdui_name);
+    filepath = g_module_build_path (MODULE_KBDUI_DIR, name);
+    g_free (name);
+    g_return_val_if_fail (filepath != NULL, NULL);
+
+    module = kbdui_module_open (filepath);
+    if (module == NULL) {
+        error = g_module_error ();
+        g_warning ("Could not open %s: %s", filepath, error ? error : "");
+        g_free (filepath);
         return NULL;
     }
+    g_free (filepath);
 
-    if ((dir  = g_dir_open (dirname, 0, &error)) == NULL) {
-        g_warning ("Cannot Open Directory: %s: %s", dirname,
-                   error ? error->message ? error->message : "" : "");
-        g_error_free (error);
+    if (!input_pad_gtk_window_kbdui_module_arg_init (argc, argv,
+                                                     module, kbdui_context)) {
+        kbdui_module_close (module);
         return NULL;
     }
 
-    while ((filename = g_dir_read_name (dir)) != NULL) {
-        if (!check_module_filename (filename)) {
-            continue;
-        }
-        filepath = g_build_filename (dirname, filename, NULL);
-        module = kbdui_module_open (filepath);
-        if (module == NULL) {
-            err_message = g_module_error ();
-            g_warning ("Could not open %s: %s", filename, err_message ? err_message : "");
-            g_free (filepath);
-            continue;
-        }
-        g_free (filepath);
-
-        if (input_pad_gtk_window_kbdui_module_arg_init (argc, argv,
-                                                        module,
-                                                        kbdui_context)) {
-            list = g_list_append (list, module);
-        } else {
-            kbdui_module_close (module);
-        }
-    }
-    g_dir_close (dir);
-    return list;
+    return module;
 }
 
 static void
@@ -4450,6 +6979,13 @@ input_pad_gtk_window_set_priv (InputPadGtkWindow *window)
         priv->group = input_pad_group_parse_all_files (NULL, NULL);
     }
     priv->char_button_sensitive = TRUE;
+    priv->paste_threshold = paste_threshold;
+    priv->keyboard_geometry =
+        (set_show_layout_type == INPUT_PAD_WINDOW_SHOW_LAYOUT_TYPE_GEOMETRY);
+    if (repeat_delay > 0 && repeat_interval > 0) {
+        input_pad_gtk_button_set_repeat (repeat_delay, repeat_interval,
+                                         repeat_accelerate);
+    }
 
     if (kbdui_name) {
         priv->kbdui_name = g_strdup (kbdui_name);
@@ -4477,6 +7013,7 @@ static void
 input_pad_gtk_window_real_destroy (GtkWidget *widget)
 {
     InputPadGtkWindow *window = INPUT_PAD_GTK_WINDOW (widget);
+    int i;
 
     if (window->priv) {
         if (window->priv->group) {
@@ -4491,13 +7028,82 @@ input_pad_gtk_window_real_destroy (GtkWidget *widget)
         if (window->priv->kbdui) {
             input_pad_gtk_window_kbdui_destroy (window);
         }
+        input_pad_gdk_xkb_remove_keymap_events (window);
+        config_dialogs_destroy (window);
+        send_event_destroy (window);
+        run_command_cancel_all (window);
+        if (window->priv->command_plans) {
+            g_hash_table_destroy (window->priv->command_plans);
+            window->priv->command_plans = NULL;
+        }
+        if (window->priv->command_cache) {
+            g_hash_table_destroy (window->priv->command_cache);
+            window->priv->command_cache = NULL;
+        }
+        if (window->priv->paste_restore_id != 0) {
+            g_source_remove (window->priv->paste_restore_id);
+            window->priv->paste_restore_id = 0;
+        }
+        paste_restore (window);
+        /* The selections with the previous texts are not kept after
+         * the window is gone. */
+        for (i = 0; i < G_N_ELEMENTS (window->priv->paste_saved_texts); i++) {
+            if (gtk_clipboard_get_owner (paste_get_clipboard (window, i)) ==
+                G_OBJECT (window)) {
+                gtk_clipboard_clear (paste_get_clipboard (window, i));
+            }
+            g_free (window->priv->paste_saved_texts[i]);
+            window->priv->paste_saved_texts[i] = NULL;
+        }
+        g_free (window->priv->focus_class_name);
+        window->priv->focus_class_name = NULL;
+        input_pad_gdk_xkb_destroy_config_registry (window->priv->xkb_config_reg);
+        window->priv->xkb_config_reg = NULL;
+        input_pad_gdk_xkb_destroy_config_registry (window->priv->xkb_group_config_reg);
+        window->priv->xkb_group_config_reg = NULL;
+        if (window->priv->keyboard_buttons) {
+            g_hash_table_destroy (window->priv->keyboard_buttons);
+            window->priv->keyboard_buttons = NULL;
+        }
+        for (i = 0; i < N_KEYBOARD_LAYOUT_PART; i++) {
+            if (window->priv->keyboard_part_buttons[i]) {
+                g_ptr_array_free (window->priv->keyboard_part_buttons[i],
+                                  TRUE);
+                window->priv->keyboard_part_buttons[i] = NULL;
+            }
+        }
         g_free (window->priv->kbdui_name);
         window->priv->kbdui_name = NULL;
+        for (i = 0; i <= INPUT_PAD_TABLE_TYPE_COMMANDS; i++) {
+            int j;
+
+            for (j = 0; j < N_PRESS_STAGES; j++) {
+                if (window->priv->press_histograms[i][j]) {
+                    input_pad_profile_histogram_free (window->priv->press_histograms[i][j]);
+                    window->priv->press_histograms[i][j] = NULL;
+                }
+            }
+        }
         window->priv = NULL;
     }
     GTK_WIDGET_CLASS (input_pad_gtk_window_parent_class)->destroy (widget);
 }
 
+static gboolean
+button_pressed_accumulator (GSignalInvocationHint *ihint,
+                            GValue                *return_accu,
+                            const GValue          *handler_return,
+                            gpointer               data)
+{
+    PressTrace *trace = current_press_trace;
+
+    if (trace && trace->n_handlers < PRESS_TRACE_MAX_HANDLERS) {
+        trace->handler_end[trace->n_handlers++] = g_get_monotonic_time ();
+    }
+    return g_signal_accumulator_true_handled (ihint, return_accu,
+                                              handler_return, data);
+}
+
 static void
 input_pad_gtk_window_real_realize (GtkWidget *window)
 {
@@ -4519,16 +7125,17 @@ input_pad_gtk_window_real_button_pressed (InputPadGtkWindow *window,
                                           guint              keycode,
                                           guint              state)
 {
+    if (current_press_trace) {
+        current_press_trace->default_start = g_get_monotonic_time ();
+    }
     if (type == INPUT_PAD_TABLE_TYPE_CHARS) {
         if (keysym > 0) {
-            send_key_event (gtk_widget_get_window (GTK_WIDGET (window)),
-                            keysym, keycode, state);
+            send_key_event (window, keysym, keycode, state);
         } else {
             g_print ("%s", str ? str : "");
         }
     } else if (type == INPUT_PAD_TABLE_TYPE_KEYSYMS) {
-        send_key_event (gtk_widget_get_window (GTK_WIDGET (window)),
-                        keysym, keycode, state);
+        send_key_event (window, keysym, keycode, state);
     } else if (type == INPUT_PAD_TABLE_TYPE_STRINGS) {
             g_print ("%s", str ? str : "");
     } else if (type == INPUT_PAD_TABLE_TYPE_COMMANDS) {
@@ -4545,6 +7152,8 @@ input_pad_gtk_window_class_init (InputPadGtkWindowClass *klass)
     GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
     GtkWidgetClass *widget_class = (GtkWidgetClass *) klass;
 
+    gobject_class->set_property = input_pad_gtk_window_set_property;
+    gobject_class->get_property = input_pad_gtk_window_get_property;
     widget_class->destroy = input_pad_gtk_window_real_destroy;
     widget_class->realize = input_pad_gtk_window_real_realize;
 
@@ -4563,12 +7172,42 @@ input_pad_gtk_window_class_init (InputPadGtkWindowClass *klass)
                                                   InputPadGtkWindow,
                                                   top_keyboard_layout_vbox);
 
+    g_object_class_install_property (gobject_class,
+                                     PROP_STATS,
+                                     g_param_spec_variant ("stats",
+                                                           "Stats",
+                                                           "The runtime statistics of the window",
+                                                           G_VARIANT_TYPE_VARDICT,
+                                                           NULL,
+                                                           G_PARAM_READABLE |
+                                                           G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property (gobject_class,
+                                     PROP_PASTE_THRESHOLD,
+                                     g_param_spec_int ("paste-threshold",
+                                                       "Paste threshold",
+                                                       "The strings of this length or more are pasted with the clipboard instead of the button-pressed signal. -1 disables it",
+                                                       -1, G_MAXINT, -1,
+                                                       G_PARAM_READWRITE |
+                                                       G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property (gobject_class,
+                                     PROP_LAYOUT_KEYS,
+                                     g_param_spec_boolean ("layout-keys",
+                                                           "Layout keys",
+                                                           "The CHARS and KEYSYMS buttons on the current layout are emitted with their keysyms, keycodes and level modifiers",
+                                                           FALSE,
+                                                           G_PARAM_READWRITE |
+                                                           G_PARAM_STATIC_STRINGS));
+
+    /* button-pressed has the string, the table type, the keysym,
+     * the keycode and the modifier state of the pressed button.
+     * The keysym of a CHARS button is 0 unless "layout-keys" is TRUE
+     * and the character is found on the current layout. */
     signals[BUTTON_PRESSED] =
         g_signal_new (I_("button-pressed"),
                       G_TYPE_FROM_CLASS (gobject_class),
                       G_SIGNAL_RUN_LAST,
                       G_STRUCT_OFFSET (InputPadGtkWindowClass, button_pressed),
-                      g_signal_accumulator_true_handled, NULL,
+                      button_pressed_accumulator, NULL,
                       INPUT_PAD_BOOL__STRING_UINT_UINT_UINT_UINT,
                       G_TYPE_BOOLEAN,
                       5, G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
@@ -4624,6 +7263,16 @@ input_pad_gtk_window_class_init (InputPadGtkWindowClass *klass)
                       g_cclosure_marshal_VOID__VOID,
                       G_TYPE_NONE,
                       0);
+
+    signals[KEYMAP_CHANGED] =
+        g_signal_new (I_("keymap-changed"),
+                      G_TYPE_FROM_CLASS (gobject_class),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (InputPadGtkWindowClass, keymap_changed),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__VOID,
+                      G_TYPE_NONE,
+                      0);
 }
 
 InputPadGtkWindow *
@@ -4723,6 +7372,83 @@ input_pad_gtk_window_reorder_button_pressed (InputPadGtkWindow *window)
     g_signal_emit (window, signals[REORDER_BUTTON_PRESSED], 0);
 }
 
+/*
+ * The strings of threshold characters or more are put on the selections
+ * and pasted with one key instead of being emitted with button-pressed.
+ */
+void
+input_pad_gtk_window_set_paste_threshold (InputPadGtkWindow *window,
+                                          int                threshold)
+{
+    g_return_if_fail (INPUT_PAD_IS_GTK_WINDOW (window));
+
+    if (threshold < -1) {
+        threshold = -1;
+    }
+    if (window->priv->paste_threshold == threshold) {
+        return;
+    }
+    window->priv->paste_threshold = threshold;
+    g_object_notify (G_OBJECT (window), "paste-threshold");
+}
+
+int
+input_pad_gtk_window_get_paste_threshold (InputPadGtkWindow *window)
+{
+    g_return_val_if_fail (INPUT_PAD_IS_GTK_WINDOW (window), -1);
+
+    return window->priv->paste_threshold;
+}
+
+/*
+ * When layout_keys is TRUE, the CHARS button of one character and
+ * the KEYSYMS button which are found on the current layout are
+ * emitted with button-pressed with the keysym, the keycode and
+ * the level modifiers of the key. The default handler then sends
+ * the key event instead of printing the CHARS string.
+ */
+void
+input_pad_gtk_window_set_layout_keys (InputPadGtkWindow *window,
+                                      gboolean           layout_keys)
+{
+    g_return_if_fail (INPUT_PAD_IS_GTK_WINDOW (window));
+
+    layout_keys = (layout_keys != FALSE);
+    if (window->priv->layout_keys == layout_keys) {
+        return;
+    }
+    window->priv->layout_keys = layout_keys;
+    g_object_notify (G_OBJECT (window), "layout-keys");
+}
+
+gboolean
+input_pad_gtk_window_get_layout_keys (InputPadGtkWindow *window)
+{
+    g_return_val_if_fail (INPUT_PAD_IS_GTK_WINDOW (window), FALSE);
+
+    return window->priv->layout_keys;
+}
+
+/*
+ * Looks up the key of keysym on the group of the current layout with
+ * the reverse index of the keymap, which is rebuilt when the keymap
+ * is changed. It does not send any server requests and is called on
+ * the main thread only.
+ */
+gboolean
+input_pad_gtk_window_lookup_keysym (InputPadGtkWindow *window,
+                                    guint              keysym,
+                                    int                group,
+                                    guint             *keycodep,
+                                    guint             *modsp)
+{
+    g_return_val_if_fail (INPUT_PAD_IS_GTK_WINDOW (window), FALSE);
+
+    return input_pad_gdk_xkb_lookup_keysym (window->priv->xkb_key_list,
+                                            keysym, group,
+                                            keycodep, modsp);
+}
+
 guint
 input_pad_gtk_window_get_keyboard_state (InputPadGtkWindow *window)
 {
@@ -4769,21 +7495,116 @@ input_pad_gtk_window_set_keyboard_state_with_keysym (InputPadGtkWindow *window,
     }
 }
 
-InputPadWindowKbduiName *
-input_pad_gtk_window_get_kbdui_name_list (void)
+static KbduiModuleOptions *
+kbdui_module_options_alloc (const gchar *module)
+{
+    KbduiModuleOptions *options = g_slice_new0 (KbduiModuleOptions);
+
+    options->module = g_strdup (module);
+    options->entries = g_array_new (FALSE, TRUE, sizeof (GOptionEntry));
+    options->args = g_ptr_array_new_with_free_func (g_free);
+    return options;
+}
+
+static void
+kbdui_module_options_free (KbduiModuleOptions *options)
+{
+    GOptionEntry *entry;
+    guint i;
+
+    for (i = 0; i < options->entries->len; i++) {
+        entry = &g_array_index (options->entries, GOptionEntry, i);
+        g_free ((gpointer) entry->long_name);
+        g_free ((gpointer) entry->description);
+        g_free ((gpointer) entry->arg_description);
+    }
+    g_array_free (options->entries, TRUE);
+    g_ptr_array_free (options->args, TRUE);
+    g_free (options->module);
+    g_free (options->name);
+    g_free (options->description);
+    g_free (options->help_description);
+    g_slice_free (KbduiModuleOptions, options);
+}
+
+static KbduiModuleOptions *
+kbdui_module_options_find (GPtrArray *options_list, const gchar *module)
+{
+    KbduiModuleOptions *options;
+    guint i;
+
+    for (i = 0; options_list && i < options_list->len; i++) {
+        options = g_ptr_array_index (options_list, i);
+        if (g_strcmp0 (options->module, module) == 0) {
+            return options;
+        }
+    }
+    return NULL;
+}
+
+/* The descriptions are translated with the domain of the module. */
+static KbduiModuleOptions *
+kbdui_module_options_new (const gchar *name, GModule *module)
+{
+    KbduiModuleOptions *options;
+    const GOptionEntry *entries;
+    const gchar *group_name = NULL;
+    const gchar *description = NULL;
+    const gchar *help_description = NULL;
+    const gchar *domain = NULL;
+    const GOptionEntry * (* get_option_entries) (const gchar **name,
+                                                 const gchar **description,
+                                                 const gchar **help_description,
+                                                 const gchar **domain);
+    GOptionEntry entry;
+    int i;
+
+    options = kbdui_module_options_alloc (name);
+    if (!g_module_symbol (module, "input_pad_module_get_option_entries",
+                          (gpointer *) &get_option_entries) ||
+        get_option_entries == NULL) {
+        return options;
+    }
+    options->known = TRUE;
+    entries = get_option_entries (&group_name, &description,
+                                  &help_description, &domain);
+    if (entries == NULL || group_name == NULL) {
+        return options;
+    }
+    options->name = g_strdup (group_name);
+    options->description =
+        g_strdup (KBDUI_OPTION_TRANSLATE (domain, description));
+    options->help_description =
+        g_strdup (KBDUI_OPTION_TRANSLATE (domain, help_description));
+    for (i = 0; entries[i].long_name; i++) {
+        if (*entries[i].long_name == '\0') {
+            continue;
+        }
+        entry = entries[i];
+        entry.long_name = g_strdup (entries[i].long_name);
+        entry.arg_data = NULL;
+        entry.description =
+            g_strdup (KBDUI_OPTION_TRANSLATE (domain, entries[i].description));
+        entry.arg_description =
+            g_strdup (KBDUI_OPTION_TRANSLATE (domain,
+                                              entries[i].arg_description));
+        g_array_append_val (options->entries, entry);
+    }
+    return options;
+}
+
+static InputPadWindowKbduiName *
+kbdui_name_list_scan (const gchar *dirname, GPtrArray *options_list)
 {
     InputPadWindowKbduiName *list = NULL;
     GError *error = NULL;
     const gchar *err_message;
-    const gchar *dirname = MODULE_KBDUI_DIR;
     const gchar *filename;
     gchar *filepath;
     GModule *module = NULL;
     GDir *dir;
     int len = 0;
 
-    g_return_val_if_fail (MODULE_KBDUI_DIR != NULL, NULL);
-
     if (!g_module_supported ()) {
         err_message = g_module_error ();
         g_warning ("Module is not supported on your platform: %s",
@@ -4842,29 +7663,502 @@ input_pad_gtk_window_get_kbdui_name_list (void)
             len++;
             list = g_renew (InputPadWindowKbduiName, list, len);
         }
-        list[len - 1].name = list[len - 1].description = NULL;
-        list[len - 1].type = INPUT_PAD_WINDOW_TYPE_GTK;
-        list[len - 2].name = g_strdup (name);
-        g_free (name);
-        input_pad_gtk_window_kbdui_module_get_desc (&list[len -2], module);
-        kbdui_module_close (module);
+        list[len - 1].name = list[len - 1].description = NULL;
+        list[len - 1].type = INPUT_PAD_WINDOW_TYPE_GTK;
+        list[len - 2].name = g_strdup (name);
+        g_free (name);
+        input_pad_gtk_window_kbdui_module_get_desc (&list[len -2], module);
+        if (options_list) {
+            g_ptr_array_add (options_list,
+                             kbdui_module_options_new (list[len - 2].name,
+                                                       module));
+        }
+        kbdui_module_close (module);
+    }
+    g_dir_close (dir);
+    return list;
+}
+
+void
+input_pad_gtk_window_get_kbdui_name_list_free (InputPadWindowKbduiName *list)
+{
+    int i;
+
+    for (i = 0; list[i].name != NULL; i++) {
+        g_free (list[i].name);
+        g_free (list[i].description);
+        list[i].name = NULL;
+        list[i].description = NULL;
+    }
+    g_free (list);
+}
+
+static InputPadWindowKbduiName *
+kbdui_name_list_copy (const InputPadWindowKbduiName *list)
+{
+    InputPadWindowKbduiName *retval;
+    int i, len;
+
+    if (list == NULL) {
+        return NULL;
+    }
+    for (len = 0; list[len].name != NULL; len++);
+    retval = g_new0 (InputPadWindowKbduiName, len + 1);
+    for (i = 0; i < len; i++) {
+        retval[i].name = g_strdup (list[i].name);
+        retval[i].description = g_strdup (list[i].description);
+        retval[i].type = list[i].type;
+    }
+    retval[len].type = INPUT_PAD_WINDOW_TYPE_GTK;
+    return retval;
+}
+
+static gint64
+kbdui_manifest_get_dir_mtime (const gchar *dirname)
+{
+    GStatBuf buf;
+
+    if (g_stat (dirname, &buf) != 0) {
+        return -1;
+    }
+    return (gint64) buf.st_mtime;
+}
+
+static gchar *
+kbdui_manifest_get_path (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), PACKAGE,
+                             KBDUI_MANIFEST_FILE, NULL);
+}
+
+static gchar *
+kbdui_manifest_get_string (GKeyFile     *keyfile,
+                           const gchar  *group,
+                           const gchar  *key)
+{
+    gchar *str = g_key_file_get_string (keyfile, group, key, NULL);
+
+    if (str && *str == '\0') {
+        g_free (str);
+        return NULL;
+    }
+    return str;
+}
+
+static KbduiModuleOptions *
+kbdui_manifest_load_options (GKeyFile      *keyfile,
+                             const gchar   *group,
+                             const gchar   *module)
+{
+    KbduiModuleOptions *options;
+    GOptionEntry entry;
+    gchar **names;
+    gchar *option_group;
+    gsize i, len = 0;
+
+    options = kbdui_module_options_alloc (module);
+    options->known = g_key_file_get_boolean (keyfile, group,
+                                             "OptionsKnown", NULL);
+    options->name = kbdui_manifest_get_string (keyfile, group, "OptionGroup");
+    if (!options->known || options->name == NULL) {
+        return options;
+    }
+    options->description = kbdui_manifest_get_string (keyfile, group,
+                                                      "OptionDescription");
+    options->help_description = kbdui_manifest_get_string (keyfile, group,
+                                                           "OptionHelp");
+    names = g_key_file_get_string_list (keyfile, group, "Options",
+                                        &len, NULL);
+    for (i = 0; i < len; i++) {
+        option_group = g_strconcat (KBDUI_MANIFEST_OPTION_GROUP_PREFIX,
+                                    module, " ", names[i], NULL);
+        memset (&entry, 0, sizeof (GOptionEntry));
+        entry.long_name = g_strdup (names[i]);
+        entry.short_name = (gchar) g_key_file_get_integer (keyfile,
+                                                           option_group,
+                                                           "ShortName",
+                                                           NULL);
+        entry.flags = g_key_file_get_integer (keyfile, option_group,
+                                              "Flags", NULL);
+        entry.arg = (GOptionArg) g_key_file_get_integer (keyfile,
+                                                         option_group,
+                                                         "Arg", NULL);
+        entry.description = kbdui_manifest_get_string (keyfile, option_group,
+                                                       "Description");
+        entry.arg_description = kbdui_manifest_get_string (keyfile,
+                                                           option_group,
+                                                           "ArgDescription");
+        g_array_append_val (options->entries, entry);
+        g_free (option_group);
+    }
+    g_strfreev (names);
+    return options;
+}
+
+/* The descriptions are translated so the manifest is also invalid when
+ * the language is changed. */
+static gboolean
+kbdui_manifest_load (const gchar               *dirname,
+                     gint64                     mtime,
+                     InputPadWindowKbduiName  **listp,
+                     GPtrArray                 *options_list)
+{
+    GKeyFile *keyfile;
+    InputPadWindowKbduiName *list;
+    gchar *path;
+    gchar *str;
+    gchar *group;
+    gchar **names = NULL;
+    gsize i, len = 0;
+    gboolean retval = FALSE;
+
+    keyfile = g_key_file_new ();
+    path = kbdui_manifest_get_path ();
+    if (!g_key_file_load_from_file (keyfile, path, G_KEY_FILE_NONE, NULL)) {
+        goto out;
+    }
+    if (g_key_file_get_integer (keyfile, KBDUI_MANIFEST_GROUP,
+                                "Version", NULL) != KBDUI_MANIFEST_VERSION) {
+        goto out;
+    }
+    str = g_key_file_get_string (keyfile, KBDUI_MANIFEST_GROUP,
+                                 "Directory", NULL);
+    if (g_strcmp0 (str, dirname) != 0) {
+        g_free (str);
+        goto out;
+    }
+    g_free (str);
+    str = g_key_file_get_string (keyfile, KBDUI_MANIFEST_GROUP,
+                                 "Language", NULL);
+    if (g_strcmp0 (str, g_get_language_names ()[0]) != 0) {
+        g_free (str);
+        goto out;
+    }
+    g_free (str);
+    if (g_key_file_get_int64 (keyfile, KBDUI_MANIFEST_GROUP,
+                              "MTime", NULL) != mtime) {
+        goto out;
+    }
+    names = g_key_file_get_string_list (keyfile, KBDUI_MANIFEST_GROUP,
+                                        "Modules", &len, NULL);
+    if (names == NULL || len == 0) {
+        *listp = NULL;
+        retval = TRUE;
+        goto out;
+    }
+    list = g_new0 (InputPadWindowKbduiName, len + 1);
+    for (i = 0; i < len; i++) {
+        group = g_strconcat (KBDUI_MANIFEST_MODULE_GROUP_PREFIX, names[i],
+                             NULL);
+        list[i].name = g_strdup (names[i]);
+        list[i].description = g_key_file_get_string (keyfile, group,
+                                                     "Description", NULL);
+        list[i].type = g_key_file_get_integer (keyfile, group, "Type", NULL);
+        if (options_list) {
+            g_ptr_array_add (options_list,
+                             kbdui_manifest_load_options (keyfile, group,
+                                                          names[i]));
+        }
+        g_free (group);
+    }
+    list[len].type = INPUT_PAD_WINDOW_TYPE_GTK;
+    *listp = list;
+    retval = TRUE;
+
+out:
+    g_strfreev (names);
+    g_free (path);
+    g_key_file_free (keyfile);
+    return retval;
+}
+
+static void
+kbdui_manifest_save_options (GKeyFile                 *keyfile,
+                             const gchar              *group,
+                             const KbduiModuleOptions *options)
+{
+    GOptionEntry *entry;
+    GPtrArray *names;
+    gchar *option_group;
+    guint i;
+
+    g_key_file_set_boolean (keyfile, group, "OptionsKnown", options->known);
+    if (!options->known || options->name == NULL) {
+        return;
+    }
+    g_key_file_set_string (keyfile, group, "OptionGroup", options->name);
+    g_key_file_set_string (keyfile, group, "OptionDescription",
+                           options->description ? options->description : "");
+    g_key_file_set_string (keyfile, group, "OptionHelp",
+                           options->help_description ?
+                               options->help_description : "");
+    names = g_ptr_array_new ();
+    for (i = 0; i < options->entries->len; i++) {
+        entry = &g_array_index (options->entries, GOptionEntry, i);
+        g_ptr_array_add (names, (gpointer) entry->long_name);
+        option_group = g_strconcat (KBDUI_MANIFEST_OPTION_GROUP_PREFIX,
+                                    options->module, " ", entry->long_name,
+                                    NULL);
+        g_key_file_set_integer (keyfile, option_group, "ShortName",
+                                entry->short_name);
+        g_key_file_set_integer (keyfile, option_group, "Flags", entry->flags);
+        g_key_file_set_integer (keyfile, option_group, "Arg", entry->arg);
+        g_key_file_set_string (keyfile, option_group, "Description",
+                               entry->description ? entry->description : "");
+        g_key_file_set_string (keyfile, option_group, "ArgDescription",
+                               entry->arg_description ?
+                                   entry->arg_description : "");
+        g_free (option_group);
+    }
+    g_key_file_set_string_list (keyfile, group, "Options",
+                                (const gchar * const *) names->pdata,
+                                names->len);
+    g_ptr_array_free (names, TRUE);
+}
+
+static void
+kbdui_manifest_save (const gchar                   *dirname,
+                     gint64                         mtime,
+                     const InputPadWindowKbduiName *list,
+                     GPtrArray                     *options_list)
+{
+    KbduiModuleOptions *options;
+    GKeyFile *keyfile;
+    GError *error = NULL;
+    GPtrArray *names;
+    gchar *path;
+    gchar *dir;
+    gchar *group;
+    int i;
+
+    keyfile = g_key_file_new ();
+    g_key_file_set_integer (keyfile, KBDUI_MANIFEST_GROUP,
+                            "Version", KBDUI_MANIFEST_VERSION);
+    g_key_file_set_string (keyfile, KBDUI_MANIFEST_GROUP,
+                           "Directory", dirname);
+    g_key_file_set_int64 (keyfile, KBDUI_MANIFEST_GROUP, "MTime", mtime);
+    g_key_file_set_string (keyfile, KBDUI_MANIFEST_GROUP,
+                           "Language", g_get_language_names ()[0]);
+    names = g_ptr_array_new ();
+    for (i = 0; list && list[i].name != NULL; i++) {
+        g_ptr_array_add (names, list[i].name);
+        group = g_strconcat (KBDUI_MANIFEST_MODULE_GROUP_PREFIX, list[i].name,
+                             NULL);
+        g_key_file_set_string (keyfile, group, "Description",
+                               list[i].description ? list[i].description : "");
+        g_key_file_set_integer (keyfile, group, "Type", list[i].type);
+        options = kbdui_module_options_find (options_list, list[i].name);
+        if (options) {
+            kbdui_manifest_save_options (keyfile, group, options);
+        }
+        g_free (group);
+    }
+    g_key_file_set_string_list (keyfile, KBDUI_MANIFEST_GROUP, "Modules",
+                                (const gchar * const *) names->pdata,
+                                names->len);
+    g_ptr_array_free (names, TRUE);
+
+    path = kbdui_manifest_get_path ();
+    dir = g_path_get_dirname (path);
+    if (g_mkdir_with_parents (dir, 0700) != 0 ||
+        !g_key_file_save_to_file (keyfile, path, &error)) {
+        g_debug ("Could not save %s: %s", path,
+                 error ? error->message : g_strerror (errno));
+        g_clear_error (&error);
+    }
+    g_free (dir);
+    g_free (path);
+    g_key_file_free (keyfile);
+}
+
+/* The modules are opened only when the manifest is out of date. */
+InputPadWindowKbduiName *
+input_pad_gtk_window_get_kbdui_name_list (void)
+{
+    const gchar *dirname = MODULE_KBDUI_DIR;
+    InputPadWindowKbduiName *list = NULL;
+    GPtrArray *options_list;
+    gint64 mtime;
+
+    g_return_val_if_fail (MODULE_KBDUI_DIR != NULL, NULL);
+
+    if ((mtime = kbdui_manifest_get_dir_mtime (dirname)) < 0) {
+        return kbdui_name_list_scan (dirname, NULL);
+    }
+    if (mtime == kbdui_name_list_mtime) {
+        return kbdui_name_list_copy (kbdui_name_list);
+    }
+    if (!kbdui_manifest_load (dirname, mtime, &list, NULL)) {
+        options_list = g_ptr_array_new_with_free_func (
+                (GDestroyNotify) kbdui_module_options_free);
+        list = kbdui_name_list_scan (dirname, options_list);
+        kbdui_manifest_save (dirname, mtime, list, options_list);
+        g_ptr_array_free (options_list, TRUE);
+    }
+    if (kbdui_name_list) {
+        input_pad_gtk_window_get_kbdui_name_list_free (kbdui_name_list);
+    }
+    kbdui_name_list = list;
+    kbdui_name_list_mtime = mtime;
+    return kbdui_name_list_copy (kbdui_name_list);
+}
+
+static GPtrArray *
+kbdui_module_options_get_all (void)
+{
+    const gchar *dirname = MODULE_KBDUI_DIR;
+    InputPadWindowKbduiName *list = NULL;
+    GPtrArray *options_list;
+    gint64 mtime;
+
+    options_list = g_ptr_array_new_with_free_func (
+            (GDestroyNotify) kbdui_module_options_free);
+    if ((mtime = kbdui_manifest_get_dir_mtime (dirname)) < 0) {
+        g_warning ("Directory Not Found: %s", dirname);
+        return options_list;
+    }
+    if (!kbdui_manifest_load (dirname, mtime, &list, options_list)) {
+        g_ptr_array_set_size (options_list, 0);
+        list = kbdui_name_list_scan (dirname, options_list);
+        kbdui_manifest_save (dirname, mtime, list, options_list);
+    }
+    if (kbdui_name_list) {
+        input_pad_gtk_window_get_kbdui_name_list_free (kbdui_name_list);
+    }
+    kbdui_name_list = list;
+    kbdui_name_list_mtime = mtime;
+    return options_list;
+}
+
+static gboolean
+on_kbdui_option_proxy (const gchar     *option_name,
+                       const gchar     *value,
+                       gpointer         data,
+                       GError         **error)
+{
+    KbduiModuleOptions *options = (KbduiModuleOptions *) data;
+
+    if (value && g_str_has_prefix (option_name, "--")) {
+        g_ptr_array_add (options->args,
+                         g_strdup_printf ("%s=%s", option_name, value));
+        return TRUE;
+    }
+    g_ptr_array_add (options->args, g_strdup (option_name));
+    if (value) {
+        g_ptr_array_add (options->args, g_strdup (value));
+    }
+    return TRUE;
+}
+
+/* The proxies keep the given options to pass them to the module
+ * after it is opened. */
+static void
+kbdui_module_options_add_proxy (KbduiModuleOptions *options,
+                                GOptionContext     *context)
+{
+    GOptionGroup *group;
+    GOptionEntry *proxies;
+    GOptionEntry *entry;
+    guint i;
+
+    if (options->entries->len == 0) {
+        return;
+    }
+    group = g_option_group_new (options->name,
+                                options->description,
+                                options->help_description,
+                                options, NULL);
+    proxies = g_new0 (GOptionEntry, options->entries->len + 1);
+    for (i = 0; i < options->entries->len; i++) {
+        entry = &g_array_index (options->entries, GOptionEntry, i);
+        proxies[i] = *entry;
+        proxies[i].arg = G_OPTION_ARG_CALLBACK;
+        proxies[i].arg_data = (gpointer) on_kbdui_option_proxy;
+        proxies[i].flags &= ~G_OPTION_FLAG_REVERSE;
+        if (entry->arg == G_OPTION_ARG_NONE) {
+            proxies[i].flags |= G_OPTION_FLAG_NO_ARG;
+        } else if (entry->arg == G_OPTION_ARG_FILENAME ||
+                   entry->arg == G_OPTION_ARG_FILENAME_ARRAY) {
+            proxies[i].flags |= G_OPTION_FLAG_FILENAME;
+        }
+    }
+    g_option_group_add_entries (group, proxies);
+    g_free (proxies);
+    g_option_context_add_group (context, group);
+}
+
+/* The modules which do not describe their options are opened before
+ * the arguments are parsed and the others are represented by
+ * the proxies. */
+static GList *
+kbdui_module_options_add_to_context (int                          *argc,
+                                     char                       ***argv,
+                                     GPtrArray                    *options_list,
+                                     InputPadGtkKbduiContext      *kbdui_context)
+{
+    KbduiModuleOptions *options;
+    GModule *module;
+    GList *list = NULL;
+    guint i;
+
+    for (i = 0; i < options_list->len; i++) {
+        options = g_ptr_array_index (options_list, i);
+        if (options->known) {
+            kbdui_module_options_add_proxy (options, kbdui_context->context);
+            continue;
+        }
+        module = input_pad_gtk_window_parse_kbdui_module_arg_init (argc, argv,
+                                                                   options->module,
+                                                                   kbdui_context);
+        if (module) {
+            list = g_list_append (list, module);
+        }
     }
-    g_dir_close (dir);
     return list;
 }
 
-void
-input_pad_gtk_window_get_kbdui_name_list_free (InputPadWindowKbduiName *list)
+/* The module whose options are given is opened and parses them. */
+static GList *
+kbdui_module_options_open_given (GPtrArray                    *options_list,
+                                 InputPadGtkKbduiContext      *kbdui_context,
+                                 GList                        *list)
 {
-    int i;
+    KbduiModuleOptions *options;
+    GOptionContext *context;
+    GModule *module;
+    GError *error = NULL;
+    gchar **args;
+    guint i, j;
 
-    for (i = 0; list[i].name != NULL; i++) {
-        g_free (list[i].name);
-        g_free (list[i].description);
-        list[i].name = NULL;
-        list[i].description = NULL;
+    for (i = 0; i < options_list->len; i++) {
+        options = g_ptr_array_index (options_list, i);
+        if (!options->known || options->args->len == 0) {
+            continue;
+        }
+        args = g_new0 (gchar *, options->args->len + 2);
+        args[0] = g_strdup (g_get_prgname () ? g_get_prgname () : PACKAGE);
+        for (j = 0; j < options->args->len; j++) {
+            args[j + 1] = g_strdup (g_ptr_array_index (options->args, j));
+        }
+        context = g_option_context_new (NULL);
+        g_option_context_set_help_enabled (context, FALSE);
+        kbdui_context->context = context;
+        module = input_pad_gtk_window_parse_kbdui_module_arg_init (NULL, NULL,
+                                                                   options->module,
+                                                                   kbdui_context);
+        if (module) {
+            if (!g_option_context_parse_strv (context, &args, &error)) {
+                g_warning ("Could not parse the options of %s: %s",
+                           options->module, error ? error->message : "");
+                g_clear_error (&error);
+            }
+            list = g_list_append (list, module);
+        }
+        kbdui_context->context = NULL;
+        g_option_context_free (context);
+        g_strfreev (args);
     }
-    g_free (list);
+    return list;
 }
 
 int
@@ -5044,6 +8338,18 @@ input_pad_gtk_window_set_show_layout (InputPadGtkWindow *window,
         //resize_toplevel_window_with_hide_widget (priv->top_keyboard_layout_vbox);
         break;
     case INPUT_PAD_WINDOW_SHOW_LAYOUT_TYPE_DEFAULT:
+    case INPUT_PAD_WINDOW_SHOW_LAYOUT_TYPE_GEOMETRY:
+        if (window->priv->keyboard_geometry !=
+            (type == INPUT_PAD_WINDOW_SHOW_LAYOUT_TYPE_GEOMETRY)) {
+            window->priv->keyboard_geometry =
+                (type == INPUT_PAD_WINDOW_SHOW_LAYOUT_TYPE_GEOMETRY);
+            if (window->priv->xkb_key_list) {
+                destroy_prev_keyboard_layout (window->priv->top_keyboard_layout_vbox,
+                                              window);
+                create_keyboard_layout_ui_real (window->priv->top_keyboard_layout_vbox,
+                                                window);
+            }
+        }
         action = g_action_map_lookup_action (map, "ShowLayout");
         g_action_change_state (action, g_variant_new_boolean (FALSE));
         //gtk_widget_show (priv->top_keyboard_layout_vbox);
@@ -5053,6 +8359,268 @@ input_pad_gtk_window_set_show_layout (InputPadGtkWindow *window,
     }
 }
 
+static gsize
+pad_string_get_size (const char *str)
+{
+    return str ? strlen (str) + 1 : 0;
+}
+
+static gulong
+pad_group_get_size (InputPadGroup *group)
+{
+    InputPadTable *table;
+    gulong size = 0;
+    int i;
+
+    for (; group; group = group->next) {
+        size += sizeof (InputPadGroup) + sizeof (InputPadGroupPrivate);
+        size += pad_string_get_size (group->name);
+        for (table = group->table; table; table = table->next) {
+            size += sizeof (InputPadTable) + sizeof (InputPadTablePrivate);
+            size += pad_string_get_size (table->name);
+            switch (table->type) {
+            case INPUT_PAD_TABLE_TYPE_CHARS:
+                size += pad_string_get_size (table->data.chars);
+                break;
+            case INPUT_PAD_TABLE_TYPE_KEYSYMS:
+                size += pad_string_get_size (table->data.keysyms);
+                break;
+            case INPUT_PAD_TABLE_TYPE_STRINGS:
+                for (i = 0; table->data.strs && table->data.strs[i].label; i++) {
+                    size += sizeof (InputPadTableStr);
+                    size += pad_string_get_size (table->data.strs[i].label);
+                    size += pad_string_get_size (table->data.strs[i].comment);
+                    size += pad_string_get_size (table->data.strs[i].rawtext);
+                }
+                if (table->data.strs) {
+                    size += sizeof (InputPadTableStr);
+                }
+                break;
+            case INPUT_PAD_TABLE_TYPE_COMMANDS:
+                for (i = 0; table->data.cmds && table->data.cmds[i].execl; i++) {
+                    size += sizeof (InputPadTableCmd);
+                    size += pad_string_get_size (table->data.cmds[i].label);
+                    size += pad_string_get_size (table->data.cmds[i].execl);
+                    if (table->priv && table->priv->cmd_caches) {
+                        size += sizeof (InputPadTableCmdCache);
+                    }
+                }
+                if (table->data.cmds) {
+                    size += sizeof (InputPadTableCmd);
+                }
+                break;
+            default:;
+            }
+        }
+    }
+    return size;
+}
+
+/* Counts the handlers which are connected with the data. */
+static guint
+count_signal_handlers (gpointer instance, GSignalMatchType mask,
+                       gpointer func, gpointer data)
+{
+    guint n;
+
+    /* The blocked handlers stay blocked after they are unblocked once. */
+    n = g_signal_handlers_block_matched (instance, mask, 0, 0, NULL,
+                                         func, data);
+    g_signal_handlers_unblock_matched (instance, mask, 0, 0, NULL,
+                                       func, data);
+    return n;
+}
+
+static void
+widget_stats_collect (GtkWidget *widget, gpointer data)
+{
+    StatsForEachData *stats_data = (StatsForEachData *) data;
+    InputPadWindowStats *stats = stats_data->stats;
+    GdkPixbuf *pixbuf;
+
+    stats->n_widgets++;
+    if (INPUT_PAD_IS_GTK_BUTTON (widget)) {
+        stats->n_buttons++;
+    }
+    if (GTK_IS_IMAGE (widget) &&
+        gtk_image_get_storage_type (GTK_IMAGE (widget)) == GTK_IMAGE_PIXBUF &&
+        (pixbuf = gtk_image_get_pixbuf (GTK_IMAGE (widget))) != NULL) {
+        stats->pixbuf_bytes += gdk_pixbuf_get_byte_length (pixbuf);
+    }
+    stats->n_signal_handlers +=
+        count_signal_handlers (widget, G_SIGNAL_MATCH_DATA,
+                               NULL, stats_data->window);
+    if (GTK_IS_CONTAINER (widget)) {
+        gtk_container_forall (GTK_CONTAINER (widget),
+                              widget_stats_collect,
+                              data);
+    }
+}
+
+void
+input_pad_gtk_window_get_stats (InputPadGtkWindow   *window,
+                                InputPadWindowStats *stats)
+{
+    StatsForEachData stats_data = { NULL, };
+    GdkDisplay *display;
+    int i;
+
+    g_return_if_fail (window && INPUT_PAD_IS_GTK_WINDOW (window));
+    g_return_if_fail (window->priv != NULL);
+    g_return_if_fail (stats != NULL);
+
+    memset (stats, 0, sizeof (InputPadWindowStats));
+    stats_data.window = window;
+    stats_data.stats = stats;
+    widget_stats_collect (GTK_WIDGET (window), &stats_data);
+    /* The sensitivity handlers on the window per char button */
+    stats->n_signal_handlers +=
+        count_signal_handlers (window, G_SIGNAL_MATCH_FUNC,
+                               on_window_char_button_sensitive, NULL);
+
+    stats->pad_bytes = pad_group_get_size (window->priv->group);
+    stats->n_events_injected = window->priv->n_events_injected;
+    display = gtk_widget_get_display (GTK_WIDGET (window));
+    if (GDK_IS_X11_DISPLAY (display)) {
+        stats->n_x_requests = XNextRequest (GDK_DISPLAY_XDISPLAY (display)) - 1;
+    }
+    stats->n_commands_spawned = window->priv->n_commands_spawned;
+    stats->n_presses = window->priv->n_presses;
+    for (i = 0; i < INPUT_PAD_WINDOW_STATS_N_LATENCY_BUCKETS; i++) {
+        stats->press_latency_buckets[i] = window->priv->press_latency_buckets[i];
+    }
+}
+
+static GVariant *
+window_stats_to_variant (InputPadGtkWindow *window)
+{
+    InputPadWindowStats stats;
+    GVariantBuilder builder;
+    guint64 buckets[INPUT_PAD_WINDOW_STATS_N_LATENCY_BUCKETS];
+    int i;
+
+    input_pad_gtk_window_get_stats (window, &stats);
+    for (i = 0; i < INPUT_PAD_WINDOW_STATS_N_LATENCY_BUCKETS; i++) {
+        buckets[i] = stats.press_latency_buckets[i];
+    }
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "n-widgets",
+                           g_variant_new_uint32 (stats.n_widgets));
+    g_variant_builder_add (&builder, "{sv}", "n-buttons",
+                           g_variant_new_uint32 (stats.n_buttons));
+    g_variant_builder_add (&builder, "{sv}", "pixbuf-bytes",
+                           g_variant_new_uint64 (stats.pixbuf_bytes));
+    g_variant_builder_add (&builder, "{sv}", "pad-bytes",
+                           g_variant_new_uint64 (stats.pad_bytes));
+    g_variant_builder_add (&builder, "{sv}", "n-signal-handlers",
+                           g_variant_new_uint32 (stats.n_signal_handlers));
+    g_variant_builder_add (&builder, "{sv}", "n-events-injected",
+                           g_variant_new_uint64 (stats.n_events_injected));
+    g_variant_builder_add (&builder, "{sv}", "n-x-requests",
+                           g_variant_new_uint64 (stats.n_x_requests));
+    g_variant_builder_add (&builder, "{sv}", "n-commands-spawned",
+                           g_variant_new_uint64 (stats.n_commands_spawned));
+    g_variant_builder_add (&builder, "{sv}", "n-presses",
+                           g_variant_new_uint64 (stats.n_presses));
+    g_variant_builder_add (&builder, "{sv}", "press-latency-buckets",
+                           g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                                      buckets,
+                                                      INPUT_PAD_WINDOW_STATS_N_LATENCY_BUCKETS,
+                                                      sizeof (guint64)));
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("{sv}"));
+    g_variant_builder_add (&builder, "s", "press-stage-latency");
+    g_variant_builder_open (&builder, G_VARIANT_TYPE_VARIANT);
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(sstttt)"));
+    for (i = 0; i <= INPUT_PAD_TABLE_TYPE_COMMANDS; i++) {
+        int j;
+
+        for (j = 0; j < N_PRESS_STAGES; j++) {
+            InputPadProfileHistogram *histogram = window->priv->press_histograms[i][j];
+
+            if (histogram == NULL ||
+                input_pad_profile_histogram_get_count (histogram) == 0) {
+                continue;
+            }
+            g_variant_builder_add (&builder, "(sstttt)",
+                                   table_type_names[i],
+                                   press_stage_names[j],
+                                   input_pad_profile_histogram_get_count (histogram),
+                                   (guint64) input_pad_profile_histogram_get_percentile (histogram, 50.),
+                                   (guint64) input_pad_profile_histogram_get_percentile (histogram, 99.),
+                                   (guint64) input_pad_profile_histogram_get_max (histogram));
+        }
+    }
+    g_variant_builder_close (&builder);
+    g_variant_builder_close (&builder);
+    g_variant_builder_close (&builder);
+    return g_variant_builder_end (&builder);
+}
+
+static void
+input_pad_gtk_window_set_property (GObject      *object,
+                                   guint         prop_id,
+                                   const GValue *value,
+                                   GParamSpec   *pspec)
+{
+    InputPadGtkWindow *window = INPUT_PAD_GTK_WINDOW (object);
+
+    switch (prop_id) {
+    case PROP_PASTE_THRESHOLD:
+        input_pad_gtk_window_set_paste_threshold (window,
+                                                  g_value_get_int (value));
+        break;
+    case PROP_LAYOUT_KEYS:
+        input_pad_gtk_window_set_layout_keys (window,
+                                              g_value_get_boolean (value));
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        break;
+    }
+}
+
+static void
+input_pad_gtk_window_get_property (GObject    *object,
+                                   guint       prop_id,
+                                   GValue     *value,
+                                   GParamSpec *pspec)
+{
+    InputPadGtkWindow *window = INPUT_PAD_GTK_WINDOW (object);
+
+    switch (prop_id) {
+    case PROP_STATS:
+        g_value_take_variant (value, window_stats_to_variant (window));
+        break;
+    case PROP_PASTE_THRESHOLD:
+        g_value_set_int (value, window->priv->paste_threshold);
+        break;
+    case PROP_LAYOUT_KEYS:
+        g_value_set_boolean (value, window->priv->layout_keys);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        break;
+    }
+}
+
+/* The prepared views are kept and the caches which are cheap to
+ * rebuild are dropped while the resident window is hidden. */
+static void
+resident_window_trim (InputPadGtkWindow *window)
+{
+    if (window->priv->config_dialogs_disuse_id != 0) {
+        config_dialogs_destroy (window);
+    }
+    if (window->priv->command_cache) {
+        g_hash_table_remove_all (window->priv->command_cache);
+    }
+    if (kbdui_name_list) {
+        input_pad_gtk_window_get_kbdui_name_list_free (kbdui_name_list);
+        kbdui_name_list = NULL;
+        kbdui_name_list_mtime = -1;
+    }
+}
+
 static void
 input_pad_gtk_application_init (InputPadGtkApplication *app)
 {
@@ -5067,18 +8635,34 @@ input_pad_window_init (int                     *argc,
 {
     GOptionContext *context;
 #ifdef MODULE_XTEST_GDK_BASE
-    GModule *module = NULL;
     gboolean has_xtest_module = FALSE;
 #endif
     InputPadGtkKbduiContext *kbdui_context;
     GError *error = NULL;
     GList *list = NULL;
+    GPtrArray *kbdui_options;
     const gchar *name;
+    InputPadProfileSpan *span;
+    int i;
 
     if (do_exit) {
         *do_exit = FALSE;
     }
 
+    /* The profiler is started before the options are parsed so that
+     * the init span covers the option parsing. */
+    if (g_getenv ("INPUT_PAD_PROFILE_STARTUP")) {
+        input_pad_profile_start (g_getenv ("INPUT_PAD_PROFILE_STARTUP"));
+    } else {
+        for (i = 1; argc && argv && i < *argc; i++) {
+            if (g_str_has_prefix ((*argv)[i], "--profile-startup")) {
+                input_pad_profile_start (NULL);
+                break;
+            }
+        }
+    }
+    span = input_pad_profile_span_begin ("init", NULL);
+
 #ifdef ENABLE_NLS
     bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
     bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
@@ -5096,8 +8680,11 @@ input_pad_window_init (int                     *argc,
     g_option_context_add_main_entries (context, entries, GETTEXT_PACKAGE);
 
 #ifdef MODULE_XTEST_GDK_BASE
-    if ((module = open_xtest_gmodule (TRUE)) != NULL) {
-        g_module_close (module);
+    /* The XTest module sends the key events from its worker thread
+     * with its own Xlib connection so Xlib is made thread safe
+     * before GDK opens the display. */
+    XInitThreads ();
+    if (has_xtest_gmodule ()) {
         has_xtest_module = TRUE;
         g_option_context_add_main_entries (context,
                                            disable_xtest_entry,
@@ -5113,12 +8700,23 @@ input_pad_window_init (int                     *argc,
 
     kbdui_context = input_pad_gtk_kbdui_context_new ();
     kbdui_context->context = context;
-    list = input_pad_gtk_window_parse_kbdui_modules (argc, argv, kbdui_context);
+    /* The kbdui modules are opened only when their options are given. */
+    kbdui_options = kbdui_module_options_get_all ();
+    list = kbdui_module_options_add_to_context (argc, argv,
+                                                kbdui_options,
+                                                kbdui_context);
 
     gdk_set_allowed_backends ("x11");
     g_option_context_parse (context, argc, argv, &error);
     g_option_context_free (context);
     kbdui_context->context = NULL;
+    list = kbdui_module_options_open_given (kbdui_options, kbdui_context,
+                                            list);
+    g_ptr_array_free (kbdui_options, TRUE);
+
+    if (profile_startup_file) {
+        input_pad_profile_start (profile_startup_file);
+    }
 
     if (ask_version) {
         g_print ("%s %s version %s\n", g_get_prgname (),
@@ -5148,6 +8746,7 @@ input_pad_window_init (int                     *argc,
         }
     }
     input_pad_gtk_kbdui_context_destroy (kbdui_context);
+    input_pad_profile_span_end (span);
 
     return 0;
 }
@@ -5158,22 +8757,101 @@ on_close_activate (GSimpleAction *action,
                    gpointer       data)
 {
     InputPadGtkApplication *app = INPUT_PAD_GTK_APPLICATION (data);
+
+    if (resident) {
+        gtk_widget_hide (GTK_WIDGET (app->window));
+        return;
+    }
     gtk_widget_destroy (GTK_WIDGET (app->window));
 }
 
 static void
-on_code_point_activate (GSimpleAction *action,
-                        GVariant      *parameter,
-                        gpointer       data)
+on_quit_activate (GSimpleAction *action,
+                  GVariant      *parameter,
+                  gpointer       data)
+{
+    InputPadGtkApplication *app = INPUT_PAD_GTK_APPLICATION (data);
+
+    if (app->window) {
+        gtk_widget_destroy (GTK_WIDGET (app->window));
+        app->window = NULL;
+    }
+    if (app->resident_trim_id != 0) {
+        g_source_remove (app->resident_trim_id);
+        app->resident_trim_id = 0;
+    }
+    if (app->held) {
+        app->held = FALSE;
+        g_application_release (G_APPLICATION (app));
+    }
+}
+
+static void
+on_show_activate (GSimpleAction *action,
+                  GVariant      *parameter,
+                  gpointer       data)
+{
+    InputPadGtkApplication *app = INPUT_PAD_GTK_APPLICATION (data);
+
+    app->show = TRUE;
+    g_application_activate (G_APPLICATION (app));
+}
+
+static void
+app_dialog_destroy (GtkWidget **dlgp)
+{
+    /* The dialog could run in the nested main loop. */
+    if (*dlgp == NULL || gtk_widget_get_visible (*dlgp)) {
+        return;
+    }
+    gtk_widget_destroy (*dlgp);
+    *dlgp = NULL;
+}
+
+static gboolean
+on_app_dialogs_disuse_timeout (gpointer data)
 {
     InputPadGtkApplication *app = INPUT_PAD_GTK_APPLICATION (data);
-    GtkBuilder *builder = app->builder;
-    GtkWidget *dlg = GTK_WIDGET (gtk_builder_get_object (builder,
-                                                         "CodePointDialog"));
+
+    app->dialogs_disuse_id = 0;
+    app_dialog_destroy (&app->code_point_dialog);
+    app_dialog_destroy (&app->about_dialog);
+    app_dialog_destroy (&app->contents_dialog);
+    return FALSE;
+}
+
+static void
+app_dialog_run (InputPadGtkApplication *app, GtkWidget *dlg)
+{
     gtk_window_set_transient_for (GTK_WINDOW (dlg), GTK_WINDOW (app->window));
 
     gtk_dialog_run (GTK_DIALOG (dlg));
     gtk_widget_hide (dlg);
+
+    if (app->dialogs_disuse_id != 0) {
+        g_source_remove (app->dialogs_disuse_id);
+    }
+    app->dialogs_disuse_id =
+        g_timeout_add_seconds (DIALOG_DISUSE_TIMEOUT,
+                               on_app_dialogs_disuse_timeout,
+                               app);
+}
+
+static void
+on_code_point_activate (GSimpleAction *action,
+                        GVariant      *parameter,
+                        gpointer       data)
+{
+    InputPadGtkApplication *app = INPUT_PAD_GTK_APPLICATION (data);
+
+    if (app->code_point_dialog == NULL) {
+        app->code_point_dialog =
+            create_code_point_dialog_ui (GTK_WIDGET (app->window));
+        if (app->code_point_dialog == NULL) {
+            return;
+        }
+    }
+    app_dialog_run (app, app->code_point_dialog);
 }
 
 static void
@@ -5220,10 +8898,12 @@ on_toggle_action (GSimpleAction *action,
 
     true_name = g_action_get_name (G_ACTION (action));
     if (g_strcmp0 (true_name, "ShowAllChars") == 0) {
+        all_char_view_ensure (window);
         gtk_widget_show (priv->top_char_view_hbox);
         gtk_widget_hide (priv->top_custom_char_view_hbox);
     }
     if (g_strcmp0 (true_name, "ShowCustomChars") == 0) {
+        custom_char_views_ensure (window);
         gtk_widget_hide (priv->top_char_view_hbox);
         gtk_widget_show (priv->top_custom_char_view_hbox);
     }
@@ -5280,13 +8960,15 @@ on_contents_activate (GSimpleAction *action,
                       gpointer       data)
 {
     InputPadGtkApplication *app = INPUT_PAD_GTK_APPLICATION (data);
-    GtkBuilder *builder = app->builder;
-    GtkWidget *dlg = GTK_WIDGET (gtk_builder_get_object (builder,
-                                                         "ContentsDialog"));
-    gtk_window_set_transient_for (GTK_WINDOW (dlg), GTK_WINDOW (app->window));
 
-    gtk_dialog_run (GTK_DIALOG (dlg));
-    gtk_widget_hide (dlg);
+    if (app->contents_dialog == NULL) {
+        app->contents_dialog =
+            create_contents_dialog_ui (GTK_WIDGET (app->window));
+        if (app->contents_dialog == NULL) {
+            return;
+        }
+    }
+    app_dialog_run (app, app->contents_dialog);
 }
 
 static void
@@ -5295,18 +8977,21 @@ on_about_activate (GSimpleAction *action,
                    gpointer       data)
 {
     InputPadGtkApplication *app = INPUT_PAD_GTK_APPLICATION (data);
-    GtkBuilder *builder = app->builder;
-    GtkWidget *dlg = GTK_WIDGET (gtk_builder_get_object (builder,
-                                                         "AboutDialog"));
-    gtk_window_set_transient_for (GTK_WINDOW (dlg), GTK_WINDOW (app->window));
+
+    if (app->about_dialog == NULL) {
+        app->about_dialog = create_about_dialog_ui (GTK_WIDGET (app->window));
+        if (app->about_dialog == NULL) {
+            return;
+        }
+    }
 
     /* Do not use GtkBuilder because gtk_about_dialog_set_logo_icon_name()
      * sets the best_size as 0 for pixmaps dir.
      * Set NULL here so that the default icon is set. */
-    gtk_about_dialog_set_logo_icon_name (GTK_ABOUT_DIALOG (dlg), NULL);
+    gtk_about_dialog_set_logo_icon_name (GTK_ABOUT_DIALOG (app->about_dialog),
+                                         NULL);
 
-    gtk_dialog_run (GTK_DIALOG (dlg));
-    gtk_widget_hide (dlg);
+    app_dialog_run (app, app->about_dialog);
 }
 
 static void
@@ -5320,6 +9005,8 @@ change_radio_state (GSimpleAction *action,
 static GActionEntry app_entries[] =
 {
     { "Close",           on_close_activate, NULL, NULL, NULL },
+    { "Quit",            on_quit_activate, NULL, NULL, NULL },
+    { "Show",            on_show_activate, NULL, NULL, NULL },
     { "CodePoint",       on_code_point_activate, NULL, NULL, NULL },
     { "ShowAllChars",    on_toggle_action, NULL, "true",  change_radio_state },
     { "ShowCustomChars", on_toggle_action, NULL, "false", change_radio_state },
@@ -5332,6 +9019,7 @@ static GActionEntry app_entries[] =
 static void
 input_pad_gtk_application_startup (GApplication *app)
 {
+    static const gchar *quit_accels[] = { "<Control>q", NULL };
     GtkBuilder *builder;
     GMenuModel *menubar;
 
@@ -5340,6 +9028,8 @@ input_pad_gtk_application_startup (GApplication *app)
     g_action_map_add_action_entries (G_ACTION_MAP (app),
                                      app_entries, G_N_ELEMENTS (app_entries),
                                      app);
+    gtk_application_set_accels_for_action (GTK_APPLICATION (app),
+                                           "app.Quit", quit_accels);
 
     builder = gtk_builder_new_from_resource (
             "/com/github/fujiwarat/input-pad/app-menu.ui");
@@ -5347,24 +9037,88 @@ input_pad_gtk_application_startup (GApplication *app)
     menubar = G_MENU_MODEL (gtk_builder_get_object (builder, "menubar"));
     gtk_application_set_menubar (GTK_APPLICATION (app), menubar);
     g_object_unref (builder);
+}
 
-    builder = gtk_builder_new_from_resource (
-            "/com/github/fujiwarat/input-pad/dialog.ui");
-    gtk_builder_set_translation_domain (builder, GETTEXT_PACKAGE);
-    INPUT_PAD_GTK_APPLICATION (app)->builder = builder;
+static gboolean
+on_resident_trim_timeout (gpointer data)
+{
+    InputPadGtkApplication *app = INPUT_PAD_GTK_APPLICATION (data);
+
+    app->resident_trim_id = 0;
+    if (app->dialogs_disuse_id != 0) {
+        g_source_remove (app->dialogs_disuse_id);
+        app->dialogs_disuse_id = 0;
+    }
+    on_app_dialogs_disuse_timeout (app);
+    if (app->window) {
+        resident_window_trim (app->window);
+    }
+    return FALSE;
+}
+
+static void
+on_resident_window_hide (GtkWidget *widget, gpointer data)
+{
+    InputPadGtkApplication *app = INPUT_PAD_GTK_APPLICATION (data);
+
+    if (app->resident_trim_id != 0) {
+        g_source_remove (app->resident_trim_id);
+    }
+    app->resident_trim_id =
+        g_timeout_add_seconds (RESIDENT_TRIM_TIMEOUT,
+                               on_resident_trim_timeout,
+                               app);
+}
+
+static void
+on_resident_window_show (GtkWidget *widget, gpointer data)
+{
+    InputPadGtkApplication *app = INPUT_PAD_GTK_APPLICATION (data);
+
+    if (app->resident_trim_id != 0) {
+        g_source_remove (app->resident_trim_id);
+        app->resident_trim_id = 0;
+    }
 }
 
 static void
 input_pad_gtk_application_activate (GApplication *app)
 {
+    InputPadGtkApplication *input_pad_app = INPUT_PAD_GTK_APPLICATION (app);
     InputPadGtkWindow *win;
 
-    win = input_pad_gtk_window_new (INPUT_PAD_GTK_APPLICATION (app));
+    /* The resident window is prepared already and only presented. */
+    if (resident && input_pad_app->window) {
+        gtk_window_present (GTK_WINDOW (input_pad_app->window));
+        g_signal_emit (app, app_signals[APP_ACTIVATED], 0);
+        return;
+    }
+
+    win = input_pad_gtk_window_new (input_pad_app);
 
-    if (INPUT_PAD_GTK_APPLICATION (app)->show)
+    if (resident) {
+        g_application_hold (app);
+        input_pad_app->held = TRUE;
+        g_signal_connect (G_OBJECT (win), "delete-event",
+                          G_CALLBACK (gtk_widget_hide_on_delete), NULL);
+        g_signal_connect (G_OBJECT (win), "hide",
+                          G_CALLBACK (on_resident_window_hide), app);
+        g_signal_connect (G_OBJECT (win), "show",
+                          G_CALLBACK (on_resident_window_show), app);
+        if (start_hidden) {
+            input_pad_app->show = FALSE;
+        }
+    }
+
+    if (input_pad_app->show) {
         gtk_window_present (GTK_WINDOW (win));
+    } else if (resident) {
+        /* Realize the hidden window so that the first show maps it only. */
+        gtk_widget_realize (GTK_WIDGET (win));
+        on_resident_window_hide (GTK_WIDGET (win), app);
+    }
 
-    INPUT_PAD_GTK_APPLICATION (app)->window = win;
+    input_pad_app->window = win;
 
     g_signal_emit (app, app_signals[APP_ACTIVATED], 0);
 }
@@ -5391,6 +9145,10 @@ input_pad_gtk_application_class_init (InputPadGtkApplicationClass *class)
 void
 on_is_registered (GObject *object, gpointer data)
 {
+    /* The resident instance is activated by the later invocations. */
+    if (resident) {
+        return;
+    }
     if (g_application_get_is_remote (G_APPLICATION (object))) {
         g_warning ("Another application executes input-pad.");
     }
@@ -5401,7 +9159,8 @@ input_pad_gtk_application_new (void)
 {
     GObject *object = g_object_new (INPUT_PAD_TYPE_GTK_APPLICATION,
                                     "application-id", "com.github.fujiwarat.input-pad",
-                                    "flags", G_APPLICATION_NON_UNIQUE,
+                                    "flags", resident ? G_APPLICATION_FLAGS_NONE
+                                                      : G_APPLICATION_NON_UNIQUE,
                                     NULL);
 
    g_signal_connect (object, "notify::is-registered", G_CALLBACK (on_is_registered), NULL);
@@ -5540,6 +9299,21 @@ input_pad_window_set_char_button_sensitive (void        *window_data,
                                                     sensitive);
 }
 
+void
+input_pad_window_set_paste_threshold (void *window_data, int threshold)
+{
+    InputPadGtkApplication *app;
+
+    g_return_if_fail (window_data != NULL &&
+                      INPUT_PAD_IS_GTK_APPLICATION (window_data));
+
+    app = INPUT_PAD_GTK_APPLICATION (window_data);
+
+    g_return_if_fail (app->window != NULL);
+
+    input_pad_gtk_window_set_paste_threshold (app->window, threshold);
+}
+
 void
 input_pad_window_reorder_button_pressed (void *window_data)
 {
@@ -5655,6 +9429,22 @@ input_pad_window_get_window (void *window_data)
     return input_pad_gtk_application_get_window (app);
 }
 
+void
+input_pad_window_get_stats (void                   *window_data,
+                            InputPadWindowStats    *stats)
+{
+    InputPadGtkApplication *app;
+
+    g_return_if_fail (window_data != NULL &&
+                      INPUT_PAD_IS_GTK_APPLICATION (window_data));
+
+    app = INPUT_PAD_GTK_APPLICATION (window_data);
+
+    g_return_if_fail (app->window != NULL);
+
+    input_pad_gtk_window_get_stats (app->window, stats);
+}
+
 void
 input_pad_window_activate (void *window_data)
 {
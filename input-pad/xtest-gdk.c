@@ -26,12 +26,21 @@
 #include <gdk/gdk.h>
 #include <gdk/gdkx.h>
 #include <X11/Xlib.h>
+#include <X11/XKBlib.h>
 #include <X11/keysym.h>
 #include <X11/extensions/XTest.h>
+#include <string.h> /* strlen */
 
 #include <input-pad-window-gtk.h>
 #include <input-pad-group.h>
 
+#include "button-gtk.h"
+#include "geometry-gdk.h"
+#include "trace-sdt.h"
+
+/* The number of the spare keycodes which are remapped for Unicode */
+#define N_SPARE_KEYS 10
+
 G_MODULE_EXPORT
 gboolean     input_pad_module_init (InputPadGtkWindow *window);
 G_MODULE_EXPORT
@@ -39,14 +48,99 @@ gboolean     input_pad_module_setup (InputPadGtkWindow *window);
 G_MODULE_EXPORT
 const gchar* g_module_check_init (GModule *module);
 
-static Display *saved_display = NULL;
+typedef struct _XTestKeyEvent XTestKeyEvent;
+typedef struct _XTestStats XTestStats;
+typedef struct _XTestSpareKey XTestSpareKey;
+typedef struct _XTestStringKey XTestStringKey;
+typedef struct _XTestCommit XTestCommit;
 
-static int
-xsend_key_state (Display       *display,
-                 guint          state,
-                 Bool           pressed)
+struct _XTestKeyEvent {
+    KeyCode                     keycode;
+    Bool                        pressed;
+};
+
+struct _XTestStats {
+    guint64                     n_commits;
+    guint64                     n_events;
+    guint64                     n_round_trips;
+    gint64                      first_time;
+    gint64                      last_time;
+};
+
+/* The unused keycode which is mapped to a keysym temporarily */
+struct _XTestSpareKey {
+    KeyCode                     keycode;
+    KeySym                      keysym;
+    guint64                     last_used;
+    guint64                     last_commit;
+};
+
+/* A character of the string and the key on the layout or keycode 0 */
+struct _XTestStringKey {
+    KeySym                      keysym;
+    KeyCode                     keycode;
+    guint                       mods;
+};
+
+/* The request of one button press which is sent by the worker thread */
+struct _XTestCommit {
+    guint                       type;
+    gchar                      *str;
+    /* The XTestStringKey of str which are looked up on the main thread */
+    GArray                     *keys;
+    guint                       keysym;
+    guint                       keycode;
+    guint                       state;
+    gint64                      queued_time;
+};
+
+/* Restores the spare keys on the worker display and ends the worker. */
+#define XTEST_COMMIT_RESTORE_QUIT G_MAXUINT
+
+/* The key events of one commit are sent with one flush. */
+static GArray *pending_events = NULL;
+static XTestStats xtest_stats = { 0, };
+/* The keycodes of the modifiers are reset on the keymap changes. */
+static KeyCode modifier_keycodes[6];
+static gboolean has_modifier_keycodes = FALSE;
+static XTestSpareKey spare_keys[N_SPARE_KEYS];
+static int n_spare_keys = -1;
+static guint64 spare_keys_clock = 0;
+static Display *spare_keys_display = NULL;
+/* The key events are sent from the worker thread with its own
+ * X connection so that the slow server does not block the UI.
+ * The spare keys are reserved on the main thread before the worker
+ * starts and the state above is then used only by the worker thread. */
+static GThread *worker_thread = NULL;
+static GAsyncQueue *worker_queue = NULL;
+static Display *worker_display = NULL;
+static guint64 n_completed_commits = 0;
+/* Pushed by the main thread and decremented by the worker thread */
+static volatile gint n_pending_commits = 0;
+static gint64 max_commit_latency = 0;
+
+static void
+xtest_queue_key_event (KeyCode  keycode,
+                       Bool     pressed)
+{
+    XTestKeyEvent event;
+
+    if (keycode == 0) {
+        return;
+    }
+    if (pending_events == NULL) {
+        pending_events = g_array_new (FALSE, FALSE, sizeof (XTestKeyEvent));
+    }
+    event.keycode = keycode;
+    event.pressed = pressed;
+    g_array_append_val (pending_events, event);
+}
+
+static void
+xtest_queue_key_state (Display     *display,
+                       guint        state,
+                       Bool         pressed)
 {
-    KeyCode     keycode_real;
     static struct {
         guint   state;
         KeySym  keysym;
@@ -56,74 +150,498 @@ xsend_key_state (Display       *display,
         { Mod4Mask,    XK_Super_L },
         { ShiftMask,   XK_Shift_L },
         { LockMask,    XK_Caps_Lock },
+        { Mod5Mask,    XK_ISO_Level3_Shift },
         { 0,           0L }
     };
     int i;
 
-    if (pressed) {
-        saved_display = display;
-    } else {
-        saved_display = NULL;
+    if (!has_modifier_keycodes) {
+        for (i = 0; state2keysym[i].state != 0; i++) {
+            modifier_keycodes[i] = XKeysymToKeycode (display,
+                                                     state2keysym[i].keysym);
+        }
+        has_modifier_keycodes = TRUE;
     }
-
     for (i = 0; state2keysym[i].state != 0; i++) {
         if (state & state2keysym[i].state) {
-            keycode_real = XKeysymToKeycode (display, state2keysym[i].keysym);
-            XTestFakeKeyEvent (display, keycode_real, pressed, CurrentTime);
-            XSync (display, False);
+            xtest_queue_key_event (modifier_keycodes[i], pressed);
+        }
+    }
+}
+
+/*
+ * XTest requests on one connection are processed in order so
+ * XSync is needed only when the caller needs to wait for the server,
+ * e.g. before the process exits.
+ */
+static void
+xtest_pending_send (Display    *display)
+{
+    XTestKeyEvent *event;
+    guint i;
+
+    if (pending_events == NULL || pending_events->len == 0) {
+        return;
+    }
+    for (i = 0; i < pending_events->len; i++) {
+        event = &g_array_index (pending_events, XTestKeyEvent, i);
+        XTestFakeKeyEvent (display, event->keycode, event->pressed,
+                           CurrentTime);
+    }
+    xtest_stats.n_events += pending_events->len;
+    g_array_set_size (pending_events, 0);
+}
+
+static void
+xtest_commit_flush (Display    *display,
+                    gboolean    sync)
+{
+    gint64 now;
+
+    xtest_pending_send (display);
+    if (sync) {
+        XSync (display, False);
+        xtest_stats.n_round_trips++;
+    } else {
+        XFlush (display);
+    }
+
+    now = g_get_monotonic_time ();
+    if (xtest_stats.n_commits == 0) {
+        xtest_stats.first_time = now;
+    }
+    xtest_stats.last_time = now;
+    xtest_stats.n_commits++;
+}
+
+/*
+ * The keycodes without any keysyms are used as the spare keys.
+ * The higher keycodes are less likely used by the hardware.
+ * This runs on the main thread before the worker starts since
+ * the GDK filter of the window reads the ignored keycodes.
+ */
+static void
+spare_keys_init (Display *display)
+{
+    KeySym *keysyms;
+    int min_keycode, max_keycode, n_keysyms_per_keycode;
+    int keycode, i;
+
+    n_spare_keys = 0;
+    XDisplayKeycodes (display, &min_keycode, &max_keycode);
+    keysyms = XGetKeyboardMapping (display, (KeyCode) min_keycode,
+                                   max_keycode - min_keycode + 1,
+                                   &n_keysyms_per_keycode);
+    if (keysyms == NULL) {
+        return;
+    }
+    for (keycode = max_keycode;
+         keycode >= min_keycode && n_spare_keys < N_SPARE_KEYS;
+         keycode--) {
+        for (i = 0; i < n_keysyms_per_keycode; i++) {
+            if (keysyms[(keycode - min_keycode) * n_keysyms_per_keycode + i]
+                != NoSymbol) {
+                break;
+            }
+        }
+        if (i < n_keysyms_per_keycode) {
+            continue;
+        }
+        spare_keys[n_spare_keys].keycode = (KeyCode) keycode;
+        spare_keys[n_spare_keys].keysym = NoSymbol;
+        spare_keys[n_spare_keys].last_used = 0;
+        spare_keys[n_spare_keys].last_commit = 0;
+        input_pad_gdk_xkb_set_keycode_ignored (keycode, TRUE);
+        n_spare_keys++;
+    }
+    XFree (keysyms);
+}
+
+/*
+ * Returns the spare keycode which is mapped to keysym. The least
+ * recently used key is remapped but a key pressed in the current
+ * commit is never remapped since the focused client could translate
+ * the earlier key press with the new mapping. Returns 0 when all
+ * the spare keys are pressed in the current commit.
+ */
+static KeyCode
+spare_keys_map (Display    *display,
+                KeySym      keysym)
+{
+    KeySym keysyms[2];
+    XTestSpareKey *key = NULL;
+    guint64 commit = xtest_stats.n_commits + 1;
+    int i;
+
+    for (i = 0; i < n_spare_keys; i++) {
+        if (spare_keys[i].keysym == keysym) {
+            key = &spare_keys[i];
+            break;
+        }
+    }
+    if (key == NULL) {
+        for (i = 0; i < n_spare_keys; i++) {
+            if (spare_keys[i].last_commit == commit) {
+                continue;
+            }
+            if (key == NULL || spare_keys[i].last_used < key->last_used) {
+                key = &spare_keys[i];
+            }
+        }
+        if (key == NULL) {
+            return 0;
+        }
+        /* The queued key events are sent before the remapping so
+         * the server processes them with the previous mapping. */
+        xtest_pending_send (display);
+        keysyms[0] = keysyms[1] = keysym;
+        XChangeKeyboardMapping (display, key->keycode, 2, keysyms, 1);
+        key->keysym = keysym;
+        /* The display which restores the keys */
+        spare_keys_display = display;
+    }
+    key->last_used = ++spare_keys_clock;
+    key->last_commit = commit;
+    return key->keycode;
+}
+
+static gboolean
+spare_keys_contain (int keycode, int count)
+{
+    int i, j;
+
+    if (n_spare_keys <= 0) {
+        return FALSE;
+    }
+    for (i = keycode; i < keycode + count; i++) {
+        for (j = 0; j < n_spare_keys; j++) {
+            if (spare_keys[j].keycode == i) {
+                break;
+            }
+        }
+        if (j == n_spare_keys) {
+            return FALSE;
         }
     }
     return TRUE;
 }
 
 static void
-signal_exit_cb (int signal_id)
+spare_keys_restore (void)
 {
-    if (saved_display != NULL) {
-        xsend_key_state (saved_display,
-                         ControlMask | Mod1Mask | Mod4Mask | ShiftMask | LockMask,
-                         FALSE);
-        saved_display = NULL;
+    KeySym keysym = NoSymbol;
+    int i;
+
+    if (spare_keys_display == NULL) {
+        return;
+    }
+    for (i = 0; i < n_spare_keys; i++) {
+        if (spare_keys[i].keysym == NoSymbol) {
+            continue;
+        }
+        XChangeKeyboardMapping (spare_keys_display, spare_keys[i].keycode,
+                                1, &keysym, 1);
+        spare_keys[i].keysym = NoSymbol;
     }
-    signal (signal_id, SIG_DFL);
-    raise (signal_id);
+    XSync (spare_keys_display, False);
 }
 
 static int
-send_key_event (GdkWindow      *gdkwindow,
+send_key_event (Display        *display,
                 guint           keysym,
                 guint           keycode,
-                guint           state)
+                guint           state,
+                gboolean        sync)
 {
-    Display    *display;
     KeyCode     keycode_real;
 
-    display = GDK_WINDOW_XDISPLAY (gdkwindow);
-    if (state != 0) {
-        xsend_key_state (display, state, True);
-    }
     if (keycode != 0) {
         keycode_real = (KeyCode) keycode;
     } else {
         keycode_real = XKeysymToKeycode (display, (KeySym) keysym);
     }
-    XTestFakeKeyEvent (display, keycode_real, True, CurrentTime);
-    XSync (display, False);
-    XTestFakeKeyEvent (display, keycode_real, False, CurrentTime);
-    XSync (display, False);
+    INPUT_PAD_TRACE3 (xtest_key, keysym, keycode_real, state);
     if (state != 0) {
-        xsend_key_state (display, state, False);
+        xtest_queue_key_state (display, state, True);
     }
+    xtest_queue_key_event (keycode_real, True);
+    xtest_queue_key_event (keycode_real, False);
+    if (state != 0) {
+        xtest_queue_key_state (display, state, False);
+    }
+
+    xtest_commit_flush (display, sync);
+
+    return TRUE;
+}
 
+/*
+ * The characters on the current group are sent with their keys and
+ * the modifiers of their levels and the other characters are sent
+ * with the spare keys.
+ */
+static gboolean
+send_string_event (Display        *display,
+                   const gchar    *str,
+                   GArray         *keys)
+{
+    XTestStringKey *key;
+    KeyCode     keycode;
+    guint       mods;
+    guint       i;
+
+    g_return_val_if_fail (str != NULL && keys != NULL, FALSE);
+
+    if (INPUT_PAD_TRACE_ENABLED (xtest_string)) {
+        INPUT_PAD_TRACE2 (xtest_string, strlen (str), g_utf8_strlen (str, -1));
+    }
+    for (i = 0; i < keys->len; i++) {
+        key = &g_array_index (keys, XTestStringKey, i);
+        keycode = key->keycode;
+        mods = key->mods;
+        /* The spare keys are found when the keymap is parsed again
+         * while they are remapped. */
+        if (keycode == 0 || spare_keys_contain (keycode, 1)) {
+            keycode = spare_keys_map (display, key->keysym);
+            mods = 0;
+            /* The string has more characters out of the layout than
+             * the spare keys so it is split into another commit.
+             * Only the server is waited for and a client which is
+             * slower than the server could still translate the
+             * earlier keys with the new mapping as between two
+             * presses. */
+            if (keycode == 0 && n_spare_keys > 0) {
+                xtest_commit_flush (display, TRUE);
+                keycode = spare_keys_map (display, key->keysym);
+            }
+        }
+        if (keycode == 0) {
+            continue;
+        }
+        if (mods != 0) {
+            xtest_queue_key_state (display, mods, True);
+        }
+        xtest_queue_key_event (keycode, True);
+        xtest_queue_key_event (keycode, False);
+        if (mods != 0) {
+            xtest_queue_key_state (display, mods, False);
+        }
+    }
+    xtest_commit_flush (display, FALSE);
     return TRUE;
 }
 
+/*
+ * The keys of the characters are looked up with the reverse index of
+ * the window on the main thread since the key list of the window is
+ * not thread safe. The index is rebuilt when the keymap is changed.
+ */
+static GArray *
+string_keys_new (InputPadGtkWindow     *window,
+                 const gchar           *str,
+                 guint                  state)
+{
+    GArray *keys;
+    XTestStringKey key;
+    gunichar ch;
+    guint keycode;
+    int group;
+    const gchar *p;
+
+    keys = g_array_new (FALSE, FALSE, sizeof (XTestStringKey));
+    group = XkbGroupForCoreState (state);
+    for (p = str; *p; p = g_utf8_next_char (p)) {
+        ch = g_utf8_get_char (p);
+        if (ch == '\n') {
+            key.keysym = XK_Return;
+        } else if (ch == '\t') {
+            key.keysym = XK_Tab;
+        } else {
+            key.keysym = (KeySym) gdk_unicode_to_keyval (ch);
+        }
+        keycode = 0;
+        key.mods = 0;
+        if (!input_pad_gtk_window_lookup_keysym (window, (guint) key.keysym,
+                                                 group,
+                                                 &keycode, &key.mods)) {
+            keycode = 0;
+            key.mods = 0;
+        }
+        key.keycode = (KeyCode) keycode;
+        g_array_append_val (keys, key);
+    }
+    return keys;
+}
+
+static void
+xtest_stats_print (void)
+{
+    gdouble seconds;
+
+    if (xtest_stats.n_commits == 0) {
+        return;
+    }
+    seconds = (xtest_stats.last_time - xtest_stats.first_time) /
+              (gdouble) G_USEC_PER_SEC;
+    g_debug ("XTest: %" G_GUINT64_FORMAT " commits, "
+             "%" G_GUINT64_FORMAT " events, %.1f events/s, "
+             "%.2f round trips/commit",
+             xtest_stats.n_commits,
+             xtest_stats.n_events,
+             seconds > 0 ? xtest_stats.n_events / seconds : 0.0,
+             (gdouble) xtest_stats.n_round_trips / xtest_stats.n_commits);
+    g_debug ("XTest: %" G_GUINT64_FORMAT " completed commits, "
+             "max latency %" G_GINT64_FORMAT " us",
+             n_completed_commits, max_commit_latency);
+}
+
+/*
+ * The worker connection does not run the main loop so the keymap
+ * changes are read here. The remaps of the spare keys are ignored
+ * because they are looked up in the LRU.
+ */
+static void
+xtest_process_mapping_events (Display *display)
+{
+    XEvent xevent;
+
+    while (XPending (display)) {
+        XNextEvent (display, &xevent);
+        if (xevent.type != MappingNotify) {
+            continue;
+        }
+        if (xevent.xmapping.request == MappingKeyboard &&
+            spare_keys_contain (xevent.xmapping.first_keycode,
+                                xevent.xmapping.count)) {
+            continue;
+        }
+        XRefreshKeyboardMapping (&xevent.xmapping);
+        has_modifier_keycodes = FALSE;
+    }
+}
+
+static void
+xtest_commit_run (Display      *display,
+                  XTestCommit  *commit)
+{
+    if (commit->type == INPUT_PAD_TABLE_TYPE_KEYSYMS ||
+        (commit->type == INPUT_PAD_TABLE_TYPE_CHARS && commit->keysym > 0)) {
+        send_key_event (display, commit->keysym, commit->keycode,
+                        commit->state, FALSE);
+    } else if (commit->str != NULL && commit->keys != NULL) {
+        send_string_event (display, commit->str, commit->keys);
+    }
+}
+
+static void
+xtest_commit_free (XTestCommit *commit)
+{
+    g_free (commit->str);
+    if (commit->keys) {
+        g_array_free (commit->keys, TRUE);
+    }
+    g_slice_free (XTestCommit, commit);
+}
+
+static gboolean
+on_commit_done_idle (gpointer data)
+{
+    XTestCommit *commit = (XTestCommit *) data;
+    gint64 latency;
+
+    latency = g_get_monotonic_time () - commit->queued_time;
+    if (latency > max_commit_latency) {
+        max_commit_latency = latency;
+    }
+    n_completed_commits++;
+    xtest_commit_free (commit);
+    return FALSE;
+}
+
+static gpointer
+worker_thread_func (gpointer data)
+{
+    Display *display = (Display *) data;
+    XTestCommit *commit;
+
+    while (1) {
+        commit = (XTestCommit *) g_async_queue_pop (worker_queue);
+        if (commit->type == XTEST_COMMIT_RESTORE_QUIT) {
+            xtest_commit_free (commit);
+            break;
+        }
+        xtest_process_mapping_events (display);
+        xtest_commit_run (display, commit);
+        g_atomic_int_add (&n_pending_commits, -1);
+        /* The completion is reported in the order of the commits. */
+        g_idle_add (on_commit_done_idle, commit);
+    }
+    /* Only the worker touches its display. */
+    spare_keys_restore ();
+    spare_keys_display = NULL;
+    XCloseDisplay (display);
+    return NULL;
+}
+
+static gboolean
+worker_start (InputPadGtkWindow *window)
+{
+    Display *display;
+    GError *error = NULL;
+
+    if (worker_thread != NULL) {
+        return TRUE;
+    }
+    if (worker_queue != NULL) {
+        /* Could not start the worker previously. */
+        return FALSE;
+    }
+    display = GDK_WINDOW_XDISPLAY (gtk_widget_get_window (GTK_WIDGET (window)));
+    worker_queue = g_async_queue_new ();
+    worker_display = XOpenDisplay (DisplayString (display));
+    if (worker_display == NULL) {
+        g_warning ("Could not open the display %s for XTest",
+                   DisplayString (display));
+        return FALSE;
+    }
+    worker_thread = g_thread_try_new ("input-pad-xtest",
+                                      worker_thread_func,
+                                      worker_display,
+                                      &error);
+    if (worker_thread == NULL) {
+        g_warning ("Could not create the XTest thread: %s",
+                   error ? error->message : "");
+        g_clear_error (&error);
+        XCloseDisplay (worker_display);
+        worker_display = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+worker_stop (void)
+{
+    XTestCommit *commit;
+
+    if (worker_thread == NULL) {
+        return;
+    }
+    commit = g_slice_new0 (XTestCommit);
+    commit->type = XTEST_COMMIT_RESTORE_QUIT;
+    g_async_queue_push (worker_queue, commit);
+    g_thread_join (worker_thread);
+    worker_thread = NULL;
+    worker_display = NULL;
+}
+
 /*
  * Need to get GdkWindow after invoke gtk_widget_show() and gtk_main()
  */
 static gboolean
 have_extension (InputPadGtkWindow *window)
 {
+    static int has_xtest = -1;
     int opcode = 0;
     int event  = 0;
     int error  = 0;
@@ -131,6 +649,10 @@ have_extension (InputPadGtkWindow *window)
     g_return_val_if_fail (window != NULL &&
                           INPUT_PAD_IS_GTK_WINDOW (window), FALSE);
 
+    if (has_xtest >= 0) {
+        return has_xtest;
+    }
+    has_xtest = FALSE;
     if (!XQueryExtension (GDK_WINDOW_XDISPLAY (gtk_widget_get_window (GTK_WIDGET (window))),
                          "XTEST", &opcode, &event, &error)) {
         g_warning ("Could not find XTEST module. Maybe you did not install "
@@ -138,6 +660,7 @@ have_extension (InputPadGtkWindow *window)
                    "%% xdpyinfo | grep XTEST");
         return FALSE;
     }
+    has_xtest = TRUE;
     return TRUE;
 }
 
@@ -150,21 +673,47 @@ on_window_button_pressed (InputPadGtkWindow    *window,
                           guint                 state,
                           gpointer              data)
 {
+    XTestCommit *commit;
+
     if (!have_extension (window)) {
         return FALSE;
     }
     if (type == INPUT_PAD_TABLE_TYPE_CHARS) {
-        if (keysym > 0) {
-            send_key_event (gtk_widget_get_window (GTK_WIDGET (window)), keysym, keycode, state);
-            return TRUE;
-        } else {
+        if (keysym == 0 && (str == NULL || *str == '\0')) {
             return FALSE;
         }
-    } else if (type == INPUT_PAD_TABLE_TYPE_KEYSYMS) {
-        send_key_event (gtk_widget_get_window (GTK_WIDGET (window)), keysym, keycode, state);
-        return TRUE;
+    } else if (type == INPUT_PAD_TABLE_TYPE_STRINGS ||
+               type == INPUT_PAD_TABLE_TYPE_COMMANDS) {
+        if (str == NULL || *str == '\0') {
+            return FALSE;
+        }
+    } else if (type != INPUT_PAD_TABLE_TYPE_KEYSYMS) {
+        return FALSE;
     }
-    return FALSE;
+
+    commit = g_slice_new0 (XTestCommit);
+    commit->type = type;
+    commit->str = g_strdup (str);
+    commit->keysym = keysym;
+    commit->keycode = keycode;
+    commit->state = state;
+    if (type != INPUT_PAD_TABLE_TYPE_KEYSYMS &&
+        (type != INPUT_PAD_TABLE_TYPE_CHARS || keysym == 0)) {
+        commit->keys = string_keys_new (window, str, state);
+    }
+    commit->queued_time = g_get_monotonic_time ();
+    if (n_spare_keys < 0) {
+        spare_keys_init (GDK_WINDOW_XDISPLAY (gtk_widget_get_window (GTK_WIDGET (window))));
+    }
+    if (worker_start (window)) {
+        g_atomic_int_inc (&n_pending_commits);
+        g_async_queue_push (worker_queue, commit);
+    } else {
+        xtest_commit_run (GDK_WINDOW_XDISPLAY (gtk_widget_get_window (GTK_WIDGET (window))),
+                          commit);
+        on_commit_done_idle (commit);
+    }
+    return TRUE;
 }
 
 static void
@@ -182,10 +731,32 @@ on_window_reorder_button_pressed (InputPadGtkWindow    *window,
 gboolean
 input_pad_module_init (InputPadGtkWindow *window)
 {
-    signal (SIGINT, signal_exit_cb);
     return TRUE;
 }
 
+static void
+on_window_keymap_changed (InputPadGtkWindow    *window,
+                          gpointer              data)
+{
+    /* The worker reads MappingNotify on its own connection. */
+    if (worker_thread == NULL) {
+        has_modifier_keycodes = FALSE;
+    }
+}
+
+static void
+on_window_destroy (GtkWidget *widget, gpointer data)
+{
+    input_pad_gtk_button_set_repeat_pending (NULL);
+    worker_stop ();
+    spare_keys_restore ();
+    xtest_stats_print ();
+    if (pending_events != NULL) {
+        g_array_free (pending_events, TRUE);
+        pending_events = NULL;
+    }
+}
+
 gboolean
 input_pad_module_setup (InputPadGtkWindow *window)
 {
@@ -198,6 +769,15 @@ input_pad_module_setup (InputPadGtkWindow *window)
     g_signal_connect (G_OBJECT (window),
                       "reorder-button-pressed",
                       G_CALLBACK (on_window_reorder_button_pressed), NULL);
+    g_signal_connect (G_OBJECT (window),
+                      "keymap-changed",
+                      G_CALLBACK (on_window_keymap_changed), NULL);
+    g_signal_connect (G_OBJECT (window),
+                      "destroy",
+                      G_CALLBACK (on_window_destroy), NULL);
+    /* The keys on the layout are sent with their keycodes. */
+    input_pad_gtk_window_set_layout_keys (window, TRUE);
+    input_pad_gtk_button_set_repeat_pending (&n_pending_commits);
     return TRUE;
 }
 
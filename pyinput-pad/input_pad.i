@@ -34,12 +34,16 @@ class InputPadWindow:
         input_pad_window_set_char_button_sensitive(self.window, sensitive)
     def reorder_button_pressed(self):
         input_pad_window_reorder_button_pressed(self.window)
+    def set_paste_threshold(self, threshold=-1):
+        input_pad_window_set_paste_threshold(self.window, threshold)
     def set_kbdui_name(self, name=None):
         input_pad_window_set_kbdui_name(self.window, name)
     def set_show_table (self, type=0):
         input_pad_window_set_show_table (self.window, type)
     def set_show_layout (self, type=0):
         input_pad_window_set_show_layout (self.window, type)
+    def get_stats(self):
+        return _input_pad_window_get_stats_wrapper(self.window)
     def connect(self, signal_id, signal_cb, data=None):
         _input_pad_window_connect_wrapper(self.window, signal_id, signal_cb,
                                           data)
@@ -101,6 +105,48 @@ _input_pad_window_get_kbdui_name_list_wrapper (void)
     return retval;
 }
 
+static void
+_input_pad_dict_set_ulong (PyObject *dict, const char *key, unsigned long value)
+{
+    PyObject *pyvalue = PyLong_FromUnsignedLong (value);
+
+    PyDict_SetItemString (dict, key, pyvalue);
+    Py_DECREF (pyvalue);
+}
+
+PyObject *
+_input_pad_window_get_stats_wrapper (void *window)
+{
+    InputPadWindowStats stats;
+    PyObject *retval;
+    PyObject *buckets;
+    int i;
+
+    memset (&stats, 0, sizeof (InputPadWindowStats));
+    input_pad_window_get_stats (window, &stats);
+    retval = PyDict_New ();
+    _input_pad_dict_set_ulong (retval, "n_widgets", stats.n_widgets);
+    _input_pad_dict_set_ulong (retval, "n_buttons", stats.n_buttons);
+    _input_pad_dict_set_ulong (retval, "pixbuf_bytes", stats.pixbuf_bytes);
+    _input_pad_dict_set_ulong (retval, "pad_bytes", stats.pad_bytes);
+    _input_pad_dict_set_ulong (retval, "n_signal_handlers",
+                               stats.n_signal_handlers);
+    _input_pad_dict_set_ulong (retval, "n_events_injected",
+                               stats.n_events_injected);
+    _input_pad_dict_set_ulong (retval, "n_x_requests", stats.n_x_requests);
+    _input_pad_dict_set_ulong (retval, "n_commands_spawned",
+                               stats.n_commands_spawned);
+    _input_pad_dict_set_ulong (retval, "n_presses", stats.n_presses);
+    buckets = PyList_New (INPUT_PAD_WINDOW_STATS_N_LATENCY_BUCKETS);
+    for (i = 0; i < INPUT_PAD_WINDOW_STATS_N_LATENCY_BUCKETS; i++) {
+        PyList_SetItem (buckets, i,
+                        PyLong_FromUnsignedLong (stats.press_latency_buckets[i]));
+    }
+    PyDict_SetItemString (retval, "press_latency_buckets", buckets);
+    Py_DECREF (buckets);
+    return retval;
+}
+
 void
 _input_pad_window_init_wrapper (PyObject *pyargv, InputPadWindowType type)
 {
@@ -31,4 +31,5 @@ window.set_char_button_sensitive(True)
 window.connect("button-pressed", button_pressed_cb)
 window.reorder_button_pressed()
 print "input-pad visible?", window.get_visible()
+print "input-pad stats:", window.get_stats()
 window.main()